@@ -0,0 +1,111 @@
+/**
+ * @file bench_c_api.cpp
+ * @brief The load, save and streaming benchmarks through dmusicpak_c.h
+ */
+
+#include "bench_common.h"
+#include <dmusicpak/dmusicpak_c.h>
+
+static size_t count_callback(void* buffer, size_t size, size_t nmemb, void* userdata) {
+    benchmark::DoNotOptimize(buffer);
+    *(uint64_t*)userdata += size * nmemb;
+    return size * nmemb;
+}
+
+/* Package decoded from the cached bytes; NULL skips the run */
+static dmusicpak_package_t load_c_package(benchmark::State& state, uint64_t size) {
+    const std::vector<uint8_t>& bytes = bench::package_bytes(size);
+    dmusicpak_package_t package = dmusicpak_load_memory(bytes.data(), bytes.size());
+    if (!package) state.SkipWithError("dmusicpak_load_memory() failed");
+    return package;
+}
+
+static void BM_C_LoadMemory(benchmark::State& state) {
+    uint64_t size = (uint64_t)state.range(0);
+    const std::vector<uint8_t>& bytes = bench::package_bytes(size);
+
+    for (auto _ : state) {
+        dmusicpak_package_t package = dmusicpak_load_memory(bytes.data(), bytes.size());
+        if (!package) {
+            state.SkipWithError("dmusicpak_load_memory() failed");
+            break;
+        }
+        dmusicpak_free(package);
+    }
+    bench::finish(state, bytes.size());
+}
+BENCHMARK(BM_C_LoadMemory)->Apply(bench::package_sizes);
+
+static void BM_C_SaveMemory(benchmark::State& state) {
+    dmusicpak_package_t package = load_c_package(state, (uint64_t)state.range(0));
+    if (!package) return;
+    size_t saved = 0;
+
+    for (auto _ : state) {
+        uint8_t* buffer = NULL;
+        if (dmusicpak_save_memory(package, &buffer, &saved) != DMUSICPAK_ERROR_OK) {
+            state.SkipWithError("dmusicpak_save_memory() failed");
+            break;
+        }
+        dmusicpak_free_memory(buffer);
+    }
+    bench::finish(state, saved);
+    dmusicpak_free(package);
+}
+BENCHMARK(BM_C_SaveMemory)->Apply(bench::package_sizes);
+
+static void BM_C_LoadIndexMetadata(benchmark::State& state) {
+    std::string path = bench::package_file((uint64_t)state.range(0));
+
+    for (auto _ : state) {
+        if (!bench::prepare_cache(state, path, state.range(1) != 0)) break;
+
+        dmusicpak_package_t package = dmusicpak_load_index(path.c_str());
+        dmusicpak_metadata_view_t metadata;
+        if (!package || dmusicpak_peek_metadata(package, &metadata) != DMUSICPAK_ERROR_OK) {
+            state.SkipWithError("dmusicpak_load_index() failed");
+            dmusicpak_free(package);
+            break;
+        }
+        benchmark::DoNotOptimize(metadata.title);
+        dmusicpak_free(package);
+    }
+}
+BENCHMARK(BM_C_LoadIndexMetadata)->Apply(bench::package_sizes_cache);
+
+static void BM_C_StreamAudio(benchmark::State& state) {
+    uint64_t size = (uint64_t)state.range(0);
+    dmusicpak_package_t package = load_c_package(state, size);
+    if (!package) return;
+
+    for (auto _ : state) {
+        uint64_t streamed = 0;
+        if (dmusicpak_stream_audio(package, count_callback, &streamed) != DMUSICPAK_ERROR_OK || streamed != size) {
+            state.SkipWithError("dmusicpak_stream_audio() failed");
+            break;
+        }
+    }
+    bench::finish(state, size);
+    dmusicpak_free(package);
+}
+BENCHMARK(BM_C_StreamAudio)->Apply(bench::package_sizes);
+
+static void BM_C_GetAudioChunk(benchmark::State& state) {
+    uint64_t size = (uint64_t)state.range(0);
+    dmusicpak_package_t package = load_c_package(state, size);
+    if (!package) return;
+
+    static uint8_t buffer[bench::CHUNK_SIZE];
+    for (auto _ : state) {
+        for (uint64_t offset = 0; offset < size; offset += sizeof(buffer)) {
+            if (dmusicpak_get_audio_chunk(package, (size_t)offset, sizeof(buffer), buffer) <= 0) {
+                state.SkipWithError("dmusicpak_get_audio_chunk() failed");
+                break;
+            }
+        }
+        benchmark::DoNotOptimize(buffer[0]);
+    }
+    bench::finish(state, size);
+    dmusicpak_free(package);
+}
+BENCHMARK(BM_C_GetAudioChunk)->Apply(bench::package_sizes);
@@ -0,0 +1,212 @@
+/**
+ * @file bench_common.cpp
+ * @brief Shared fixtures for the DMusicPak benchmarks
+ */
+
+#include "bench_common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace dmusicpak;
+
+namespace {
+
+const uint64_t KB = 1024;
+const uint64_t MB = 1024 * KB;
+const uint64_t GB = 1024 * MB;
+
+/* 100 KB to 4 GB */
+const uint64_t SIZES[] = { 100 * KB, 1 * MB, 16 * MB, 64 * MB, 256 * MB, 1 * GB, 4 * GB };
+
+uint64_t max_size() {
+    const char* env = getenv("DMUSICPAK_BENCH_MAX_SIZE");
+    if (!env || !*env) return 64 * MB;
+    return strtoull(env, NULL, 10);
+}
+
+std::string bench_dir() {
+    const char* env = getenv("DMUSICPAK_BENCH_DIR");
+    if (env && *env) return env;
+#ifdef _WIN32
+    env = getenv("TEMP");
+    return env ? env : ".";
+#else
+    env = getenv("TMPDIR");
+    return env && *env ? env : "/tmp";
+#endif
+}
+
+bool file_exists(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+    fclose(file);
+    return true;
+}
+
+/* Deterministic incompressible bytes (xorshift64) */
+void fill_random(uint8_t* data, size_t size, uint64_t seed) {
+    uint64_t state = seed | 1;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        memcpy(data + i, &state, 8);
+    }
+    for (; i < size; i++) data[i] = (uint8_t)(state >> (8 * (i & 7)));
+}
+
+const char LYRICS[] =
+    "[00:01.00]First line of the benchmark lyrics\n"
+    "[00:05.00]Second line of the benchmark lyrics\n"
+    "[00:09.00]Third line of the benchmark lyrics\n";
+
+}  // namespace
+
+namespace bench {
+
+void package_sizes(benchmark::internal::Benchmark* b) {
+    uint64_t limit = max_size();
+    for (size_t i = 0; i < sizeof(SIZES) / sizeof(SIZES[0]); i++) {
+        if (SIZES[i] <= limit && SIZES[i] <= (uint64_t)(size_t)-1) b->Arg((int64_t)SIZES[i]);
+    }
+    b->ArgName("size")->Unit(benchmark::kMicrosecond);
+}
+
+void package_sizes_cache(benchmark::internal::Benchmark* b) {
+    uint64_t limit = max_size();
+    for (size_t i = 0; i < sizeof(SIZES) / sizeof(SIZES[0]); i++) {
+        if (SIZES[i] > limit || SIZES[i] > (uint64_t)(size_t)-1) continue;
+        b->Args({ (int64_t)SIZES[i], 0 });
+        b->Args({ (int64_t)SIZES[i], 1 });
+    }
+    b->ArgNames({ "size", "cold" })->Unit(benchmark::kMicrosecond);
+}
+
+Package* make_package(uint64_t size) {
+    Package* package = create();
+    if (!package) return NULL;
+
+    Metadata metadata;
+    memset(&metadata, 0, sizeof(metadata));
+    metadata.title = (char*)"Benchmark Title";
+    metadata.artist = (char*)"Benchmark Artist";
+    metadata.album = (char*)"Benchmark Album";
+    metadata.genre = (char*)"Electronic";
+    metadata.year = (char*)"2025";
+    metadata.duration_ms = (uint32_t)(size / 40);  /* 320 kbps */
+    metadata.bitrate = 320;
+    metadata.sample_rate = 44100;
+    metadata.channels = 2;
+    set_metadata(package, &metadata);
+
+    Lyrics lyrics = { LyricFormat::LRC_LINE_BY_LINE, (uint8_t*)LYRICS, sizeof(LYRICS) - 1 };
+    set_lyrics(package, &lyrics);
+
+    std::vector<uint8_t> image(64 * KB);
+    fill_random(image.data(), image.size(), 7);
+    Cover cover = { CoverFormat::JPEG, image.data(), image.size(), 600, 600 };
+    set_cover(package, &cover);
+
+    /* The package takes the audio buffer, so a 4 GB package is held once */
+    Audio audio;
+    audio.format = AudioFormat::MP3;
+    audio.source_filename = (char*)"benchmark.mp3";
+    audio.size = (size_t)size;
+    audio.data = (uint8_t*)alloc_buffer(audio.size);
+    if (!audio.data) {
+        dmusicpak::free(package);
+        return NULL;
+    }
+    fill_random(audio.data, audio.size, size);
+    if (set_audio_owned(package, &audio) != Error::OK) {
+        free_buffer(audio.data);
+        dmusicpak::free(package);
+        return NULL;
+    }
+    return package;
+}
+
+const std::vector<uint8_t>& package_bytes(uint64_t size) {
+    static std::vector<uint8_t> bytes;
+    static uint64_t cached_size = 0;
+    if (cached_size == size && !bytes.empty()) return bytes;
+
+    bytes.clear();
+    bytes.shrink_to_fit();
+    cached_size = 0;
+
+    Package* package = make_package(size);
+    uint8_t* buffer = NULL;
+    size_t buffer_size = 0;
+    if (package && save_memory(package, &buffer, &buffer_size) == Error::OK) {
+        bytes.assign(buffer, buffer + buffer_size);
+        cached_size = size;
+    }
+    free_buffer(buffer);
+    dmusicpak::free(package);
+    return bytes;
+}
+
+std::string package_file(uint64_t size) {
+    char name[64];
+    snprintf(name, sizeof(name), "dmusicpak_bench_%llu.dmusicpak", (unsigned long long)size);
+    std::string path = scratch_file(name);
+    if (file_exists(path)) return path;
+
+    Package* package = make_package(size);
+    if (!package || save(package, path.c_str()) != Error::OK) path.clear();
+    dmusicpak::free(package);
+    return path;
+}
+
+std::string scratch_file(const char* name) {
+    std::string dir = bench_dir();
+#ifdef _WIN32
+    return dir + "\\" + name;
+#else
+    return dir + "/" + name;
+#endif
+}
+
+bool drop_cache(const std::string& path) {
+#if defined(__linux__)
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    /* Only clean pages can be dropped */
+    fdatasync(fd);
+    int result = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+    return result == 0;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+bool prepare_cache(benchmark::State& state, const std::string& path, bool cold) {
+    if (path.empty()) {
+        state.SkipWithError("could not write the package file");
+        return false;
+    }
+    if (!cold) return true;
+
+    state.PauseTiming();
+    bool dropped = drop_cache(path);
+    state.ResumeTiming();
+    if (!dropped) state.SkipWithError("cold cache runs need posix_fadvise()");
+    return dropped;
+}
+
+void finish(benchmark::State& state, uint64_t size) {
+    state.SetBytesProcessed((int64_t)(state.iterations() * size));
+}
+
+}  // namespace bench
@@ -0,0 +1,54 @@
+/**
+ * @file bench_common.h
+ * @brief Shared fixtures for the DMusicPak benchmarks
+ *
+ * Benchmarks take the package size as their first argument. Sizes run from
+ * 100 KB up to DMUSICPAK_BENCH_MAX_SIZE bytes (environment, default 64 MB;
+ * up to 4 GB), and files go to DMUSICPAK_BENCH_DIR (default: the system
+ * temporary directory), written on first use and reused afterwards.
+ */
+
+#ifndef DMUSICPAK_BENCH_COMMON_H
+#define DMUSICPAK_BENCH_COMMON_H
+
+#include <dmusicpak/dmusicpak.h>
+#include <benchmark/benchmark.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+/* Read sizes for chunked benchmarks */
+const size_t CHUNK_SIZE = 64 * 1024;
+
+/* Register one run per package size */
+void package_sizes(benchmark::internal::Benchmark* b);
+
+/* Register one run per package size with a warm (0) and a cold (1) page cache */
+void package_sizes_cache(benchmark::internal::Benchmark* b);
+
+/* Package with 'size' bytes of audio, metadata, lyrics and a cover; free with dmusicpak::free() */
+dmusicpak::Package* make_package(uint64_t size);
+
+/* Serialized make_package(size); the last size requested stays cached */
+const std::vector<uint8_t>& package_bytes(uint64_t size);
+
+/* Path of a saved make_package(size), written on first use */
+std::string package_file(uint64_t size);
+
+/* Scratch path in the benchmark directory */
+std::string scratch_file(const char* name);
+
+/* Drop a file from the page cache; false where the platform cannot */
+bool drop_cache(const std::string& path);
+
+/* Drop 'path' from the cache outside the timed region when the run is cold; false skips the run */
+bool prepare_cache(benchmark::State& state, const std::string& path, bool cold);
+
+/* Report one package of 'size' bytes processed per iteration */
+void finish(benchmark::State& state, uint64_t size);
+
+}  // namespace bench
+
+#endif  // DMUSICPAK_BENCH_COMMON_H
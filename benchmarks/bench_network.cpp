@@ -0,0 +1,320 @@
+/**
+ * @file bench_network.cpp
+ * @brief Network loader benchmarks against a local HTTP server
+ *
+ * Packages are served by a minimal HTTP/1.1 server on the loopback
+ * interface (GET and HEAD, single byte ranges, keep-alive), so the numbers
+ * measure the library and libcurl, not a network. Set DMUSICPAK_BENCH_URL
+ * to a base URL to run against another server instead; it must serve the
+ * benchmark files (dmusicpak_bench_<size>.dmusicpak) from the same path.
+ * Built with ENABLE_NETWORK on POSIX systems.
+ */
+
+#include "bench_common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace dmusicpak;
+
+namespace {
+
+const size_t MAX_REQUEST_SIZE = 16 * 1024;
+
+bool send_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent <= 0) return false;
+        data += sent;
+        size -= (size_t)sent;
+    }
+    return true;
+}
+
+/* Value of a request header, or NULL */
+const char* find_header(const char* request, const char* name, size_t* length) {
+    size_t name_length = strlen(name);
+    for (const char* line = strstr(request, "\r\n"); line; line = strstr(line, "\r\n")) {
+        line += 2;
+        if (strncasecmp(line, name, name_length) != 0 || line[name_length] != ':') continue;
+
+        const char* value = line + name_length + 1;
+        while (*value == ' ') value++;
+        const char* end = strstr(value, "\r\n");
+        *length = end ? (size_t)(end - value) : strlen(value);
+        return value;
+    }
+    return NULL;
+}
+
+/* Parse "bytes=first-last", "bytes=first-" or "bytes=-suffix" */
+bool parse_range(const char* value, uint64_t total, uint64_t* first, uint64_t* last) {
+    if (strncmp(value, "bytes=", 6) != 0 || total == 0) return false;
+    value += 6;
+
+    char* end = NULL;
+    if (*value == '-') {
+        uint64_t suffix = strtoull(value + 1, NULL, 10);
+        if (suffix == 0) return false;
+        *first = suffix < total ? total - suffix : 0;
+        *last = total - 1;
+        return true;
+    }
+
+    *first = strtoull(value, &end, 10);
+    if (end == value || *end != '-') return false;
+    *last = end[1] >= '0' && end[1] <= '9' ? strtoull(end + 1, NULL, 10) : total - 1;
+    if (*last >= total) *last = total - 1;
+    return *first <= *last;
+}
+
+bool serve_request(int client, const char* request) {
+    char method[8] = {0};
+    char path[256] = {0};
+    if (sscanf(request, "%7s %255s", method, path) != 2) return false;
+    bool head = strcmp(method, "HEAD") == 0;
+
+    size_t length = 0;
+    const char* connection = find_header(request, "Connection", &length);
+    bool keep_alive = !(connection && length == 5 && strncasecmp(connection, "close", 5) == 0);
+
+    const char* name = strrchr(path, '/');
+    int file = -1;
+    if (name && strncmp(name + 1, "dmusicpak_bench_", 16) == 0 && !strstr(name, "..")) {
+        file = open(bench::scratch_file(name + 1).c_str(), O_RDONLY);
+    }
+
+    char header[512];
+    struct stat st;
+    if (file < 0 || fstat(file, &st) != 0) {
+        if (file >= 0) close(file);
+        snprintf(header, sizeof(header), "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+        return send_all(client, header, strlen(header)) && keep_alive;
+    }
+
+    uint64_t total = (uint64_t)st.st_size;
+    uint64_t first = 0;
+    uint64_t last = total - 1;
+    const char* range = find_header(request, "Range", &length);
+    bool partial = range && parse_range(range, total, &first, &last);
+    if (range && !partial) {
+        close(file);
+        snprintf(header, sizeof(header),
+                 "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */%llu\r\nContent-Length: 0\r\n\r\n",
+                 (unsigned long long)total);
+        return send_all(client, header, strlen(header)) && keep_alive;
+    }
+
+    uint64_t body = total > 0 ? last - first + 1 : 0;
+    if (partial) {
+        snprintf(header, sizeof(header),
+                 "HTTP/1.1 206 Partial Content\r\nAccept-Ranges: bytes\r\nContent-Type: application/octet-stream\r\n"
+                 "Content-Range: bytes %llu-%llu/%llu\r\nContent-Length: %llu\r\n\r\n",
+                 (unsigned long long)first, (unsigned long long)last, (unsigned long long)total,
+                 (unsigned long long)body);
+    } else {
+        snprintf(header, sizeof(header),
+                 "HTTP/1.1 200 OK\r\nAccept-Ranges: bytes\r\nContent-Type: application/octet-stream\r\n"
+                 "Content-Length: %llu\r\n\r\n",
+                 (unsigned long long)body);
+    }
+
+    bool ok = send_all(client, header, strlen(header));
+    static thread_local char buffer[256 * 1024];
+    for (uint64_t offset = first; ok && !head && offset < first + body;) {
+        size_t chunk = first + body - offset < sizeof(buffer) ? (size_t)(first + body - offset) : sizeof(buffer);
+        ssize_t got = pread(file, buffer, chunk, (off_t)offset);
+        ok = got > 0 && send_all(client, buffer, (size_t)got);
+        offset += got > 0 ? (uint64_t)got : 0;
+    }
+    close(file);
+    return ok && keep_alive;
+}
+
+void serve_connection(int client) {
+    std::string pending;
+    char buffer[4096];
+    for (;;) {
+        size_t end = pending.find("\r\n\r\n");
+        if (end == std::string::npos) {
+            if (pending.size() > MAX_REQUEST_SIZE) break;
+            ssize_t got = recv(client, buffer, sizeof(buffer), 0);
+            if (got <= 0) break;
+            pending.append(buffer, (size_t)got);
+            continue;
+        }
+
+        std::string request = pending.substr(0, end + 2);
+        pending.erase(0, end + 4);
+        if (!serve_request(client, request.c_str())) break;
+    }
+    close(client);
+}
+
+/* Base URL of the benchmark server, started on first use */
+std::string base_url() {
+    static std::string url;
+    if (!url.empty()) return url;
+
+    const char* env = getenv("DMUSICPAK_BENCH_URL");
+    if (env && *env) return url = env;
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t address_size = sizeof(address);
+    if (listener < 0 || bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(listener, 64) != 0 || getsockname(listener, (struct sockaddr*)&address, &address_size) != 0) {
+        if (listener >= 0) close(listener);
+        return url;
+    }
+
+    std::thread([listener]() {
+        for (;;) {
+            int client = accept(listener, NULL, NULL);
+            if (client < 0) continue;
+
+            /* Headers and bodies go out in separate sends; don't hold them for delayed ACKs */
+            int nodelay = 1;
+            setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+            std::thread(serve_connection, client).detach();
+        }
+    }).detach();
+
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "http://127.0.0.1:%u", (unsigned)ntohs(address.sin_port));
+    return url = buffer;
+}
+
+}  // namespace
+
+/* URL of the package file for the run's size; empty skips the run */
+static std::string package_url(benchmark::State& state) {
+    uint64_t size = (uint64_t)state.range(0);
+    std::string path = bench::package_file(size);
+    std::string base = base_url();
+    if (path.empty() || base.empty()) {
+        state.SkipWithError("could not serve the package file");
+        return std::string();
+    }
+    return base + path.substr(path.find_last_of('/'));
+}
+
+static void BM_LoadUrl(benchmark::State& state) {
+    std::string url = package_url(state);
+    if (url.empty()) return;
+
+    for (auto _ : state) {
+        Package* package = load_url(url.c_str(), 0);
+        if (!package) {
+            state.SkipWithError("load_url() failed");
+            break;
+        }
+        dmusicpak::free(package);
+    }
+    bench::finish(state, (uint64_t)state.range(0));
+}
+BENCHMARK(BM_LoadUrl)->Apply(bench::package_sizes)->UseRealTime();
+
+static void BM_LoadUrlStream(benchmark::State& state) {
+    std::string url = package_url(state);
+    if (url.empty()) return;
+
+    for (auto _ : state) {
+        Package* package = load_url_stream(url.c_str(), 0, 0);
+        if (!package) {
+            state.SkipWithError("load_url_stream() failed");
+            break;
+        }
+        dmusicpak::free(package);
+    }
+    bench::finish(state, (uint64_t)state.range(0));
+}
+BENCHMARK(BM_LoadUrlStream)->Apply(bench::package_sizes)->UseRealTime();
+
+/* Metadata only: header and index Range requests on a warm session */
+static void BM_LoadUrlIndexMetadata(benchmark::State& state) {
+    std::string url = package_url(state);
+    if (url.empty()) return;
+    Session* session = create_session(0);
+
+    for (auto _ : state) {
+        Package* package = load_url_index(url.c_str(), session);
+        MetadataView metadata;
+        if (!package || peek_metadata(package, &metadata) != Error::OK) {
+            state.SkipWithError("load_url_index() failed");
+            dmusicpak::free(package);
+            break;
+        }
+        benchmark::DoNotOptimize(metadata.title);
+        dmusicpak::free(package);
+    }
+    free_session(session);
+}
+BENCHMARK(BM_LoadUrlIndexMetadata)->Apply(bench::package_sizes)->UseRealTime();
+
+/* Sequential CHUNK_SIZE Range requests over the whole file */
+static void BM_GetAudioChunkSession(benchmark::State& state) {
+    std::string url = package_url(state);
+    if (url.empty()) return;
+    uint64_t size = (uint64_t)state.range(0);
+    Session* session = create_session(0);
+
+    static uint8_t buffer[bench::CHUNK_SIZE];
+    for (auto _ : state) {
+        for (uint64_t offset = 0; offset < size; offset += sizeof(buffer)) {
+            if (get_audio_chunk_session(session, url.c_str(), (size_t)offset, sizeof(buffer), buffer) <= 0) {
+                state.SkipWithError("get_audio_chunk_session() failed");
+                break;
+            }
+        }
+    }
+    bench::finish(state, size);
+    free_session(session);
+}
+BENCHMARK(BM_GetAudioChunkSession)->Apply(bench::package_sizes)->UseRealTime();
+
+static void BM_PrefetchRead(benchmark::State& state) {
+    std::string url = package_url(state);
+    if (url.empty()) return;
+    uint64_t size = (uint64_t)state.range(0);
+    Session* session = create_session(0);
+    Package* package = load_url_index(url.c_str(), session);
+
+    static uint8_t buffer[bench::CHUNK_SIZE];
+    for (auto _ : state) {
+        Prefetcher* prefetcher = package ? create_prefetcher(package, 0, 0) : NULL;
+        if (!prefetcher) {
+            state.SkipWithError("create_prefetcher() failed");
+            break;
+        }
+
+        uint64_t read = 0;
+        int64_t got;
+        while ((got = prefetch_read(prefetcher, buffer, sizeof(buffer))) > 0) read += (uint64_t)got;
+        free_prefetcher(prefetcher);
+        if (got < 0 || read != size) {
+            state.SkipWithError("prefetch_read() failed");
+            break;
+        }
+    }
+    bench::finish(state, size);
+    dmusicpak::free(package);
+    free_session(session);
+}
+BENCHMARK(BM_PrefetchRead)->Apply(bench::package_sizes)->UseRealTime();
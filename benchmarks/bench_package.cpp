@@ -0,0 +1,213 @@
+/**
+ * @file bench_package.cpp
+ * @brief Load and save benchmarks (memory and files, full decode and metadata only)
+ */
+
+#include "bench_common.h"
+#include <stdio.h>
+#include <string.h>
+
+using namespace dmusicpak;
+
+/* Full decode of a package in memory */
+static void BM_LoadMemory(benchmark::State& state) {
+    uint64_t size = (uint64_t)state.range(0);
+    const std::vector<uint8_t>& bytes = bench::package_bytes(size);
+
+    for (auto _ : state) {
+        Package* package = load_memory(bytes.data(), bytes.size());
+        if (!package) {
+            state.SkipWithError("load_memory() failed");
+            break;
+        }
+        dmusicpak::free(package);
+    }
+    bench::finish(state, bytes.size());
+}
+BENCHMARK(BM_LoadMemory)->Apply(bench::package_sizes);
+
+/* Full decode of a checksummed package; each chunk is verified as it is copied */
+static void BM_LoadMemoryChecksums(benchmark::State& state) {
+    uint64_t size = (uint64_t)state.range(0);
+    Package* package = bench::make_package(size);
+    SaveOptions options;
+    memset(&options, 0, sizeof(options));
+    options.checksums = 1;
+
+    uint8_t* bytes = NULL;
+    size_t saved = 0;
+    if (!package || set_save_options(package, &options) != Error::OK ||
+        save_memory(package, &bytes, &saved) != Error::OK) {
+        state.SkipWithError("save_memory() failed");
+        dmusicpak::free(package);
+        return;
+    }
+    dmusicpak::free(package);
+
+    for (auto _ : state) {
+        Error error = Error::OK;
+        Package* loaded = load_memory_ex(bytes, saved, &error);
+        if (!loaded) {
+            state.SkipWithError("load_memory_ex() failed");
+            break;
+        }
+        dmusicpak::free(loaded);
+    }
+    bench::finish(state, saved);
+    free_buffer(bytes);
+}
+BENCHMARK(BM_LoadMemoryChecksums)->Apply(bench::package_sizes);
+
+/* Chunk parsing alone: a package of metadata and lyrics, so no large payload is copied */
+static void BM_ParseMetadataPackage(benchmark::State& state) {
+    std::vector<uint8_t> bytes;
+    Package* package = create();
+    Metadata metadata;
+    memset(&metadata, 0, sizeof(metadata));
+    metadata.title = (char*)"Benchmark Title";
+    metadata.artist = (char*)"Benchmark Artist";
+    metadata.album = (char*)"Benchmark Album";
+    set_metadata(package, &metadata);
+    static const char lyrics_text[] = "[00:01.00]First line\n[00:05.00]Second line\n";
+    Lyrics lyrics = { LyricFormat::LRC_LINE_BY_LINE, (uint8_t*)lyrics_text, sizeof(lyrics_text) - 1 };
+    set_lyrics(package, &lyrics);
+
+    uint8_t* buffer = NULL;
+    size_t saved = 0;
+    if (save_memory(package, &buffer, &saved) == Error::OK) bytes.assign(buffer, buffer + saved);
+    free_buffer(buffer);
+    dmusicpak::free(package);
+    if (bytes.empty()) {
+        state.SkipWithError("save_memory() failed");
+        return;
+    }
+
+    for (auto _ : state) {
+        Package* loaded = load_memory(bytes.data(), bytes.size());
+        if (!loaded) {
+            state.SkipWithError("load_memory() failed");
+            break;
+        }
+        dmusicpak::free(loaded);
+    }
+    state.SetItemsProcessed((int64_t)state.iterations());
+    bench::finish(state, bytes.size());
+}
+BENCHMARK(BM_ParseMetadataPackage);
+
+static void BM_SaveMemory(benchmark::State& state) {
+    uint64_t size = (uint64_t)state.range(0);
+    Package* package = bench::make_package(size);
+    size_t saved = 0;
+
+    for (auto _ : state) {
+        uint8_t* buffer = NULL;
+        if (!package || save_memory(package, &buffer, &saved) != Error::OK) {
+            state.SkipWithError("save_memory() failed");
+            break;
+        }
+        free_buffer(buffer);
+    }
+    bench::finish(state, saved);
+    dmusicpak::free(package);
+}
+BENCHMARK(BM_SaveMemory)->Apply(bench::package_sizes);
+
+/* Full decode of a package file */
+static void BM_LoadFile(benchmark::State& state) {
+    uint64_t size = (uint64_t)state.range(0);
+    std::string path = bench::package_file(size);
+
+    for (auto _ : state) {
+        if (!bench::prepare_cache(state, path, state.range(1) != 0)) break;
+
+        Package* package = load(path.c_str());
+        if (!package) {
+            state.SkipWithError("load() failed");
+            break;
+        }
+        dmusicpak::free(package);
+    }
+    bench::finish(state, size);
+}
+BENCHMARK(BM_LoadFile)->Apply(bench::package_sizes_cache);
+
+/* Mapped package with every audio page touched */
+static void BM_LoadMmap(benchmark::State& state) {
+    uint64_t size = (uint64_t)state.range(0);
+    std::string path = bench::package_file(size);
+
+    for (auto _ : state) {
+        if (!bench::prepare_cache(state, path, state.range(1) != 0)) break;
+
+        Package* package = load_mmap(path.c_str());
+        AudioView audio;
+        if (!package || peek_audio(package, &audio) != Error::OK) {
+            state.SkipWithError("load_mmap() failed");
+            dmusicpak::free(package);
+            break;
+        }
+
+        uint8_t sum = 0;
+        for (size_t i = 0; i < audio.size; i += 4096) sum += audio.data[i];
+        benchmark::DoNotOptimize(sum);
+        dmusicpak::free(package);
+    }
+    bench::finish(state, size);
+}
+BENCHMARK(BM_LoadMmap)->Apply(bench::package_sizes_cache);
+
+/* Metadata only: chunk index plus the metadata chunk */
+static void BM_LoadIndexMetadata(benchmark::State& state) {
+    uint64_t size = (uint64_t)state.range(0);
+    std::string path = bench::package_file(size);
+
+    for (auto _ : state) {
+        if (!bench::prepare_cache(state, path, state.range(1) != 0)) break;
+
+        Package* package = load_index(path.c_str());
+        MetadataView metadata;
+        if (!package || peek_metadata(package, &metadata) != Error::OK) {
+            state.SkipWithError("load_index() failed");
+            dmusicpak::free(package);
+            break;
+        }
+        benchmark::DoNotOptimize(metadata.title);
+        dmusicpak::free(package);
+    }
+}
+BENCHMARK(BM_LoadIndexMetadata)->Apply(bench::package_sizes_cache);
+
+static void BM_ScanMetadata(benchmark::State& state) {
+    uint64_t size = (uint64_t)state.range(0);
+    std::string path = bench::package_file(size);
+
+    for (auto _ : state) {
+        if (!bench::prepare_cache(state, path, state.range(1) != 0)) break;
+
+        MetadataScan scan;
+        if (scan_metadata(path.c_str(), &scan) != Error::OK) {
+            state.SkipWithError("scan_metadata() failed");
+            break;
+        }
+        benchmark::DoNotOptimize(scan.metadata.title);
+    }
+}
+BENCHMARK(BM_ScanMetadata)->Apply(bench::package_sizes_cache);
+
+static void BM_SaveFile(benchmark::State& state) {
+    uint64_t size = (uint64_t)state.range(0);
+    Package* package = bench::make_package(size);
+    std::string path = bench::scratch_file("dmusicpak_bench_save.dmusicpak");
+
+    for (auto _ : state) {
+        if (!package || save(package, path.c_str()) != Error::OK) {
+            state.SkipWithError("save() failed");
+            break;
+        }
+    }
+    bench::finish(state, size);
+    dmusicpak::free(package);
+    remove(path.c_str());
+}
+BENCHMARK(BM_SaveFile)->Apply(bench::package_sizes);
@@ -0,0 +1,102 @@
+/**
+ * @file bench_stream.cpp
+ * @brief Audio streaming benchmarks (stream_audio and get_audio_chunk)
+ */
+
+#include "bench_common.h"
+
+using namespace dmusicpak;
+
+static size_t count_callback(void* buffer, size_t size, size_t nmemb, void* userdata) {
+    benchmark::DoNotOptimize(buffer);
+    *(uint64_t*)userdata += size * nmemb;
+    return size * nmemb;
+}
+
+static void stream_package(benchmark::State& state, Package* package, uint64_t size) {
+    uint64_t streamed = 0;
+    if (stream_audio(package, count_callback, &streamed) != Error::OK || streamed != size) {
+        state.SkipWithError("stream_audio() failed");
+    }
+}
+
+/* Sequential CHUNK_SIZE reads of the whole payload */
+static void read_chunks(benchmark::State& state, Package* package, uint64_t size) {
+    static uint8_t buffer[bench::CHUNK_SIZE];
+    for (uint64_t offset = 0; offset < size; offset += bench::CHUNK_SIZE) {
+        if (get_audio_chunk(package, (size_t)offset, sizeof(buffer), buffer) <= 0) {
+            state.SkipWithError("get_audio_chunk() failed");
+            return;
+        }
+    }
+    benchmark::DoNotOptimize(buffer[0]);
+}
+
+static void BM_StreamAudioMemory(benchmark::State& state) {
+    uint64_t size = (uint64_t)state.range(0);
+    const std::vector<uint8_t>& bytes = bench::package_bytes(size);
+    Package* package = load_memory(bytes.data(), bytes.size());
+    if (!package) {
+        state.SkipWithError("load_memory() failed");
+        return;
+    }
+
+    for (auto _ : state) stream_package(state, package, size);
+    bench::finish(state, size);
+    dmusicpak::free(package);
+}
+BENCHMARK(BM_StreamAudioMemory)->Apply(bench::package_sizes);
+
+/* Streaming from the file, opened per iteration so cold runs start uncached */
+static void BM_StreamAudioIndex(benchmark::State& state) {
+    uint64_t size = (uint64_t)state.range(0);
+    std::string path = bench::package_file(size);
+
+    for (auto _ : state) {
+        if (!bench::prepare_cache(state, path, state.range(1) != 0)) break;
+
+        Package* package = load_index(path.c_str());
+        if (!package) {
+            state.SkipWithError("load_index() failed");
+            break;
+        }
+        stream_package(state, package, size);
+        dmusicpak::free(package);
+    }
+    bench::finish(state, size);
+}
+BENCHMARK(BM_StreamAudioIndex)->Apply(bench::package_sizes_cache);
+
+static void BM_GetAudioChunkMemory(benchmark::State& state) {
+    uint64_t size = (uint64_t)state.range(0);
+    const std::vector<uint8_t>& bytes = bench::package_bytes(size);
+    Package* package = load_memory(bytes.data(), bytes.size());
+    if (!package) {
+        state.SkipWithError("load_memory() failed");
+        return;
+    }
+
+    for (auto _ : state) read_chunks(state, package, size);
+    bench::finish(state, size);
+    dmusicpak::free(package);
+}
+BENCHMARK(BM_GetAudioChunkMemory)->Apply(bench::package_sizes);
+
+static void BM_GetAudioChunkIndex(benchmark::State& state) {
+    uint64_t size = (uint64_t)state.range(0);
+    std::string path = bench::package_file(size);
+
+    for (auto _ : state) {
+        if (!bench::prepare_cache(state, path, state.range(1) != 0)) break;
+
+        Package* package = load_index(path.c_str());
+        if (!package) {
+            state.SkipWithError("load_index() failed");
+            break;
+        }
+        read_chunks(state, package, size);
+        dmusicpak::free(package);
+    }
+    bench::finish(state, size);
+}
+BENCHMARK(BM_GetAudioChunkIndex)->Apply(bench::package_sizes_cache);
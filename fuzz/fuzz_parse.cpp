@@ -0,0 +1,60 @@
+/**
+ * @file fuzz_parse.cpp
+ * @brief libFuzzer target for the package parsers
+ *
+ * Each input goes through load_memory_ex(), verify_memory() and the push
+ * parser, fed in pieces whose size comes from the first input byte so
+ * chunks straddle parser_feed() calls. Whatever is accepted is read back
+ * the way a player would.
+ */
+
+#include "dmusicpak/dmusicpak.h"
+#include "internal.h"
+#include <stdint.h>
+#include <stddef.h>
+
+using namespace dmusicpak;
+
+/* Read every part of an accepted package */
+static void read_package(Package* package) {
+    Metadata metadata;
+    if (get_metadata(package, &metadata) == Error::OK) free_metadata(&metadata);
+
+    Lyrics lyrics;
+    if (get_lyrics(package, &lyrics) == Error::OK) free_lyrics(&lyrics);
+    const LyricTimeline* timeline = NULL;
+    get_lyric_timeline(package, &timeline);
+
+    Cover cover;
+    if (get_cover_best_fit(package, 64, 64, &cover) == Error::OK) free_cover(&cover);
+
+    uint8_t buffer[256];
+    get_audio_chunk(package, 0, sizeof(buffer), buffer);
+    SeekPoint point;
+    seek_audio_ms(package, 1000, &point);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    Error error = Error::OK;
+    Package* package = load_memory_ex(data, size, &error);
+    if (package) {
+        read_package(package);
+        dmusicpak::free(package);
+    }
+
+    verify_memory(data, size);
+
+    size_t piece = size > 0 ? (size_t)data[0] + 1 : 1;
+    PushParser* parser = parser_create(NULL, 0);
+    if (!parser) return 0;
+    for (size_t offset = 0; offset < size; offset += piece) {
+        size_t length = size - offset < piece ? size - offset : piece;
+        if (!parser_feed(parser, data + offset, length)) break;
+    }
+    package = parser_finish(parser);
+    if (package) {
+        read_package(package);
+        dmusicpak::free(package);
+    }
+    return 0;
+}
@@ -16,6 +16,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdio.h>
 
 /* Export/Import macros for Windows DLL */
 #ifdef DMUSICPAK_STATIC
@@ -36,6 +37,11 @@
 #define DMUSICPAK_VERSION_MINOR 1
 #define DMUSICPAK_VERSION_PATCH 0
 
+/* Bytes of metadata a MetadataScan holds; longer metadata is truncated */
+#ifndef DMUSICPAK_SCAN_STORAGE_SIZE
+#define DMUSICPAK_SCAN_STORAGE_SIZE 4096
+#endif
+
 #ifdef __cplusplus
 namespace dmusicpak {
 
@@ -86,6 +92,84 @@ enum class AudioFormat {
     DSD = 10        /* Direct Stream Digital */
 };
 
+/* Package chunk types */
+enum class ChunkType {
+    METADATA = 1,
+    LYRICS = 2,
+    AUDIO = 3,
+    COVER = 4,
+    THUMBNAILS = 13       /* Cover thumbnails */
+};
+
+/* Location of a chunk inside a package file */
+struct ChunkInfo {
+    ChunkType type;
+    uint64_t offset;       /* Absolute file offset of chunk data */
+    uint64_t size;         /* Size of chunk data in bytes (as stored, i.e. compressed) */
+};
+
+/* Chunk compression codecs */
+enum class Compression {
+    NONE = 0,
+    ZSTD = 1        /* Zstandard (requires ENABLE_COMPRESSION) */
+};
+
+/* Memory hooks for set_allocator(); all three are required */
+struct Allocator {
+    void* (*allocate)(size_t size, void* context);
+    void* (*reallocate)(void* ptr, size_t size, void* context);
+    void (*release)(void* ptr, void* context);
+    void* context;
+};
+
+/* How save(), save_stream() and save_memory() write a package */
+struct SaveOptions {
+    int checksums;         /* Non-zero to store a CRC32C of every chunk */
+    /* Codec for metadata, lyrics, WAV audio and BMP covers; chunks that
+       would not shrink are stored as they are */
+    Compression compression;
+    int compression_level; /* Codec level (negative is faster); 0 for the default */
+    /* Non-zero to store a seek table with an entry every this many ms of audio */
+    uint32_t seek_interval_ms;
+    /* Bytes of free space to reserve after the metadata and lyrics chunks, so
+       update_metadata() and update_lyrics() can grow them in place */
+    uint32_t padding;
+    /* Non-zero to start the audio and cover payloads on a multiple of this
+       many bytes (a power of two, e.g. 4096 for O_DIRECT); compressed chunks
+       are not aligned */
+    uint32_t alignment;
+};
+
+/* Audio position found by seek_audio_ms() */
+struct SeekPoint {
+    uint64_t time_ms;      /* Start time of the frame at 'offset' */
+    uint64_t offset;       /* Byte offset into the audio payload, for get_audio_chunk() */
+};
+
+/* One line of a lyric timeline */
+struct LyricLine {
+    uint32_t start_ms;
+    uint32_t end_ms;       /* LRC: start of the next line; UINT32_MAX when shown to the end */
+    const char* text;      /* NUL-terminated UTF-8 without timing tags; owned by the timeline */
+    size_t length;         /* Bytes of text */
+    uint32_t first_word;   /* Index of the line's first word for get_lyric_word() */
+    uint32_t word_count;   /* 0 without word timings */
+};
+
+/* One timed word of a line (LRC word-by-word, ESLyric, ASS karaoke) */
+struct LyricWord {
+    uint32_t start_ms;
+    uint32_t end_ms;
+    const char* text;      /* Points into the line text; not NUL-terminated */
+    size_t length;
+};
+
+/* Playback position for lyric_cursor_advance(); zero-initialize before first use */
+struct LyricCursor {
+    uint32_t started;      /* Lines starting at or before time_ms */
+    uint64_t time_ms;
+};
+
 /* Music metadata structure */
 struct Metadata {
     char* title;           /* Song title */
@@ -124,9 +208,77 @@ struct Cover {
     uint32_t height;
 };
 
+/*
+ * Borrowed views into a package. Pointers remain valid until the
+ * corresponding chunk is replaced (set_*) or the package is freed,
+ * and must not be freed by the caller.
+ */
+struct MetadataView {
+    const char* title;
+    const char* artist;
+    const char* album;
+    const char* genre;
+    const char* year;
+    const char* comment;
+    uint32_t duration_ms;
+    uint32_t bitrate;
+    uint32_t sample_rate;
+    uint16_t channels;
+};
+
+struct LyricsView {
+    LyricFormat format;
+    const uint8_t* data;
+    size_t size;
+};
+
+struct AudioView {
+    AudioFormat format;
+    const char* source_filename;
+    const uint8_t* data;
+    size_t size;
+};
+
+struct CoverView {
+    CoverFormat format;
+    const uint8_t* data;
+    size_t size;
+    uint32_t width;
+    uint32_t height;
+};
+
+/**
+ * @brief Result of scan_metadata()
+ * The metadata strings point into 'storage', so they are valid only as
+ * long as this struct is (not in a copy of it). Strings that do not fit in
+ * storage are NULL and 'truncated' is set.
+ */
+struct MetadataScan {
+    MetadataView metadata;     /* All NULL/0 without a metadata chunk */
+    int has_metadata;
+    int truncated;
+    int has_cover;
+    CoverFormat cover_format;  /* Format and dimensions are NONE/0 for compressed covers */
+    uint32_t cover_width;
+    uint32_t cover_height;
+    char storage[DMUSICPAK_SCAN_STORAGE_SIZE];
+};
+
 /* Main package structure */
 struct Package;
 
+/* Reusable HTTP session (network support only) */
+struct Session;
+
+/* Background read-ahead over a remote package (network support only) */
+struct Prefetcher;
+
+/* Parsed lyrics with time lookup; immutable once built */
+struct LyricTimeline;
+
+/* Process-wide cache of shared packages keyed by file name or URL */
+struct Cache;
+
 /* Streaming callback function type */
 using StreamCallback = size_t (*)(
     void* buffer,
@@ -135,6 +287,165 @@ using StreamCallback = size_t (*)(
     void* userdata
 );
 
+/* Contiguous run of audio bytes, laid out like struct iovec */
+struct AudioSpan {
+    const void* data;
+    size_t size;
+};
+
+/* Vectored streaming callback; returns the bytes consumed across all spans */
+using StreamVecCallback = size_t (*)(
+    const AudioSpan* spans,
+    size_t count,
+    void* userdata
+);
+
+/* Options for stream_audio_ex(), stream_audio_vec() and send_audio(); zero-initialize for defaults */
+struct StreamOptions {
+    uint64_t offset;       /* First payload byte to deliver */
+    uint64_t length;       /* Bytes to deliver; 0 for the rest of the payload */
+    size_t chunk_size;     /* Bytes per callback (per span for stream_audio_vec()); 0 for the whole
+                              range when audio is in memory, 256 KB when it is read from the file */
+    uint32_t max_spans;    /* Spans per stream_audio_vec() call; 0 for 16, at most 64 */
+    uint8_t* buffer;       /* Buffer for file reads; NULL to allocate one per call */
+    size_t buffer_size;
+};
+
+/**
+ * @brief Callbacks for incremental loading
+ * Every member may be NULL. Views passed to the callbacks point into the
+ * package being built and stay valid until it is freed.
+ */
+struct StreamListener {
+    void (*on_metadata)(const MetadataView* metadata, void* userdata);
+    void (*on_lyrics)(const LyricsView* lyrics, void* userdata);
+    void (*on_cover)(const CoverView* cover, void* userdata);
+    /* Audio chunk header arrived; data is NULL and size is the full payload size */
+    void (*on_audio_start)(const AudioView* audio, void* userdata);
+    /* Audio bytes as they arrive; returning less than size*nmemb aborts the load */
+    StreamCallback on_audio;
+    /* Non-zero to also keep audio in the returned package (always kept if on_audio is NULL) */
+    int retain_audio;
+    void* userdata;
+};
+
+/**
+ * @brief One package to write with pack_batch()
+ * Any of metadata, lyrics, audio and cover may be NULL to omit that chunk.
+ * Buffers are only read and must stay valid until pack_batch() returns.
+ */
+struct PackJob {
+    const char* filename;      /* Output package file */
+    const Metadata* metadata;
+    const Lyrics* lyrics;
+    const Audio* audio;
+    const Cover* cover;
+    /* If non-NULL, the audio payload is read from this file; format and
+       source_filename still come from 'audio' when it is set */
+    const char* audio_file;
+    const SaveOptions* options; /* NULL for defaults */
+};
+
+/* Called once per finished job, from the thread that ran it */
+using BatchCallback = void (*)(size_t index, Error result, void* userdata);
+
+/* Called once per file by scan_directory(), from the thread that scanned it;
+   scan is only valid during the call */
+using ScanCallback = void (*)(const char* filename, const MetadataScan* scan, Error result, void* userdata);
+
+/* Library counters summed over all threads, from get_stats() */
+struct Stats {
+    uint64_t bytes_read;          /* Read from package files */
+    uint64_t bytes_written;       /* Package bytes written by the save and update functions */
+    uint64_t bytes_copied;        /* Payload bytes copied in memory (loads, setters, get_*(), chunk reads) */
+    uint64_t allocations;         /* Calls to the allocator (malloc and realloc) */
+    uint64_t allocated_bytes;
+    uint64_t packages_loaded;
+    uint64_t packages_saved;      /* Including in-place updates */
+    uint64_t chunks_parsed;
+    uint64_t network_requests;    /* Finished HTTP transfers */
+    uint64_t network_connections; /* New connections (each a TCP and, for HTTPS, a TLS handshake) */
+    uint64_t network_bytes;       /* Response body bytes received */
+    uint64_t load_time_ns;        /* Time spent in loaders */
+    uint64_t save_time_ns;        /* Time spent in the save and update functions */
+    uint64_t network_time_ns;     /* Time spent in HTTP transfers */
+};
+
+/* Operation reported to the trace callback when it finishes */
+enum class TraceEvent {
+    LOAD = 1,             /* A package was loaded */
+    SAVE = 2,             /* A package was saved or updated in place */
+    CHUNK = 3,            /* A chunk was parsed while loading */
+    NETWORK_REQUEST = 4   /* An HTTP transfer finished */
+};
+
+/* One finished operation; start and duration make a complete trace slice */
+struct TraceRecord {
+    TraceEvent event;
+    const char* name;     /* File name or URL; NULL for packages in memory and chunks */
+    uint8_t chunk_type;   /* CHUNK: type as stored (0x80 set when compressed) */
+    uint64_t bytes;       /* Package, chunk or response body size */
+    uint64_t start_ns;    /* Monotonic clock */
+    uint64_t duration_ns;
+    Error result;
+};
+
+/* Called on the thread that finished the operation */
+using TraceCallback = void (*)(const TraceRecord* record, void* userdata);
+
+/* How much of a package a cache entry keeps in memory */
+enum class CacheLevel {
+    METADATA = 0,  /* Chunk index, metadata and lyrics; get_cover() and the audio read from
+                      the file, peek_cover() needs COVER */
+    COVER = 1,     /* METADATA plus the cover */
+    AUDIO = 2      /* The whole package (local files are mapped) */
+};
+
+/* Cache byte budgets by level; zero fields take the defaults */
+struct CacheOptions {
+    uint64_t metadata_bytes;  /* Default 16 MB */
+    uint64_t cover_bytes;     /* Default 64 MB */
+    uint64_t audio_bytes;     /* Default 256 MB */
+    uint32_t shards;          /* Separately locked parts, rounded up to a power of two; default 16 */
+};
+
+/* Cache counters, from cache_get_stats() */
+struct CacheStats {
+    uint64_t hits;
+    uint64_t misses;          /* Including stale entries that were reloaded */
+    uint64_t evictions;
+    uint64_t entries;
+    uint64_t metadata_bytes;  /* Held by the entries of each level */
+    uint64_t cover_bytes;
+    uint64_t audio_bytes;
+};
+
+/* Queue of asynchronous loads, saves and reads, from create_async_context() */
+struct AsyncContext;
+
+/* Kind of operation an async completion reports */
+enum class AsyncOperation {
+    LOAD = 0,            /* load_async() */
+    SAVE = 1,            /* save_async() */
+    READ_AUDIO = 2,      /* read_audio_chunk_async() */
+    LOAD_URL = 3,        /* load_url_async() (network support only) */
+    READ_AUDIO_URL = 4   /* get_audio_chunk_url_async() (network support only) */
+};
+
+/* One finished asynchronous operation; only valid during the callback */
+struct AsyncCompletion {
+    AsyncOperation operation;
+    Error result;
+    Package* package;    /* LOAD, LOAD_URL: the loaded package, now the callback's to free (NULL on
+                            error); SAVE, READ_AUDIO: the package passed in */
+    uint8_t* buffer;     /* READ_AUDIO, READ_AUDIO_URL: the buffer passed in */
+    int64_t bytes;       /* READ_AUDIO, READ_AUDIO_URL: bytes read, -1 on error */
+    void* userdata;
+};
+
+/* Called by async_poll() on the polling thread */
+using AsyncCallback = void (*)(const AsyncCompletion* completion);
+
 /**
  * @brief Get library version string
  * @return Version string (e.g., "1.0.0")
@@ -150,10 +461,90 @@ DMUSICPAK_API const char* error_string(Error error);
 
 /**
  * @brief Create a new empty package
+ * Uses an arena when set_package_arena() has set a block size.
  * @return Pointer to new package or NULL on error
  */
 DMUSICPAK_API Package* create();
 
+/**
+ * @brief Create a new empty package whose memory comes from one arena
+ * The package structure, chunk index, metadata strings and chunk payloads
+ * are bump-allocated from blocks of block_size bytes and released together
+ * by free(). Payloads larger than a quarter block get a block of their own,
+ * released when the payload is replaced; smaller replaced fields are
+ * reclaimed only by free().
+ * @param block_size Arena block size in bytes (0 for 64 KB)
+ * @return Pointer to new package or NULL on error
+ */
+DMUSICPAK_API Package* create_with_arena(size_t block_size);
+
+/**
+ * @brief Make packages created or loaded from now on use arenas
+ * Applies to create() and every loader, as create_with_arena(block_size).
+ * @param block_size Arena block size in bytes, or 0 (the default) for
+ *                   individual allocations
+ */
+DMUSICPAK_API void set_package_arena(size_t block_size);
+
+/**
+ * @brief Route the library's memory allocations through custom hooks
+ * Call before any other function, or while no package, buffer or other
+ * object from the library is alive: memory is released with the hooks
+ * active at the time. Buffers the library returns (save_memory(), get_*()
+ * copies) come from the hooks and buffers passed to the *_owned() setters
+ * must too; release the former with free_buffer() or the free_*() functions.
+ * @param allocator Hooks (copied), or NULL to restore malloc/realloc/free
+ * @return Error code (INVALID_PARAM if a hook is missing)
+ */
+DMUSICPAK_API Error set_allocator(const Allocator* allocator);
+
+/**
+ * @brief Turn the get_stats() counters on or off
+ * Counters are kept per thread and only summed by get_stats(); while off
+ * (the default) each counting point costs one relaxed atomic load.
+ * @param enabled Non-zero to count
+ */
+DMUSICPAK_API void set_stats_enabled(int enabled);
+
+/**
+ * @brief Read the library counters, summed over all threads
+ * Counts since the last reset_stats(), taken while counting was enabled;
+ * threads that have exited still count.
+ * @param stats Output counters
+ * @return Error code
+ */
+DMUSICPAK_API Error get_stats(Stats* stats);
+
+/**
+ * @brief Restart the get_stats() counters from zero
+ */
+DMUSICPAK_API void reset_stats();
+
+/**
+ * @brief Report loads, chunk parses, saves and HTTP transfers to a callback
+ * The callback runs synchronously on the library's threads, so it should
+ * only queue the record (e.g. for a Perfetto or Prometheus exporter); name
+ * is valid only during the call. Set it while no other library call is
+ * running. Without a callback the trace points cost one relaxed atomic load.
+ * @param callback Callback, or NULL to stop tracing
+ * @param userdata User data passed to callback
+ */
+DMUSICPAK_API void set_trace_callback(TraceCallback callback, void* userdata);
+
+/**
+ * @brief Allocate a buffer with the library's allocator
+ * Use for data handed to the *_owned() setters when hooks are installed.
+ * @param size Number of bytes
+ * @return Buffer (free with free_buffer()) or NULL on error
+ */
+DMUSICPAK_API void* alloc_buffer(size_t size);
+
+/**
+ * @brief Free a buffer allocated by the library (e.g. by save_memory())
+ * @param buffer Buffer to free (may be NULL)
+ */
+DMUSICPAK_API void free_buffer(void* buffer);
+
 /**
  * @brief Load package from file
  * @param filename Path to .dmusicpak file
@@ -163,16 +554,118 @@ DMUSICPAK_API Package* load(const char* filename);
 
 /**
  * @brief Load package from memory
+ * Chunks are checked against the file's checksums, if it has any
  * @param data Pointer to package data
  * @param size Size of data
- * @return Pointer to loaded package or NULL on error
+ * @return Pointer to loaded package or NULL on error (including a checksum mismatch)
  */
 DMUSICPAK_API Package* load_memory(const uint8_t* data, size_t size);
 
+/**
+ * @brief Load package from memory, reporting why a load failed
+ * Every length in the package is checked against the buffer in the same
+ * pass that decodes it, so untrusted data needs no separate validation:
+ * a chunk running past the end of the buffer, a string running past the
+ * end of its chunk or a checksum mismatch fails with CORRUPTED.
+ * @param data Pointer to package data
+ * @param size Size of data
+ * @param error Output error code (can be NULL)
+ * @return Pointer to loaded package or NULL on error
+ */
+DMUSICPAK_API Package* load_memory_ex(const uint8_t* data, size_t size, Error* error);
+
+/**
+ * @brief Load package by memory-mapping the file (zero-copy)
+ * Only chunk headers are parsed; audio, lyrics and cover data point
+ * straight into the read-only mapping, which lives until free().
+ * Stored checksums are verified over the mapped payloads in place, which
+ * reads every checksummed page once but copies nothing; a mismatch fails
+ * the load. Compressed chunks are decoded into memory of their own.
+ * @param filename Path to .dmusicpak file
+ * @return Pointer to loaded package or NULL on error
+ */
+DMUSICPAK_API Package* load_mmap(const char* filename);
+
+/**
+ * @brief Open package reading only the file header and chunk index
+ * Uses the TOC chunk when present (one small read), otherwise walks the
+ * chunk headers. No chunk data is read up front: the getters fetch each
+ * chunk on first use, and get_audio_chunk()/stream_audio() read audio
+ * straight from the file without loading the whole payload. Compressed
+ * audio is read by decoding only the frames a range covers.
+ * @param filename Path to .dmusicpak file
+ * @return Pointer to package (chunks loaded lazily) or NULL on error
+ */
+DMUSICPAK_API Package* load_index(const char* filename);
+
+/**
+ * @brief Read one chunk of a package opened with load_index()
+ * Does nothing for packages that are already fully loaded. The chunk is
+ * checked against the file's checksum for it, if there is one.
+ * @param package Target package
+ * @param type Chunk to read
+ * @return Error code (NOT_SUPPORTED if the package has no such chunk,
+ *         CORRUPTED if it does not match its checksum)
+ */
+DMUSICPAK_API Error load_chunk(Package* package, ChunkType type);
+
+/**
+ * @brief Get file location of a chunk
+ * @param package Source package
+ * @param type Chunk to look up
+ * @param info Output chunk location
+ * @return Error code (NOT_SUPPORTED if the package has no such chunk)
+ */
+DMUSICPAK_API Error get_chunk_info(Package* package, ChunkType type, ChunkInfo* info);
+
+/**
+ * @brief Get file location of a chunk's payload
+ * The range holds exactly the Audio, Cover, Lyrics or thumbnail data bytes,
+ * without the fields before them, so it can be handed to sendfile() or read
+ * with direct I/O. Saved with SaveOptions::alignment, the audio and cover
+ * payloads start on an aligned offset.
+ * @param package Source package
+ * @param type LYRICS, AUDIO, COVER or THUMBNAILS
+ * @param info Output payload location
+ * @return Error code (NOT_SUPPORTED if the package has no such chunk or it is
+ *         compressed, CORRUPTED if its fields overrun it)
+ */
+DMUSICPAK_API Error get_payload_info(Package* package, ChunkType type, ChunkInfo* info);
+
 #ifdef DMUSICPAK_ENABLE_NETWORK
+/**
+ * @brief Initialize the network layer (curl_global_init())
+ * Optional: the network functions initialize it on first use, from any
+ * thread. With libcurl older than 7.84, whose global init is not
+ * thread-safe, call it from the main thread before other threads use curl.
+ * @return Error code (NETWORK if libcurl failed to initialize)
+ */
+DMUSICPAK_API Error network_init();
+
+/**
+ * @brief Release the network layer (the default session and curl_global_cleanup())
+ * Call once no other library call is running and every session,
+ * prefetcher and load_url_index() package is freed; the network
+ * functions initialize it again on next use.
+ */
+DMUSICPAK_API void network_cleanup();
+
+/**
+ * @brief Keep load_url() downloads in a directory and revalidate them
+ * Each download that carries an ETag or Last-Modified header is stored
+ * with it; later loads of the URL send If-None-Match or If-Modified-Since
+ * and read the stored copy when the server answers 304 Not Modified.
+ * Files are replaced atomically, so several processes may share the
+ * directory. Failing to write the cache does not fail the load.
+ * @param directory Existing directory, or NULL to stop caching
+ * @return Error code
+ */
+DMUSICPAK_API Error set_url_cache_dir(const char* directory);
+
 /**
  * @brief Load package from URL (HTTP/HTTPS)
- * Downloads entire file into memory before parsing
+ * Downloads entire file into memory before parsing, or revalidates the
+ * copy in the set_url_cache_dir() directory
  * @param url URL to load from (must be http:// or https://)
  * @param timeout_ms Timeout in milliseconds (0 for default: 30000ms)
  * @return Pointer to loaded package or NULL on error
@@ -189,9 +682,28 @@ DMUSICPAK_API Package* load_url(const char* url, uint32_t timeout_ms);
  */
 DMUSICPAK_API Package* load_url_stream(const char* url, uint32_t timeout_ms, size_t chunk_size);
 
+/**
+ * @brief Load package from URL, parsing chunks as the bytes arrive
+ * Each chunk is allocated once at its final size and filled in place;
+ * listener callbacks fire as soon as their chunk is complete, and audio
+ * is delivered in chunk_size pieces while it is still downloading
+ * @param url URL to load from (must be http:// or https://)
+ * @param timeout_ms Timeout in milliseconds (0 for default: 30000ms)
+ * @param chunk_size Audio delivery and receive buffer size (0 for default: 64KB)
+ * @param listener Callbacks (can be NULL)
+ * @return Pointer to loaded package or NULL on error
+ */
+DMUSICPAK_API Package* load_url_stream_ex(
+    const char* url,
+    uint32_t timeout_ms,
+    size_t chunk_size,
+    const StreamListener* listener
+);
+
 /**
  * @brief Get audio chunk from URL using HTTP Range request
- * Useful for streaming audio without downloading entire file
+ * Useful for streaming audio without downloading entire file.
+ * Requests go through a shared process-wide session, so connections are reused
  * @param url URL to load from
  * @param offset Byte offset to start reading from
  * @param size Number of bytes to read
@@ -206,31 +718,557 @@ DMUSICPAK_API int64_t get_audio_chunk_url(
     uint8_t* buffer,
     uint32_t timeout_ms
 );
+
+/**
+ * @brief Create an HTTP session for repeated range requests
+ * DNS results, TLS sessions and connections are cached and shared by all
+ * requests issued through the session, so consecutive reads against the
+ * same host reuse one keep-alive (or HTTP/2) connection instead of
+ * handshaking each time. A session may be used from several threads.
+ * @param timeout_ms Per-request timeout in milliseconds (0 for default: 30000ms)
+ * @return Session or NULL on error
+ */
+DMUSICPAK_API Session* create_session(uint32_t timeout_ms);
+
+/**
+ * @brief Free an HTTP session and close its connections
+ * @param session Session to free (can be NULL)
+ */
+DMUSICPAK_API void free_session(Session* session);
+
+/**
+ * @brief Get audio chunk from URL using HTTP Range request over a session
+ * @param session Session from create_session()
+ * @param url URL to load from
+ * @param offset Byte offset to start reading from
+ * @param size Number of bytes to read
+ * @param buffer Output buffer (must be at least 'size' bytes)
+ * @return Number of bytes read, or -1 on error
+ */
+DMUSICPAK_API int64_t get_audio_chunk_session(
+    Session* session,
+    const char* url,
+    size_t offset,
+    size_t size,
+    uint8_t* buffer
+);
+
+/**
+ * @brief Open a package over HTTP from its header and index only
+ * A single small Range request fetches the header and TOC (or the chunk
+ * headers of packages without one); chunks are then fetched on demand like
+ * load_index() packages. get_audio_chunk() and stream_audio() take
+ * audio-relative offsets and translate them into file Range requests, so
+ * clients can seek without downloading metadata or cover first.
+ * The server must support Range requests.
+ * @param url URL to load from (must be http:// or https://)
+ * @param session Session to issue requests on, which must outlive the
+ *                package (NULL for the process-wide session)
+ * @return Pointer to package or NULL on error
+ */
+DMUSICPAK_API Package* load_url_index(const char* url, Session* session);
+
+/**
+ * @brief Start prefetching the audio of a remote package
+ * A background worker keeps 'depth' Range windows of 'window_size' bytes
+ * in flight ahead of the read cursor (multiplexed over HTTP/2 where the
+ * server supports it), so network stalls are absorbed by the buffered
+ * windows instead of blocking playback.
+ * @param package Package from load_url_index(); must outlive the prefetcher
+ * @param window_size Bytes per Range request (0 for default: 256KB)
+ * @param depth Number of windows kept ahead of the cursor (0 for default: 4)
+ * @return Prefetcher or NULL on error (NULL for packages not opened with load_url_index()
+ *         and for compressed audio)
+ */
+DMUSICPAK_API Prefetcher* create_prefetcher(Package* package, size_t window_size, uint32_t depth);
+
+/**
+ * @brief Stop prefetching and release buffers
+ * @param prefetcher Prefetcher to free (can be NULL)
+ */
+DMUSICPAK_API void free_prefetcher(Prefetcher* prefetcher);
+
+/**
+ * @brief Read audio at the cursor and advance it
+ * Blocks until 'size' bytes or the end of the audio have been read
+ * @param prefetcher Prefetcher
+ * @param buffer Output buffer (must be at least 'size' bytes)
+ * @param size Number of bytes to read
+ * @return Number of bytes read (0 at end of audio), or -1 if the window at
+ *         the cursor failed to download (seek to retry)
+ */
+DMUSICPAK_API int64_t prefetch_read(Prefetcher* prefetcher, uint8_t* buffer, size_t size);
+
+/**
+ * @brief Get number of bytes readable at the cursor without blocking
+ * @param prefetcher Prefetcher
+ * @return Buffered contiguous bytes
+ */
+DMUSICPAK_API size_t prefetch_available(Prefetcher* prefetcher);
+
+/**
+ * @brief Move the read cursor
+ * In-flight windows that do not cover the new position are cancelled and
+ * read-ahead restarts from it
+ * @param prefetcher Prefetcher
+ * @param offset New audio-relative cursor position
+ * @return Error code
+ */
+DMUSICPAK_API Error prefetch_seek(Prefetcher* prefetcher, uint64_t offset);
 #endif /* DMUSICPAK_ENABLE_NETWORK */
 
+/**
+ * @brief Set how the package is written by the save functions
+ * Packages loaded from a file with checksums keep writing them.
+ * @param package Package handle
+ * @param options Options to use from now on
+ * @return Error code (NOT_SUPPORTED for a codec the library was built without)
+ */
+DMUSICPAK_API Error set_save_options(Package* package, const SaveOptions* options);
+
+/**
+ * @brief Get the options the save functions will use
+ * @param package Package handle
+ * @param options Output options
+ * @return Error code
+ */
+DMUSICPAK_API Error get_save_options(Package* package, SaveOptions* options);
+
+/**
+ * @brief Check a package file against its stored checksums
+ * Checksums straight off a read-only mapping of the file; no chunk is
+ * decoded or copied. The tracks of an album file are checked against
+ * their own checksums.
+ * @param filename Package file
+ * @return Error::OK if every chunk matches, Error::CORRUPTED on a mismatch or
+ *         missing chunk, Error::NOT_SUPPORTED if the file has no checksums
+ */
+DMUSICPAK_API Error verify(const char* filename);
+
+/**
+ * @brief Check a package in memory against its stored checksums
+ * @param data Package bytes
+ * @param size Size of data
+ * @return Same as verify()
+ */
+DMUSICPAK_API Error verify_memory(const uint8_t* data, size_t size);
+
 /**
  * @brief Save package to file
+ * Streams to a temporary file next to the target, then renames it over
+ * the target, so a package may be saved back to the file it was loaded from
  * @param package Package to save
  * @param filename Output filename
  * @return Error code
  */
 DMUSICPAK_API Error save(Package* package, const char* filename);
 
+/**
+ * @brief Save package directly to an open stream
+ * Header and chunk headers are written as they are produced and payloads
+ * go from the package's buffers straight to the stream, so no in-memory
+ * image of the whole package is built. Chunks of a load_index() package
+ * that were never loaded are copied from its file in fixed-size blocks.
+ * @param package Package to save
+ * @param file Output stream opened in binary mode (not the package's own file)
+ * @return Error code
+ */
+DMUSICPAK_API Error save_stream(Package* package, FILE* file);
+
 /**
  * @brief Save package to memory buffer
  * @param package Package to save
- * @param buffer Output buffer (allocated by function)
+ * @param buffer Output buffer (allocated by function; free with free_buffer())
  * @param size Output size
  * @return Error code
  */
 DMUSICPAK_API Error save_memory(Package* package, uint8_t** buffer, size_t* size);
 
+/**
+ * @brief Replace the metadata of a package file in place
+ * Only the metadata chunk and the header, TOC and checksum entries are
+ * written. The chunk grows into the padding behind it (SaveOptions::padding)
+ * or moves to the end of the file, leaving padding behind. Unlike save(),
+ * the update is not atomic; an interrupted one can leave the metadata
+ * unreadable (detected when the file has checksums). Packages loaded from
+ * the file with load_mmap() or load_index() must be freed first.
+ * @param filename Package file (written by save() or save_memory(), with a TOC)
+ * @param metadata New metadata (compressed if the old chunk was)
+ * @return Error code (NOT_SUPPORTED if the file has no TOC or no metadata chunk)
+ */
+DMUSICPAK_API Error update_metadata(const char* filename, const Metadata* metadata);
+
+/**
+ * @brief Replace the lyrics of a package file in place
+ * Works like update_metadata().
+ * @param filename Package file (written by save() or save_memory(), with a TOC)
+ * @param lyrics New lyrics (compressed if the old chunk was)
+ * @return Error code (NOT_SUPPORTED if the file has no TOC or no lyrics chunk)
+ */
+DMUSICPAK_API Error update_lyrics(const char* filename, const Lyrics* lyrics);
+
+/**
+ * @brief Write several packages in parallel
+ * Jobs are spread over 'threads' threads (0 for one per core), so reading
+ * one job's audio file overlaps with serializing the others.
+ * @param jobs Array of jobs
+ * @param count Number of jobs
+ * @param threads Maximum number of threads, including the caller's
+ * @param callback Per-job result callback (can be NULL)
+ * @param userdata User data passed to callback
+ * @return Error::OK if every job succeeded, otherwise the error of the first failed job
+ */
+DMUSICPAK_API Error pack_batch(
+    const PackJob* jobs,
+    size_t count,
+    unsigned threads,
+    BatchCallback callback,
+    void* userdata
+);
+
+/**
+ * @brief Load several packages in parallel
+ * @param filenames Array of input filenames
+ * @param count Number of files
+ * @param threads Maximum number of threads, including the caller's (0 for one per core)
+ * @param packages Output array of count packages; NULL for files that failed to load
+ * @param callback Per-file result callback (can be NULL)
+ * @param userdata User data passed to callback
+ * @return Error::OK if every file loaded, otherwise the error of the first failed file
+ */
+DMUSICPAK_API Error load_batch(
+    const char* const* filenames,
+    size_t count,
+    unsigned threads,
+    Package** packages,
+    BatchCallback callback,
+    void* userdata
+);
+
+/**
+ * @brief Read the metadata and cover facts of a package file without loading it
+ * The chunks are found from the first 4 KB of the file, so a scan normally
+ * takes one or two small reads and no heap allocation (compressed metadata
+ * is decoded in a temporary buffer).
+ * @param filename Package file
+ * @param scan Output; 'metadata' strings point into scan->storage
+ * @return Error code (CORRUPTED if the metadata chunk is malformed or fails its checksum)
+ */
+DMUSICPAK_API Error scan_metadata(const char* filename, MetadataScan* scan);
+
+/**
+ * @brief Scan the metadata of every package in a directory in parallel
+ * Files are listed in batches of 1024 and each batch is scanned with
+ * scan_metadata() on a pool of threads. Symbolic links are not followed
+ * and subdirectories that cannot be opened are skipped.
+ * @param directory Directory to scan
+ * @param extension Only scan files whose name ends with this (e.g. ".dmusicpak",
+ *                  ignoring ASCII case); NULL for every file
+ * @param recursive Non-zero to scan subdirectories too
+ * @param threads Maximum number of threads, including the caller's (0 for one per core)
+ * @param callback Per-file callback, called concurrently from several threads
+ * @param userdata User data passed to callback
+ * @return Error code (FILE_NOT_FOUND if the directory cannot be opened); per-file
+ *         results go to the callback
+ */
+DMUSICPAK_API Error scan_directory(
+    const char* directory,
+    const char* extension,
+    int recursive,
+    unsigned threads,
+    ScanCallback callback,
+    void* userdata
+);
+
 /**
  * @brief Free package and all associated data
- * @param package Package to free
+ * A shared package is freed when its last reference is released.
+ * @param package Package to free, or a reference to release
  */
 DMUSICPAK_API void free(Package* package);
 
+/**
+ * @brief Make a package immutable so many threads can read it without locks
+ * Loads the metadata, lyrics and cover chunks, locates the audio of
+ * load_index() packages and builds the seek table and lyric timeline up
+ * front, so no read fills anything in later. From then on the getters,
+ * peek_*(), get_audio_chunk(), stream_audio*(), send_audio(),
+ * seek_audio_ms(), get_lyric_timeline() and save*() may be called from any
+ * number of threads at once; compressed audio is decoded into a per-thread
+ * frame cache. The setters and set_save_options() return NOT_SUPPORTED,
+ * and so do peek_audio() and get_audio() when the audio is still in the
+ * package file. The caller's pointer becomes the first reference.
+ * @param package Package to share (calling it again does nothing)
+ * @return Error code (the package is unchanged on error)
+ */
+DMUSICPAK_API Error share(Package* package);
+
+/**
+ * @brief Take another reference to a shared package
+ * Each reference is released with free(); reference counting is atomic,
+ * so references may be taken and released from any thread.
+ * @param package Package passed to share()
+ * @return package, or NULL if it is not shared
+ */
+DMUSICPAK_API Package* retain(Package* package);
+
+/**
+ * @brief Create a package cache
+ * Entries are shared packages (see share()) evicted least recently used
+ * first, each level within its own byte budget. The budgets are split
+ * evenly across the shards; a package larger than its shard's budget is
+ * returned without being cached.
+ * @param options Budgets and shard count (NULL for the defaults)
+ * @return Cache, or NULL on failure
+ */
+DMUSICPAK_API Cache* create_cache(const CacheOptions* options);
+
+/**
+ * @brief Free a cache
+ * Packages still referenced by callers stay valid until they are freed.
+ * @param cache Cache to free
+ */
+DMUSICPAK_API void free_cache(Cache* cache);
+
+/**
+ * @brief Load a package file through a cache
+ * An entry is reused while the file's size and modification time are
+ * unchanged; otherwise the file is loaded again (load_index() for the
+ * METADATA and COVER levels, load_mmap() for AUDIO) and shared. Entries
+ * keep their file open. Safe to call from several threads at once. At the
+ * METADATA level get_cover() reads the cover from the file on every call;
+ * peek_cover() needs the COVER level.
+ * @param cache Cache to use
+ * @param filename Package file
+ * @param level How much of the package to keep in memory
+ * @return A reference to a shared package, released with free(); NULL on error
+ */
+DMUSICPAK_API Package* cache_load(Cache* cache, const char* filename, CacheLevel level);
+
+#ifdef DMUSICPAK_ENABLE_NETWORK
+/**
+ * @brief Load a remote package through a cache
+ * A HEAD request revalidates the entry against the resource's ETag, or its
+ * Last-Modified date when there is no ETag; resources with neither are
+ * loaded but not cached. Packages are opened with load_url_index() and
+ * read their chunks through the session, which must outlive the entries.
+ * @param cache Cache to use
+ * @param url Package URL
+ * @param level How much of the package to keep in memory
+ * @param session Session for the requests (NULL for the process-wide one)
+ * @return A reference to a shared package, released with free(); NULL on error
+ */
+DMUSICPAK_API Package* cache_load_url(Cache* cache, const char* url, CacheLevel level, Session* session);
+#endif
+
+/**
+ * @brief Drop every entry of a cache
+ * @param cache Cache to clear
+ */
+DMUSICPAK_API void cache_clear(Cache* cache);
+
+/**
+ * @brief Get cache counters
+ * @param cache Cache to query
+ * @param stats Output counters
+ * @return Error code
+ */
+DMUSICPAK_API Error cache_get_stats(Cache* cache, CacheStats* stats);
+
+/* Multi-track package file (album); tracks are lazily loaded packages over it */
+struct Album;
+
+/**
+ * @brief Save packages as the tracks of one album file
+ * The album package supplies the album-level metadata and cover. Metadata
+ * fields a track shares with it (album, artist, genre, year) and a track
+ * cover identical to it are stored once for the whole album. Each package
+ * is written with its own SaveOptions; with alignment set, payloads start
+ * on aligned offsets of the album file.
+ * @param filename Output file path
+ * @param album Album-level metadata and cover (can be NULL)
+ * @param tracks Track packages, in track order
+ * @param count Number of tracks
+ * @return Error code
+ */
+DMUSICPAK_API Error save_album(const char* filename, Package* album, Package* const* tracks, uint32_t count);
+
+/**
+ * @brief Open an album file, reading the album metadata, cover and track index
+ * @param filename Album file path
+ * @return Album handle or NULL on error
+ */
+DMUSICPAK_API Album* open_album(const char* filename);
+
+/**
+ * @brief Open an album file through a read-only memory mapping
+ * @param filename Album file path
+ * @return Album handle or NULL on error
+ */
+DMUSICPAK_API Album* open_album_mmap(const char* filename);
+
+/**
+ * @brief Close an album handle
+ * Tracks loaded from it stay valid; the file is closed with the last of them.
+ * @param album Album to close
+ */
+DMUSICPAK_API void close_album(Album* album);
+
+/**
+ * @brief Get the number of tracks in an album
+ * @param album Album handle
+ * @return Track count
+ */
+DMUSICPAK_API uint32_t album_track_count(const Album* album);
+
+/**
+ * @brief Get the album-level metadata and cover
+ * @param album Album handle
+ * @return Shared package (release with free()) or NULL
+ */
+DMUSICPAK_API Package* album_info(Album* album);
+
+/**
+ * @brief Load one track of an album like load_index()
+ * Chunks are read on demand; album-level fields the track does not set and
+ * the album cover, when the track has none, are filled in. Safe to call
+ * from several threads.
+ * @param album Album handle
+ * @param index Track index
+ * @return Package pointer or NULL on error
+ */
+DMUSICPAK_API Package* load_album_track(Album* album, uint32_t index);
+
+/**
+ * @brief Create a context for asynchronous loads, saves and reads
+ * Loads and saves run on a pool of worker threads, audio reads of file
+ * packages go to an io_uring where available, and HTTP range reads run
+ * together on one curl multi handle. Finished operations wait in the
+ * context until async_poll() runs their callbacks, so an event loop can
+ * watch async_fd() (async_event() on Windows) and poll when it is signalled.
+ * @param threads Worker threads for file operations and URL loads (0 for 4, at most 64)
+ * @return Context, or NULL on failure
+ */
+DMUSICPAK_API AsyncContext* create_async_context(uint32_t threads);
+
+/**
+ * @brief Free an async context
+ * Waits for every submitted operation, then runs the callbacks that have
+ * not been delivered yet; callbacks cannot submit more at that point.
+ * @param context Context to free
+ */
+DMUSICPAK_API void free_async_context(AsyncContext* context);
+
+/**
+ * @brief Get a descriptor that is readable while completions are waiting
+ * async_poll() makes it unreadable again; watch it with poll(), epoll or select().
+ * @param context Async context
+ * @return File descriptor, or -1 where there is none (Windows: see async_event())
+ */
+DMUSICPAK_API int async_fd(const AsyncContext* context);
+
+/**
+ * @brief Get an event that is set while completions are waiting (Windows)
+ * A manual-reset event HANDLE that async_poll() resets; wait on it with
+ * WaitForSingleObject() or WaitForMultipleObjects(). It belongs to the context.
+ * @param context Async context
+ * @return Event HANDLE, or NULL elsewhere (see async_fd())
+ */
+DMUSICPAK_API void* async_event(const AsyncContext* context);
+
+/**
+ * @brief Run the callbacks of finished operations on the calling thread
+ * Callbacks may submit further operations.
+ * @param context Async context
+ * @param timeout_ms How long to wait when nothing has finished yet (0 to return at once)
+ * @return Number of callbacks run
+ */
+DMUSICPAK_API uint32_t async_poll(AsyncContext* context, uint32_t timeout_ms);
+
+/**
+ * @brief Get the number of submitted operations whose callbacks have not run
+ * @param context Async context
+ * @return Operation count
+ */
+DMUSICPAK_API uint32_t async_pending(AsyncContext* context);
+
+/**
+ * @brief Load a package file in the background like load()
+ * @param context Async context
+ * @param filename Input file path
+ * @param callback Completion callback
+ * @param userdata User data passed in the completion
+ * @return Error code (the callback only runs if this is OK)
+ */
+DMUSICPAK_API Error load_async(AsyncContext* context, const char* filename, AsyncCallback callback, void* userdata);
+
+/**
+ * @brief Save a package in the background like save()
+ * The package must not be changed or freed until the callback runs, nor
+ * used by other operations meanwhile unless it is shared (see share()).
+ * @param context Async context
+ * @param package Package to save
+ * @param filename Output file path
+ * @param callback Completion callback
+ * @param userdata User data passed in the completion
+ * @return Error code (the callback only runs if this is OK)
+ */
+DMUSICPAK_API Error save_async(AsyncContext* context, Package* package, const char* filename,
+                               AsyncCallback callback, void* userdata);
+
+/**
+ * @brief Read audio in the background like get_audio_chunk()
+ * Audio held in memory is copied before this returns and the callback runs
+ * on the next async_poll(). Uncompressed audio of a load_index() package is
+ * queued on an io_uring on Linux, so many reads can be in flight without a
+ * worker thread each; compressed audio and other platforms use the workers.
+ * The package and buffer must stay valid until the callback runs. Several
+ * operations on one package at a time need a shared package (see share()).
+ * @param context Async context
+ * @param package Source package
+ * @param offset Offset in bytes
+ * @param size Size to read
+ * @param buffer Output buffer
+ * @param callback Completion callback
+ * @param userdata User data passed in the completion
+ * @return Error code (the callback only runs if this is OK)
+ */
+DMUSICPAK_API Error read_audio_chunk_async(AsyncContext* context, Package* package, size_t offset, size_t size,
+                                           uint8_t* buffer, AsyncCallback callback, void* userdata);
+
+#ifdef DMUSICPAK_ENABLE_NETWORK
+/**
+ * @brief Load a remote package in the background like load_url()
+ * @param context Async context
+ * @param url Package URL
+ * @param timeout_ms Timeout in milliseconds (0 for default)
+ * @param callback Completion callback
+ * @param userdata User data passed in the completion
+ * @return Error code (the callback only runs if this is OK)
+ */
+DMUSICPAK_API Error load_url_async(AsyncContext* context, const char* url, uint32_t timeout_ms,
+                                   AsyncCallback callback, void* userdata);
+
+/**
+ * @brief Read a byte range of a URL in the background like get_audio_chunk_session()
+ * Reads share the context's curl multi handle, so any number can be in
+ * flight without a thread each. The buffer, and the session if one is
+ * given, must stay valid until the callback runs.
+ * @param context Async context
+ * @param session Session for the request (NULL for the process-wide one)
+ * @param url Resource URL
+ * @param offset Offset in bytes
+ * @param size Size to read
+ * @param buffer Output buffer
+ * @param callback Completion callback
+ * @param userdata User data passed in the completion
+ * @return Error code (the callback only runs if this is OK)
+ */
+DMUSICPAK_API Error get_audio_chunk_url_async(AsyncContext* context, Session* session, const char* url,
+                                              size_t offset, size_t size, uint8_t* buffer,
+                                              AsyncCallback callback, void* userdata);
+#endif
+
 /**
  * @brief Set metadata for package
  * @param package Target package
@@ -289,12 +1327,110 @@ DMUSICPAK_API Error set_cover(Package* package, const Cover* cover);
 
 /**
  * @brief Get cover image from package
+ * Shared packages whose cover is still in the file read it into 'cover' on
+ * every call without keeping it.
  * @param package Source package
  * @param cover Output cover structure (data must be freed by caller)
  * @return Error code
  */
 DMUSICPAK_API Error get_cover(Package* package, Cover* cover);
 
+/**
+ * @brief Add a pre-scaled rendition of the cover
+ * The image is stored as given (the library does not scale images); a
+ * thumbnail with the same width and height is replaced. The full cover is
+ * set with set_cover() and is not affected.
+ * @param package Target package
+ * @param thumbnail Thumbnail image with its width and height (will be copied)
+ * @return Error code (INVALID_PARAM without data or dimensions, or past 32 thumbnails)
+ */
+DMUSICPAK_API Error add_cover_thumbnail(Package* package, const Cover* thumbnail);
+
+/**
+ * @brief Remove every cover thumbnail from package
+ * @param package Target package
+ * @return Error code
+ */
+DMUSICPAK_API Error clear_cover_thumbnails(Package* package);
+
+/**
+ * @brief Get the cover image best suited to a display size
+ * Picks the smallest of the thumbnails and the full cover that is at least
+ * width x height, or the largest image when none is; a cover without
+ * dimensions counts as larger than any thumbnail. On packages loaded with
+ * load_index() only the thumbnail directory and the chosen image are read.
+ * @param package Source package
+ * @param width Display width in pixels (0 for any)
+ * @param height Display height in pixels (0 for any)
+ * @param cover Output cover structure (data must be freed by caller)
+ * @return Error code (NOT_SUPPORTED if the package has no cover or thumbnails)
+ */
+DMUSICPAK_API Error get_cover_best_fit(Package* package, uint32_t width, uint32_t height, Cover* cover);
+
+/**
+ * @brief Set lyrics taking ownership of the data buffer (no copy)
+ * @param package Target package
+ * @param lyrics Lyrics whose data was allocated with malloc() (or the
+ *               set_allocator() hooks); on success
+ *               the package owns it and lyrics->data is set to NULL
+ * @return Error code
+ */
+DMUSICPAK_API Error set_lyrics_owned(Package* package, Lyrics* lyrics);
+
+/**
+ * @brief Set audio data taking ownership of the data buffer (no copy)
+ * @param package Target package
+ * @param audio Audio whose data was allocated with malloc() (or the
+ *              set_allocator() hooks); on success
+ *              the package owns it and audio->data is set to NULL
+ *              (source_filename is copied)
+ * @return Error code
+ */
+DMUSICPAK_API Error set_audio_owned(Package* package, Audio* audio);
+
+/**
+ * @brief Set cover image taking ownership of the data buffer (no copy)
+ * @param package Target package
+ * @param cover Cover whose data was allocated with malloc() (or the
+ *              set_allocator() hooks); on success
+ *              the package owns it and cover->data is set to NULL
+ * @return Error code
+ */
+DMUSICPAK_API Error set_cover_owned(Package* package, Cover* cover);
+
+/**
+ * @brief Borrow metadata from package without copying
+ * @param package Source package
+ * @param view Output view (points into the package, do not free)
+ * @return Error code
+ */
+DMUSICPAK_API Error peek_metadata(Package* package, MetadataView* view);
+
+/**
+ * @brief Borrow lyrics from package without copying
+ * @param package Source package
+ * @param view Output view (points into the package, do not free)
+ * @return Error code
+ */
+DMUSICPAK_API Error peek_lyrics(Package* package, LyricsView* view);
+
+/**
+ * @brief Borrow audio data from package without copying
+ * @param package Source package
+ * @param view Output view (points into the package, do not free)
+ * @return Error code
+ */
+DMUSICPAK_API Error peek_audio(Package* package, AudioView* view);
+
+/**
+ * @brief Borrow cover image from package without copying
+ * @param package Source package
+ * @param view Output view (points into the package, do not free)
+ * @return Error code (NOT_SUPPORTED for a shared package whose cover is
+ *         still in its file, e.g. from cache_load() at the METADATA level)
+ */
+DMUSICPAK_API Error peek_cover(Package* package, CoverView* view);
+
 /**
  * @brief Stream audio data with callback
  * @param package Source package
@@ -308,6 +1444,61 @@ DMUSICPAK_API Error stream_audio(
     void* userdata
 );
 
+/**
+ * @brief Stream a range of audio data with a caller-chosen chunk size
+ * Audio in memory (loaded or mapped) is passed to the callback in place;
+ * load_index() packages are read through one buffer, the caller's if given.
+ * As with stream_audio(), returning 0 stops and returning less than the
+ * chunk delivers the rest of it again.
+ * @param package Source package
+ * @param options Range and chunking (NULL for the whole payload in as few calls as possible)
+ * @param callback Callback function for streaming data
+ * @param userdata User data passed to callback
+ * @return Error code
+ */
+DMUSICPAK_API Error stream_audio_ex(
+    Package* package,
+    const StreamOptions* options,
+    StreamCallback callback,
+    void* userdata
+);
+
+/**
+ * @brief Stream a range of audio data as batches of spans
+ * Each call gets up to options->max_spans consecutive spans of
+ * options->chunk_size bytes, ready for writev(). Returning 0 stops;
+ * returning less than the total resumes after the bytes consumed.
+ * @param package Source package
+ * @param options Range and chunking (NULL for defaults)
+ * @param callback Vectored callback
+ * @param userdata User data passed to callback
+ * @return Error code
+ */
+DMUSICPAK_API Error stream_audio_vec(
+    Package* package,
+    const StreamOptions* options,
+    StreamVecCallback callback,
+    void* userdata
+);
+
+/**
+ * @brief Write a range of audio data to a file descriptor or socket
+ * Uncompressed audio of a local load_index() package is copied by the
+ * kernel with sendfile() on Linux; other packages are written from memory
+ * or through a buffer. The descriptor should be blocking.
+ * @param package Source package
+ * @param fd Destination descriptor (a CRT descriptor on Windows)
+ * @param options Range (NULL for the whole payload); chunk_size and buffer apply to buffered copies
+ * @param sent Output: bytes written, also on error (may be NULL)
+ * @return Error code (IO if a read or write failed)
+ */
+DMUSICPAK_API Error send_audio(
+    Package* package,
+    int fd,
+    const StreamOptions* options,
+    uint64_t* sent
+);
+
 /**
  * @brief Get audio data chunk for streaming
  * @param package Source package
@@ -323,6 +1514,108 @@ DMUSICPAK_API int64_t get_audio_chunk(
     uint8_t* buffer
 );
 
+/**
+ * @brief Find where to start decoding audio for a playback time
+ * Binary search of the package's seek table, read on first use for
+ * load_index() packages. Without a stored table one is built from the
+ * loaded audio by scanning its frames (MP3, ADTS AAC, FLAC, Ogg Vorbis/Opus,
+ * WAV); other formats are estimated from metadata bitrate or duration
+ * and their offsets are not frame-aligned.
+ * @param package Source package
+ * @param time_ms Playback time in milliseconds
+ * @param point Output: last seek point at or before time_ms
+ * @return Error code (NOT_SUPPORTED if there is no table and none can be built,
+ *         e.g. a load_index() package whose file has no seek table)
+ */
+DMUSICPAK_API Error seek_audio_ms(Package* package, uint64_t time_ms, SeekPoint* point);
+
+/**
+ * @brief Parse timed lyrics into a timeline
+ * LRC lines may carry several timestamps and "<mm:ss.xx>" or inline
+ * "[mm:ss.xx]" word timings, and "[offset:]" is applied. SRT cues and ASS
+ * "Dialogue:" events keep their own end times; ASS override blocks are
+ * removed and "\k" karaoke tags become word timings. Untimed lines are
+ * dropped, so plain text gives an empty timeline.
+ * @param data Lyrics text (UTF-8)
+ * @param size Size of data in bytes
+ * @param format Lyrics format
+ * @return Timeline (free with free_lyric_timeline()) or NULL on error
+ */
+DMUSICPAK_API LyricTimeline* parse_lyrics(const uint8_t* data, size_t size, LyricFormat format);
+
+/**
+ * @brief Free a timeline returned by parse_lyrics()
+ * @param timeline Timeline to free (may be NULL)
+ */
+DMUSICPAK_API void free_lyric_timeline(LyricTimeline* timeline);
+
+/**
+ * @brief Get the package's lyrics as a timeline
+ * Parsed on first use, loading the lyrics chunk of load_index() packages,
+ * and kept until the lyrics are replaced or the package is freed. The
+ * timeline is read-only and may be queried from any thread.
+ * @param package Source package
+ * @param timeline Output: timeline owned by the package
+ * @return Error code (NOT_SUPPORTED if the package has no lyrics)
+ */
+DMUSICPAK_API Error get_lyric_timeline(Package* package, const LyricTimeline** timeline);
+
+/**
+ * @brief Get the number of lines in a timeline
+ * @param timeline Source timeline
+ * @return Line count (0 for NULL)
+ */
+DMUSICPAK_API uint32_t lyric_line_count(const LyricTimeline* timeline);
+
+/**
+ * @brief Get one line of a timeline, in start time order
+ * @param timeline Source timeline
+ * @param index Line index
+ * @param line Output line; text points into the timeline
+ * @return Error code
+ */
+DMUSICPAK_API Error get_lyric_line(const LyricTimeline* timeline, uint32_t index, LyricLine* line);
+
+/**
+ * @brief Get one word timing of a timeline
+ * @param timeline Source timeline
+ * @param index Word index (from LyricLine::first_word)
+ * @param word Output word; text points into the timeline
+ * @return Error code
+ */
+DMUSICPAK_API Error get_lyric_word(const LyricTimeline* timeline, uint32_t index, LyricWord* word);
+
+/**
+ * @brief Find the line showing at a playback time
+ * Binary search over the line start times. When several lines have
+ * started and not ended (translations sharing a timestamp, overlapping
+ * subtitles) the last of them is returned.
+ * @param timeline Source timeline
+ * @param time_ms Playback time in milliseconds
+ * @return Line index, or -1 when no line is showing
+ */
+DMUSICPAK_API int64_t lyric_at(const LyricTimeline* timeline, uint64_t time_ms);
+
+/**
+ * @brief Find the line showing at a playback time, continuing from a cursor
+ * Same result as lyric_at(); while time_ms only moves forward the cursor
+ * walks past the lines started since the previous call instead of searching.
+ * @param timeline Source timeline
+ * @param cursor Cursor for this timeline, updated to time_ms
+ * @param time_ms Playback time in milliseconds
+ * @return Line index, or -1 when no line is showing
+ */
+DMUSICPAK_API int64_t lyric_cursor_advance(const LyricTimeline* timeline, LyricCursor* cursor, uint64_t time_ms);
+
+/**
+ * @brief Find the word of a line being sung at a playback time
+ * @param timeline Source timeline
+ * @param line Line index
+ * @param time_ms Playback time in milliseconds
+ * @return Word index for get_lyric_word(), or -1 when no word is timed then
+ */
+DMUSICPAK_API int64_t lyric_word_at(const LyricTimeline* timeline, uint32_t line, uint64_t time_ms);
+
 /**
  * @brief Free metadata structure
  * @param metadata Metadata to free
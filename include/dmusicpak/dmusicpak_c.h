@@ -12,6 +12,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdio.h>
 
 /* Export/Import macros for Windows DLL */
 #ifdef DMUSICPAK_STATIC
@@ -79,6 +80,68 @@ typedef enum {
     DMUSICPAK_AUDIO_FORMAT_DSD = 10
 } dmusicpak_audio_format_t;
 
+/* C-compatible chunk types */
+typedef enum {
+    DMUSICPAK_CHUNK_METADATA = 1,
+    DMUSICPAK_CHUNK_LYRICS = 2,
+    DMUSICPAK_CHUNK_AUDIO = 3,
+    DMUSICPAK_CHUNK_COVER = 4,
+    DMUSICPAK_CHUNK_THUMBNAILS = 13
+} dmusicpak_chunk_type_t;
+
+/* C-compatible chunk location structure */
+typedef struct {
+    dmusicpak_chunk_type_t type;
+    uint64_t offset;
+    uint64_t size;
+} dmusicpak_chunk_info_t;
+
+/* C-compatible chunk compression codecs */
+typedef enum {
+    DMUSICPAK_COMPRESSION_NONE = 0,
+    DMUSICPAK_COMPRESSION_ZSTD = 1
+} dmusicpak_compression_t;
+
+/* How the save functions write a package */
+typedef struct {
+    int checksums;         /* Non-zero to store a CRC32C of every chunk */
+    dmusicpak_compression_t compression; /* Codec for metadata, lyrics, WAV audio and BMP covers */
+    int compression_level; /* Codec level (negative is faster); 0 for the default */
+    uint32_t seek_interval_ms; /* Non-zero to store a seek table with an entry every this many ms */
+    uint32_t padding;      /* Bytes reserved after the metadata and lyrics chunks for in-place updates */
+    uint32_t alignment;    /* Non-zero to start audio and cover payloads on a multiple of this power of two */
+} dmusicpak_save_options_t;
+
+/* C-compatible audio seek position */
+typedef struct {
+    uint64_t time_ms;      /* Start time of the frame at 'offset' */
+    uint64_t offset;       /* Byte offset into the audio payload */
+} dmusicpak_seek_point_t;
+
+/* C-compatible lyric timeline line */
+typedef struct {
+    uint32_t start_ms;
+    uint32_t end_ms;       /* UINT32_MAX when shown to the end */
+    const char* text;      /* NUL-terminated, owned by the timeline */
+    size_t length;
+    uint32_t first_word;
+    uint32_t word_count;
+} dmusicpak_lyric_line_t;
+
+/* C-compatible lyric word timing */
+typedef struct {
+    uint32_t start_ms;
+    uint32_t end_ms;
+    const char* text;      /* Points into the line text; not NUL-terminated */
+    size_t length;
+} dmusicpak_lyric_word_t;
+
+/* Playback position for dmusicpak_lyric_cursor_advance(); zero-initialize before first use */
+typedef struct {
+    uint32_t started;
+    uint64_t time_ms;
+} dmusicpak_lyric_cursor_t;
+
 /* C-compatible music metadata structure */
 typedef struct {
     char* title;
@@ -117,9 +180,172 @@ typedef struct {
     uint32_t height;
 } dmusicpak_cover_t;
 
+/* C-compatible borrowed views (point into the package, do not free) */
+typedef struct {
+    const char* title;
+    const char* artist;
+    const char* album;
+    const char* genre;
+    const char* year;
+    const char* comment;
+    uint32_t duration_ms;
+    uint32_t bitrate;
+    uint32_t sample_rate;
+    uint16_t channels;
+} dmusicpak_metadata_view_t;
+
+typedef struct {
+    dmusicpak_lyric_format_t format;
+    const uint8_t* data;
+    size_t size;
+} dmusicpak_lyrics_view_t;
+
+typedef struct {
+    dmusicpak_audio_format_t format;
+    const char* source_filename;
+    const uint8_t* data;
+    size_t size;
+} dmusicpak_audio_view_t;
+
+typedef struct {
+    dmusicpak_cover_format_t format;
+    const uint8_t* data;
+    size_t size;
+    uint32_t width;
+    uint32_t height;
+} dmusicpak_cover_view_t;
+
+/* Bytes of metadata a dmusicpak_metadata_scan_t holds; longer metadata is truncated */
+#ifndef DMUSICPAK_SCAN_STORAGE_SIZE
+#define DMUSICPAK_SCAN_STORAGE_SIZE 4096
+#endif
+
+/* C-compatible scan_metadata() result; metadata strings point into 'storage' */
+typedef struct {
+    dmusicpak_metadata_view_t metadata;   /* All NULL/0 without a metadata chunk */
+    int has_metadata;
+    int truncated;                        /* Strings that did not fit are NULL */
+    int has_cover;
+    dmusicpak_cover_format_t cover_format; /* Format and dimensions are NONE/0 for compressed covers */
+    uint32_t cover_width;
+    uint32_t cover_height;
+    char storage[DMUSICPAK_SCAN_STORAGE_SIZE];
+} dmusicpak_metadata_scan_t;
+
 /* Opaque package handle */
 typedef void* dmusicpak_package_t;
 
+/* C-compatible memory hooks for dmusicpak_set_allocator(); all three are required */
+typedef struct {
+    void* (*allocate)(size_t size, void* context);
+    void* (*reallocate)(void* ptr, size_t size, void* context);
+    void (*release)(void* ptr, void* context);
+    void* context;
+} dmusicpak_allocator_t;
+
+/* C-compatible library counters, from dmusicpak_get_stats() */
+typedef struct {
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    uint64_t bytes_copied;
+    uint64_t allocations;
+    uint64_t allocated_bytes;
+    uint64_t packages_loaded;
+    uint64_t packages_saved;
+    uint64_t chunks_parsed;
+    uint64_t network_requests;
+    uint64_t network_connections;
+    uint64_t network_bytes;
+    uint64_t load_time_ns;
+    uint64_t save_time_ns;
+    uint64_t network_time_ns;
+} dmusicpak_stats_t;
+
+/* Operation reported to the trace callback */
+typedef enum {
+    DMUSICPAK_TRACE_LOAD = 1,
+    DMUSICPAK_TRACE_SAVE = 2,
+    DMUSICPAK_TRACE_CHUNK = 3,
+    DMUSICPAK_TRACE_NETWORK_REQUEST = 4
+} dmusicpak_trace_event_t;
+
+/* C-compatible finished operation; name is only valid during the callback */
+typedef struct {
+    dmusicpak_trace_event_t event;
+    const char* name;
+    uint8_t chunk_type;
+    uint64_t bytes;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    dmusicpak_error_t result;
+} dmusicpak_trace_record_t;
+
+/* Opaque HTTP session handle (network support only) */
+typedef void* dmusicpak_session_t;
+
+/* Opaque prefetcher handle (network support only) */
+typedef void* dmusicpak_prefetcher_t;
+
+/* Opaque lyric timeline handle */
+typedef void* dmusicpak_lyric_timeline_t;
+
+/* Opaque package cache handle */
+typedef void* dmusicpak_cache_t;
+
+/* Opaque album file handle */
+typedef void* dmusicpak_album_t;
+
+/* How much of a package a cache entry keeps in memory */
+typedef enum {
+    DMUSICPAK_CACHE_METADATA = 0,
+    DMUSICPAK_CACHE_COVER = 1,
+    DMUSICPAK_CACHE_AUDIO = 2
+} dmusicpak_cache_level_t;
+
+/* C-compatible cache budgets; zero fields take the defaults */
+typedef struct {
+    uint64_t metadata_bytes;
+    uint64_t cover_bytes;
+    uint64_t audio_bytes;
+    uint32_t shards;
+} dmusicpak_cache_options_t;
+
+/* C-compatible cache counters, from dmusicpak_cache_get_stats() */
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t entries;
+    uint64_t metadata_bytes;
+    uint64_t cover_bytes;
+    uint64_t audio_bytes;
+} dmusicpak_cache_stats_t;
+
+/* Opaque async context handle */
+typedef void* dmusicpak_async_context_t;
+
+/* Kind of operation an async completion reports */
+typedef enum {
+    DMUSICPAK_ASYNC_LOAD = 0,
+    DMUSICPAK_ASYNC_SAVE = 1,
+    DMUSICPAK_ASYNC_READ_AUDIO = 2,
+    DMUSICPAK_ASYNC_LOAD_URL = 3,
+    DMUSICPAK_ASYNC_READ_AUDIO_URL = 4
+} dmusicpak_async_operation_t;
+
+/* C-compatible finished operation; only valid during the callback */
+typedef struct {
+    dmusicpak_async_operation_t operation;
+    dmusicpak_error_t result;
+    dmusicpak_package_t package;
+    uint8_t* buffer;
+    int64_t bytes;
+    void* userdata;
+} dmusicpak_async_completion_t;
+
+/* Called by dmusicpak_async_poll() on the polling thread */
+typedef void (*dmusicpak_async_callback_t)(const dmusicpak_async_completion_t* completion);
+
 /* Streaming callback function type */
 typedef size_t (*dmusicpak_stream_callback_t)(
     void* buffer,
@@ -128,6 +354,71 @@ typedef size_t (*dmusicpak_stream_callback_t)(
     void* userdata
 );
 
+/* C-compatible audio span, laid out like struct iovec */
+typedef struct {
+    const void* data;
+    size_t size;
+} dmusicpak_audio_span_t;
+
+/* Vectored streaming callback; returns the bytes consumed across all spans */
+typedef size_t (*dmusicpak_stream_vec_callback_t)(
+    const dmusicpak_audio_span_t* spans,
+    size_t count,
+    void* userdata
+);
+
+/* C-compatible streaming options; zero-initialize for defaults */
+typedef struct {
+    uint64_t offset;       /* First payload byte to deliver */
+    uint64_t length;       /* Bytes to deliver; 0 for the rest */
+    size_t chunk_size;     /* Bytes per callback or span; 0 for the whole range in memory, 256 KB from files */
+    uint32_t max_spans;    /* Spans per vectored call; 0 for 16, at most 64 */
+    uint8_t* buffer;       /* Buffer for file reads; NULL to allocate one per call */
+    size_t buffer_size;
+} dmusicpak_stream_options_t;
+
+/* Callbacks for incremental loading (every member may be NULL) */
+typedef struct {
+    void (*on_metadata)(const dmusicpak_metadata_view_t* metadata, void* userdata);
+    void (*on_lyrics)(const dmusicpak_lyrics_view_t* lyrics, void* userdata);
+    void (*on_cover)(const dmusicpak_cover_view_t* cover, void* userdata);
+    /* Audio chunk header arrived; data is NULL and size is the full payload size */
+    void (*on_audio_start)(const dmusicpak_audio_view_t* audio, void* userdata);
+    /* Audio bytes as they arrive; returning less than size*nmemb aborts the load */
+    dmusicpak_stream_callback_t on_audio;
+    /* Non-zero to also keep audio in the returned package (always kept if on_audio is NULL) */
+    int retain_audio;
+    void* userdata;
+} dmusicpak_stream_listener_t;
+
+/* One package to write with dmusicpak_pack_batch(); NULL members omit that chunk */
+typedef struct {
+    const char* filename;                 /* Output package file */
+    const dmusicpak_metadata_t* metadata;
+    const dmusicpak_lyrics_t* lyrics;
+    const dmusicpak_audio_t* audio;
+    const dmusicpak_cover_t* cover;
+    /* If non-NULL, the audio payload is read from this file; format and
+       source_filename still come from 'audio' when it is set */
+    const char* audio_file;
+    const dmusicpak_save_options_t* options; /* NULL for defaults */
+} dmusicpak_pack_job_t;
+
+/* Called once per finished job, from the thread that ran it */
+typedef void (*dmusicpak_batch_callback_t)(size_t index, dmusicpak_error_t result, void* userdata);
+
+/* Called once per file by dmusicpak_scan_directory(), from the thread that scanned it;
+   scan is only valid during the call */
+typedef void (*dmusicpak_scan_callback_t)(
+    const char* filename,
+    const dmusicpak_metadata_scan_t* scan,
+    dmusicpak_error_t result,
+    void* userdata
+);
+
+/* Called on the thread that finished the operation */
+typedef void (*dmusicpak_trace_callback_t)(const dmusicpak_trace_record_t* record, void* userdata);
+
 /**
  * @brief Get library version string (C API)
  * @return Version string (e.g., "1.0.0")
@@ -147,6 +438,51 @@ DMUSICPAK_API const char* dmusicpak_error_string(dmusicpak_error_t error);
  */
 DMUSICPAK_API dmusicpak_package_t dmusicpak_create(void);
 
+/**
+ * @brief Create a new empty package backed by an arena (C API)
+ * @param block_size Arena block size in bytes (0 for the 64 KB default)
+ * @return Package handle or NULL on error
+ */
+DMUSICPAK_API dmusicpak_package_t dmusicpak_create_with_arena(size_t block_size);
+
+/**
+ * @brief Set the arena block size for packages created or loaded from now on (C API)
+ * @param block_size Arena block size in bytes (0 to disable arenas)
+ */
+DMUSICPAK_API void dmusicpak_set_package_arena(size_t block_size);
+
+/**
+ * @brief Install allocator hooks for all library allocations (C API)
+ * @param allocator Hooks to install (NULL restores malloc/realloc/free)
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_set_allocator(const dmusicpak_allocator_t* allocator);
+
+/**
+ * @brief Turn the dmusicpak_get_stats() counters on or off (C API)
+ * @param enabled Non-zero to count
+ */
+DMUSICPAK_API void dmusicpak_set_stats_enabled(int enabled);
+
+/**
+ * @brief Read the library counters, summed over all threads (C API)
+ * @param stats Output counters
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_get_stats(dmusicpak_stats_t* stats);
+
+/**
+ * @brief Restart the dmusicpak_get_stats() counters from zero (C API)
+ */
+DMUSICPAK_API void dmusicpak_reset_stats(void);
+
+/**
+ * @brief Report loads, chunk parses, saves and HTTP transfers to a callback (C API)
+ * @param callback Trace callback (NULL to stop tracing)
+ * @param userdata User data passed to callback
+ */
+DMUSICPAK_API void dmusicpak_set_trace_callback(dmusicpak_trace_callback_t callback, void* userdata);
+
 /**
  * @brief Load package from file (C API)
  * @param filename Path to .dmusicpak file
@@ -162,7 +498,76 @@ DMUSICPAK_API dmusicpak_package_t dmusicpak_load(const char* filename);
  */
 DMUSICPAK_API dmusicpak_package_t dmusicpak_load_memory(const uint8_t* data, size_t size);
 
+/**
+ * @brief Load package from memory, reporting why a load failed (C API)
+ * @param data Pointer to package data
+ * @param size Size of data
+ * @param error Output error code (can be NULL)
+ * @return Package handle or NULL on error
+ */
+DMUSICPAK_API dmusicpak_package_t dmusicpak_load_memory_ex(const uint8_t* data, size_t size, dmusicpak_error_t* error);
+
+/**
+ * @brief Load package by memory-mapping the file (C API)
+ * Audio, lyrics and cover data point into the mapping until dmusicpak_free()
+ * @param filename Path to .dmusicpak file
+ * @return Package handle or NULL on error
+ */
+DMUSICPAK_API dmusicpak_package_t dmusicpak_load_mmap(const char* filename);
+
+/**
+ * @brief Open package reading only the file header and chunk index (C API)
+ * Chunks are fetched lazily by the getters on first use
+ * @param filename Path to .dmusicpak file
+ * @return Package handle (chunks not loaded) or NULL on error
+ */
+DMUSICPAK_API dmusicpak_package_t dmusicpak_load_index(const char* filename);
+
+/**
+ * @brief Read one chunk of a package opened with dmusicpak_load_index() (C API)
+ * @param package Package handle
+ * @param type Chunk to read
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_load_chunk(dmusicpak_package_t package, dmusicpak_chunk_type_t type);
+
+/**
+ * @brief Get file location of a chunk (C API)
+ * @param package Package handle
+ * @param type Chunk to look up
+ * @param info Output chunk location
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_get_chunk_info(dmusicpak_package_t package, dmusicpak_chunk_type_t type, dmusicpak_chunk_info_t* info);
+
+/**
+ * @brief Get file location of a chunk's payload, without its fields (C API)
+ * @param package Package handle
+ * @param type Lyrics, audio, cover or thumbnails chunk
+ * @param info Output payload location
+ * @return Error code (NOT_SUPPORTED for a missing or compressed chunk)
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_get_payload_info(dmusicpak_package_t package, dmusicpak_chunk_type_t type, dmusicpak_chunk_info_t* info);
+
 #ifdef DMUSICPAK_ENABLE_NETWORK
+/**
+ * @brief Initialize the network layer (C API)
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_network_init(void);
+
+/**
+ * @brief Release the network layer (C API)
+ */
+DMUSICPAK_API void dmusicpak_network_cleanup(void);
+
+/**
+ * @brief Keep dmusicpak_load_url() downloads in a directory and revalidate them (C API)
+ * @param directory Existing directory, or NULL to stop caching
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_set_url_cache_dir(const char* directory);
+
 /**
  * @brief Load package from URL (HTTP/HTTPS) (C API)
  * @param url URL to load from (must be http:// or https://)
@@ -180,6 +585,21 @@ DMUSICPAK_API dmusicpak_package_t dmusicpak_load_url(const char* url, uint32_t t
  */
 DMUSICPAK_API dmusicpak_package_t dmusicpak_load_url_stream(const char* url, uint32_t timeout_ms, size_t chunk_size);
 
+/**
+ * @brief Load package from URL, parsing chunks as the bytes arrive (C API)
+ * @param url URL to load from (must be http:// or https://)
+ * @param timeout_ms Timeout in milliseconds (0 for default: 30000ms)
+ * @param chunk_size Audio delivery and receive buffer size (0 for default: 64KB)
+ * @param listener Callbacks (can be NULL)
+ * @return Package handle or NULL on error
+ */
+DMUSICPAK_API dmusicpak_package_t dmusicpak_load_url_stream_ex(
+    const char* url,
+    uint32_t timeout_ms,
+    size_t chunk_size,
+    const dmusicpak_stream_listener_t* listener
+);
+
 /**
  * @brief Get audio chunk from URL using HTTP Range request (C API)
  * @param url URL to load from
@@ -196,8 +616,119 @@ DMUSICPAK_API int64_t dmusicpak_get_audio_chunk_url(
     uint8_t* buffer,
     uint32_t timeout_ms
 );
+
+/**
+ * @brief Create an HTTP session for repeated range requests (C API)
+ * @param timeout_ms Per-request timeout in milliseconds (0 for default: 30000ms)
+ * @return Session handle or NULL on error
+ */
+DMUSICPAK_API dmusicpak_session_t dmusicpak_create_session(uint32_t timeout_ms);
+
+/**
+ * @brief Free an HTTP session (C API)
+ * @param session Session handle (can be NULL)
+ */
+DMUSICPAK_API void dmusicpak_free_session(dmusicpak_session_t session);
+
+/**
+ * @brief Get audio chunk from URL using HTTP Range request over a session (C API)
+ * @param session Session handle
+ * @param url URL to load from
+ * @param offset Byte offset to start reading from
+ * @param size Number of bytes to read
+ * @param buffer Output buffer (must be at least 'size' bytes)
+ * @return Number of bytes read, or -1 on error
+ */
+DMUSICPAK_API int64_t dmusicpak_get_audio_chunk_session(
+    dmusicpak_session_t session,
+    const char* url,
+    size_t offset,
+    size_t size,
+    uint8_t* buffer
+);
+
+/**
+ * @brief Open a package over HTTP from its header and index only (C API)
+ * Chunks are fetched on demand; dmusicpak_get_audio_chunk() takes
+ * audio-relative offsets. The server must support Range requests.
+ * @param url URL to load from (must be http:// or https://)
+ * @param session Session that must outlive the package (NULL for the process-wide session)
+ * @return Package handle or NULL on error
+ */
+DMUSICPAK_API dmusicpak_package_t dmusicpak_load_url_index(const char* url, dmusicpak_session_t session);
+
+/**
+ * @brief Start prefetching the audio of a remote package (C API)
+ * @param package Package from dmusicpak_load_url_index(); must outlive the prefetcher
+ * @param window_size Bytes per Range request (0 for default: 256KB)
+ * @param depth Number of windows kept ahead of the cursor (0 for default: 4)
+ * @return Prefetcher handle or NULL on error
+ */
+DMUSICPAK_API dmusicpak_prefetcher_t dmusicpak_create_prefetcher(dmusicpak_package_t package, size_t window_size, uint32_t depth);
+
+/**
+ * @brief Stop prefetching and release buffers (C API)
+ * @param prefetcher Prefetcher handle (can be NULL)
+ */
+DMUSICPAK_API void dmusicpak_free_prefetcher(dmusicpak_prefetcher_t prefetcher);
+
+/**
+ * @brief Read audio at the cursor and advance it (C API)
+ * @param prefetcher Prefetcher handle
+ * @param buffer Output buffer (must be at least 'size' bytes)
+ * @param size Number of bytes to read
+ * @return Number of bytes read (0 at end of audio), or -1 on error
+ */
+DMUSICPAK_API int64_t dmusicpak_prefetch_read(dmusicpak_prefetcher_t prefetcher, uint8_t* buffer, size_t size);
+
+/**
+ * @brief Get number of bytes readable at the cursor without blocking (C API)
+ * @param prefetcher Prefetcher handle
+ * @return Buffered contiguous bytes
+ */
+DMUSICPAK_API size_t dmusicpak_prefetch_available(dmusicpak_prefetcher_t prefetcher);
+
+/**
+ * @brief Move the read cursor (C API)
+ * @param prefetcher Prefetcher handle
+ * @param offset New audio-relative cursor position
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_prefetch_seek(dmusicpak_prefetcher_t prefetcher, uint64_t offset);
 #endif /* DMUSICPAK_ENABLE_NETWORK */
 
+/**
+ * @brief Set how the package is written by the save functions (C API)
+ * @param package Package handle
+ * @param options Options to use from now on
+ * @return Error code (DMUSICPAK_ERROR_NOT_SUPPORTED for a codec the library was built without)
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_set_save_options(dmusicpak_package_t package, const dmusicpak_save_options_t* options);
+
+/**
+ * @brief Get the options the save functions will use (C API)
+ * @param package Package handle
+ * @param options Output options
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_get_save_options(dmusicpak_package_t package, dmusicpak_save_options_t* options);
+
+/**
+ * @brief Check a package file against its stored checksums without decoding it (C API)
+ * @param filename Package file
+ * @return DMUSICPAK_OK, DMUSICPAK_ERROR_CORRUPTED on a mismatch or missing chunk,
+ *         DMUSICPAK_ERROR_NOT_SUPPORTED if the file has no checksums
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_verify(const char* filename);
+
+/**
+ * @brief Check a package in memory against its stored checksums (C API)
+ * @param data Package bytes
+ * @param size Size of data
+ * @return Same as dmusicpak_verify()
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_verify_memory(const uint8_t* data, size_t size);
+
 /**
  * @brief Save package to file (C API)
  * @param package Package handle
@@ -206,6 +737,14 @@ DMUSICPAK_API int64_t dmusicpak_get_audio_chunk_url(
  */
 DMUSICPAK_API dmusicpak_error_t dmusicpak_save(dmusicpak_package_t package, const char* filename);
 
+/**
+ * @brief Save package directly to an open stream without an in-memory image (C API)
+ * @param package Package handle
+ * @param file Output stream opened in binary mode
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_save_stream(dmusicpak_package_t package, FILE* file);
+
 /**
  * @brief Save package to memory buffer (C API)
  * @param package Package handle
@@ -215,6 +754,94 @@ DMUSICPAK_API dmusicpak_error_t dmusicpak_save(dmusicpak_package_t package, cons
  */
 DMUSICPAK_API dmusicpak_error_t dmusicpak_save_memory(dmusicpak_package_t package, uint8_t** buffer, size_t* size);
 
+/**
+ * @brief Replace the metadata of a package file in place (C API)
+ * @param filename Package file with a TOC
+ * @param metadata New metadata
+ * @return Error code (NOT_SUPPORTED if the file has no TOC or no metadata chunk)
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_update_metadata(const char* filename, const dmusicpak_metadata_t* metadata);
+
+/**
+ * @brief Replace the lyrics of a package file in place (C API)
+ * @param filename Package file with a TOC
+ * @param lyrics New lyrics
+ * @return Error code (NOT_SUPPORTED if the file has no TOC or no lyrics chunk)
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_update_lyrics(const char* filename, const dmusicpak_lyrics_t* lyrics);
+
+/**
+ * @brief Write several packages in parallel (C API)
+ * @param jobs Array of jobs; buffers must stay valid until the call returns
+ * @param count Number of jobs
+ * @param threads Maximum number of threads, including the caller's (0 for one per core)
+ * @param callback Per-job result callback (can be NULL)
+ * @param userdata User data passed to callback
+ * @return DMUSICPAK_OK if every job succeeded, otherwise the error of the first failed job
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_pack_batch(
+    const dmusicpak_pack_job_t* jobs,
+    size_t count,
+    unsigned threads,
+    dmusicpak_batch_callback_t callback,
+    void* userdata
+);
+
+/**
+ * @brief Load several packages in parallel (C API)
+ * @param filenames Array of input filenames
+ * @param count Number of files
+ * @param threads Maximum number of threads, including the caller's (0 for one per core)
+ * @param packages Output array of count handles; NULL for files that failed to load
+ * @param callback Per-file result callback (can be NULL)
+ * @param userdata User data passed to callback
+ * @return DMUSICPAK_OK if every file loaded, otherwise the error of the first failed file
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_load_batch(
+    const char* const* filenames,
+    size_t count,
+    unsigned threads,
+    dmusicpak_package_t* packages,
+    dmusicpak_batch_callback_t callback,
+    void* userdata
+);
+
+/**
+ * @brief Read the metadata and cover facts of a package file without loading it (C API)
+ * @param filename Package file
+ * @param scan Output; metadata strings point into scan->storage
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_scan_metadata(const char* filename, dmusicpak_metadata_scan_t* scan);
+
+/**
+ * @brief Scan the metadata of every package in a directory in parallel (C API)
+ * @param directory Directory to scan
+ * @param extension Only scan files ending with this, ignoring ASCII case (NULL for all)
+ * @param recursive Non-zero to scan subdirectories too
+ * @param threads Maximum number of threads, including the caller's (0 for one per core)
+ * @param callback Per-file callback, called concurrently from several threads
+ * @param userdata User data passed to callback
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_scan_directory(
+    const char* directory,
+    const char* extension,
+    int recursive,
+    unsigned threads,
+    dmusicpak_scan_callback_t callback,
+    void* userdata
+);
+
+/**
+ * @brief Allocate a buffer the library can take ownership of (C API)
+ * Use for data handed to dmusicpak_set_*_owned(), so the buffer comes from
+ * the same heap (or dmusicpak_set_allocator() hooks) the library frees it with
+ * @param size Number of bytes
+ * @return Buffer or NULL on error
+ */
+DMUSICPAK_API uint8_t* dmusicpak_alloc_memory(size_t size);
+
 /**
  * @brief Free memory buffer allocated by dmusicpak_save_memory (C API)
  * @param buffer Buffer to free (must be allocated by dmusicpak_save_memory)
@@ -227,6 +854,271 @@ DMUSICPAK_API void dmusicpak_free_memory(uint8_t* buffer);
  */
 DMUSICPAK_API void dmusicpak_free(dmusicpak_package_t package);
 
+/**
+ * @brief Make a package immutable so many threads can read it without locks (C API)
+ * @param package Package handle
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_share(dmusicpak_package_t package);
+
+/**
+ * @brief Take another reference to a shared package (C API)
+ * @param package Package handle passed to dmusicpak_share()
+ * @return Package handle, or NULL if it is not shared
+ */
+DMUSICPAK_API dmusicpak_package_t dmusicpak_retain(dmusicpak_package_t package);
+
+/**
+ * @brief Create a package cache (C API)
+ * @param options Budgets and shard count (NULL for the defaults)
+ * @return Cache handle, or NULL on failure
+ */
+DMUSICPAK_API dmusicpak_cache_t dmusicpak_create_cache(const dmusicpak_cache_options_t* options);
+
+/**
+ * @brief Free a cache (C API)
+ * @param cache Cache handle
+ */
+DMUSICPAK_API void dmusicpak_free_cache(dmusicpak_cache_t cache);
+
+/**
+ * @brief Load a package file through a cache (C API)
+ * @param cache Cache handle
+ * @param filename Package file
+ * @param level How much of the package to keep in memory
+ * @return Shared package handle, released with dmusicpak_free(); NULL on error
+ */
+DMUSICPAK_API dmusicpak_package_t dmusicpak_cache_load(
+    dmusicpak_cache_t cache,
+    const char* filename,
+    dmusicpak_cache_level_t level
+);
+
+#ifdef DMUSICPAK_ENABLE_NETWORK
+/**
+ * @brief Load a remote package through a cache (C API)
+ * @param cache Cache handle
+ * @param url Package URL
+ * @param level How much of the package to keep in memory
+ * @param session Session handle (NULL for the process-wide one)
+ * @return Shared package handle, released with dmusicpak_free(); NULL on error
+ */
+DMUSICPAK_API dmusicpak_package_t dmusicpak_cache_load_url(
+    dmusicpak_cache_t cache,
+    const char* url,
+    dmusicpak_cache_level_t level,
+    dmusicpak_session_t session
+);
+#endif
+
+/**
+ * @brief Drop every entry of a cache (C API)
+ * @param cache Cache handle
+ */
+DMUSICPAK_API void dmusicpak_cache_clear(dmusicpak_cache_t cache);
+
+/**
+ * @brief Get cache counters (C API)
+ * @param cache Cache handle
+ * @param stats Output counters
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_cache_get_stats(dmusicpak_cache_t cache, dmusicpak_cache_stats_t* stats);
+
+/**
+ * @brief Save packages as the tracks of one album file (C API)
+ * @param filename Output file path
+ * @param album Album-level metadata and cover (can be NULL)
+ * @param tracks Track package handles, in track order
+ * @param count Number of tracks
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_save_album(
+    const char* filename,
+    dmusicpak_package_t album,
+    const dmusicpak_package_t* tracks,
+    uint32_t count
+);
+
+/**
+ * @brief Open an album file (C API)
+ * @param filename Album file path
+ * @return Album handle or NULL on error
+ */
+DMUSICPAK_API dmusicpak_album_t dmusicpak_open_album(const char* filename);
+
+/**
+ * @brief Open an album file through a read-only memory mapping (C API)
+ * @param filename Album file path
+ * @return Album handle or NULL on error
+ */
+DMUSICPAK_API dmusicpak_album_t dmusicpak_open_album_mmap(const char* filename);
+
+/**
+ * @brief Close an album handle; loaded tracks stay valid (C API)
+ * @param album Album handle
+ */
+DMUSICPAK_API void dmusicpak_close_album(dmusicpak_album_t album);
+
+/**
+ * @brief Get the number of tracks in an album (C API)
+ * @param album Album handle
+ * @return Track count
+ */
+DMUSICPAK_API uint32_t dmusicpak_album_track_count(dmusicpak_album_t album);
+
+/**
+ * @brief Get the album-level metadata and cover (C API)
+ * @param album Album handle
+ * @return Package handle (release with dmusicpak_free) or NULL
+ */
+DMUSICPAK_API dmusicpak_package_t dmusicpak_album_info(dmusicpak_album_t album);
+
+/**
+ * @brief Load one track of an album (C API)
+ * @param album Album handle
+ * @param index Track index
+ * @return Package handle or NULL on error
+ */
+DMUSICPAK_API dmusicpak_package_t dmusicpak_load_album_track(dmusicpak_album_t album, uint32_t index);
+
+/**
+ * @brief Create a context for asynchronous loads, saves and reads (C API)
+ * @param threads Worker threads for file operations and URL loads (0 for 4)
+ * @return Context handle or NULL on failure
+ */
+DMUSICPAK_API dmusicpak_async_context_t dmusicpak_create_async_context(uint32_t threads);
+
+/**
+ * @brief Free an async context after its operations finish (C API)
+ * @param context Context handle
+ */
+DMUSICPAK_API void dmusicpak_free_async_context(dmusicpak_async_context_t context);
+
+/**
+ * @brief Get a descriptor that is readable while completions are waiting (C API)
+ * @param context Context handle
+ * @return File descriptor, or -1 where there is none (Windows: see dmusicpak_async_event())
+ */
+DMUSICPAK_API int dmusicpak_async_fd(dmusicpak_async_context_t context);
+
+/**
+ * @brief Get an event HANDLE that is set while completions are waiting (C API, Windows)
+ * @param context Context handle
+ * @return Manual-reset event owned by the context, or NULL elsewhere
+ */
+DMUSICPAK_API void* dmusicpak_async_event(dmusicpak_async_context_t context);
+
+/**
+ * @brief Run the callbacks of finished operations on the calling thread (C API)
+ * @param context Context handle
+ * @param timeout_ms How long to wait when nothing has finished yet (0 to return at once)
+ * @return Number of callbacks run
+ */
+DMUSICPAK_API uint32_t dmusicpak_async_poll(dmusicpak_async_context_t context, uint32_t timeout_ms);
+
+/**
+ * @brief Get the number of submitted operations whose callbacks have not run (C API)
+ * @param context Context handle
+ * @return Operation count
+ */
+DMUSICPAK_API uint32_t dmusicpak_async_pending(dmusicpak_async_context_t context);
+
+/**
+ * @brief Load a package file in the background (C API)
+ * @param context Context handle
+ * @param filename Input file path
+ * @param callback Completion callback
+ * @param userdata User data passed in the completion
+ * @return Error code (the callback only runs if this is OK)
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_load_async(
+    dmusicpak_async_context_t context,
+    const char* filename,
+    dmusicpak_async_callback_t callback,
+    void* userdata
+);
+
+/**
+ * @brief Save a package in the background (C API)
+ * @param context Context handle
+ * @param package Package handle, unchanged until the callback runs
+ * @param filename Output file path
+ * @param callback Completion callback
+ * @param userdata User data passed in the completion
+ * @return Error code (the callback only runs if this is OK)
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_save_async(
+    dmusicpak_async_context_t context,
+    dmusicpak_package_t package,
+    const char* filename,
+    dmusicpak_async_callback_t callback,
+    void* userdata
+);
+
+/**
+ * @brief Read audio in the background (C API)
+ * @param context Context handle
+ * @param package Package handle
+ * @param offset Offset in bytes
+ * @param size Size to read
+ * @param buffer Output buffer, valid until the callback runs
+ * @param callback Completion callback
+ * @param userdata User data passed in the completion
+ * @return Error code (the callback only runs if this is OK)
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_read_audio_chunk_async(
+    dmusicpak_async_context_t context,
+    dmusicpak_package_t package,
+    size_t offset,
+    size_t size,
+    uint8_t* buffer,
+    dmusicpak_async_callback_t callback,
+    void* userdata
+);
+
+#ifdef DMUSICPAK_ENABLE_NETWORK
+/**
+ * @brief Load a remote package in the background (C API)
+ * @param context Context handle
+ * @param url Package URL
+ * @param timeout_ms Timeout in milliseconds (0 for default)
+ * @param callback Completion callback
+ * @param userdata User data passed in the completion
+ * @return Error code (the callback only runs if this is OK)
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_load_url_async(
+    dmusicpak_async_context_t context,
+    const char* url,
+    uint32_t timeout_ms,
+    dmusicpak_async_callback_t callback,
+    void* userdata
+);
+
+/**
+ * @brief Read a byte range of a URL in the background (C API)
+ * @param context Context handle
+ * @param session Session handle (NULL for the process-wide one)
+ * @param url Resource URL
+ * @param offset Offset in bytes
+ * @param size Size to read
+ * @param buffer Output buffer, valid until the callback runs
+ * @param callback Completion callback
+ * @param userdata User data passed in the completion
+ * @return Error code (the callback only runs if this is OK)
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_get_audio_chunk_url_async(
+    dmusicpak_async_context_t context,
+    dmusicpak_session_t session,
+    const char* url,
+    size_t offset,
+    size_t size,
+    uint8_t* buffer,
+    dmusicpak_async_callback_t callback,
+    void* userdata
+);
+#endif
+
 /**
  * @brief Set metadata for package (C API)
  * @param package Package handle
@@ -291,6 +1183,95 @@ DMUSICPAK_API dmusicpak_error_t dmusicpak_set_cover(dmusicpak_package_t package,
  */
 DMUSICPAK_API dmusicpak_error_t dmusicpak_get_cover(dmusicpak_package_t package, dmusicpak_cover_t* cover);
 
+/**
+ * @brief Add a pre-scaled rendition of the cover (C API)
+ * @param package Package handle
+ * @param thumbnail Thumbnail image with its width and height (will be copied)
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_add_cover_thumbnail(dmusicpak_package_t package, const dmusicpak_cover_t* thumbnail);
+
+/**
+ * @brief Remove every cover thumbnail from package (C API)
+ * @param package Package handle
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_clear_cover_thumbnails(dmusicpak_package_t package);
+
+/**
+ * @brief Get the cover image best suited to a display size (C API)
+ * @param package Package handle
+ * @param width Display width in pixels (0 for any)
+ * @param height Display height in pixels (0 for any)
+ * @param cover Output cover structure (data must be freed by caller)
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_get_cover_best_fit(
+    dmusicpak_package_t package,
+    uint32_t width,
+    uint32_t height,
+    dmusicpak_cover_t* cover
+);
+
+/**
+ * @brief Set lyrics taking ownership of the data buffer (C API)
+ * @param package Package handle
+ * @param lyrics Lyrics whose data came from dmusicpak_alloc_memory(); on
+ *               success the package owns it and lyrics->data is set to NULL
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_set_lyrics_owned(dmusicpak_package_t package, dmusicpak_lyrics_t* lyrics);
+
+/**
+ * @brief Set audio data taking ownership of the data buffer (C API)
+ * @param package Package handle
+ * @param audio Audio whose data came from dmusicpak_alloc_memory(); on
+ *              success the package owns it and audio->data is set to NULL
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_set_audio_owned(dmusicpak_package_t package, dmusicpak_audio_t* audio);
+
+/**
+ * @brief Set cover image taking ownership of the data buffer (C API)
+ * @param package Package handle
+ * @param cover Cover whose data came from dmusicpak_alloc_memory(); on
+ *              success the package owns it and cover->data is set to NULL
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_set_cover_owned(dmusicpak_package_t package, dmusicpak_cover_t* cover);
+
+/**
+ * @brief Borrow metadata from package without copying (C API)
+ * @param package Package handle
+ * @param view Output view (valid until the chunk is replaced or the package is freed)
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_peek_metadata(dmusicpak_package_t package, dmusicpak_metadata_view_t* view);
+
+/**
+ * @brief Borrow lyrics from package without copying (C API)
+ * @param package Package handle
+ * @param view Output view (valid until the chunk is replaced or the package is freed)
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_peek_lyrics(dmusicpak_package_t package, dmusicpak_lyrics_view_t* view);
+
+/**
+ * @brief Borrow audio data from package without copying (C API)
+ * @param package Package handle
+ * @param view Output view (valid until the chunk is replaced or the package is freed)
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_peek_audio(dmusicpak_package_t package, dmusicpak_audio_view_t* view);
+
+/**
+ * @brief Borrow cover image from package without copying (C API)
+ * @param package Package handle
+ * @param view Output view (valid until the chunk is replaced or the package is freed)
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_peek_cover(dmusicpak_package_t package, dmusicpak_cover_view_t* view);
+
 /**
  * @brief Stream audio data with callback (C API)
  * @param package Package handle
@@ -304,6 +1285,52 @@ DMUSICPAK_API dmusicpak_error_t dmusicpak_stream_audio(
     void* userdata
 );
 
+/**
+ * @brief Stream a range of audio data with a caller-chosen chunk size (C API)
+ * @param package Package handle
+ * @param options Range and chunking (NULL for the whole payload in as few calls as possible)
+ * @param callback Callback function for streaming data
+ * @param userdata User data passed to callback
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_stream_audio_ex(
+    dmusicpak_package_t package,
+    const dmusicpak_stream_options_t* options,
+    dmusicpak_stream_callback_t callback,
+    void* userdata
+);
+
+/**
+ * @brief Stream a range of audio data as batches of spans (C API)
+ * @param package Package handle
+ * @param options Range and chunking (NULL for defaults)
+ * @param callback Vectored callback
+ * @param userdata User data passed to callback
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_stream_audio_vec(
+    dmusicpak_package_t package,
+    const dmusicpak_stream_options_t* options,
+    dmusicpak_stream_vec_callback_t callback,
+    void* userdata
+);
+
+/**
+ * @brief Write a range of audio data to a file descriptor or socket (C API)
+ * Uses sendfile() for uncompressed audio of local load_index() packages on Linux.
+ * @param package Package handle
+ * @param fd Destination descriptor (blocking)
+ * @param options Range (NULL for the whole payload)
+ * @param sent Output: bytes written, also on error (may be NULL)
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_send_audio(
+    dmusicpak_package_t package,
+    int fd,
+    const dmusicpak_stream_options_t* options,
+    uint64_t* sent
+);
+
 /**
  * @brief Get audio data chunk for streaming (C API)
  * @param package Package handle
@@ -319,6 +1346,116 @@ DMUSICPAK_API int64_t dmusicpak_get_audio_chunk(
     uint8_t* buffer
 );
 
+/**
+ * @brief Find where to start decoding audio for a playback time (C API)
+ * @param package Package handle
+ * @param time_ms Playback time in milliseconds
+ * @param point Output: last seek point at or before time_ms
+ * @return Error code (DMUSICPAK_ERROR_NOT_SUPPORTED if no seek table is available)
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_seek_audio_ms(
+    dmusicpak_package_t package,
+    uint64_t time_ms,
+    dmusicpak_seek_point_t* point
+);
+
+/**
+ * @brief Parse timed lyrics (LRC, SRT, ASS) into a timeline (C API)
+ * @param data Lyrics text (UTF-8)
+ * @param size Size of data in bytes
+ * @param format Lyrics format
+ * @return Timeline (free with dmusicpak_free_lyric_timeline()) or NULL on error
+ */
+DMUSICPAK_API dmusicpak_lyric_timeline_t dmusicpak_parse_lyrics(
+    const uint8_t* data,
+    size_t size,
+    dmusicpak_lyric_format_t format
+);
+
+/**
+ * @brief Free a timeline returned by dmusicpak_parse_lyrics() (C API)
+ * @param timeline Timeline to free (may be NULL)
+ */
+DMUSICPAK_API void dmusicpak_free_lyric_timeline(dmusicpak_lyric_timeline_t timeline);
+
+/**
+ * @brief Get the package's lyrics as a timeline, parsed on first use (C API)
+ * @param package Source package
+ * @param timeline Output: timeline owned by the package, valid until its lyrics change
+ * @return Error code (DMUSICPAK_ERROR_NOT_SUPPORTED if the package has no lyrics)
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_get_lyric_timeline(
+    dmusicpak_package_t package,
+    dmusicpak_lyric_timeline_t* timeline
+);
+
+/**
+ * @brief Get the number of lines in a timeline (C API)
+ * @param timeline Source timeline
+ * @return Line count
+ */
+DMUSICPAK_API uint32_t dmusicpak_lyric_line_count(dmusicpak_lyric_timeline_t timeline);
+
+/**
+ * @brief Get one line of a timeline (C API)
+ * @param timeline Source timeline
+ * @param index Line index
+ * @param line Output line
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_get_lyric_line(
+    dmusicpak_lyric_timeline_t timeline,
+    uint32_t index,
+    dmusicpak_lyric_line_t* line
+);
+
+/**
+ * @brief Get one word timing of a timeline (C API)
+ * @param timeline Source timeline
+ * @param index Word index
+ * @param word Output word
+ * @return Error code
+ */
+DMUSICPAK_API dmusicpak_error_t dmusicpak_get_lyric_word(
+    dmusicpak_lyric_timeline_t timeline,
+    uint32_t index,
+    dmusicpak_lyric_word_t* word
+);
+
+/**
+ * @brief Find the line showing at a playback time (C API)
+ * @param timeline Source timeline
+ * @param time_ms Playback time in milliseconds
+ * @return Line index, or -1 when no line is showing
+ */
+DMUSICPAK_API int64_t dmusicpak_lyric_at(dmusicpak_lyric_timeline_t timeline, uint64_t time_ms);
+
+/**
+ * @brief Find the line showing at a playback time, continuing from a cursor (C API)
+ * @param timeline Source timeline
+ * @param cursor Cursor for this timeline, updated to time_ms
+ * @param time_ms Playback time in milliseconds
+ * @return Line index, or -1 when no line is showing
+ */
+DMUSICPAK_API int64_t dmusicpak_lyric_cursor_advance(
+    dmusicpak_lyric_timeline_t timeline,
+    dmusicpak_lyric_cursor_t* cursor,
+    uint64_t time_ms
+);
+
+/**
+ * @brief Find the word of a line being sung at a playback time (C API)
+ * @param timeline Source timeline
+ * @param line Line index
+ * @param time_ms Playback time in milliseconds
+ * @return Word index, or -1 when no word is timed then
+ */
+DMUSICPAK_API int64_t dmusicpak_lyric_word_at(
+    dmusicpak_lyric_timeline_t timeline,
+    uint32_t line,
+    uint64_t time_ms
+);
+
 /**
  * @brief Free metadata structure (C API)
  * @param metadata Metadata to free
@@ -0,0 +1,508 @@
+/**
+ * @file album.cpp
+ * @brief Multi-track album files for DMusicPak library
+ *
+ * An album file is a package whose top-level metadata and cover describe
+ * the album, followed by one track chunk per track. Each track chunk holds
+ * a complete package (header, TOC, checksums, seek table, chunks) with
+ * offsets relative to its own start, so a track is opened like a
+ * load_index() package over that region of the album file. Metadata
+ * fields a track shares with the album and a cover (with its thumbnails)
+ * identical to the album's are stored only at the album level and filled
+ * back in when the track is opened.
+ */
+
+#include "../include/dmusicpak/dmusicpak.h"
+#include "internal.h"
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <new>
+
+using namespace dmusicpak;
+
+/* Location of one track chunk's data in the album file */
+struct AlbumTrack {
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct dmusicpak::Album {
+    MappedFile mapping;        /* open_album_mmap() */
+    FileHandle file;           /* open_album() */
+    int has_file;
+    uint64_t size;
+    AlbumTrack* tracks;
+    uint32_t track_count;
+    Package* info;             /* Album-level metadata and cover; shared */
+    std::atomic<uint32_t> refs; /* One per package reading from the album */
+};
+
+/* Reads of one package in the album file: [base, base + limit) */
+struct AlbumSource {
+    Album* album;
+    uint64_t base;
+    uint64_t limit;
+};
+
+/* One top-level chunk of an album file being written */
+struct AlbumChunk {
+    uint8_t type;
+    uint64_t size;
+    uint64_t offset;           /* Chunk data offset in the file */
+    uint64_t lead;             /* Bytes of a padding chunk written before this one, header included */
+    PackagePlan* plan;         /* Track chunks */
+};
+
+static void release_album(Album* album) {
+    if (album->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+    unmap_file(&album->mapping);
+    if (album->has_file) file_close(&album->file);
+    mem_free(album->tracks);
+    delete album;
+}
+
+static bool album_read_at(void* source, uint64_t offset, void* buffer, size_t size) {
+    AlbumSource* region = (AlbumSource*)source;
+    if (offset > region->limit || size > region->limit - offset) return false;
+
+    Album* album = region->album;
+    offset += region->base;
+    if (album->mapping.data) {
+        memcpy(buffer, album->mapping.data + offset, size);
+        stat_add(STAT_BYTES_COPIED, size);
+        return true;
+    }
+    return file_read_at(&album->file, offset, buffer, size);
+}
+
+static void album_source_close(void* source) {
+    AlbumSource* region = (AlbumSource*)source;
+    release_album(region->album);
+    mem_free(region);
+}
+
+static const SourceOps album_source_ops = { album_read_at, album_source_close };
+
+/* Lazily loaded package stored at [base, base + size) of the album file */
+static Package* open_album_package(Album* album, uint64_t base, uint64_t size) {
+    if (size < FILE_HEADER_SIZE) return NULL;
+
+    Package* package = create();
+    AlbumSource* region = (AlbumSource*)mem_malloc(sizeof(AlbumSource));
+    if (!package || !region) {
+        mem_free(region);
+        dmusicpak::free(package);
+        return NULL;
+    }
+    region->album = album;
+    region->base = base;
+    region->limit = size;
+    album->refs.fetch_add(1, std::memory_order_relaxed);
+
+    package->source_ops = &album_source_ops;
+    package->source = region;
+    package->has_file = 1;
+
+    uint8_t head[INDEX_HEAD_SIZE];
+    size_t head_size = size < sizeof(head) ? (size_t)size : sizeof(head);
+    if (!package_read_at(package, 0, head, head_size) || !index_package(package, size, head, head_size)) {
+        dmusicpak::free(package);
+        return NULL;
+    }
+
+    /* The index is relative to the embedded package; reads from here on use file offsets */
+    for (uint32_t i = 0; i < package->num_chunks; i++) package->chunks[i].offset += base;
+    region->base = 0;
+    region->limit = album->size;
+    return package;
+}
+
+static Album* open_album_file(const char* filename, bool map) {
+    if (!filename) return NULL;
+
+    uint64_t start = trace_begin();
+    Album* album = new (std::nothrow) Album();
+    if (!album) return NULL;
+    album->refs.store(1, std::memory_order_relaxed);  /* Dropped once the info package holds one */
+
+    bool opened;
+    if (map) {
+        opened = map_file(filename, &album->mapping);
+        album->size = album->mapping.size;
+    } else {
+        opened = file_open(filename, &album->file);
+        album->has_file = opened ? 1 : 0;
+        opened = opened && file_size(&album->file, &album->size);
+    }
+    if (!opened) {
+        release_album(album);
+        trace_end(start, TraceEvent::LOAD, filename, 0, 0, Error::FILE_NOT_FOUND);
+        return NULL;
+    }
+
+    Package* info = open_album_package(album, 0, album->size);
+    uint32_t count = 0;
+    for (uint32_t i = 0; info && i < info->num_chunks; i++) {
+        if (info->chunks[i].type == CHUNK_TRACK && !info->chunks[i].compressed) count++;
+    }
+
+    /* The TOC lists track chunks in track order */
+    album->tracks = info ? (AlbumTrack*)mem_malloc((count > 0 ? count : 1) * sizeof(AlbumTrack)) : NULL;
+    for (uint32_t i = 0; album->tracks && i < info->num_chunks; i++) {
+        const ChunkEntry* entry = &info->chunks[i];
+        if (entry->type != CHUNK_TRACK || entry->compressed) continue;
+        album->tracks[album->track_count].offset = entry->offset;
+        album->tracks[album->track_count].size = entry->size;
+        album->track_count++;
+    }
+
+    Error result = info && album->tracks ? share(info) : Error::INVALID_FORMAT;
+    if (result != Error::OK) {
+        dmusicpak::free(info);
+        release_album(album);
+        trace_end(start, TraceEvent::LOAD, filename, 0, album->size, result);
+        return NULL;
+    }
+
+    album->info = info;
+    release_album(album);
+    trace_end(start, TraceEvent::LOAD, filename, 0, album->size, Error::OK);
+    return album;
+}
+
+Album* dmusicpak::open_album(const char* filename) {
+    return open_album_file(filename, false);
+}
+
+Album* dmusicpak::open_album_mmap(const char* filename) {
+    return open_album_file(filename, true);
+}
+
+void dmusicpak::close_album(Album* album) {
+    if (!album) return;
+
+    /* The album goes with the last package reading from it */
+    dmusicpak::free(album->info);
+}
+
+uint32_t dmusicpak::album_track_count(const Album* album) {
+    return album ? album->track_count : 0;
+}
+
+Package* dmusicpak::album_info(Album* album) {
+    return album ? retain(album->info) : NULL;
+}
+
+/* Give a track the album-level chunks and metadata fields it does not store itself */
+static Error inherit_album(Package* track, const Package* info) {
+    const ChunkEntry* cover = find_chunk(info, CHUNK_COVER);
+    if (cover && !find_chunk(track, CHUNK_COVER)) {
+        if (!add_chunk_entry(track, CHUNK_COVER | (cover->compressed ? CHUNK_COMPRESSED : 0), cover->offset,
+                             cover->size)) {
+            return Error::MEMORY_ALLOC;
+        }
+
+        /* Thumbnails go with the cover they were scaled from */
+        const ChunkEntry* thumbnails = find_chunk(info, CHUNK_THUMBNAILS);
+        if (thumbnails && !find_chunk(track, CHUNK_THUMBNAILS) &&
+            !add_chunk_entry(track, CHUNK_THUMBNAILS | (thumbnails->compressed ? CHUNK_COMPRESSED : 0),
+                             thumbnails->offset, thumbnails->size)) {
+            return Error::MEMORY_ALLOC;
+        }
+    }
+
+    if (!info->has_metadata) return Error::OK;
+    if (find_chunk(track, CHUNK_METADATA)) {
+        Error result = load_chunk(track, ChunkType::METADATA);
+        if (result != Error::OK) return result;
+    }
+
+    Metadata* metadata = &track->metadata;
+    char** fields[] = { &metadata->album, &metadata->artist, &metadata->genre, &metadata->year };
+    const char* values[] = { info->metadata.album, info->metadata.artist, info->metadata.genre, info->metadata.year };
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        if ((*fields[i] && **fields[i]) || !values[i] || !*values[i]) continue;
+
+        package_release(track, *fields[i]);
+        *fields[i] = package_strdup(track, values[i]);
+        if (!*fields[i]) return Error::MEMORY_ALLOC;
+        track->has_metadata = 1;
+    }
+    return Error::OK;
+}
+
+Package* dmusicpak::load_album_track(Album* album, uint32_t index) {
+    if (!album || index >= album->track_count) return NULL;
+
+    uint64_t start = trace_begin();
+    const AlbumTrack* entry = &album->tracks[index];
+    Package* track = open_album_package(album, entry->offset, entry->size);
+    Error result = track ? inherit_album(track, album->info) : Error::INVALID_FORMAT;
+    if (result != Error::OK) {
+        dmusicpak::free(track);
+        track = NULL;
+    }
+
+    trace_end(start, TraceEvent::LOAD, NULL, 0, entry->size, result);
+    return track;
+}
+
+/* Load a chunk that is still only indexed, for comparison with the album's */
+static Error ensure_chunk(Package* package, ChunkType type, int loaded) {
+    if (loaded || !package->has_file || !find_chunk(package, (uint8_t)type)) return Error::OK;
+    return load_chunk(package, type);
+}
+
+/* NULL when a track field repeats the album's */
+static char* track_field(char* field, const char* album_field) {
+    return field && album_field && strcmp(field, album_field) == 0 ? NULL : field;
+}
+
+/* The track's cover is the album's, and its thumbnails (if any) are too */
+static bool same_cover(const Package* track, const Package* album) {
+    const Cover* a = &track->cover;
+    const Cover* b = &album->cover;
+    if (!track->has_cover || !album->has_cover || a->format != b->format || a->width != b->width ||
+        a->height != b->height || a->size != b->size || (a->size > 0 && memcmp(a->data, b->data, a->size) != 0)) {
+        return false;
+    }
+
+    /* Dropping the cover drops the thumbnails too, so they must match or be absent */
+    if (!track->has_thumbnails) return !find_chunk(track, CHUNK_THUMBNAILS);
+    if (track->thumbnail_count == 0) return true;
+    return album->has_thumbnails && track->thumbnail_count == album->thumbnail_count &&
+           track->thumbnails_size == album->thumbnails_size &&
+           memcmp(track->thumbnails, album->thumbnails, track->thumbnails_size) == 0;
+}
+
+static bool write_all(FILE* file, const void* data, size_t size) {
+    if (size > 0 && fwrite(data, 1, size, file) != size) return false;
+    stat_add(STAT_BYTES_WRITTEN, size);
+    return true;
+}
+
+/* Header, TOC and chunks of an album file */
+static Error write_album(FILE* file, const Package* album, const AlbumChunk* chunks, uint32_t count,
+                         uint32_t version) {
+    size_t header_size = chunk_header_size(version);
+    size_t head_size = FILE_HEADER_SIZE + header_size + 4 + (size_t)count * TOC_ENTRY_SIZE;
+    uint8_t* head = (uint8_t*)mem_malloc(head_size);
+    if (!head) return Error::MEMORY_ALLOC;
+
+    /* Padding chunks count as chunks but are not listed in the TOC */
+    uint32_t num_chunks = count + 1;
+    for (uint32_t i = 0; i < count; i++) {
+        if (chunks[i].lead > 0) num_chunks++;
+    }
+
+    memcpy(head, DMUSICPAK_MAGIC, 4);
+    write_uint32_le(head + 4, version);
+    write_uint32_le(head + 8, num_chunks);
+    write_chunk_header(head + FILE_HEADER_SIZE, CHUNK_TOC, 4 + (uint64_t)count * TOC_ENTRY_SIZE, version);
+    size_t offset = FILE_HEADER_SIZE + header_size;
+    write_uint32_le(head + offset, count);
+    offset += 4;
+    for (uint32_t i = 0; i < count; i++) {
+        head[offset] = chunks[i].type;
+        write_uint64_le(head + offset + 1, chunks[i].offset);
+        write_uint64_le(head + offset + 9, chunks[i].size);
+        offset += TOC_ENTRY_SIZE;
+    }
+    bool ok = write_all(file, head, head_size);
+    mem_free(head);
+
+    Error result = ok ? Error::OK : Error::IO;
+    for (uint32_t i = 0; i < count && result == Error::OK; i++) {
+        uint8_t chunk_header[CHUNK_HEADER_SIZE_LARGE];
+        if (chunks[i].lead > 0) {
+            static const uint8_t zeros[4096] = {0};
+            write_chunk_header(chunk_header, CHUNK_PADDING, chunks[i].lead - header_size, version);
+            ok = write_all(file, chunk_header, header_size);
+            for (uint64_t left = chunks[i].lead - header_size; ok && left > 0;) {
+                size_t size = left < sizeof(zeros) ? (size_t)left : sizeof(zeros);
+                ok = write_all(file, zeros, size);
+                left -= size;
+            }
+            if (!ok) {
+                result = Error::IO;
+                break;
+            }
+        }
+        write_chunk_header(chunk_header, chunks[i].type, chunks[i].size, version);
+        if (!write_all(file, chunk_header, header_size)) {
+            result = Error::IO;
+            break;
+        }
+
+        if (chunks[i].type == CHUNK_TRACK) {
+            result = write_package_plan(chunks[i].plan, file);
+        } else if (chunks[i].type == CHUNK_METADATA) {
+            uint8_t* data = (uint8_t*)mem_malloc((size_t)chunks[i].size);
+            if (!data) {
+                result = Error::MEMORY_ALLOC;
+                break;
+            }
+            write_metadata_chunk(data, &album->metadata);
+            if (!write_all(file, data, (size_t)chunks[i].size)) result = Error::IO;
+            mem_free(data);
+        } else if (chunks[i].type == CHUNK_THUMBNAILS) {
+            uint8_t count[4];
+            write_uint32_le(count, album->thumbnail_count);
+            if (!write_all(file, count, sizeof(count)) || !write_all(file, album->thumbnails, album->thumbnails_size)) {
+                result = Error::IO;
+            }
+        } else {
+            uint8_t fields[12];
+            write_uint32_le(fields, (uint32_t)album->cover.format);
+            write_uint32_le(fields + 4, album->cover.width);
+            write_uint32_le(fields + 8, album->cover.height);
+            if (!write_all(file, fields, sizeof(fields)) || !write_all(file, album->cover.data, album->cover.size)) {
+                result = Error::IO;
+            }
+        }
+    }
+    return result;
+}
+
+/* Plan every chunk of an album file; track plans are left in chunks on error too */
+static Error plan_album(Package* album, Package* const* tracks, uint32_t count, AlbumChunk* chunks,
+                        uint32_t* chunk_count, uint32_t* version) {
+    *chunk_count = 0;
+    if (album) {
+        Error result = ensure_chunk(album, ChunkType::METADATA, album->has_metadata);
+        if (result != Error::OK) return result;
+        ensure_chunk(album, ChunkType::COVER, album->has_cover);  /* Not shared if it cannot be read */
+        ensure_chunk(album, ChunkType::THUMBNAILS, album->has_thumbnails);
+
+        if (album->has_metadata) {
+            chunks[*chunk_count].type = CHUNK_METADATA;
+            chunks[*chunk_count].size = metadata_chunk_size(&album->metadata);
+            (*chunk_count)++;
+        }
+        if (album->has_cover) {
+            chunks[*chunk_count].type = CHUNK_COVER;
+            chunks[*chunk_count].size = 12 + (uint64_t)album->cover.size;
+            (*chunk_count)++;
+        }
+        if (album->has_cover && album->has_thumbnails && album->thumbnail_count > 0) {
+            chunks[*chunk_count].type = CHUNK_THUMBNAILS;
+            chunks[*chunk_count].size = 4 + (uint64_t)album->thumbnails_size;
+            (*chunk_count)++;
+        }
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        Package* track = tracks[i];
+        Error result = ensure_chunk(track, ChunkType::METADATA, track->has_metadata);
+        if (result != Error::OK) return result;
+        if (album && album->has_cover) {
+            ensure_chunk(track, ChunkType::COVER, track->has_cover);
+            ensure_chunk(track, ChunkType::THUMBNAILS, track->has_thumbnails);
+        }
+    }
+
+    /*
+     * Tracks are planned where they land in the file, so aligned payloads
+     * (SaveOptions::alignment) sit on absolute boundaries. Version 2 unless
+     * some chunk does not fit a 32-bit size; a track that needs version 3
+     * changes the header size, and everything is placed again.
+     */
+    uint32_t album_chunks = *chunk_count;
+    *version = DMUSICPAK_VERSION;
+    while (true) {
+        size_t header_size = chunk_header_size(*version);
+        uint64_t offset = FILE_HEADER_SIZE + header_size + 4 + (uint64_t)(album_chunks + count) * TOC_ENTRY_SIZE;
+        bool large = false;
+        for (uint32_t i = 0; i < album_chunks; i++) {
+            /* The shared cover is aligned like a track's, by a padding chunk in front */
+            uint32_t alignment = album->save_options.alignment;
+            if (alignment > 0 && chunks[i].type == CHUNK_COVER) {
+                uint64_t lead = (alignment - (offset + header_size + 12) % alignment) % alignment;
+                if (lead > 0 && lead < header_size) lead += alignment;
+                chunks[i].lead = lead;
+                offset += lead;
+            }
+            chunks[i].offset = offset + header_size;
+            offset += header_size + chunks[i].size;
+            if (chunks[i].size > 0xFFFFFFFFu) large = true;
+        }
+
+        for (uint32_t i = 0; i < count; i++) {
+            Package* track = tracks[i];
+
+            /* Fields repeated from the album are stored once, at the album level */
+            Metadata metadata = track->metadata;
+            bool deduplicated = album && album->has_metadata && track->has_metadata;
+            if (deduplicated) {
+                metadata.album = track_field(metadata.album, album->metadata.album);
+                metadata.artist = track_field(metadata.artist, album->metadata.artist);
+                metadata.genre = track_field(metadata.genre, album->metadata.genre);
+                metadata.year = track_field(metadata.year, album->metadata.year);
+            }
+
+            AlbumChunk* chunk = &chunks[*chunk_count];
+            chunk->type = CHUNK_TRACK;
+            chunk->offset = offset + header_size;
+            Error result = plan_package(track, deduplicated ? &metadata : NULL, album && same_cover(track, album),
+                                        chunk->offset, &chunk->plan);
+            if (result != Error::OK) return result;
+            chunk->size = package_plan_size(chunk->plan);
+            (*chunk_count)++;
+
+            offset += header_size + chunk->size;
+            if (chunk->size > 0xFFFFFFFFu) large = true;
+        }
+
+        if (!large || *version == DMUSICPAK_VERSION_LARGE) return Error::OK;
+
+        *version = DMUSICPAK_VERSION_LARGE;
+        for (uint32_t i = album_chunks; i < *chunk_count; i++) {
+            free_package_plan(chunks[i].plan);
+            chunks[i].plan = NULL;
+        }
+        *chunk_count = album_chunks;
+    }
+}
+
+Error dmusicpak::save_album(const char* filename, Package* album, Package* const* tracks, uint32_t count) {
+    if (!filename || (count > 0 && !tracks)) return Error::INVALID_PARAM;
+    for (uint32_t i = 0; i < count; i++) {
+        if (!tracks[i]) return Error::INVALID_PARAM;
+    }
+
+    uint64_t start = trace_begin();
+    AlbumChunk* chunks = (AlbumChunk*)mem_calloc((size_t)count + 3, sizeof(AlbumChunk));
+    if (!chunks) return Error::MEMORY_ALLOC;
+
+    uint32_t chunk_count = 0;
+    uint32_t version = DMUSICPAK_VERSION;
+    Error result = plan_album(album, tracks, count, chunks, &chunk_count, &version);
+
+    /* Written next to the target and renamed over it, like save() */
+    size_t len = strlen(filename);
+    char* temp = result == Error::OK ? (char*)mem_malloc(len + 5) : NULL;
+    if (result == Error::OK && !temp) result = Error::MEMORY_ALLOC;
+    if (result == Error::OK) {
+        memcpy(temp, filename, len);
+        memcpy(temp + len, ".tmp", 5);
+
+        FILE* file = fopen(temp, "wb");
+        if (!file) {
+            result = Error::FILE_NOT_FOUND;
+        } else {
+            result = write_album(file, album, chunks, chunk_count, version);
+            if (fclose(file) != 0 && result == Error::OK) result = Error::IO;
+            if (result == Error::OK && !file_replace(temp, filename)) result = Error::IO;
+            if (result != Error::OK) remove(temp);
+        }
+    }
+
+    uint64_t size = chunk_count > 0 ? chunks[chunk_count - 1].offset + chunks[chunk_count - 1].size : 0;
+    for (uint32_t i = 0; i < (uint32_t)count + 3; i++) free_package_plan(chunks[i].plan);
+    mem_free(chunks);
+    mem_free(temp);
+    trace_end(start, TraceEvent::SAVE, filename, 0, result == Error::OK ? size : 0, result);
+    return result;
+}
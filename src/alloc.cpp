@@ -0,0 +1,232 @@
+/**
+ * @file alloc.cpp
+ * @brief Allocator hooks and package arenas for DMusicPak library
+ *
+ * Every allocation the library makes goes through mem_malloc() and friends,
+ * which call the hooks installed by set_allocator() (the C library by
+ * default). A package with an arena takes its structure, chunk index,
+ * strings and payloads from bump-allocated blocks released together by
+ * free(); allocations too large to share a block get a block of their own,
+ * which is released as soon as its payload is replaced.
+ */
+
+#include "internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+using namespace dmusicpak;
+
+/* Bump allocation alignment */
+#define ARENA_ALIGNMENT 16
+
+/* Allocations above this fraction of the block size get their own block */
+#define ARENA_DEDICATED_DIVISOR 4
+
+/* Block of an arena; data follows the (aligned) header */
+struct ArenaBlock {
+    ArenaBlock* next;
+    size_t size;
+    size_t used;
+    bool dedicated;    /* Holds one large allocation */
+};
+
+struct dmusicpak::Arena {
+    ArenaBlock* blocks;  /* Current block first */
+    size_t block_size;
+};
+
+/* All members NULL: malloc/realloc/free */
+static Allocator g_allocator;
+
+/* Arena block size for packages from create(); 0 for none */
+static std::atomic<size_t> g_package_arena(0);
+
+static size_t align_size(size_t size) {
+    return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+#define ARENA_HEADER_SIZE align_size(sizeof(ArenaBlock))
+
+Error dmusicpak::set_allocator(const Allocator* allocator) {
+    if (!allocator) {
+        memset(&g_allocator, 0, sizeof(g_allocator));
+        return Error::OK;
+    }
+    if (!allocator->allocate || !allocator->reallocate || !allocator->release) return Error::INVALID_PARAM;
+
+    g_allocator = *allocator;
+    return Error::OK;
+}
+
+void* dmusicpak::mem_malloc(size_t size) {
+    stat_add(STAT_ALLOCATIONS, 1);
+    stat_add(STAT_ALLOCATED_BYTES, size);
+    if (g_allocator.allocate) return g_allocator.allocate(size, g_allocator.context);
+    return malloc(size);
+}
+
+void* dmusicpak::mem_calloc(size_t count, size_t size) {
+    if (size > 0 && count > (size_t)-1 / size) return NULL;
+
+    void* ptr = mem_malloc(count * size);
+    if (ptr) memset(ptr, 0, count * size);
+    return ptr;
+}
+
+void* dmusicpak::mem_realloc(void* ptr, size_t size) {
+    stat_add(STAT_ALLOCATIONS, 1);
+    stat_add(STAT_ALLOCATED_BYTES, size);
+    if (g_allocator.reallocate) return g_allocator.reallocate(ptr, size, g_allocator.context);
+    return realloc(ptr, size);
+}
+
+void dmusicpak::mem_free(void* ptr) {
+    if (!ptr) return;
+    if (g_allocator.release) {
+        g_allocator.release(ptr, g_allocator.context);
+    } else {
+        ::free(ptr);
+    }
+}
+
+void* dmusicpak::alloc_buffer(size_t size) {
+    return mem_malloc(size);
+}
+
+void dmusicpak::free_buffer(void* buffer) {
+    mem_free(buffer);
+}
+
+void dmusicpak::set_package_arena(size_t block_size) {
+    g_package_arena.store(block_size);
+}
+
+size_t dmusicpak::package_arena_size() {
+    return g_package_arena.load();
+}
+
+static uint8_t* block_data(ArenaBlock* block) {
+    return (uint8_t*)block + ARENA_HEADER_SIZE;
+}
+
+static ArenaBlock* new_block(size_t size, bool dedicated) {
+    if (size > (size_t)-1 - ARENA_HEADER_SIZE) return NULL;
+
+    ArenaBlock* block = (ArenaBlock*)mem_malloc(ARENA_HEADER_SIZE + size);
+    if (!block) return NULL;
+
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    block->dedicated = dedicated;
+    return block;
+}
+
+Arena* dmusicpak::arena_create(size_t block_size) {
+    /* The arena lives at the start of its first block */
+    size_t header = align_size(sizeof(Arena));
+    if (block_size < header + ARENA_ALIGNMENT) block_size = header + ARENA_ALIGNMENT;
+    block_size = align_size(block_size);
+
+    ArenaBlock* block = new_block(block_size, false);
+    if (!block) return NULL;
+
+    Arena* arena = (Arena*)block_data(block);
+    block->used = header;
+    arena->blocks = block;
+    arena->block_size = block_size;
+    return arena;
+}
+
+void* dmusicpak::arena_alloc(Arena* arena, size_t size) {
+    size = align_size(size > 0 ? size : 1);
+    if (size == 0) return NULL;  /* Overflowed */
+
+    ArenaBlock* current = arena->blocks;
+    if (current->size - current->used >= size) {
+        void* ptr = block_data(current) + current->used;
+        current->used += size;
+        return ptr;
+    }
+
+    /* Large allocations go in their own block behind the current one, which keeps filling */
+    if (size > arena->block_size / ARENA_DEDICATED_DIVISOR) {
+        ArenaBlock* block = new_block(size, true);
+        if (!block) return NULL;
+        block->used = size;
+        block->next = current->next;
+        current->next = block;
+        return block_data(block);
+    }
+
+    ArenaBlock* block = new_block(arena->block_size, false);
+    if (!block) return NULL;
+    block->used = size;
+    block->next = current;
+    arena->blocks = block;
+    return block_data(block);
+}
+
+/* True if ptr came from the arena; a dedicated block holding it is released */
+static bool arena_release(Arena* arena, const void* ptr) {
+    for (ArenaBlock** link = &arena->blocks; *link; link = &(*link)->next) {
+        ArenaBlock* block = *link;
+        const uint8_t* data = block_data(block);
+        if ((const uint8_t*)ptr < data || (const uint8_t*)ptr >= data + block->size) continue;
+
+        if (block->dedicated && (const uint8_t*)ptr == data) {
+            *link = block->next;
+            mem_free(block);
+        }
+        return true;
+    }
+    return false;
+}
+
+void dmusicpak::arena_destroy(Arena* arena) {
+    if (!arena) return;
+
+    /* The first block, holding the arena itself, is last in the list */
+    ArenaBlock* block = arena->blocks;
+    while (block) {
+        ArenaBlock* next = block->next;
+        mem_free(block);
+        block = next;
+    }
+}
+
+void* dmusicpak::package_alloc(Package* package, size_t size) {
+    if (package->arena) return arena_alloc(package->arena, size);
+    return mem_malloc(size > 0 ? size : 1);
+}
+
+void* dmusicpak::package_realloc(Package* package, void* ptr, size_t old_size, size_t size) {
+    if (!package->arena) return mem_realloc(ptr, size);
+    if (ptr && size <= old_size) return ptr;
+
+    void* grown = arena_alloc(package->arena, size);
+    if (!grown) return NULL;
+    if (ptr) {
+        memcpy(grown, ptr, old_size);
+        package_release(package, ptr);
+    }
+    return grown;
+}
+
+void dmusicpak::package_release(Package* package, void* ptr) {
+    if (!ptr || is_borrowed(package, ptr)) return;
+
+    /* Arena memory is reclaimed by free(), except for dedicated blocks */
+    if (package->arena && arena_release(package->arena, ptr)) return;
+    mem_free(ptr);
+}
+
+char* dmusicpak::package_strdup(Package* package, const char* str) {
+    if (!str) return NULL;
+
+    size_t len = strlen(str);
+    char* dup = (char*)package_alloc(package, len + 1);
+    if (dup) memcpy(dup, str, len + 1);
+    return dup;
+}
@@ -0,0 +1,753 @@
+/**
+ * @file async.cpp
+ * @brief Asynchronous load, save and read queue for DMusicPak library
+ *
+ * Loading and saving a package is as much parsing and serializing as it is
+ * I/O, so those run to completion on a small pool of worker threads. Audio
+ * reads need no thread: audio already in memory is copied at submission,
+ * and uncompressed audio of a load_index() package is read by the kernel
+ * through an io_uring on Linux, so hundreds can be in flight with one
+ * thread reaping them. Compressed audio, and file reads where io_uring is
+ * missing (Windows included), still take a worker. HTTP range reads go to
+ * one curl multi handle (network.cpp). Either way a finished operation is
+ * queued on the context and its callback runs when the owner calls
+ * async_poll(); the notify descriptor (an event on Windows) is signalled
+ * when the queue becomes non-empty so an event loop can wait on it with
+ * the rest of its sources.
+ */
+
+#include "../include/dmusicpak/dmusicpak.h"
+#include "internal.h"
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <errno.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define ASYNC_IO_URING 1
+#endif
+#endif
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace dmusicpak;
+
+/* Upper bound on worker threads, whatever the caller asks for */
+#define MAX_ASYNC_THREADS 64
+
+/* Worker threads when the caller passes 0 */
+#define DEFAULT_ASYNC_THREADS 4
+
+#ifdef ASYNC_IO_URING
+/* Submission queue entries; the kernel gives the completion queue twice as many */
+#define ASYNC_RING_ENTRIES 256
+
+/* Longest single read queued; longer ones continue where the last one stopped */
+#define ASYNC_RING_MAX_READ (1u << 30)
+
+/* Audio reads of load_index() packages, queued on an io_uring and reaped by one thread */
+struct AsyncRing {
+    int fd;
+    void* sq_map;
+    size_t sq_map_size;
+    void* cq_map;                 /* Same as sq_map with IORING_FEAT_SINGLE_MMAP */
+    size_t cq_map_size;
+    io_uring_sqe* sqes;
+    size_t sqes_size;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    io_uring_cqe* cqes;
+    unsigned cq_mask;
+    uint32_t capacity;            /* Reads that may be in flight, so the completion queue cannot overflow */
+    uint32_t in_flight;           /* Guarded by the context lock, like the submission queue */
+    AsyncJob* waiting;            /* Reads for the next free slots, oldest first */
+    AsyncJob* waiting_tail;
+    std::thread reaper;
+};
+#endif
+
+struct dmusicpak::AsyncContext {
+    std::mutex lock;
+    std::condition_variable work;      /* Signalled when jobs are queued or the workers stop */
+    std::condition_variable finished;  /* Signalled when completions are queued */
+    AsyncJob* jobs;                    /* Waiting for a worker, oldest first */
+    AsyncJob* jobs_tail;
+    AsyncJob* completed;               /* Waiting for async_poll(), oldest first */
+    AsyncJob* completed_tail;
+    uint32_t pending;                  /* Submitted and not yet delivered */
+    bool stop;
+    std::thread workers[MAX_ASYNC_THREADS];
+    uint32_t worker_count;
+    int notify_read;                   /* Readable while completions wait; -1 on Windows */
+    int notify_write;
+#ifdef _WIN32
+    HANDLE notify_event;               /* Set while completions wait */
+#endif
+#ifdef ASYNC_IO_URING
+    AsyncRing* ring;                   /* Created by the first file audio read */
+    bool ring_failed;                  /* io_uring is unavailable; file reads use the workers */
+#endif
+#ifdef DMUSICPAK_ENABLE_NETWORK
+    AsyncTransfers* transfers;         /* Created by the first URL range read */
+#endif
+};
+
+static bool open_notify(AsyncContext* context) {
+#ifdef _WIN32
+    context->notify_read = context->notify_write = -1;
+    context->notify_event = CreateEventW(NULL, TRUE, FALSE, NULL);
+    return context->notify_event != NULL;
+#elif defined(__linux__)
+    context->notify_read = context->notify_write = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return context->notify_read >= 0;
+#else
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    for (int i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    context->notify_read = fds[0];
+    context->notify_write = fds[1];
+    return true;
+#endif
+}
+
+static void close_notify(AsyncContext* context) {
+#ifdef _WIN32
+    CloseHandle(context->notify_event);
+#else
+    if (context->notify_read >= 0) close(context->notify_read);
+    if (context->notify_write != context->notify_read && context->notify_write >= 0) close(context->notify_write);
+#endif
+}
+
+/* Make the descriptor readable; called with the lock held */
+static void signal_notify(AsyncContext* context) {
+#ifdef _WIN32
+    SetEvent(context->notify_event);
+#elif defined(__linux__)
+    uint64_t one = 1;
+    ssize_t written = write(context->notify_write, &one, sizeof(one));
+    (void)written;
+#else
+    char byte = 0;
+    ssize_t written = write(context->notify_write, &byte, 1);
+    (void)written;
+#endif
+}
+
+/* Make the descriptor unreadable again; called with the lock held */
+static void clear_notify(AsyncContext* context) {
+#ifdef _WIN32
+    ResetEvent(context->notify_event);
+#elif defined(__linux__)
+    uint64_t count;
+    ssize_t got = read(context->notify_read, &count, sizeof(count));
+    (void)got;
+#else
+    char bytes[64];
+    while (read(context->notify_read, bytes, sizeof(bytes)) > 0) {}
+#endif
+}
+
+static void free_job(AsyncJob* job) {
+    mem_free(job->name);
+    mem_free(job);
+}
+
+void dmusicpak::async_complete(AsyncJob* job) {
+    AsyncContext* context = job->context;
+    job->next = NULL;
+
+    std::lock_guard<std::mutex> lock(context->lock);
+    if (context->completed) {
+        context->completed_tail->next = job;
+    } else {
+        context->completed = job;
+        signal_notify(context);
+    }
+    context->completed_tail = job;
+    context->finished.notify_all();
+}
+
+static void run_job(AsyncJob* job) {
+    AsyncCompletion* completion = &job->completion;
+    switch (completion->operation) {
+        case AsyncOperation::LOAD: {
+            Error error = Error::OK;
+            completion->package = load_file(job->name, &error);
+            completion->result = completion->package ? Error::OK :
+                                 (error != Error::OK ? error : Error::INVALID_FORMAT);
+            break;
+        }
+        case AsyncOperation::SAVE:
+            completion->result = save(completion->package, job->name);
+            break;
+        case AsyncOperation::READ_AUDIO:
+            completion->bytes = get_audio_chunk(completion->package, job->offset, job->size, completion->buffer);
+            completion->result = completion->bytes >= 0 ? Error::OK : Error::IO;
+            break;
+#ifdef DMUSICPAK_ENABLE_NETWORK
+        case AsyncOperation::LOAD_URL:
+            completion->package = load_url(job->name, job->timeout_ms);
+            completion->result = completion->package ? Error::OK : Error::NETWORK;
+            break;
+#endif
+        default:
+            completion->result = Error::NOT_SUPPORTED;
+            break;
+    }
+    async_complete(job);
+}
+
+static void async_worker(AsyncContext* context) {
+    std::unique_lock<std::mutex> lock(context->lock);
+    for (;;) {
+        /* Queued jobs still run after free_async_context() asks the workers to stop */
+        while (!context->jobs && !context->stop) context->work.wait(lock);
+        AsyncJob* job = context->jobs;
+        if (!job) break;
+
+        context->jobs = job->next;
+        lock.unlock();
+        run_job(job);
+        lock.lock();
+    }
+}
+
+/* New job for the context; the callback is checked by the caller */
+static AsyncJob* create_job(AsyncContext* context, AsyncOperation operation, const char* name,
+                            AsyncCallback callback, void* userdata) {
+    AsyncJob* job = (AsyncJob*)mem_calloc(1, sizeof(AsyncJob));
+    if (!job) return NULL;
+
+    if (name) {
+        size_t length = strlen(name);
+        job->name = (char*)mem_malloc(length + 1);
+        if (!job->name) {
+            mem_free(job);
+            return NULL;
+        }
+        memcpy(job->name, name, length + 1);
+    }
+
+    job->context = context;
+    job->callback = callback;
+    job->completion.operation = operation;
+    job->completion.result = Error::OK;
+    job->completion.userdata = userdata;
+    return job;
+}
+
+/* Hand a counted job to the workers; called with the lock held */
+static void push_job(AsyncContext* context, AsyncJob* job) {
+    job->next = NULL;
+    if (context->jobs) {
+        context->jobs_tail->next = job;
+    } else {
+        context->jobs = job;
+    }
+    context->jobs_tail = job;
+    context->work.notify_one();
+}
+
+static Error submit_job(AsyncContext* context, AsyncJob* job) {
+    std::lock_guard<std::mutex> lock(context->lock);
+    if (context->stop) {
+        free_job(job);
+        return Error::NOT_SUPPORTED;
+    }
+
+    push_job(context, job);
+    context->pending++;
+    return Error::OK;
+}
+
+/* Count a job that completes without a worker; false once the context is stopping */
+static bool accept_job(AsyncContext* context) {
+    std::lock_guard<std::mutex> lock(context->lock);
+    if (context->stop) return false;
+    context->pending++;
+    return true;
+}
+
+#ifdef ASYNC_IO_URING
+static void free_ring_maps(AsyncRing* ring) {
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_map && ring->cq_map != ring->sq_map) munmap(ring->cq_map, ring->cq_map_size);
+    if (ring->sq_map) munmap(ring->sq_map, ring->sq_map_size);
+    close(ring->fd);
+    delete ring;
+}
+
+static void* map_ring(int fd, size_t size, uint64_t offset) {
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, (off_t)offset);
+    return map == MAP_FAILED ? NULL : map;
+}
+
+/* Ring with plain reads supported, or NULL (kernels before 5.6, or io_uring disabled) */
+static AsyncRing* open_ring() {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = (int)syscall(__NR_io_uring_setup, ASYNC_RING_ENTRIES, &params);
+    if (fd < 0) return NULL;
+
+    AsyncRing* ring = new (std::nothrow) AsyncRing();
+    if (!ring) {
+        close(fd);
+        return NULL;
+    }
+    ring->fd = fd;
+
+    const size_t probe_size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+    io_uring_probe* probe = (io_uring_probe*)mem_calloc(1, probe_size);
+    bool readable = probe && syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+                    probe->last_op >= IORING_OP_READ && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+    mem_free(probe);
+    if (!readable) {
+        free_ring_maps(ring);
+        return NULL;
+    }
+
+    ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+        if (ring->cq_map_size > ring->sq_map_size) ring->sq_map_size = ring->cq_map_size;
+        ring->cq_map_size = ring->sq_map_size;
+    }
+    ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+    ring->sq_map = map_ring(fd, ring->sq_map_size, IORING_OFF_SQ_RING);
+    ring->cq_map = single ? ring->sq_map : map_ring(fd, ring->cq_map_size, IORING_OFF_CQ_RING);
+    ring->sqes = ring->sq_map && ring->cq_map ?
+                 (io_uring_sqe*)map_ring(fd, ring->sqes_size, IORING_OFF_SQES) : NULL;
+    if (!ring->sqes) {
+        free_ring_maps(ring);
+        return NULL;
+    }
+
+    uint8_t* sq = (uint8_t*)ring->sq_map;
+    uint8_t* cq = (uint8_t*)ring->cq_map;
+    ring->sq_head = (unsigned*)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+    ring->sq_mask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+    ring->cq_mask = *(unsigned*)(cq + params.cq_off.ring_mask);
+
+    /* One completion slot stays free for the wake-up sent by free_ring() */
+    ring->capacity = params.cq_entries - 1;
+    return ring;
+}
+
+/* Queue one entry and hand it to the kernel; called with the context lock held.
+   An entry the kernel did not take is withdrawn, so false means it never runs */
+static bool ring_submit(AsyncRing* ring, uint8_t opcode, int fd, void* buffer, uint32_t size,
+                        uint64_t offset, AsyncJob* job) {
+    unsigned tail = *ring->sq_tail;
+    if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries) return false;
+
+    unsigned index = tail & ring->sq_mask;
+    io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buffer;
+    sqe->len = size;
+    sqe->off = offset;
+    sqe->user_data = (uint64_t)(uintptr_t)job;
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    long submitted;
+    do {
+        submitted = syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, NULL, 0);
+    } while (submitted < 0 && errno == EINTR);
+    if (submitted == 1) return true;
+
+    __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+    return false;
+}
+
+/* Queue the rest of an audio read; called with the context lock held */
+static bool ring_submit_read(AsyncRing* ring, AsyncJob* job) {
+    AsyncCompletion* completion = &job->completion;
+    size_t done = (size_t)completion->bytes;
+    size_t left = job->size - done;
+    uint32_t size = left < ASYNC_RING_MAX_READ ? (uint32_t)left : ASYNC_RING_MAX_READ;
+    return ring_submit(ring, IORING_OP_READ, completion->package->file.fd, completion->buffer + done,
+                       size, job->file_offset + done, job);
+}
+
+/* Queue a read now, or once a slot frees up; called with the context lock held */
+static void ring_queue_read(AsyncContext* context, AsyncJob* job) {
+    AsyncRing* ring = context->ring;
+    job->next = NULL;
+    if (ring->in_flight < ring->capacity && !ring->waiting) {
+        if (ring_submit_read(ring, job)) {
+            ring->in_flight++;
+        } else {
+            push_job(context, job);
+        }
+    } else if (ring->waiting) {
+        ring->waiting_tail->next = job;
+        ring->waiting_tail = job;
+    } else {
+        ring->waiting = ring->waiting_tail = job;
+    }
+}
+
+/* Account for one finished read; short reads continue until the range is done.
+   Jobs are only touched with the context lock held, which orders them after
+   the submitting thread's writes */
+static void ring_finish_read(AsyncContext* context, AsyncJob* job, int32_t result) {
+    AsyncRing* ring = context->ring;
+    AsyncCompletion* completion = &job->completion;
+    {
+        std::lock_guard<std::mutex> lock(context->lock);
+        if (result > 0) {
+            completion->bytes += result;
+            stat_add(STAT_BYTES_READ, (uint64_t)result);
+            if ((size_t)completion->bytes < job->size && ring_submit_read(ring, job)) return;
+        }
+
+        /* The slot goes to the oldest waiting read; a read the ring refuses goes to the workers */
+        ring->in_flight--;
+        while (ring->waiting && ring->in_flight < ring->capacity) {
+            AsyncJob* next = ring->waiting;
+            ring->waiting = next->next;
+            if (ring_submit_read(ring, next)) {
+                ring->in_flight++;
+            } else {
+                push_job(context, next);
+            }
+        }
+    }
+
+    /* End of file before the range was read means the chunk index no longer matches the file */
+    if ((size_t)completion->bytes < job->size) {
+        completion->bytes = -1;
+        completion->result = Error::IO;
+    }
+    async_complete(job);
+}
+
+static void ring_reaper(AsyncContext* context) {
+    AsyncRing* ring = context->ring;
+    bool stopping = false;
+    for (;;) {
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            if (stopping) {
+                std::lock_guard<std::mutex> lock(context->lock);
+                if (ring->in_flight == 0) break;
+            }
+            syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+            continue;
+        }
+
+        for (; head != tail; head++) {
+            const io_uring_cqe* cqe = &ring->cqes[head & ring->cq_mask];
+            AsyncJob* job = (AsyncJob*)(uintptr_t)cqe->user_data;
+            int32_t result = cqe->res;
+            __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+            if (job) {
+                ring_finish_read(context, job, result);
+            } else {
+                /* The wake-up from free_ring() */
+                stopping = true;
+                std::lock_guard<std::mutex> lock(context->lock);
+                ring->in_flight--;
+            }
+        }
+    }
+}
+
+/* Ring of the context, created on first use; called with the context lock held */
+static AsyncRing* context_ring(AsyncContext* context) {
+    if (context->ring || context->ring_failed) return context->ring;
+
+    AsyncRing* ring = open_ring();
+    if (ring) {
+        context->ring = ring;
+        try {
+            ring->reaper = std::thread(ring_reaper, context);
+        } catch (...) {
+            context->ring = NULL;
+            free_ring_maps(ring);
+        }
+    }
+    context->ring_failed = context->ring == NULL;
+    return context->ring;
+}
+
+/* Wait for the reads in flight, then release the ring */
+static void free_ring(AsyncContext* context) {
+    AsyncRing* ring = context->ring;
+    if (!ring) return;
+
+    {
+        std::unique_lock<std::mutex> lock(context->lock);
+        ring->in_flight++;
+        while (!ring_submit(ring, IORING_OP_NOP, -1, NULL, 0, 0, NULL)) {
+            lock.unlock();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            lock.lock();
+        }
+    }
+    ring->reaper.join();
+    free_ring_maps(ring);
+    context->ring = NULL;
+}
+#endif
+
+AsyncContext* dmusicpak::create_async_context(uint32_t threads) {
+    if (threads == 0) threads = DEFAULT_ASYNC_THREADS;
+    if (threads > MAX_ASYNC_THREADS) threads = MAX_ASYNC_THREADS;
+
+    AsyncContext* context = new (std::nothrow) AsyncContext();
+    if (!context) return NULL;
+    if (!open_notify(context)) {
+        delete context;
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < threads; i++) {
+        try {
+            context->workers[context->worker_count] = std::thread(async_worker, context);
+            context->worker_count++;
+        } catch (...) {
+            break;
+        }
+    }
+    if (context->worker_count == 0) {
+        close_notify(context);
+        delete context;
+        return NULL;
+    }
+    return context;
+}
+
+void dmusicpak::free_async_context(AsyncContext* context) {
+    if (!context) return;
+
+    {
+        std::lock_guard<std::mutex> lock(context->lock);
+        context->stop = true;
+        context->work.notify_all();
+    }
+#ifdef ASYNC_IO_URING
+    /* Before the workers, which take the reads the ring refuses */
+    free_ring(context);
+#endif
+    for (uint32_t i = 0; i < context->worker_count; i++) context->workers[i].join();
+#ifdef DMUSICPAK_ENABLE_NETWORK
+    free_async_transfers(context->transfers);
+#endif
+
+    /* Everything has finished; deliver what was not polled */
+    while (async_poll(context, 0) > 0) {}
+
+    close_notify(context);
+    delete context;
+}
+
+int dmusicpak::async_fd(const AsyncContext* context) {
+    return context ? context->notify_read : -1;
+}
+
+void* dmusicpak::async_event(const AsyncContext* context) {
+#ifdef _WIN32
+    return context ? context->notify_event : NULL;
+#else
+    (void)context;
+    return NULL;
+#endif
+}
+
+uint32_t dmusicpak::async_poll(AsyncContext* context, uint32_t timeout_ms) {
+    if (!context) return 0;
+
+    AsyncJob* jobs;
+    {
+        std::unique_lock<std::mutex> lock(context->lock);
+        if (!context->completed && context->pending > 0 && timeout_ms > 0) {
+            context->finished.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                                       [context]() { return context->completed != NULL; });
+        }
+
+        jobs = context->completed;
+        if (!jobs) return 0;
+        context->completed = NULL;
+        context->completed_tail = NULL;
+        clear_notify(context);
+    }
+
+    /* Callbacks run unlocked, so they may submit further operations */
+    uint32_t delivered = 0;
+    while (jobs) {
+        AsyncJob* job = jobs;
+        jobs = job->next;
+        job->callback(&job->completion);
+        free_job(job);
+        delivered++;
+
+        std::lock_guard<std::mutex> lock(context->lock);
+        context->pending--;
+    }
+    return delivered;
+}
+
+uint32_t dmusicpak::async_pending(AsyncContext* context) {
+    if (!context) return 0;
+
+    std::lock_guard<std::mutex> lock(context->lock);
+    return context->pending;
+}
+
+Error dmusicpak::load_async(AsyncContext* context, const char* filename, AsyncCallback callback, void* userdata) {
+    if (!context || !filename || !callback) return Error::INVALID_PARAM;
+
+    AsyncJob* job = create_job(context, AsyncOperation::LOAD, filename, callback, userdata);
+    if (!job) return Error::MEMORY_ALLOC;
+    return submit_job(context, job);
+}
+
+Error dmusicpak::save_async(AsyncContext* context, Package* package, const char* filename,
+                            AsyncCallback callback, void* userdata) {
+    if (!context || !package || !filename || !callback) return Error::INVALID_PARAM;
+
+    AsyncJob* job = create_job(context, AsyncOperation::SAVE, filename, callback, userdata);
+    if (!job) return Error::MEMORY_ALLOC;
+    job->completion.package = package;
+    return submit_job(context, job);
+}
+
+Error dmusicpak::read_audio_chunk_async(AsyncContext* context, Package* package, size_t offset, size_t size,
+                                        uint8_t* buffer, AsyncCallback callback, void* userdata) {
+    if (!context || !package || !buffer || !callback) return Error::INVALID_PARAM;
+
+    AsyncJob* job = create_job(context, AsyncOperation::READ_AUDIO, NULL, callback, userdata);
+    if (!job) return Error::MEMORY_ALLOC;
+    AsyncCompletion* completion = &job->completion;
+    completion->package = package;
+    completion->buffer = buffer;
+    job->offset = offset;
+    job->size = size;
+
+    /* Audio in memory (load(), load_mmap(), a loaded chunk) is copied now */
+    if (package->has_audio || !package->has_file) {
+        if (!accept_job(context)) {
+            free_job(job);
+            return Error::NOT_SUPPORTED;
+        }
+        completion->bytes = get_audio_chunk(package, offset, size, buffer);
+        completion->result = completion->bytes >= 0 ? Error::OK : Error::IO;
+        async_complete(job);
+        return Error::OK;
+    }
+
+#ifdef ASYNC_IO_URING
+    /* Uncompressed audio of a load_index() package is read straight into the buffer by the kernel */
+    uint64_t audio_offset, audio_size;
+    if (!package->source_ops && locate_audio(package, &audio_offset, &audio_size) == Error::OK &&
+        !package->audio_frames) {
+        if (offset >= audio_size) {
+            job->size = 0;
+        } else if (size > audio_size - offset) {
+            job->size = (size_t)(audio_size - offset);
+        }
+        job->file_offset = audio_offset + offset;
+
+        std::lock_guard<std::mutex> lock(context->lock);
+        if (context->stop) {
+            free_job(job);
+            return Error::NOT_SUPPORTED;
+        }
+        if (context_ring(context)) {
+            ring_queue_read(context, job);
+            context->pending++;
+            return Error::OK;
+        }
+        job->size = size;
+    }
+#endif
+
+    /* Compressed audio, other backing stores, and file reads without a ring */
+    return submit_job(context, job);
+}
+
+#ifdef DMUSICPAK_ENABLE_NETWORK
+Error dmusicpak::load_url_async(AsyncContext* context, const char* url, uint32_t timeout_ms,
+                                AsyncCallback callback, void* userdata) {
+    if (!context || !url || !callback) return Error::INVALID_PARAM;
+
+    AsyncJob* job = create_job(context, AsyncOperation::LOAD_URL, url, callback, userdata);
+    if (!job) return Error::MEMORY_ALLOC;
+    job->timeout_ms = timeout_ms;
+    return submit_job(context, job);
+}
+
+Error dmusicpak::get_audio_chunk_url_async(AsyncContext* context, Session* session, const char* url,
+                                           size_t offset, size_t size, uint8_t* buffer,
+                                           AsyncCallback callback, void* userdata) {
+    if (!context || !url || !buffer || size == 0 || !callback) return Error::INVALID_PARAM;
+
+    AsyncJob* job = create_job(context, AsyncOperation::READ_AUDIO_URL, url, callback, userdata);
+    if (!job) return Error::MEMORY_ALLOC;
+    job->session = session;
+    job->offset = offset;
+    job->size = size;
+    job->completion.buffer = buffer;
+    job->completion.bytes = -1;
+
+    AsyncTransfers* transfers;
+    {
+        std::lock_guard<std::mutex> lock(context->lock);
+        if (context->stop) {
+            free_job(job);
+            return Error::NOT_SUPPORTED;
+        }
+        if (!context->transfers) context->transfers = create_async_transfers();
+        transfers = context->transfers;
+        if (transfers) context->pending++;
+    }
+    if (!transfers) {
+        free_job(job);
+        return Error::NETWORK;
+    }
+    if (!submit_async_transfer(transfers, job)) {
+        free_job(job);
+        std::lock_guard<std::mutex> lock(context->lock);
+        context->pending--;
+        return Error::NETWORK;
+    }
+    return Error::OK;
+}
+#endif
@@ -0,0 +1,201 @@
+/**
+ * @file batch.cpp
+ * @brief Multi-threaded batch packing and loading for DMusicPak library
+ *
+ * Jobs are independent, so workers simply pull the next job index from a
+ * shared counter; a slow job never holds up the others and there is no
+ * per-thread queue to rebalance.
+ */
+
+#include "../include/dmusicpak/dmusicpak.h"
+#include "internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+using namespace dmusicpak;
+
+/* Upper bound on worker threads, whatever the caller asks for */
+#define MAX_BATCH_THREADS 64
+
+struct parallel_context_t {
+    std::atomic<size_t> next;
+    size_t count;
+    void (*fn)(size_t index, void* context);
+    void* context;
+};
+
+static void parallel_worker(parallel_context_t* ctx) {
+    for (;;) {
+        size_t index = ctx->next.fetch_add(1);
+        if (index >= ctx->count) break;
+        ctx->fn(index, ctx->context);
+    }
+}
+
+void dmusicpak::parallel_for(size_t count, unsigned threads,
+                             void (*fn)(size_t index, void* context), void* context) {
+    if (count == 0 || !fn) return;
+
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    if (threads > MAX_BATCH_THREADS) threads = MAX_BATCH_THREADS;
+    if (threads > count) threads = (unsigned)count;
+
+    parallel_context_t ctx;
+    ctx.next = 0;
+    ctx.count = count;
+    ctx.fn = fn;
+    ctx.context = context;
+
+    /* The calling thread is one of the workers */
+    std::thread workers[MAX_BATCH_THREADS];
+    unsigned started = 0;
+    for (unsigned i = 1; i < threads; i++) {
+        try {
+            workers[started] = std::thread(parallel_worker, &ctx);
+            started++;
+        } catch (...) {
+            break;  /* Fewer threads still finish every job */
+        }
+    }
+
+    parallel_worker(&ctx);
+
+    for (unsigned i = 0; i < started; i++) workers[i].join();
+}
+
+/* Shared state of one pack_batch()/load_batch() call */
+struct batch_t {
+    const PackJob* jobs;
+    const char* const* filenames;
+    Package** packages;
+    BatchCallback callback;
+    void* userdata;
+
+    std::mutex lock;              /* Guards the fields below (taken on failure only) */
+    size_t first_failed;
+    Error first_error;
+};
+
+static void finish_job(batch_t* batch, size_t index, Error result) {
+    if (result != Error::OK) {
+        std::lock_guard<std::mutex> guard(batch->lock);
+        if (index < batch->first_failed) {
+            batch->first_failed = index;
+            batch->first_error = result;
+        }
+    }
+
+    if (batch->callback) batch->callback(index, result, batch->userdata);
+}
+
+static Error pack_one(const PackJob* job) {
+    if (!job->filename) return Error::INVALID_PARAM;
+
+    Package* package = create();
+    if (!package) return Error::MEMORY_ALLOC;
+
+    /*
+     * save() only reads the chunk buffers, so the package borrows the
+     * job's data instead of copying it; the fields are cleared again
+     * before free().
+     */
+    uint8_t* audio_data = NULL;
+    Error result = Error::OK;
+
+    if (job->options) package->save_options = *job->options;
+    if (job->metadata) {
+        package->metadata = *job->metadata;
+        package->has_metadata = 1;
+    }
+    if (job->lyrics) {
+        package->lyrics = *job->lyrics;
+        package->has_lyrics = 1;
+    }
+    if (job->cover) {
+        package->cover = *job->cover;
+        package->has_cover = 1;
+    }
+    if (job->audio) {
+        package->audio = *job->audio;
+        package->has_audio = 1;
+    }
+    if (job->audio_file) {
+        size_t size = 0;
+        audio_data = read_file(job->audio_file, &size, &result);
+        if (audio_data) {
+            if (!job->audio) package->audio.format = AudioFormat::NONE;
+            package->audio.data = audio_data;
+            package->audio.size = size;
+            package->has_audio = 1;
+        }
+    }
+
+    if (result == Error::OK) result = save(package, job->filename);
+
+    memset(&package->metadata, 0, sizeof(Metadata));
+    memset(&package->lyrics, 0, sizeof(Lyrics));
+    memset(&package->audio, 0, sizeof(Audio));
+    memset(&package->cover, 0, sizeof(Cover));
+    dmusicpak::free(package);
+    mem_free(audio_data);
+
+    return result;
+}
+
+static void pack_task(size_t index, void* context) {
+    batch_t* batch = (batch_t*)context;
+    finish_job(batch, index, pack_one(&batch->jobs[index]));
+}
+
+static void load_task(size_t index, void* context) {
+    batch_t* batch = (batch_t*)context;
+    const char* filename = batch->filenames[index];
+
+    Error result = Error::INVALID_PARAM;
+    Package* package = filename ? load_file(filename, &result) : NULL;
+    if (package) result = Error::OK;
+
+    batch->packages[index] = package;
+    finish_job(batch, index, result);
+}
+
+static Error run_batch(batch_t* batch, size_t count, unsigned threads,
+                       void (*task)(size_t index, void* context)) {
+    batch->first_failed = count;
+    batch->first_error = Error::OK;
+
+    parallel_for(count, threads, task, batch);
+    return batch->first_error;
+}
+
+Error dmusicpak::pack_batch(const PackJob* jobs, size_t count, unsigned threads,
+                            BatchCallback callback, void* userdata) {
+    if (!jobs && count > 0) return Error::INVALID_PARAM;
+
+    batch_t batch;
+    batch.jobs = jobs;
+    batch.filenames = NULL;
+    batch.packages = NULL;
+    batch.callback = callback;
+    batch.userdata = userdata;
+
+    return run_batch(&batch, count, threads, pack_task);
+}
+
+Error dmusicpak::load_batch(const char* const* filenames, size_t count, unsigned threads,
+                            Package** packages, BatchCallback callback, void* userdata) {
+    if ((!filenames || !packages) && count > 0) return Error::INVALID_PARAM;
+
+    batch_t batch;
+    batch.jobs = NULL;
+    batch.filenames = filenames;
+    batch.packages = packages;
+    batch.callback = callback;
+    batch.userdata = userdata;
+
+    return run_batch(&batch, count, threads, load_task);
+}
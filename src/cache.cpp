@@ -0,0 +1,421 @@
+/**
+ * @file cache.cpp
+ * @brief Sharded LRU cache of shared packages for DMusicPak library
+ *
+ * Keys (file name or URL plus level) hash to one of a power-of-two number
+ * of shards, each with its own lock, hash table and one LRU list per
+ * level, so lookups of different keys rarely contend. Packages are loaded
+ * and entries released outside the shard lock; two threads missing the
+ * same key at once may both load it, and the second keeps the first's
+ * entry.
+ */
+
+#include "../include/dmusicpak/dmusicpak.h"
+#include "internal.h"
+#include <stdio.h>
+#include <string.h>
+#include <mutex>
+#include <new>
+
+using namespace dmusicpak;
+
+#define CACHE_LEVELS 3
+#define DEFAULT_CACHE_SHARDS 16
+#define MAX_CACHE_SHARDS 1024
+#define INITIAL_CACHE_BUCKETS 16
+#define MAX_VALIDATOR_SIZE 128
+
+static const uint64_t DEFAULT_CACHE_BUDGETS[CACHE_LEVELS] = {
+    16ULL * 1024 * 1024,   /* METADATA */
+    64ULL * 1024 * 1024,   /* COVER */
+    256ULL * 1024 * 1024   /* AUDIO */
+};
+
+/* One cached package */
+struct CacheEntry {
+    char* key;                 /* File name or URL */
+    uint32_t hash;
+    int level;
+    char validator[MAX_VALIDATOR_SIZE]; /* Version the package was loaded from */
+    Package* package;          /* The cache's reference */
+    uint64_t bytes;
+    CacheEntry* bucket_next;   /* Also links entries waiting to be released */
+    CacheEntry* lru_prev;      /* More recently used */
+    CacheEntry* lru_next;      /* Less recently used */
+};
+
+/* Entries of one level, most recently used first */
+struct LruList {
+    CacheEntry* head;
+    CacheEntry* tail;
+    uint64_t bytes;
+};
+
+struct CacheShard {
+    std::mutex lock;
+    CacheEntry** buckets;
+    uint32_t bucket_count;     /* Power of two */
+    uint32_t entries;
+    LruList lists[CACHE_LEVELS];
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+};
+
+struct dmusicpak::Cache {
+    CacheShard* shards;
+    uint32_t shard_count;      /* Power of two */
+    uint32_t shard_bits;
+    uint64_t budgets[CACHE_LEVELS]; /* Per shard */
+};
+
+/* Loads and shares the package for a key; NULL on failure */
+typedef Package* (*CacheLoader)(const char* key, CacheLevel level, void* context);
+
+/* FNV-1a over the key, mixed with the level */
+static uint32_t hash_key(const char* key, int level) {
+    uint32_t hash = 2166136261u;
+    for (const uint8_t* p = (const uint8_t*)key; *p; p++) {
+        hash = (hash ^ *p) * 16777619u;
+    }
+    return (hash ^ (uint32_t)level) * 16777619u;
+}
+
+/* Approximate memory held by a shared package */
+static uint64_t package_footprint(const Package* package) {
+    uint64_t bytes = sizeof(Package) + (uint64_t)package->num_chunks * sizeof(ChunkEntry);
+
+    const char* strings[] = {
+        package->metadata.title, package->metadata.artist, package->metadata.album,
+        package->metadata.genre, package->metadata.year, package->metadata.comment
+    };
+    for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+        if (strings[i]) bytes += strlen(strings[i]) + 1;
+    }
+
+    if (package->has_lyrics) bytes += package->lyrics.size;
+    if (package->mapping.data) {
+        /* Mapped payloads point into the mapping */
+        bytes += package->mapping.size;
+    } else {
+        if (package->has_audio) bytes += package->audio.size;
+        if (package->has_cover) bytes += package->cover.size;
+        if (package->has_thumbnails) bytes += package->thumbnails_size;
+    }
+    if (package->seek_table) {
+        bytes += (uint64_t)package->seek_table->count * (sizeof(uint32_t) + sizeof(uint64_t));
+    }
+    if (package->audio_frames) {
+        bytes += ((uint64_t)package->audio_frames->header.frame_count + 1) * sizeof(uint64_t);
+    }
+    return bytes;
+}
+
+static CacheShard* shard_for(Cache* cache, uint32_t hash) {
+    return &cache->shards[hash & (cache->shard_count - 1)];
+}
+
+static uint32_t bucket_for(const Cache* cache, const CacheShard* shard, uint32_t hash) {
+    return (hash >> cache->shard_bits) & (shard->bucket_count - 1);
+}
+
+static CacheEntry* find_entry(const Cache* cache, CacheShard* shard, const char* key, int level, uint32_t hash) {
+    for (CacheEntry* entry = shard->buckets[bucket_for(cache, shard, hash)]; entry; entry = entry->bucket_next) {
+        if (entry->hash == hash && entry->level == level && strcmp(entry->key, key) == 0) return entry;
+    }
+    return NULL;
+}
+
+static void lru_unlink(LruList* list, CacheEntry* entry) {
+    if (entry->lru_prev) entry->lru_prev->lru_next = entry->lru_next; else list->head = entry->lru_next;
+    if (entry->lru_next) entry->lru_next->lru_prev = entry->lru_prev; else list->tail = entry->lru_prev;
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+}
+
+static void lru_push_front(LruList* list, CacheEntry* entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = list->head;
+    if (list->head) list->head->lru_prev = entry; else list->tail = entry;
+    list->head = entry;
+}
+
+/* Take an entry out of its shard and queue it on 'released' */
+static void detach_entry(const Cache* cache, CacheShard* shard, CacheEntry* entry, CacheEntry** released) {
+    for (CacheEntry** link = &shard->buckets[bucket_for(cache, shard, entry->hash)]; *link;
+         link = &(*link)->bucket_next) {
+        if (*link == entry) {
+            *link = entry->bucket_next;
+            break;
+        }
+    }
+
+    LruList* list = &shard->lists[entry->level];
+    lru_unlink(list, entry);
+    list->bytes -= entry->bytes;
+    shard->entries--;
+
+    entry->bucket_next = *released;
+    *released = entry;
+}
+
+/* Drop the cache's references; called without the shard lock */
+static void release_entries(CacheEntry* entry) {
+    while (entry) {
+        CacheEntry* next = entry->bucket_next;
+        dmusicpak::free(entry->package);
+        mem_free(entry->key);
+        mem_free(entry);
+        entry = next;
+    }
+}
+
+/* Double the bucket array; the shard keeps its old one if that fails */
+static void grow_buckets(const Cache* cache, CacheShard* shard) {
+    uint32_t count = shard->bucket_count * 2;
+    CacheEntry** buckets = (CacheEntry**)mem_calloc(count, sizeof(CacheEntry*));
+    if (!buckets) return;
+
+    CacheEntry** old = shard->buckets;
+    uint32_t old_count = shard->bucket_count;
+    shard->buckets = buckets;
+    shard->bucket_count = count;
+    for (uint32_t i = 0; i < old_count; i++) {
+        CacheEntry* entry = old[i];
+        while (entry) {
+            CacheEntry* next = entry->bucket_next;
+            uint32_t bucket = bucket_for(cache, shard, entry->hash);
+            entry->bucket_next = buckets[bucket];
+            buckets[bucket] = entry;
+            entry = next;
+        }
+    }
+    mem_free(old);
+}
+
+/* Cache a freshly loaded package, evicting from the tail of its level's list.
+   Returns the entry's package, which is another thread's when it got there first */
+static Package* insert_entry(Cache* cache, const char* key, int level, uint32_t hash,
+                             const char* validator, Package* package) {
+    uint64_t bytes = package_footprint(package);
+    if (bytes > cache->budgets[level]) return package;
+
+    size_t key_length = strlen(key);
+    CacheEntry* entry = (CacheEntry*)mem_calloc(1, sizeof(CacheEntry));
+    if (entry) entry->key = (char*)mem_malloc(key_length + 1);
+    if (!entry || !entry->key) {
+        mem_free(entry);
+        return package;
+    }
+    memcpy(entry->key, key, key_length + 1);
+    entry->hash = hash;
+    entry->level = level;
+    snprintf(entry->validator, sizeof(entry->validator), "%s", validator);
+    entry->package = retain(package);
+    entry->bytes = bytes;
+
+    CacheShard* shard = shard_for(cache, hash);
+    CacheEntry* released = NULL;
+    Package* result = package;
+    {
+        std::lock_guard<std::mutex> lock(shard->lock);
+
+        CacheEntry* existing = find_entry(cache, shard, key, level, hash);
+        if (existing && strcmp(existing->validator, validator) == 0) {
+            /* Lost the race: hand out the cached package and drop ours */
+            result = retain(existing->package);
+            entry->bucket_next = released;
+            released = entry;
+        } else {
+            if (existing) detach_entry(cache, shard, existing, &released);
+
+            LruList* list = &shard->lists[level];
+            while (list->tail && list->bytes + bytes > cache->budgets[level]) {
+                detach_entry(cache, shard, list->tail, &released);
+                shard->evictions++;
+            }
+
+            if (shard->entries >= shard->bucket_count) grow_buckets(cache, shard);
+            uint32_t bucket = bucket_for(cache, shard, hash);
+            entry->bucket_next = shard->buckets[bucket];
+            shard->buckets[bucket] = entry;
+            lru_push_front(list, entry);
+            list->bytes += bytes;
+            shard->entries++;
+        }
+    }
+
+    release_entries(released);
+    if (result != package) dmusicpak::free(package);
+    return result;
+}
+
+/* Look up a key at a version, loading it on a miss; an empty validator is never cached */
+static Package* cache_get(Cache* cache, const char* key, CacheLevel level, const char* validator,
+                          CacheLoader loader, void* context) {
+    int index = (int)level;
+    uint32_t hash = hash_key(key, index);
+    CacheShard* shard = shard_for(cache, hash);
+    CacheEntry* released = NULL;
+    {
+        std::lock_guard<std::mutex> lock(shard->lock);
+
+        CacheEntry* entry = find_entry(cache, shard, key, index, hash);
+        if (entry && validator[0] && strcmp(entry->validator, validator) == 0) {
+            LruList* list = &shard->lists[index];
+            lru_unlink(list, entry);
+            lru_push_front(list, entry);
+            shard->hits++;
+            return retain(entry->package);
+        }
+
+        /* Stale: the file or resource has changed since it was cached */
+        if (entry) detach_entry(cache, shard, entry, &released);
+        shard->misses++;
+    }
+    release_entries(released);
+
+    Package* package = loader(key, level, context);
+    if (!package || !validator[0]) return package;
+    return insert_entry(cache, key, index, hash, validator, package);
+}
+
+Cache* dmusicpak::create_cache(const CacheOptions* options) {
+    uint32_t requested = options && options->shards > 0 ? options->shards : DEFAULT_CACHE_SHARDS;
+    if (requested > MAX_CACHE_SHARDS) requested = MAX_CACHE_SHARDS;
+
+    Cache* cache = new (std::nothrow) Cache();
+    if (!cache) return NULL;
+
+    cache->shard_count = 1;
+    while (cache->shard_count < requested) {
+        cache->shard_count <<= 1;
+        cache->shard_bits++;
+    }
+
+    const uint64_t budgets[CACHE_LEVELS] = {
+        options ? options->metadata_bytes : 0,
+        options ? options->cover_bytes : 0,
+        options ? options->audio_bytes : 0
+    };
+    for (int i = 0; i < CACHE_LEVELS; i++) {
+        uint64_t total = budgets[i] > 0 ? budgets[i] : DEFAULT_CACHE_BUDGETS[i];
+        cache->budgets[i] = total / cache->shard_count;
+    }
+
+    cache->shards = new (std::nothrow) CacheShard[cache->shard_count]();
+    if (!cache->shards) {
+        delete cache;
+        return NULL;
+    }
+    for (uint32_t i = 0; i < cache->shard_count; i++) {
+        CacheShard* shard = &cache->shards[i];
+        shard->buckets = (CacheEntry**)mem_calloc(INITIAL_CACHE_BUCKETS, sizeof(CacheEntry*));
+        if (!shard->buckets) {
+            free_cache(cache);
+            return NULL;
+        }
+        shard->bucket_count = INITIAL_CACHE_BUCKETS;
+    }
+    return cache;
+}
+
+void dmusicpak::cache_clear(Cache* cache) {
+    if (!cache) return;
+
+    for (uint32_t i = 0; i < cache->shard_count; i++) {
+        CacheShard* shard = &cache->shards[i];
+        CacheEntry* released = NULL;
+        {
+            std::lock_guard<std::mutex> lock(shard->lock);
+            for (int level = 0; level < CACHE_LEVELS; level++) {
+                while (shard->lists[level].head) detach_entry(cache, shard, shard->lists[level].head, &released);
+            }
+        }
+        release_entries(released);
+    }
+}
+
+void dmusicpak::free_cache(Cache* cache) {
+    if (!cache) return;
+
+    cache_clear(cache);
+    for (uint32_t i = 0; i < cache->shard_count; i++) mem_free(cache->shards[i].buckets);
+    delete[] cache->shards;
+    delete cache;
+}
+
+Error dmusicpak::cache_get_stats(Cache* cache, CacheStats* stats) {
+    if (!cache || !stats) return Error::INVALID_PARAM;
+
+    memset(stats, 0, sizeof(CacheStats));
+    for (uint32_t i = 0; i < cache->shard_count; i++) {
+        CacheShard* shard = &cache->shards[i];
+        std::lock_guard<std::mutex> lock(shard->lock);
+        stats->hits += shard->hits;
+        stats->misses += shard->misses;
+        stats->evictions += shard->evictions;
+        stats->entries += shard->entries;
+        stats->metadata_bytes += shard->lists[(int)CacheLevel::METADATA].bytes;
+        stats->cover_bytes += shard->lists[(int)CacheLevel::COVER].bytes;
+        stats->audio_bytes += shard->lists[(int)CacheLevel::AUDIO].bytes;
+    }
+    return Error::OK;
+}
+
+static Package* load_cached_file(const char* filename, CacheLevel level, void* context) {
+    (void)context;
+
+    Package* package = NULL;
+    if (level == CacheLevel::AUDIO) {
+        /* Packages that cannot be mapped are decoded whole */
+        package = load_mmap(filename);
+        if (!package) package = load(filename);
+    } else {
+        package = load_index(filename);
+    }
+
+    if (package && share_package(package, level != CacheLevel::METADATA) != Error::OK) {
+        dmusicpak::free(package);
+        return NULL;
+    }
+    return package;
+}
+
+Package* dmusicpak::cache_load(Cache* cache, const char* filename, CacheLevel level) {
+    if (!cache || !filename || (int)level < 0 || (int)level >= CACHE_LEVELS) return NULL;
+
+    /* Stat first: a file replaced during the load is reloaded next time */
+    uint64_t size, mtime_ns;
+    if (!file_stat(filename, &size, &mtime_ns)) return NULL;
+
+    char validator[MAX_VALIDATOR_SIZE];
+    snprintf(validator, sizeof(validator), "%llu:%llu", (unsigned long long)size, (unsigned long long)mtime_ns);
+    return cache_get(cache, filename, level, validator, load_cached_file, NULL);
+}
+
+#ifdef DMUSICPAK_ENABLE_NETWORK
+static Package* load_cached_url(const char* url, CacheLevel level, void* context) {
+    Package* package = load_url_index(url, (Session*)context);
+    if (!package) return NULL;
+
+    Error result = Error::OK;
+    if (level == CacheLevel::AUDIO && find_chunk(package, CHUNK_AUDIO)) {
+        result = load_chunk(package, ChunkType::AUDIO);
+    }
+    if (result == Error::OK) result = share_package(package, level != CacheLevel::METADATA);
+    if (result != Error::OK) {
+        dmusicpak::free(package);
+        return NULL;
+    }
+    return package;
+}
+
+Package* dmusicpak::cache_load_url(Cache* cache, const char* url, CacheLevel level, Session* session) {
+    if (!cache || !url || (int)level < 0 || (int)level >= CACHE_LEVELS) return NULL;
+
+    char validator[MAX_VALIDATOR_SIZE];
+    if (!url_validator(session, url, validator, sizeof(validator))) return NULL;
+    return cache_get(cache, url, level, validator, load_cached_url, session);
+}
+#endif /* DMUSICPAK_ENABLE_NETWORK */
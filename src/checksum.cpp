@@ -0,0 +1,380 @@
+/**
+ * @file checksum.cpp
+ * @brief CRC32C (Castagnoli) for chunk integrity checks
+ *
+ * Uses the SSE4.2 or ARMv8 CRC32 instructions when the CPU has them and
+ * falls back to slicing-by-8 tables otherwise. The instruction is chosen
+ * once, on first use. Large buffers are split into three lanes hashed in
+ * parallel, which hides the instruction's latency, and the lane CRCs are
+ * joined with zero-shift tables (after Mark Adler's crc32c.c).
+ */
+
+#include "internal.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CRC32C_X86 1
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define CRC32C_ARM64 1
+#if defined(__ARM_FEATURE_CRC32) || defined(_M_ARM64)
+#define CRC32C_ARM64_ALWAYS 1
+#elif defined(__linux__) && (defined(__GNUC__) || defined(__clang__))
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#else
+#undef CRC32C_ARM64  /* No way to detect the extension; tables only */
+#endif
+#if defined(CRC32C_ARM64) && defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(CRC32C_ARM64)
+#include <arm_acle.h>
+#endif
+#endif
+
+using namespace dmusicpak;
+
+#define CRC32C_POLY 0x82F63B78u  /* Reflected Castagnoli polynomial */
+
+/* Slicing-by-8 lookup tables */
+struct crc_tables_t {
+    uint32_t table[8][256];
+
+    crc_tables_t() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (CRC32C_POLY & (0u - (crc & 1)));
+            table[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int k = 1; k < 8; k++) table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+        }
+    }
+};
+
+static uint32_t crc32c_soft(uint32_t crc, const uint8_t* data, size_t size) {
+    static const crc_tables_t tables;
+    const uint32_t (*t)[256] = tables.table;
+
+    while (size > 0 && ((uintptr_t)data & 7) != 0) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF];
+        size--;
+    }
+    while (size >= 8) {
+        uint32_t lo = crc ^ read_uint32_le(data);
+        uint32_t hi = read_uint32_le(data + 4);
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+        data += 8;
+        size -= 8;
+    }
+    while (size > 0) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF];
+        size--;
+    }
+    return crc;
+}
+
+#if (defined(CRC32C_X86) && (defined(__x86_64__) || defined(_M_X64))) || defined(CRC32C_ARM64)
+
+/* Lane sizes for the interleaved hardware loop (powers of two) */
+#define CRC32C_LONG  8192
+#define CRC32C_SHORT 256
+
+static uint32_t gf2_matrix_times(const uint32_t* mat, uint32_t vec) {
+    uint32_t sum = 0;
+    while (vec) {
+        if (vec & 1) sum ^= *mat;
+        vec >>= 1;
+        mat++;
+    }
+    return sum;
+}
+
+static void gf2_matrix_square(uint32_t* square, const uint32_t* mat) {
+    for (int n = 0; n < 32; n++) square[n] = gf2_matrix_times(mat, mat[n]);
+}
+
+/* Tables that advance a CRC register over len zero bytes */
+struct crc_shift_t {
+    uint32_t table[4][256];
+
+    explicit crc_shift_t(size_t len) {
+        /* Operator for one zero bit, squared up to len bytes */
+        uint32_t even[32], odd[32];
+        odd[0] = CRC32C_POLY;
+        for (int n = 1; n < 32; n++) odd[n] = 1u << (n - 1);
+        gf2_matrix_square(even, odd);  /* 2 bits */
+        gf2_matrix_square(odd, even);  /* 4 bits */
+        const uint32_t* op = odd;
+        for (;;) {
+            gf2_matrix_square(even, odd);
+            op = even;
+            len >>= 1;
+            if (len == 0) break;
+            gf2_matrix_square(odd, even);
+            op = odd;
+            len >>= 1;
+            if (len == 0) break;
+        }
+
+        for (uint32_t n = 0; n < 256; n++) {
+            table[0][n] = gf2_matrix_times(op, n);
+            table[1][n] = gf2_matrix_times(op, n << 8);
+            table[2][n] = gf2_matrix_times(op, n << 16);
+            table[3][n] = gf2_matrix_times(op, n << 24);
+        }
+    }
+
+    uint32_t apply(uint32_t crc) const {
+        return table[0][crc & 0xFF] ^ table[1][(crc >> 8) & 0xFF] ^
+               table[2][(crc >> 16) & 0xFF] ^ table[3][crc >> 24];
+    }
+};
+
+#endif
+
+#if defined(CRC32C_X86)
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("sse4.2")))
+#endif
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t* data, size_t size) {
+    while (size > 0 && ((uintptr_t)data & 7) != 0) {
+        crc = _mm_crc32_u8(crc, *data++);
+        size--;
+    }
+#if defined(__x86_64__) || defined(_M_X64)
+    static const crc_shift_t shift_long(CRC32C_LONG);
+    static const crc_shift_t shift_short(CRC32C_SHORT);
+    const size_t lanes[2] = { CRC32C_LONG, CRC32C_SHORT };
+    const crc_shift_t* shifts[2] = { &shift_long, &shift_short };
+
+    uint64_t crc64 = crc;
+    for (int i = 0; i < 2; i++) {
+        size_t lane = lanes[i];
+        while (size >= 3 * lane) {
+            uint64_t crc1 = 0, crc2 = 0;
+            const uint8_t* end = data + lane;
+            do {
+                uint64_t w0, w1, w2;
+                memcpy(&w0, data, 8);
+                memcpy(&w1, data + lane, 8);
+                memcpy(&w2, data + 2 * lane, 8);
+                crc64 = _mm_crc32_u64(crc64, w0);
+                crc1 = _mm_crc32_u64(crc1, w1);
+                crc2 = _mm_crc32_u64(crc2, w2);
+                data += 8;
+            } while (data < end);
+            crc64 = shifts[i]->apply((uint32_t)crc64) ^ (uint32_t)crc1;
+            crc64 = shifts[i]->apply((uint32_t)crc64) ^ (uint32_t)crc2;
+            data += 2 * lane;
+            size -= 3 * lane;
+        }
+    }
+
+    while (size >= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        size -= 8;
+    }
+    crc = (uint32_t)crc64;
+#endif
+    while (size >= 4) {
+        uint32_t word;
+        memcpy(&word, data, 4);
+        crc = _mm_crc32_u32(crc, word);
+        data += 4;
+        size -= 4;
+    }
+    while (size > 0) {
+        crc = _mm_crc32_u8(crc, *data++);
+        size--;
+    }
+    return crc;
+}
+
+static bool have_crc32c_hw() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    return __builtin_cpu_supports("sse4.2") != 0;
+#endif
+}
+
+#elif defined(CRC32C_ARM64)
+
+#if !defined(CRC32C_ARM64_ALWAYS)
+__attribute__((target("+crc")))
+#endif
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t* data, size_t size) {
+    while (size > 0 && ((uintptr_t)data & 7) != 0) {
+        crc = __crc32cb(crc, *data++);
+        size--;
+    }
+
+    static const crc_shift_t shift_long(CRC32C_LONG);
+    static const crc_shift_t shift_short(CRC32C_SHORT);
+    const size_t lanes[2] = { CRC32C_LONG, CRC32C_SHORT };
+    const crc_shift_t* shifts[2] = { &shift_long, &shift_short };
+    for (int i = 0; i < 2; i++) {
+        size_t lane = lanes[i];
+        while (size >= 3 * lane) {
+            uint32_t crc1 = 0, crc2 = 0;
+            const uint8_t* end = data + lane;
+            do {
+                uint64_t w0, w1, w2;
+                memcpy(&w0, data, 8);
+                memcpy(&w1, data + lane, 8);
+                memcpy(&w2, data + 2 * lane, 8);
+                crc = __crc32cd(crc, w0);
+                crc1 = __crc32cd(crc1, w1);
+                crc2 = __crc32cd(crc2, w2);
+                data += 8;
+            } while (data < end);
+            crc = shifts[i]->apply(crc) ^ crc1;
+            crc = shifts[i]->apply(crc) ^ crc2;
+            data += 2 * lane;
+            size -= 3 * lane;
+        }
+    }
+
+    while (size >= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        crc = __crc32cd(crc, word);
+        data += 8;
+        size -= 8;
+    }
+    while (size > 0) {
+        crc = __crc32cb(crc, *data++);
+        size--;
+    }
+    return crc;
+}
+
+static bool have_crc32c_hw() {
+#if defined(CRC32C_ARM64_ALWAYS)
+    return true;
+#else
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#endif
+}
+
+#endif
+
+typedef uint32_t (*crc_fn_t)(uint32_t crc, const uint8_t* data, size_t size);
+
+static crc_fn_t select_crc32c() {
+#if defined(CRC32C_X86) || defined(CRC32C_ARM64)
+    if (have_crc32c_hw()) return crc32c_hw;
+#endif
+    return crc32c_soft;
+}
+
+uint32_t dmusicpak::crc32c(uint32_t crc, const void* data, size_t size) {
+    static const crc_fn_t update = select_crc32c();
+    if (size == 0) return crc;
+    return ~update(~crc, (const uint8_t*)data, size);
+}
+
+bool dmusicpak::read_checksum_chunk(const uint8_t* chunk, uint64_t size, ChecksumTable* table) {
+    memset(table, 0, sizeof(ChecksumTable));
+    if (size < 8) return false;
+
+    uint32_t algorithm = read_uint32_le(chunk);
+    uint32_t count = read_uint32_le(chunk + 4);
+    if ((uint64_t)count * CHECKSUM_ENTRY_SIZE > size - 8) return false;
+
+    /* Checksums from a newer algorithm cannot be checked; treat them as absent */
+    if (algorithm != CHECKSUM_CRC32C) return true;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t* entry = chunk + 8 + (size_t)i * CHECKSUM_ENTRY_SIZE;
+        uint8_t type = entry[0];
+        if (type >= MAX_CHECKSUM_TYPES || (table->mask & (1u << type))) continue;
+
+        table->mask |= 1u << type;
+        table->checksum[type] = read_uint32_le(entry + 1);
+    }
+    return true;
+}
+
+bool dmusicpak::has_checksum(const ChecksumTable* table, uint8_t type) {
+    return type < MAX_CHECKSUM_TYPES && (table->mask & (1u << type)) != 0;
+}
+
+bool dmusicpak::adopt_checksums(Package* package, const uint8_t* chunk, uint64_t size) {
+    if (!read_checksum_chunk(chunk, size, &package->checksums)) return false;
+
+    /* Saving the package again keeps it checksummed */
+    if (package->checksums.mask) package->save_options.checksums = 1;
+    return true;
+}
+
+Error dmusicpak::check_checksums(const Package* package, const uint8_t* data, uint32_t hashed) {
+    for (uint8_t type = 0; type < MAX_CHECKSUM_TYPES; type++) {
+        if (!has_checksum(&package->checksums, type)) continue;
+
+        const ChunkEntry* entry = find_chunk(package, type);
+        if (!entry) return Error::CORRUPTED;
+        if (!(hashed & (1u << type)) && crc32c(0, data + entry->offset, (size_t)entry->size) != package->checksums.checksum[type]) {
+            return Error::CORRUPTED;
+        }
+    }
+    return Error::OK;
+}
+
+/* Check a package in memory; album tracks (never nested) are checked against their own checksums */
+static Error verify_package(const uint8_t* data, size_t size, bool tracks) {
+    /* Only the chunk index is built; with the whole package as the head, nothing is read or copied */
+    Package* package = create();
+    if (!package) return Error::MEMORY_ALLOC;
+
+    Error result = Error::INVALID_FORMAT;
+    if (index_package(package, size, data, size)) {
+        bool checked = package->checksums.mask != 0;
+        result = checked ? check_checksums(package, data, 0) : Error::OK;
+
+        for (uint32_t i = 0; tracks && result == Error::OK && i < package->num_chunks; i++) {
+            const ChunkEntry* entry = &package->chunks[i];
+            if (entry->type != CHUNK_TRACK || entry->compressed) continue;
+
+            Error track = verify_package(data + entry->offset, (size_t)entry->size, false);
+            if (track == Error::OK) {
+                checked = true;
+            } else if (track != Error::NOT_SUPPORTED) {
+                result = track;
+            }
+        }
+        if (result == Error::OK && !checked) result = Error::NOT_SUPPORTED;
+    }
+
+    dmusicpak::free(package);
+    return result;
+}
+
+Error dmusicpak::verify_memory(const uint8_t* data, size_t size) {
+    if (!data) return Error::INVALID_PARAM;
+    return verify_package(data, size, true);
+}
+
+Error dmusicpak::verify(const char* filename) {
+    if (!filename) return Error::INVALID_PARAM;
+
+    MappedFile mapping;
+    if (!map_file(filename, &mapping)) return Error::FILE_NOT_FOUND;
+
+    Error result = verify_memory(mapping.data, mapping.size);
+    unmap_file(&mapping);
+    return result;
+}
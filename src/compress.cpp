@@ -0,0 +1,183 @@
+/**
+ * @file compress.cpp
+ * @brief Per-chunk compression for DMusicPak library
+ *
+ * A compressed chunk stores its data as independent frames of a fixed
+ * uncompressed size, preceded by a table of compressed frame sizes, so a
+ * reader can decode any byte range by decoding only the frames it covers.
+ * Without ENABLE_COMPRESSION every function reports failure and such
+ * chunks are skipped like unknown ones.
+ */
+
+#include "internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef DMUSICPAK_ENABLE_COMPRESSION
+#include <zstd.h>
+#endif
+
+using namespace dmusicpak;
+
+bool dmusicpak::read_frame_header(const uint8_t* chunk, uint64_t size, FrameHeader* header) {
+    if (size < COMPRESSION_HEADER_SIZE) return false;
+
+    header->codec = read_uint32_le(chunk);
+    header->raw_size = read_uint64_le(chunk + 4);
+    header->frame_size = read_uint32_le(chunk + 12);
+    header->frame_count = read_uint32_le(chunk + 16);
+
+    /* Frame count must match the sizes, and the table must fit the chunk */
+    if (header->frame_size == 0 || header->frame_size > MAX_COMPRESSION_FRAME_SIZE) return false;
+    uint64_t frames = (header->raw_size + header->frame_size - 1) / header->frame_size;
+    if (frames != header->frame_count) return false;
+    return (uint64_t)header->frame_count * 4 <= size - COMPRESSION_HEADER_SIZE;
+}
+
+uint64_t dmusicpak::frame_raw_size(const FrameHeader* header, uint32_t frame) {
+    uint64_t start = (uint64_t)frame * header->frame_size;
+    uint64_t left = header->raw_size - start;
+    return left < header->frame_size ? left : header->frame_size;
+}
+
+#ifdef DMUSICPAK_ENABLE_COMPRESSION
+
+bool dmusicpak::compression_available(Compression codec) {
+    return codec == Compression::ZSTD;
+}
+
+bool dmusicpak::decode_frame(uint32_t codec, const uint8_t* src, size_t src_size,
+                             uint8_t* dst, size_t dst_size) {
+    if (codec != (uint32_t)Compression::ZSTD) return false;
+
+    size_t result = ZSTD_decompress(dst, dst_size, src, src_size);
+    return !ZSTD_isError(result) && result == dst_size;
+}
+
+bool dmusicpak::encode_chunk(Compression codec, int level,
+                             const uint8_t* head, size_t head_size,
+                             const uint8_t* body, size_t body_size,
+                             uint8_t** out, size_t* out_size) {
+    if (codec != Compression::ZSTD) return false;
+
+    uint64_t raw_size = (uint64_t)head_size + body_size;
+    uint32_t frame_size = COMPRESSION_FRAME_SIZE;
+    uint64_t frame_count64 = (raw_size + frame_size - 1) / frame_size;
+    if (frame_count64 > 0xFFFFFFFFu) return false;
+    uint32_t frame_count = (uint32_t)frame_count64;
+
+    /* Worst case: every frame at its compress bound */
+    size_t table_size = COMPRESSION_HEADER_SIZE + (size_t)frame_count * 4;
+    if (frame_count > ((size_t)-1 - table_size) / ZSTD_compressBound(frame_size)) return false;
+    size_t capacity = table_size + (size_t)frame_count * ZSTD_compressBound(frame_size);
+    uint8_t* buffer = (uint8_t*)mem_malloc(capacity);
+    ZSTD_CCtx* cctx = ZSTD_createCCtx();
+    uint8_t* staging = NULL;  /* Frames that straddle head and body */
+    if (!buffer || !cctx) {
+        mem_free(buffer);
+        ZSTD_freeCCtx(cctx);
+        return false;
+    }
+
+    write_uint32_le(buffer, (uint32_t)codec);
+    write_uint64_le(buffer + 4, raw_size);
+    write_uint32_le(buffer + 12, frame_size);
+    write_uint32_le(buffer + 16, frame_count);
+
+    FrameHeader header;
+    header.raw_size = raw_size;
+    header.frame_size = frame_size;
+
+    bool ok = true;
+    size_t offset = table_size;
+    for (uint32_t i = 0; i < frame_count && ok; i++) {
+        uint64_t start = (uint64_t)i * frame_size;
+        size_t size = (size_t)frame_raw_size(&header, i);
+
+        const uint8_t* src;
+        if (start >= head_size) {
+            src = body + (start - head_size);
+        } else if (start + size <= head_size) {
+            src = head + start;
+        } else {
+            if (!staging) staging = (uint8_t*)mem_malloc(frame_size);
+            if (!staging) {
+                ok = false;
+                break;
+            }
+            size_t from_head = head_size - (size_t)start;
+            memcpy(staging, head + start, from_head);
+            memcpy(staging + from_head, body, size - from_head);
+            src = staging;
+        }
+
+        size_t written = ZSTD_compressCCtx(cctx, buffer + offset, capacity - offset, src, size, level);
+        if (ZSTD_isError(written)) {
+            ok = false;
+        } else {
+            write_uint32_le(buffer + COMPRESSION_HEADER_SIZE + (size_t)i * 4, (uint32_t)written);
+            offset += written;
+        }
+    }
+
+    mem_free(staging);
+    ZSTD_freeCCtx(cctx);
+    if (!ok) {
+        mem_free(buffer);
+        return false;
+    }
+
+    uint8_t* shrunk = (uint8_t*)mem_realloc(buffer, offset);
+    *out = shrunk ? shrunk : buffer;
+    *out_size = offset;
+    return true;
+}
+
+#else
+
+bool dmusicpak::compression_available(Compression codec) {
+    (void)codec;
+    return false;
+}
+
+bool dmusicpak::decode_frame(uint32_t codec, const uint8_t* src, size_t src_size,
+                             uint8_t* dst, size_t dst_size) {
+    (void)codec; (void)src; (void)src_size; (void)dst; (void)dst_size;
+    return false;
+}
+
+bool dmusicpak::encode_chunk(Compression codec, int level,
+                             const uint8_t* head, size_t head_size,
+                             const uint8_t* body, size_t body_size,
+                             uint8_t** out, size_t* out_size) {
+    (void)codec; (void)level; (void)head; (void)head_size;
+    (void)body; (void)body_size; (void)out; (void)out_size;
+    return false;
+}
+
+#endif /* DMUSICPAK_ENABLE_COMPRESSION */
+
+bool dmusicpak::decode_chunk(const uint8_t* chunk, uint64_t size, uint8_t** raw, size_t* raw_size) {
+    FrameHeader header;
+    if (!read_frame_header(chunk, size, &header) || header.raw_size > (size_t)-1) return false;
+
+    uint8_t* buffer = (uint8_t*)mem_malloc(header.raw_size > 0 ? (size_t)header.raw_size : 1);
+    if (!buffer) return false;
+
+    const uint8_t* table = chunk + COMPRESSION_HEADER_SIZE;
+    uint64_t offset = COMPRESSION_HEADER_SIZE + (uint64_t)header.frame_count * 4;
+    for (uint32_t i = 0; i < header.frame_count; i++) {
+        uint32_t stored = read_uint32_le(table + (size_t)i * 4);
+        if (stored > size - offset ||
+            !decode_frame(header.codec, chunk + offset, stored,
+                          buffer + (size_t)i * header.frame_size, (size_t)frame_raw_size(&header, i))) {
+            mem_free(buffer);
+            return false;
+        }
+        offset += stored;
+    }
+
+    *raw = buffer;
+    *raw_size = (size_t)header.raw_size;
+    return true;
+}
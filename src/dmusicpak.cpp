@@ -8,16 +8,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
-
-/* File format constants */
-#define DMUSICPAK_MAGIC "DMPK"
-#define DMUSICPAK_VERSION 2
-
-/* Chunk type identifiers */
-#define CHUNK_METADATA 0x01
-#define CHUNK_LYRICS   0x02
-#define CHUNK_AUDIO    0x03
-#define CHUNK_COVER    0x04
+#include <new>
 
 using namespace dmusicpak;
 
@@ -25,7 +16,7 @@ using namespace dmusicpak;
 static char* str_dup(const char* str) {
     if (!str) return NULL;
     size_t len = strlen(str);
-    char* dup = (char*)malloc(len + 1);
+    char* dup = (char*)mem_malloc(len + 1);
     if (dup) {
         memcpy(dup, str, len + 1);
     }
@@ -56,6 +47,104 @@ uint16_t dmusicpak::read_uint16_le(const uint8_t* buffer) {
     return ((uint16_t)buffer[0]) | ((uint16_t)buffer[1] << 8);
 }
 
+void dmusicpak::write_uint64_le(uint8_t* buffer, uint64_t value) {
+    write_uint32_le(buffer, (uint32_t)(value & 0xFFFFFFFF));
+    write_uint32_le(buffer + 4, (uint32_t)(value >> 32));
+}
+
+uint64_t dmusicpak::read_uint64_le(const uint8_t* buffer) {
+    return ((uint64_t)read_uint32_le(buffer)) |
+           ((uint64_t)read_uint32_le(buffer + 4) << 32);
+}
+
+bool dmusicpak::is_supported_version(uint32_t version) {
+    return version == DMUSICPAK_VERSION || version == DMUSICPAK_VERSION_LARGE;
+}
+
+size_t dmusicpak::chunk_header_size(uint32_t version) {
+    return version == DMUSICPAK_VERSION_LARGE ? CHUNK_HEADER_SIZE_LARGE : CHUNK_HEADER_SIZE;
+}
+
+uint64_t dmusicpak::read_chunk_size(const uint8_t* header, uint32_t version) {
+    if (version == DMUSICPAK_VERSION_LARGE) return read_uint64_le(header + 1);
+    return read_uint32_le(header + 1);
+}
+
+void dmusicpak::write_chunk_header(uint8_t* header, uint8_t type, uint64_t size, uint32_t version) {
+    header[0] = type;
+    if (version == DMUSICPAK_VERSION_LARGE) {
+        write_uint64_le(header + 1, size);
+    } else {
+        write_uint32_le(header + 1, (uint32_t)size);
+    }
+}
+
+bool dmusicpak::is_borrowed(const Package* package, const void* ptr) {
+    if (!package || !ptr || !package->mapping.data) return false;
+
+    const uint8_t* p = (const uint8_t*)ptr;
+    return p >= package->mapping.data && p < package->mapping.data + package->mapping.size;
+}
+
+const ChunkEntry* dmusicpak::find_chunk(const Package* package, uint8_t type) {
+    if (!package) return NULL;
+
+    for (uint32_t i = 0; i < package->num_chunks; i++) {
+        if (package->chunks[i].type == type) return &package->chunks[i];
+    }
+    return NULL;
+}
+
+bool dmusicpak::package_read_at(const Package* package, uint64_t offset, void* buffer, size_t size) {
+    if (package->source_ops) return package->source_ops->read_at(package->source, offset, buffer, size);
+    return file_read_at(&package->file, offset, buffer, size);
+}
+
+/* Release package fields, leaving data that points into the mapping alone */
+static void release_metadata(Package* package) {
+    Metadata* metadata = &package->metadata;
+    package_release(package, metadata->title);
+    package_release(package, metadata->artist);
+    package_release(package, metadata->album);
+    package_release(package, metadata->genre);
+    package_release(package, metadata->year);
+    package_release(package, metadata->comment);
+    memset(metadata, 0, sizeof(Metadata));
+}
+
+static void release_lyrics(Package* package) {
+    package_release(package, package->lyrics.data);
+    memset(&package->lyrics, 0, sizeof(Lyrics));
+
+    /* Parsed from the old text */
+    free_lyric_timeline(package->lyric_timeline);
+    package->lyric_timeline = NULL;
+}
+
+static void release_audio(Package* package) {
+    package_release(package, package->audio.source_filename);
+    package_release(package, package->audio.data);
+    memset(&package->audio, 0, sizeof(Audio));
+
+    /* Offsets describe the old payload */
+    free_seek_table(package->seek_table);
+    package->seek_table = NULL;
+}
+
+static void release_cover(Package* package) {
+    package_release(package, package->cover.data);
+    memset(&package->cover, 0, sizeof(Cover));
+}
+
+/* Fetch a chunk of a load_index() package the first time it is needed */
+static Error ensure_loaded(Package* package, ChunkType type, const int* loaded) {
+    if (!*loaded && package->has_file && !package->shared) {
+        Error result = load_chunk(package, type);
+        if (result != Error::OK) return result;
+    }
+    return *loaded ? Error::OK : Error::NOT_SUPPORTED;
+}
+
 const char* dmusicpak::version() {
     return "1.0.1";
 }
@@ -76,37 +165,132 @@ const char* dmusicpak::error_string(Error error) {
 }
 
 Package* dmusicpak::create() {
-    Package* package = (Package*)calloc(1, sizeof(Package));
-    if (!package) return NULL;
+    size_t arena_size = package_arena_size();
+    if (arena_size > 0) return create_with_arena(arena_size);
+
+    void* memory = mem_malloc(sizeof(Package));
+    if (!memory) return NULL;
+
+    /* Value-initialized: every field zero */
+    Package* package = new (memory) Package();
+    return package;
+}
+
+Package* dmusicpak::create_with_arena(size_t block_size) {
+    Arena* arena = arena_create(block_size > 0 ? block_size : DEFAULT_ARENA_BLOCK_SIZE);
+    if (!arena) return NULL;
 
-    memset(package, 0, sizeof(Package));
+    void* memory = arena_alloc(arena, sizeof(Package));
+    if (!memory) {
+        arena_destroy(arena);
+        return NULL;
+    }
+
+    Package* package = new (memory) Package();
+    package->arena = arena;
+    return package;
+}
+
+Error dmusicpak::share(Package* package) {
+    return share_package(package, true);
+}
+
+Error dmusicpak::share_package(Package* package, bool load_cover) {
+    if (!package) return Error::INVALID_PARAM;
+    if (package->shared) return Error::OK;
+
+    /* Fill in now everything a read would otherwise load or build on first use */
+    static const ChunkType small_chunks[] = { ChunkType::METADATA, ChunkType::LYRICS, ChunkType::COVER };
+    for (size_t i = 0; i < sizeof(small_chunks) / sizeof(small_chunks[0]); i++) {
+        if (small_chunks[i] == ChunkType::COVER && !load_cover) continue;
+        Error result = find_chunk(package, (uint8_t)small_chunks[i]) ? load_chunk(package, small_chunks[i]) : Error::OK;
+        if (result != Error::OK) return result;
+    }
+    if (!package->has_audio && package->has_file && find_chunk(package, CHUNK_AUDIO)) {
+        uint64_t audio_offset, audio_size;
+        Error result = locate_audio(package, &audio_offset, &audio_size);
+        if (result != Error::OK) return result;
+    }
+
+    /* Without a seek table or timed lyrics those calls return NOT_SUPPORTED later */
+    SeekPoint point;
+    const LyricTimeline* timeline;
+    seek_audio_ms(package, 0, &point);
+    if (package->has_lyrics) get_lyric_timeline(package, &timeline);
+
+    package->refs.store(1, std::memory_order_relaxed);
+    package->shared = 1;
+    return Error::OK;
+}
+
+Package* dmusicpak::retain(Package* package) {
+    if (!package || !package->shared) return NULL;
+
+    package->refs.fetch_add(1, std::memory_order_relaxed);
     return package;
 }
 
 void dmusicpak::free(Package* package) {
     if (!package) return;
 
-    free_metadata(&package->metadata);
-    free_lyrics(&package->lyrics);
-    free_audio(&package->audio);
-    free_cover(&package->cover);
+    /* A shared package goes with its last reference */
+    if (package->shared && package->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+    release_metadata(package);
+    release_lyrics(package);
+    release_audio(package);
+    release_cover(package);
+    release_thumbnails(package);
+    unmap_file(&package->mapping);
+    if (package->source_ops) {
+        package->source_ops->close(package->source);
+    } else if (package->has_file) {
+        file_close(&package->file);
+    }
+    package_release(package, package->chunks);
+    free_frame_index(package->audio_frames);
+
+    /* An arena package lives in its own arena */
+    if (package->arena) {
+        arena_destroy(package->arena);
+    } else {
+        mem_free(package);
+    }
+}
+
+Error dmusicpak::set_save_options(Package* package, const SaveOptions* options) {
+    if (!package || !options) return Error::INVALID_PARAM;
+    if (package->shared) return Error::NOT_SUPPORTED;  /* Shared packages are immutable */
+    if (options->compression != Compression::NONE && !compression_available(options->compression)) {
+        return Error::NOT_SUPPORTED;
+    }
+    if ((options->alignment & (options->alignment - 1)) != 0) return Error::INVALID_PARAM;
+
+    package->save_options = *options;
+    return Error::OK;
+}
+
+Error dmusicpak::get_save_options(Package* package, SaveOptions* options) {
+    if (!package || !options) return Error::INVALID_PARAM;
 
-    ::free(package);
+    *options = package->save_options;
+    return Error::OK;
 }
 
 Error dmusicpak::set_metadata(Package* package, const Metadata* metadata) {
     if (!package || !metadata) return Error::INVALID_PARAM;
+    if (package->shared) return Error::NOT_SUPPORTED;
 
     /* Free existing metadata */
-    free_metadata(&package->metadata);
+    release_metadata(package);
 
     /* Copy strings */
-    package->metadata.title = str_dup(metadata->title);
-    package->metadata.artist = str_dup(metadata->artist);
-    package->metadata.album = str_dup(metadata->album);
-    package->metadata.genre = str_dup(metadata->genre);
-    package->metadata.year = str_dup(metadata->year);
-    package->metadata.comment = str_dup(metadata->comment);
+    package->metadata.title = package_strdup(package, metadata->title);
+    package->metadata.artist = package_strdup(package, metadata->artist);
+    package->metadata.album = package_strdup(package, metadata->album);
+    package->metadata.genre = package_strdup(package, metadata->genre);
+    package->metadata.year = package_strdup(package, metadata->year);
+    package->metadata.comment = package_strdup(package, metadata->comment);
 
     /* Copy numeric values */
     package->metadata.duration_ms = metadata->duration_ms;
@@ -120,7 +304,9 @@ Error dmusicpak::set_metadata(Package* package, const Metadata* metadata) {
 
 Error dmusicpak::get_metadata(Package* package, Metadata* metadata) {
     if (!package || !metadata) return Error::INVALID_PARAM;
-    if (!package->has_metadata) return Error::NOT_SUPPORTED;
+
+    Error result = ensure_loaded(package, ChunkType::METADATA, &package->has_metadata);
+    if (result != Error::OK) return result;
 
     memset(metadata, 0, sizeof(Metadata));
 
@@ -140,16 +326,18 @@ Error dmusicpak::get_metadata(Package* package, Metadata* metadata) {
 
 Error dmusicpak::set_lyrics(Package* package, const Lyrics* lyrics) {
     if (!package || !lyrics) return Error::INVALID_PARAM;
+    if (package->shared) return Error::NOT_SUPPORTED;
 
-    free_lyrics(&package->lyrics);
+    release_lyrics(package);
 
     package->lyrics.format = lyrics->format;
     package->lyrics.size = lyrics->size;
 
     if (lyrics->data && lyrics->size > 0) {
-        package->lyrics.data = (uint8_t*)malloc(lyrics->size);
+        package->lyrics.data = (uint8_t*)package_alloc(package, lyrics->size);
         if (!package->lyrics.data) return Error::MEMORY_ALLOC;
         memcpy(package->lyrics.data, lyrics->data, lyrics->size);
+        stat_add(STAT_BYTES_COPIED, lyrics->size);
     }
 
     package->has_lyrics = 1;
@@ -158,7 +346,9 @@ Error dmusicpak::set_lyrics(Package* package, const Lyrics* lyrics) {
 
 Error dmusicpak::get_lyrics(Package* package, Lyrics* lyrics) {
     if (!package || !lyrics) return Error::INVALID_PARAM;
-    if (!package->has_lyrics) return Error::NOT_SUPPORTED;
+
+    Error result = ensure_loaded(package, ChunkType::LYRICS, &package->has_lyrics);
+    if (result != Error::OK) return result;
 
     memset(lyrics, 0, sizeof(Lyrics));
 
@@ -166,9 +356,10 @@ Error dmusicpak::get_lyrics(Package* package, Lyrics* lyrics) {
     lyrics->size = package->lyrics.size;
 
     if (package->lyrics.data && package->lyrics.size > 0) {
-        lyrics->data = (uint8_t*)malloc(package->lyrics.size);
+        lyrics->data = (uint8_t*)mem_malloc(package->lyrics.size);
         if (!lyrics->data) return Error::MEMORY_ALLOC;
         memcpy(lyrics->data, package->lyrics.data, package->lyrics.size);
+        stat_add(STAT_BYTES_COPIED, package->lyrics.size);
     }
 
     return Error::OK;
@@ -176,17 +367,19 @@ Error dmusicpak::get_lyrics(Package* package, Lyrics* lyrics) {
 
 Error dmusicpak::set_audio(Package* package, const Audio* audio) {
     if (!package || !audio) return Error::INVALID_PARAM;
+    if (package->shared) return Error::NOT_SUPPORTED;
 
-    free_audio(&package->audio);
+    release_audio(package);
 
     package->audio.format = audio->format;
-    package->audio.source_filename = str_dup(audio->source_filename);
+    package->audio.source_filename = package_strdup(package, audio->source_filename);
     package->audio.size = audio->size;
 
     if (audio->data && audio->size > 0) {
-        package->audio.data = (uint8_t*)malloc(audio->size);
+        package->audio.data = (uint8_t*)package_alloc(package, audio->size);
         if (!package->audio.data) return Error::MEMORY_ALLOC;
         memcpy(package->audio.data, audio->data, audio->size);
+        stat_add(STAT_BYTES_COPIED, audio->size);
     }
 
     package->has_audio = 1;
@@ -195,7 +388,9 @@ Error dmusicpak::set_audio(Package* package, const Audio* audio) {
 
 Error dmusicpak::get_audio(Package* package, Audio* audio) {
     if (!package || !audio) return Error::INVALID_PARAM;
-    if (!package->has_audio) return Error::NOT_SUPPORTED;
+
+    Error result = ensure_loaded(package, ChunkType::AUDIO, &package->has_audio);
+    if (result != Error::OK) return result;
 
     memset(audio, 0, sizeof(Audio));
 
@@ -204,9 +399,10 @@ Error dmusicpak::get_audio(Package* package, Audio* audio) {
     audio->size = package->audio.size;
 
     if (package->audio.data && package->audio.size > 0) {
-        audio->data = (uint8_t*)malloc(package->audio.size);
+        audio->data = (uint8_t*)mem_malloc(package->audio.size);
         if (!audio->data) return Error::MEMORY_ALLOC;
         memcpy(audio->data, package->audio.data, package->audio.size);
+        stat_add(STAT_BYTES_COPIED, package->audio.size);
     }
 
     return Error::OK;
@@ -214,8 +410,9 @@ Error dmusicpak::get_audio(Package* package, Audio* audio) {
 
 Error dmusicpak::set_cover(Package* package, const Cover* cover) {
     if (!package || !cover) return Error::INVALID_PARAM;
+    if (package->shared) return Error::NOT_SUPPORTED;
 
-    free_cover(&package->cover);
+    release_cover(package);
 
     package->cover.format = cover->format;
     package->cover.size = cover->size;
@@ -223,9 +420,10 @@ Error dmusicpak::set_cover(Package* package, const Cover* cover) {
     package->cover.height = cover->height;
 
     if (cover->data && cover->size > 0) {
-        package->cover.data = (uint8_t*)malloc(cover->size);
+        package->cover.data = (uint8_t*)package_alloc(package, cover->size);
         if (!package->cover.data) return Error::MEMORY_ALLOC;
         memcpy(package->cover.data, cover->data, cover->size);
+        stat_add(STAT_BYTES_COPIED, cover->size);
     }
 
     package->has_cover = 1;
@@ -234,7 +432,12 @@ Error dmusicpak::set_cover(Package* package, const Cover* cover) {
 
 Error dmusicpak::get_cover(Package* package, Cover* cover) {
     if (!package || !cover) return Error::INVALID_PARAM;
-    if (!package->has_cover) return Error::NOT_SUPPORTED;
+
+    /* Shared packages cannot keep what they read; the cover goes straight to the caller */
+    if (!package->has_cover && package->has_file && package->shared) return read_cover_from_file(package, cover);
+
+    Error result = ensure_loaded(package, ChunkType::COVER, &package->has_cover);
+    if (result != Error::OK) return result;
 
     memset(cover, 0, sizeof(Cover));
 
@@ -244,38 +447,360 @@ Error dmusicpak::get_cover(Package* package, Cover* cover) {
     cover->height = package->cover.height;
 
     if (package->cover.data && package->cover.size > 0) {
-        cover->data = (uint8_t*)malloc(package->cover.size);
+        cover->data = (uint8_t*)mem_malloc(package->cover.size);
         if (!cover->data) return Error::MEMORY_ALLOC;
         memcpy(cover->data, package->cover.data, package->cover.size);
+        stat_add(STAT_BYTES_COPIED, package->cover.size);
+    }
+
+    return Error::OK;
+}
+
+Error dmusicpak::set_lyrics_owned(Package* package, Lyrics* lyrics) {
+    if (!package || !lyrics) return Error::INVALID_PARAM;
+    if (package->shared) return Error::NOT_SUPPORTED;
+
+    release_lyrics(package);
+
+    /* Adopt the caller's buffer; it is released by free() */
+    package->lyrics.format = lyrics->format;
+    package->lyrics.data = lyrics->data;
+    package->lyrics.size = lyrics->size;
+    lyrics->data = NULL;
+    lyrics->size = 0;
+
+    package->has_lyrics = 1;
+    return Error::OK;
+}
+
+Error dmusicpak::set_audio_owned(Package* package, Audio* audio) {
+    if (!package || !audio) return Error::INVALID_PARAM;
+    if (package->shared) return Error::NOT_SUPPORTED;
+
+    release_audio(package);
+
+    /* Adopt the caller's buffer; the short filename is still copied */
+    package->audio.format = audio->format;
+    package->audio.source_filename = package_strdup(package, audio->source_filename);
+    package->audio.data = audio->data;
+    package->audio.size = audio->size;
+    audio->data = NULL;
+    audio->size = 0;
+
+    package->has_audio = 1;
+    return Error::OK;
+}
+
+Error dmusicpak::set_cover_owned(Package* package, Cover* cover) {
+    if (!package || !cover) return Error::INVALID_PARAM;
+    if (package->shared) return Error::NOT_SUPPORTED;
+
+    release_cover(package);
+
+    /* Adopt the caller's buffer; it is released by free() */
+    package->cover.format = cover->format;
+    package->cover.data = cover->data;
+    package->cover.size = cover->size;
+    package->cover.width = cover->width;
+    package->cover.height = cover->height;
+    cover->data = NULL;
+    cover->size = 0;
+
+    package->has_cover = 1;
+    return Error::OK;
+}
+
+Error dmusicpak::peek_metadata(Package* package, MetadataView* view) {
+    if (!package || !view) return Error::INVALID_PARAM;
+
+    Error result = ensure_loaded(package, ChunkType::METADATA, &package->has_metadata);
+    if (result != Error::OK) return result;
+
+    view->title = package->metadata.title;
+    view->artist = package->metadata.artist;
+    view->album = package->metadata.album;
+    view->genre = package->metadata.genre;
+    view->year = package->metadata.year;
+    view->comment = package->metadata.comment;
+    view->duration_ms = package->metadata.duration_ms;
+    view->bitrate = package->metadata.bitrate;
+    view->sample_rate = package->metadata.sample_rate;
+    view->channels = package->metadata.channels;
+
+    return Error::OK;
+}
+
+Error dmusicpak::peek_lyrics(Package* package, LyricsView* view) {
+    if (!package || !view) return Error::INVALID_PARAM;
+
+    Error result = ensure_loaded(package, ChunkType::LYRICS, &package->has_lyrics);
+    if (result != Error::OK) return result;
+
+    view->format = package->lyrics.format;
+    view->data = package->lyrics.data;
+    view->size = package->lyrics.size;
+
+    return Error::OK;
+}
+
+Error dmusicpak::peek_audio(Package* package, AudioView* view) {
+    if (!package || !view) return Error::INVALID_PARAM;
+
+    Error result = ensure_loaded(package, ChunkType::AUDIO, &package->has_audio);
+    if (result != Error::OK) return result;
+
+    view->format = package->audio.format;
+    view->source_filename = package->audio.source_filename;
+    view->data = package->audio.data;
+    view->size = package->audio.size;
+
+    return Error::OK;
+}
+
+Error dmusicpak::peek_cover(Package* package, CoverView* view) {
+    if (!package || !view) return Error::INVALID_PARAM;
+
+    Error result = ensure_loaded(package, ChunkType::COVER, &package->has_cover);
+    if (result != Error::OK) return result;
+
+    view->format = package->cover.format;
+    view->data = package->cover.data;
+    view->size = package->cover.size;
+    view->width = package->cover.width;
+    view->height = package->cover.height;
+
+    return Error::OK;
+}
+
+/* Audio range being streamed, from memory or read through a buffer */
+struct audio_stream_t {
+    Package* package;
+    const uint8_t* data;     /* Payload in memory, or NULL to read from the file */
+    uint64_t file_offset;    /* Payload location for read_audio() */
+    uint64_t offset;         /* Next byte to deliver */
+    uint64_t end;
+    uint8_t* buffer;
+    size_t capacity;
+    uint64_t buffered;       /* Payload offset of the buffer contents */
+    size_t buffered_size;
+    bool owned;
+};
+
+static Error open_audio_stream(Package* package, const StreamOptions* options, size_t buffer_size,
+                               audio_stream_t* stream) {
+    memset(stream, 0, sizeof(audio_stream_t));
+    stream->package = package;
+
+    uint64_t size;
+    if (package->has_audio) {
+        stream->data = package->audio.data;
+        size = package->audio.size;
+    } else if (package->has_file) {
+        Error result = locate_audio(package, &stream->file_offset, &size);
+        if (result != Error::OK) return result;
+    } else {
+        return Error::NOT_SUPPORTED;
     }
 
+    uint64_t offset = options ? options->offset : 0;
+    uint64_t length = options ? options->length : 0;
+    stream->offset = offset < size ? offset : size;
+    stream->end = (length == 0 || length > size - stream->offset) ? size : stream->offset + length;
+    if (stream->data) return Error::OK;
+
+    /* One buffer for the whole call, no larger than the range */
+    if (options && options->buffer && options->buffer_size > 0) {
+        stream->buffer = options->buffer;
+        stream->capacity = options->buffer_size;
+        return Error::OK;
+    }
+    uint64_t range = stream->end - stream->offset;
+    stream->capacity = range < buffer_size ? (size_t)range : buffer_size;
+    stream->buffer = (uint8_t*)mem_malloc(stream->capacity > 0 ? stream->capacity : 1);
+    if (!stream->buffer) return Error::MEMORY_ALLOC;
+    stream->owned = true;
     return Error::OK;
 }
 
+static void close_audio_stream(audio_stream_t* stream) {
+    if (stream->owned) mem_free(stream->buffer);
+}
+
+/* Up to 'size' bytes at stream->offset, or NULL if they could not be read */
+static const uint8_t* audio_stream_next(audio_stream_t* stream, size_t size, size_t* available) {
+    uint64_t left = stream->end - stream->offset;
+    if (size > left) size = (size_t)left;
+
+    if (stream->data) {
+        *available = size;
+        return stream->data + stream->offset;
+    }
+
+    /* Bytes left over from a partially consumed read are delivered again without rereading */
+    if (stream->offset >= stream->buffered && stream->offset < stream->buffered + stream->buffered_size) {
+        size_t skip = (size_t)(stream->offset - stream->buffered);
+        size_t held = stream->buffered_size - skip;
+        *available = held < size ? held : size;
+        return stream->buffer + skip;
+    }
+
+    if (size > stream->capacity) size = stream->capacity;
+    if (!read_audio(stream->package, stream->file_offset + stream->offset, stream->buffer, size)) {
+        stream->buffered_size = 0;
+        return NULL;
+    }
+    stream->buffered = stream->offset;
+    stream->buffered_size = size;
+    *available = size;
+    return stream->buffer;
+}
+
+static size_t stream_chunk_size(const StreamOptions* options, const audio_stream_t* stream) {
+    if (options && options->chunk_size > 0) return options->chunk_size;
+    return stream->data ? (size_t)-1 : STREAM_FILE_CHUNK_SIZE;
+}
+
 Error dmusicpak::stream_audio(
     Package* package,
     StreamCallback callback,
     void* userdata
 ) {
-    if (!package || !callback) return Error::INVALID_PARAM;
-    if (!package->has_audio) return Error::NOT_SUPPORTED;
+    StreamOptions options;
+    memset(&options, 0, sizeof(options));
+    options.chunk_size = 8192; /* 8KB chunks */
+
+    return stream_audio_ex(package, &options, callback, userdata);
+}
 
-    const size_t chunk_size = 8192; /* 8KB chunks */
-    size_t offset = 0;
+Error dmusicpak::stream_audio_ex(
+    Package* package,
+    const StreamOptions* options,
+    StreamCallback callback,
+    void* userdata
+) {
+    if (!package || !callback) return Error::INVALID_PARAM;
 
-    while (offset < package->audio.size) {
-        size_t to_read = chunk_size;
-        if (offset + to_read > package->audio.size) {
-            to_read = package->audio.size - offset;
+    audio_stream_t stream;
+    size_t chunk_size = options && options->chunk_size > 0 ? options->chunk_size : STREAM_FILE_CHUNK_SIZE;
+    Error result = open_audio_stream(package, options, chunk_size, &stream);
+    if (result != Error::OK) return result;
+    chunk_size = stream_chunk_size(options, &stream);
+
+    while (stream.offset < stream.end) {
+        size_t size;
+        const uint8_t* data = audio_stream_next(&stream, chunk_size, &size);
+        if (!data) {
+            result = Error::IO;
+            break;
         }
 
-        size_t written = callback(package->audio.data + offset, 1, to_read, userdata);
+        size_t written = callback((void*)data, 1, size, userdata);
         if (written == 0) break;
 
-        offset += written;
+        stream.offset += written < size ? written : size;
     }
 
-    return Error::OK;
+    close_audio_stream(&stream);
+    return result;
+}
+
+Error dmusicpak::stream_audio_vec(
+    Package* package,
+    const StreamOptions* options,
+    StreamVecCallback callback,
+    void* userdata
+) {
+    if (!package || !callback) return Error::INVALID_PARAM;
+
+    size_t max_spans = options && options->max_spans > 0 ? options->max_spans : DEFAULT_STREAM_SPANS;
+    if (max_spans > MAX_STREAM_SPANS) max_spans = MAX_STREAM_SPANS;
+
+    /* File reads fill one buffer per call, split into spans */
+    size_t span_size = options && options->chunk_size > 0 ? options->chunk_size : STREAM_FILE_CHUNK_SIZE;
+    size_t batch_size = span_size > (size_t)-1 / max_spans ? (size_t)-1 : span_size * max_spans;
+
+    audio_stream_t stream;
+    Error result = open_audio_stream(package, options, batch_size, &stream);
+    if (result != Error::OK) return result;
+    span_size = stream_chunk_size(options, &stream);
+    batch_size = span_size > (size_t)-1 / max_spans ? (size_t)-1 : span_size * max_spans;
+
+    AudioSpan spans[MAX_STREAM_SPANS];
+    while (stream.offset < stream.end) {
+        size_t size;
+        const uint8_t* data = audio_stream_next(&stream, batch_size, &size);
+        if (!data) {
+            result = Error::IO;
+            break;
+        }
+
+        size_t count = 0;
+        for (size_t done = 0; done < size; count++) {
+            size_t span = size - done < span_size ? size - done : span_size;
+            spans[count].data = data + done;
+            spans[count].size = span;
+            done += span;
+        }
+
+        size_t consumed = callback(spans, count, userdata);
+        if (consumed == 0) break;
+
+        stream.offset += consumed < size ? consumed : size;
+    }
+
+    close_audio_stream(&stream);
+    return result;
+}
+
+Error dmusicpak::send_audio(
+    Package* package,
+    int fd,
+    const StreamOptions* options,
+    uint64_t* sent
+) {
+    uint64_t written = 0;
+    if (sent) *sent = 0;
+    if (!package || fd < 0) return Error::INVALID_PARAM;
+
+    size_t chunk_size = options && options->chunk_size > 0 ? options->chunk_size : STREAM_FILE_CHUNK_SIZE;
+    audio_stream_t stream;
+    Error result;
+
+    /* Plain audio in a local file goes straight from the page cache */
+    if (!package->has_audio && package->has_file && !package->source_ops) {
+        uint64_t audio_offset, audio_size;
+        result = locate_audio(package, &audio_offset, &audio_size);
+        if (result != Error::OK) return result;
+
+        if (!package->audio_frames) {
+            uint64_t offset = options ? options->offset : 0;
+            uint64_t length = options ? options->length : 0;
+            if (offset > audio_size) offset = audio_size;
+            if (length == 0 || length > audio_size - offset) length = audio_size - offset;
+
+            bool ok = file_send(&package->file, audio_offset + offset, length, fd, &written);
+            if (sent) *sent = written;
+            return ok ? Error::OK : Error::IO;
+        }
+    }
+
+    result = open_audio_stream(package, options, chunk_size, &stream);
+    if (result != Error::OK) return result;
+    chunk_size = stream_chunk_size(options, &stream);
+
+    while (stream.offset < stream.end) {
+        size_t size;
+        const uint8_t* data = audio_stream_next(&stream, chunk_size, &size);
+        if (!data || !fd_write(fd, data, size, &written)) {
+            result = Error::IO;
+            break;
+        }
+        stream.offset += size;
+    }
+
+    close_audio_stream(&stream);
+    if (sent) *sent = written;
+    return result;
 }
 
 int64_t dmusicpak::get_audio_chunk(
@@ -285,6 +810,23 @@ int64_t dmusicpak::get_audio_chunk(
     uint8_t* buffer
 ) {
     if (!package || !buffer) return -1;
+
+    /* Lazily indexed packages read the requested range without loading the payload */
+    if (!package->has_audio && package->has_file) {
+        uint64_t audio_offset = 0;
+        uint64_t audio_size = 0;
+        if (locate_audio(package, &audio_offset, &audio_size) != Error::OK) return -1;
+        if (offset >= audio_size) return 0;
+
+        size_t to_read = size;
+        if (offset + to_read > audio_size) {
+            to_read = (size_t)(audio_size - offset);
+        }
+
+        if (!read_audio(package, audio_offset + offset, buffer, to_read)) return -1;
+        return (int64_t)to_read;
+    }
+
     if (!package->has_audio) return -1;
     if (offset >= package->audio.size) return 0;
 
@@ -294,18 +836,19 @@ int64_t dmusicpak::get_audio_chunk(
     }
 
     memcpy(buffer, package->audio.data + offset, to_read);
+    stat_add(STAT_BYTES_COPIED, to_read);
     return (int64_t)to_read;
 }
 
 void dmusicpak::free_metadata(Metadata* metadata) {
     if (!metadata) return;
 
-    ::free(metadata->title);
-    ::free(metadata->artist);
-    ::free(metadata->album);
-    ::free(metadata->genre);
-    ::free(metadata->year);
-    ::free(metadata->comment);
+    mem_free(metadata->title);
+    mem_free(metadata->artist);
+    mem_free(metadata->album);
+    mem_free(metadata->genre);
+    mem_free(metadata->year);
+    mem_free(metadata->comment);
 
     memset(metadata, 0, sizeof(Metadata));
 }
@@ -313,21 +856,21 @@ void dmusicpak::free_metadata(Metadata* metadata) {
 void dmusicpak::free_lyrics(Lyrics* lyrics) {
     if (!lyrics) return;
 
-    ::free(lyrics->data);
+    mem_free(lyrics->data);
     memset(lyrics, 0, sizeof(Lyrics));
 }
 
 void dmusicpak::free_audio(Audio* audio) {
     if (!audio) return;
 
-    ::free(audio->source_filename);
-    ::free(audio->data);
+    mem_free(audio->source_filename);
+    mem_free(audio->data);
     memset(audio, 0, sizeof(Audio));
 }
 
 void dmusicpak::free_cover(Cover* cover) {
     if (!cover) return;
 
-    ::free(cover->data);
+    mem_free(cover->data);
     memset(cover, 0, sizeof(Cover));
 }
@@ -119,6 +119,15 @@ static void c_cover_from_cpp(const Cover* cpp_cover, dmusicpak_cover_t* c_cover)
     c_cover->height = cpp_cover->height;
 }
 
+static void cpp_save_options_from_c(const dmusicpak_save_options_t* c_options, SaveOptions* options) {
+    options->checksums = c_options->checksums;
+    options->compression = (Compression)c_options->compression;
+    options->compression_level = c_options->compression_level;
+    options->seek_interval_ms = c_options->seek_interval_ms;
+    options->padding = c_options->padding;
+    options->alignment = c_options->alignment;
+}
+
 /* C API implementations */
 
 DMUSICPAK_API const char* dmusicpak_version(void) {
@@ -133,6 +142,77 @@ DMUSICPAK_API dmusicpak_package_t dmusicpak_create(void) {
     return reinterpret_cast<dmusicpak_package_t>(dmusicpak::create());
 }
 
+DMUSICPAK_API dmusicpak_package_t dmusicpak_create_with_arena(size_t block_size) {
+    return reinterpret_cast<dmusicpak_package_t>(dmusicpak::create_with_arena(block_size));
+}
+
+DMUSICPAK_API void dmusicpak_set_package_arena(size_t block_size) {
+    dmusicpak::set_package_arena(block_size);
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_set_allocator(const dmusicpak_allocator_t* allocator) {
+    if (!allocator) return c_error_from_cpp(dmusicpak::set_allocator(NULL));
+
+    dmusicpak::Allocator cpp_allocator;
+    cpp_allocator.allocate = allocator->allocate;
+    cpp_allocator.reallocate = allocator->reallocate;
+    cpp_allocator.release = allocator->release;
+    cpp_allocator.context = allocator->context;
+    return c_error_from_cpp(dmusicpak::set_allocator(&cpp_allocator));
+}
+
+DMUSICPAK_API void dmusicpak_set_stats_enabled(int enabled) {
+    dmusicpak::set_stats_enabled(enabled);
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_get_stats(dmusicpak_stats_t* stats) {
+    if (!stats) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    Stats cpp_stats;
+    Error result = dmusicpak::get_stats(&cpp_stats);
+    if (result != Error::OK) return c_error_from_cpp(result);
+
+    stats->bytes_read = cpp_stats.bytes_read;
+    stats->bytes_written = cpp_stats.bytes_written;
+    stats->bytes_copied = cpp_stats.bytes_copied;
+    stats->allocations = cpp_stats.allocations;
+    stats->allocated_bytes = cpp_stats.allocated_bytes;
+    stats->packages_loaded = cpp_stats.packages_loaded;
+    stats->packages_saved = cpp_stats.packages_saved;
+    stats->chunks_parsed = cpp_stats.chunks_parsed;
+    stats->network_requests = cpp_stats.network_requests;
+    stats->network_connections = cpp_stats.network_connections;
+    stats->network_bytes = cpp_stats.network_bytes;
+    stats->load_time_ns = cpp_stats.load_time_ns;
+    stats->save_time_ns = cpp_stats.save_time_ns;
+    stats->network_time_ns = cpp_stats.network_time_ns;
+    return DMUSICPAK_ERROR_OK;
+}
+
+DMUSICPAK_API void dmusicpak_reset_stats(void) {
+    dmusicpak::reset_stats();
+}
+
+/* The C trace callback lives as long as it is installed, unlike per-call wrappers */
+static dmusicpak_trace_callback_t g_c_trace_callback = NULL;
+
+static void c_trace_trampoline(const TraceRecord* record, void* userdata) {
+    dmusicpak_trace_record_t c_record;
+    c_record.event = (dmusicpak_trace_event_t)record->event;
+    c_record.name = record->name;
+    c_record.chunk_type = record->chunk_type;
+    c_record.bytes = record->bytes;
+    c_record.start_ns = record->start_ns;
+    c_record.duration_ns = record->duration_ns;
+    c_record.result = c_error_from_cpp(record->result);
+    g_c_trace_callback(&c_record, userdata);
+}
+
+DMUSICPAK_API void dmusicpak_set_trace_callback(dmusicpak_trace_callback_t callback, void* userdata) {
+    g_c_trace_callback = callback;
+    dmusicpak::set_trace_callback(callback ? c_trace_trampoline : NULL, userdata);
+}
+
 DMUSICPAK_API dmusicpak_package_t dmusicpak_load(const char* filename) {
     return reinterpret_cast<dmusicpak_package_t>(dmusicpak::load(filename));
 }
@@ -141,7 +221,136 @@ DMUSICPAK_API dmusicpak_package_t dmusicpak_load_memory(const uint8_t* data, siz
     return reinterpret_cast<dmusicpak_package_t>(dmusicpak::load_memory(data, size));
 }
 
+DMUSICPAK_API dmusicpak_package_t dmusicpak_load_memory_ex(const uint8_t* data, size_t size, dmusicpak_error_t* error) {
+    Error result = Error::OK;
+    Package* package = dmusicpak::load_memory_ex(data, size, &result);
+    if (error) *error = c_error_from_cpp(result);
+    return reinterpret_cast<dmusicpak_package_t>(package);
+}
+
+DMUSICPAK_API dmusicpak_package_t dmusicpak_load_mmap(const char* filename) {
+    return reinterpret_cast<dmusicpak_package_t>(dmusicpak::load_mmap(filename));
+}
+
+DMUSICPAK_API dmusicpak_package_t dmusicpak_load_index(const char* filename) {
+    return reinterpret_cast<dmusicpak_package_t>(dmusicpak::load_index(filename));
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_load_chunk(dmusicpak_package_t package, dmusicpak_chunk_type_t type) {
+    Package* pkg = reinterpret_cast<Package*>(package);
+    if (!pkg) return DMUSICPAK_ERROR_INVALID_PARAM;
+    return c_error_from_cpp(dmusicpak::load_chunk(pkg, static_cast<ChunkType>(type)));
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_get_chunk_info(dmusicpak_package_t package, dmusicpak_chunk_type_t type, dmusicpak_chunk_info_t* info) {
+    Package* pkg = reinterpret_cast<Package*>(package);
+    if (!pkg || !info) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    ChunkInfo cpp_info;
+    Error result = dmusicpak::get_chunk_info(pkg, static_cast<ChunkType>(type), &cpp_info);
+    if (result == Error::OK) {
+        info->type = type;
+        info->offset = cpp_info.offset;
+        info->size = cpp_info.size;
+    }
+    return c_error_from_cpp(result);
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_get_payload_info(dmusicpak_package_t package, dmusicpak_chunk_type_t type, dmusicpak_chunk_info_t* info) {
+    Package* pkg = reinterpret_cast<Package*>(package);
+    if (!pkg || !info) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    ChunkInfo cpp_info;
+    Error result = dmusicpak::get_payload_info(pkg, static_cast<ChunkType>(type), &cpp_info);
+    if (result == Error::OK) {
+        info->type = type;
+        info->offset = cpp_info.offset;
+        info->size = cpp_info.size;
+    }
+    return c_error_from_cpp(result);
+}
+
+static void c_metadata_view_from_cpp(const MetadataView* src, dmusicpak_metadata_view_t* dst) {
+    dst->title = src->title;
+    dst->artist = src->artist;
+    dst->album = src->album;
+    dst->genre = src->genre;
+    dst->year = src->year;
+    dst->comment = src->comment;
+    dst->duration_ms = src->duration_ms;
+    dst->bitrate = src->bitrate;
+    dst->sample_rate = src->sample_rate;
+    dst->channels = src->channels;
+}
+
+static void c_lyrics_view_from_cpp(const LyricsView* src, dmusicpak_lyrics_view_t* dst) {
+    dst->format = c_lyric_format_from_cpp(src->format);
+    dst->data = src->data;
+    dst->size = src->size;
+}
+
+static void c_audio_view_from_cpp(const AudioView* src, dmusicpak_audio_view_t* dst) {
+    dst->format = c_audio_format_from_cpp(src->format);
+    dst->source_filename = src->source_filename;
+    dst->data = src->data;
+    dst->size = src->size;
+}
+
+static void c_cover_view_from_cpp(const CoverView* src, dmusicpak_cover_view_t* dst) {
+    dst->format = c_cover_format_from_cpp(src->format);
+    dst->data = src->data;
+    dst->size = src->size;
+    dst->width = src->width;
+    dst->height = src->height;
+}
+
 #ifdef DMUSICPAK_ENABLE_NETWORK
+/* Forwards C++ listener callbacks to a C listener */
+static void c_on_metadata(const MetadataView* metadata, void* userdata) {
+    const dmusicpak_stream_listener_t* listener = (const dmusicpak_stream_listener_t*)userdata;
+    dmusicpak_metadata_view_t view;
+    c_metadata_view_from_cpp(metadata, &view);
+    listener->on_metadata(&view, listener->userdata);
+}
+
+static void c_on_lyrics(const LyricsView* lyrics, void* userdata) {
+    const dmusicpak_stream_listener_t* listener = (const dmusicpak_stream_listener_t*)userdata;
+    dmusicpak_lyrics_view_t view;
+    c_lyrics_view_from_cpp(lyrics, &view);
+    listener->on_lyrics(&view, listener->userdata);
+}
+
+static void c_on_cover(const CoverView* cover, void* userdata) {
+    const dmusicpak_stream_listener_t* listener = (const dmusicpak_stream_listener_t*)userdata;
+    dmusicpak_cover_view_t view;
+    c_cover_view_from_cpp(cover, &view);
+    listener->on_cover(&view, listener->userdata);
+}
+
+static void c_on_audio_start(const AudioView* audio, void* userdata) {
+    const dmusicpak_stream_listener_t* listener = (const dmusicpak_stream_listener_t*)userdata;
+    dmusicpak_audio_view_t view;
+    c_audio_view_from_cpp(audio, &view);
+    listener->on_audio_start(&view, listener->userdata);
+}
+
+static size_t c_on_audio(void* buffer, size_t size, size_t nmemb, void* userdata) {
+    const dmusicpak_stream_listener_t* listener = (const dmusicpak_stream_listener_t*)userdata;
+    return listener->on_audio(buffer, size, nmemb, listener->userdata);
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_network_init(void) {
+    return c_error_from_cpp(dmusicpak::network_init());
+}
+
+DMUSICPAK_API void dmusicpak_network_cleanup(void) {
+    dmusicpak::network_cleanup();
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_set_url_cache_dir(const char* directory) {
+    return c_error_from_cpp(dmusicpak::set_url_cache_dir(directory));
+}
+
 DMUSICPAK_API dmusicpak_package_t dmusicpak_load_url(const char* url, uint32_t timeout_ms) {
     return reinterpret_cast<dmusicpak_package_t>(dmusicpak::load_url(url, timeout_ms));
 }
@@ -150,6 +359,28 @@ DMUSICPAK_API dmusicpak_package_t dmusicpak_load_url_stream(const char* url, uin
     return reinterpret_cast<dmusicpak_package_t>(dmusicpak::load_url_stream(url, timeout_ms, chunk_size));
 }
 
+DMUSICPAK_API dmusicpak_package_t dmusicpak_load_url_stream_ex(
+    const char* url,
+    uint32_t timeout_ms,
+    size_t chunk_size,
+    const dmusicpak_stream_listener_t* listener
+) {
+    if (!listener) {
+        return reinterpret_cast<dmusicpak_package_t>(dmusicpak::load_url_stream_ex(url, timeout_ms, chunk_size, NULL));
+    }
+
+    StreamListener cpp_listener;
+    cpp_listener.on_metadata = listener->on_metadata ? c_on_metadata : NULL;
+    cpp_listener.on_lyrics = listener->on_lyrics ? c_on_lyrics : NULL;
+    cpp_listener.on_cover = listener->on_cover ? c_on_cover : NULL;
+    cpp_listener.on_audio_start = listener->on_audio_start ? c_on_audio_start : NULL;
+    cpp_listener.on_audio = listener->on_audio ? c_on_audio : NULL;
+    cpp_listener.retain_audio = listener->retain_audio;
+    cpp_listener.userdata = (void*)listener;
+
+    return reinterpret_cast<dmusicpak_package_t>(dmusicpak::load_url_stream_ex(url, timeout_ms, chunk_size, &cpp_listener));
+}
+
 DMUSICPAK_API int64_t dmusicpak_get_audio_chunk_url(
     const char* url,
     size_t offset,
@@ -159,23 +390,296 @@ DMUSICPAK_API int64_t dmusicpak_get_audio_chunk_url(
 ) {
     return dmusicpak::get_audio_chunk_url(url, offset, size, buffer, timeout_ms);
 }
+
+DMUSICPAK_API dmusicpak_session_t dmusicpak_create_session(uint32_t timeout_ms) {
+    return reinterpret_cast<dmusicpak_session_t>(dmusicpak::create_session(timeout_ms));
+}
+
+DMUSICPAK_API void dmusicpak_free_session(dmusicpak_session_t session) {
+    dmusicpak::free_session(reinterpret_cast<Session*>(session));
+}
+
+DMUSICPAK_API int64_t dmusicpak_get_audio_chunk_session(
+    dmusicpak_session_t session,
+    const char* url,
+    size_t offset,
+    size_t size,
+    uint8_t* buffer
+) {
+    return dmusicpak::get_audio_chunk_session(reinterpret_cast<Session*>(session), url, offset, size, buffer);
+}
+
+DMUSICPAK_API dmusicpak_package_t dmusicpak_load_url_index(const char* url, dmusicpak_session_t session) {
+    return reinterpret_cast<dmusicpak_package_t>(dmusicpak::load_url_index(url, reinterpret_cast<Session*>(session)));
+}
+
+DMUSICPAK_API dmusicpak_prefetcher_t dmusicpak_create_prefetcher(dmusicpak_package_t package, size_t window_size, uint32_t depth) {
+    return reinterpret_cast<dmusicpak_prefetcher_t>(
+        dmusicpak::create_prefetcher(reinterpret_cast<Package*>(package), window_size, depth));
+}
+
+DMUSICPAK_API void dmusicpak_free_prefetcher(dmusicpak_prefetcher_t prefetcher) {
+    dmusicpak::free_prefetcher(reinterpret_cast<Prefetcher*>(prefetcher));
+}
+
+DMUSICPAK_API int64_t dmusicpak_prefetch_read(dmusicpak_prefetcher_t prefetcher, uint8_t* buffer, size_t size) {
+    return dmusicpak::prefetch_read(reinterpret_cast<Prefetcher*>(prefetcher), buffer, size);
+}
+
+DMUSICPAK_API size_t dmusicpak_prefetch_available(dmusicpak_prefetcher_t prefetcher) {
+    return dmusicpak::prefetch_available(reinterpret_cast<Prefetcher*>(prefetcher));
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_prefetch_seek(dmusicpak_prefetcher_t prefetcher, uint64_t offset) {
+    Prefetcher* cpp_prefetcher = reinterpret_cast<Prefetcher*>(prefetcher);
+    if (!cpp_prefetcher) return DMUSICPAK_ERROR_INVALID_PARAM;
+    return c_error_from_cpp(dmusicpak::prefetch_seek(cpp_prefetcher, offset));
+}
 #endif /* DMUSICPAK_ENABLE_NETWORK */
 
+DMUSICPAK_API dmusicpak_error_t dmusicpak_set_save_options(dmusicpak_package_t package, const dmusicpak_save_options_t* options) {
+    Package* pkg = reinterpret_cast<Package*>(package);
+    if (!pkg || !options) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    SaveOptions cpp_options;
+    cpp_save_options_from_c(options, &cpp_options);
+    return c_error_from_cpp(dmusicpak::set_save_options(pkg, &cpp_options));
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_get_save_options(dmusicpak_package_t package, dmusicpak_save_options_t* options) {
+    Package* pkg = reinterpret_cast<Package*>(package);
+    if (!pkg || !options) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    SaveOptions cpp_options;
+    Error result = dmusicpak::get_save_options(pkg, &cpp_options);
+    if (result == Error::OK) {
+        options->checksums = cpp_options.checksums;
+        options->compression = (dmusicpak_compression_t)cpp_options.compression;
+        options->compression_level = cpp_options.compression_level;
+        options->seek_interval_ms = cpp_options.seek_interval_ms;
+        options->padding = cpp_options.padding;
+        options->alignment = cpp_options.alignment;
+    }
+    return c_error_from_cpp(result);
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_verify(const char* filename) {
+    return c_error_from_cpp(dmusicpak::verify(filename));
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_verify_memory(const uint8_t* data, size_t size) {
+    return c_error_from_cpp(dmusicpak::verify_memory(data, size));
+}
+
 DMUSICPAK_API dmusicpak_error_t dmusicpak_save(dmusicpak_package_t package, const char* filename) {
     Package* pkg = reinterpret_cast<Package*>(package);
     if (!pkg) return DMUSICPAK_ERROR_INVALID_PARAM;
     return c_error_from_cpp(dmusicpak::save(pkg, filename));
 }
 
+DMUSICPAK_API dmusicpak_error_t dmusicpak_save_stream(dmusicpak_package_t package, FILE* file) {
+    Package* pkg = reinterpret_cast<Package*>(package);
+    if (!pkg) return DMUSICPAK_ERROR_INVALID_PARAM;
+    return c_error_from_cpp(dmusicpak::save_stream(pkg, file));
+}
+
 DMUSICPAK_API dmusicpak_error_t dmusicpak_save_memory(dmusicpak_package_t package, uint8_t** buffer, size_t* size) {
     Package* pkg = reinterpret_cast<Package*>(package);
     if (!pkg) return DMUSICPAK_ERROR_INVALID_PARAM;
     return c_error_from_cpp(dmusicpak::save_memory(pkg, buffer, size));
 }
 
+DMUSICPAK_API dmusicpak_error_t dmusicpak_update_metadata(const char* filename, const dmusicpak_metadata_t* metadata) {
+    if (!filename || !metadata) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    Metadata cpp_meta;
+    cpp_metadata_from_c(metadata, &cpp_meta);
+    return c_error_from_cpp(dmusicpak::update_metadata(filename, &cpp_meta));
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_update_lyrics(const char* filename, const dmusicpak_lyrics_t* lyrics) {
+    if (!filename || !lyrics) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    Lyrics cpp_lyrics;
+    cpp_lyrics_from_c(lyrics, &cpp_lyrics);
+    return c_error_from_cpp(dmusicpak::update_lyrics(filename, &cpp_lyrics));
+}
+
+/* C++ copies of the chunk structs one C job points to */
+struct c_pack_job_data_t {
+    Metadata metadata;
+    Lyrics lyrics;
+    Audio audio;
+    Cover cover;
+    SaveOptions options;
+};
+
+/* Forwards batch results to a C callback */
+struct c_batch_callback_t {
+    dmusicpak_batch_callback_t callback;
+    void* userdata;
+};
+
+static void c_on_batch_job(size_t index, Error result, void* userdata) {
+    c_batch_callback_t* c_callback = static_cast<c_batch_callback_t*>(userdata);
+    c_callback->callback(index, c_error_from_cpp(result), c_callback->userdata);
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_pack_batch(
+    const dmusicpak_pack_job_t* jobs,
+    size_t count,
+    unsigned threads,
+    dmusicpak_batch_callback_t callback,
+    void* userdata
+) {
+    if (!jobs && count > 0) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    size_t n = count > 0 ? count : 1;
+    PackJob* cpp_jobs = static_cast<PackJob*>(std::calloc(n, sizeof(PackJob)));
+    c_pack_job_data_t* data = static_cast<c_pack_job_data_t*>(std::calloc(n, sizeof(c_pack_job_data_t)));
+    if (!cpp_jobs || !data) {
+        std::free(cpp_jobs);
+        std::free(data);
+        return DMUSICPAK_ERROR_MEMORY_ALLOC;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const dmusicpak_pack_job_t* src = &jobs[i];
+        PackJob* dst = &cpp_jobs[i];
+
+        dst->filename = src->filename;
+        dst->audio_file = src->audio_file;
+        if (src->metadata) {
+            cpp_metadata_from_c(src->metadata, &data[i].metadata);
+            dst->metadata = &data[i].metadata;
+        }
+        if (src->lyrics) {
+            cpp_lyrics_from_c(src->lyrics, &data[i].lyrics);
+            dst->lyrics = &data[i].lyrics;
+        }
+        if (src->audio) {
+            cpp_audio_from_c(src->audio, &data[i].audio);
+            dst->audio = &data[i].audio;
+        }
+        if (src->cover) {
+            cpp_cover_from_c(src->cover, &data[i].cover);
+            dst->cover = &data[i].cover;
+        }
+        if (src->options) {
+            cpp_save_options_from_c(src->options, &data[i].options);
+            dst->options = &data[i].options;
+        }
+    }
+
+    c_batch_callback_t c_callback;
+    c_callback.callback = callback;
+    c_callback.userdata = userdata;
+
+    Error result = dmusicpak::pack_batch(cpp_jobs, count, threads,
+                                         callback ? c_on_batch_job : NULL, &c_callback);
+
+    std::free(cpp_jobs);
+    std::free(data);
+    return c_error_from_cpp(result);
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_load_batch(
+    const char* const* filenames,
+    size_t count,
+    unsigned threads,
+    dmusicpak_package_t* packages,
+    dmusicpak_batch_callback_t callback,
+    void* userdata
+) {
+    if ((!filenames || !packages) && count > 0) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    c_batch_callback_t c_callback;
+    c_callback.callback = callback;
+    c_callback.userdata = userdata;
+
+    return c_error_from_cpp(dmusicpak::load_batch(filenames, count, threads,
+                                                  reinterpret_cast<Package**>(packages),
+                                                  callback ? c_on_batch_job : NULL, &c_callback));
+}
+
+/* Copy a scan; its strings are moved to the copy's storage */
+static void c_metadata_scan_from_cpp(const MetadataScan* src, dmusicpak_metadata_scan_t* dst) {
+    c_metadata_view_from_cpp(&src->metadata, &dst->metadata);
+    dst->has_metadata = src->has_metadata;
+    dst->truncated = src->truncated;
+    dst->has_cover = src->has_cover;
+    dst->cover_format = c_cover_format_from_cpp(src->cover_format);
+    dst->cover_width = src->cover_width;
+    dst->cover_height = src->cover_height;
+
+    const char** fields[] = {
+        &dst->metadata.title, &dst->metadata.artist, &dst->metadata.album,
+        &dst->metadata.genre, &dst->metadata.year, &dst->metadata.comment
+    };
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        if (!*fields[i]) continue;
+        size_t offset = (size_t)(*fields[i] - src->storage);
+        size_t length = strlen(*fields[i]);
+        memcpy(dst->storage + offset, *fields[i], length + 1);
+        *fields[i] = dst->storage + offset;
+    }
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_scan_metadata(const char* filename, dmusicpak_metadata_scan_t* scan) {
+    if (!filename || !scan) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    MetadataScan cpp_scan;
+    Error result = dmusicpak::scan_metadata(filename, &cpp_scan);
+    if (result == Error::OK) {
+        c_metadata_scan_from_cpp(&cpp_scan, scan);
+    } else {
+        memset(scan, 0, offsetof(dmusicpak_metadata_scan_t, storage));
+    }
+    return c_error_from_cpp(result);
+}
+
+struct c_scan_callback_t {
+    dmusicpak_scan_callback_t callback;
+    void* userdata;
+};
+
+static void c_on_scan(const char* filename, const MetadataScan* scan, Error result, void* userdata) {
+    c_scan_callback_t* c_callback = static_cast<c_scan_callback_t*>(userdata);
+
+    dmusicpak_metadata_scan_t c_scan;
+    if (result == Error::OK) {
+        c_metadata_scan_from_cpp(scan, &c_scan);
+    } else {
+        memset(&c_scan, 0, offsetof(dmusicpak_metadata_scan_t, storage));
+    }
+    c_callback->callback(filename, &c_scan, c_error_from_cpp(result), c_callback->userdata);
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_scan_directory(
+    const char* directory,
+    const char* extension,
+    int recursive,
+    unsigned threads,
+    dmusicpak_scan_callback_t callback,
+    void* userdata
+) {
+    if (!directory || !callback) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    c_scan_callback_t c_callback;
+    c_callback.callback = callback;
+    c_callback.userdata = userdata;
+
+    return c_error_from_cpp(dmusicpak::scan_directory(directory, extension, recursive, threads,
+                                                      c_on_scan, &c_callback));
+}
+
+DMUSICPAK_API uint8_t* dmusicpak_alloc_memory(size_t size) {
+    return static_cast<uint8_t*>(dmusicpak::alloc_buffer(size > 0 ? size : 1));
+}
+
 DMUSICPAK_API void dmusicpak_free_memory(uint8_t* buffer) {
     if (!buffer) return;
-    std::free(buffer);
+    dmusicpak::free_buffer(buffer);
 }
 
 DMUSICPAK_API void dmusicpak_free(dmusicpak_package_t package) {
@@ -184,6 +688,246 @@ DMUSICPAK_API void dmusicpak_free(dmusicpak_package_t package) {
     dmusicpak::free(pkg);
 }
 
+DMUSICPAK_API dmusicpak_error_t dmusicpak_share(dmusicpak_package_t package) {
+    return c_error_from_cpp(dmusicpak::share(reinterpret_cast<Package*>(package)));
+}
+
+DMUSICPAK_API dmusicpak_package_t dmusicpak_retain(dmusicpak_package_t package) {
+    return reinterpret_cast<dmusicpak_package_t>(dmusicpak::retain(reinterpret_cast<Package*>(package)));
+}
+
+DMUSICPAK_API dmusicpak_cache_t dmusicpak_create_cache(const dmusicpak_cache_options_t* options) {
+    if (!options) return reinterpret_cast<dmusicpak_cache_t>(dmusicpak::create_cache(NULL));
+
+    CacheOptions cpp_options;
+    cpp_options.metadata_bytes = options->metadata_bytes;
+    cpp_options.cover_bytes = options->cover_bytes;
+    cpp_options.audio_bytes = options->audio_bytes;
+    cpp_options.shards = options->shards;
+    return reinterpret_cast<dmusicpak_cache_t>(dmusicpak::create_cache(&cpp_options));
+}
+
+DMUSICPAK_API void dmusicpak_free_cache(dmusicpak_cache_t cache) {
+    dmusicpak::free_cache(reinterpret_cast<Cache*>(cache));
+}
+
+DMUSICPAK_API dmusicpak_package_t dmusicpak_cache_load(
+    dmusicpak_cache_t cache,
+    const char* filename,
+    dmusicpak_cache_level_t level
+) {
+    return reinterpret_cast<dmusicpak_package_t>(
+        dmusicpak::cache_load(reinterpret_cast<Cache*>(cache), filename, static_cast<CacheLevel>(level)));
+}
+
+#ifdef DMUSICPAK_ENABLE_NETWORK
+DMUSICPAK_API dmusicpak_package_t dmusicpak_cache_load_url(
+    dmusicpak_cache_t cache,
+    const char* url,
+    dmusicpak_cache_level_t level,
+    dmusicpak_session_t session
+) {
+    return reinterpret_cast<dmusicpak_package_t>(
+        dmusicpak::cache_load_url(reinterpret_cast<Cache*>(cache), url, static_cast<CacheLevel>(level),
+                                  reinterpret_cast<Session*>(session)));
+}
+#endif
+
+DMUSICPAK_API void dmusicpak_cache_clear(dmusicpak_cache_t cache) {
+    dmusicpak::cache_clear(reinterpret_cast<Cache*>(cache));
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_cache_get_stats(dmusicpak_cache_t cache, dmusicpak_cache_stats_t* stats) {
+    if (!stats) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    CacheStats cpp_stats;
+    Error result = dmusicpak::cache_get_stats(reinterpret_cast<Cache*>(cache), &cpp_stats);
+    if (result != Error::OK) return c_error_from_cpp(result);
+
+    stats->hits = cpp_stats.hits;
+    stats->misses = cpp_stats.misses;
+    stats->evictions = cpp_stats.evictions;
+    stats->entries = cpp_stats.entries;
+    stats->metadata_bytes = cpp_stats.metadata_bytes;
+    stats->cover_bytes = cpp_stats.cover_bytes;
+    stats->audio_bytes = cpp_stats.audio_bytes;
+    return DMUSICPAK_ERROR_OK;
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_save_album(
+    const char* filename,
+    dmusicpak_package_t album,
+    const dmusicpak_package_t* tracks,
+    uint32_t count
+) {
+    Error result = dmusicpak::save_album(filename, reinterpret_cast<Package*>(album),
+                                         reinterpret_cast<Package* const*>(tracks), count);
+    return c_error_from_cpp(result);
+}
+
+DMUSICPAK_API dmusicpak_album_t dmusicpak_open_album(const char* filename) {
+    return reinterpret_cast<dmusicpak_album_t>(dmusicpak::open_album(filename));
+}
+
+DMUSICPAK_API dmusicpak_album_t dmusicpak_open_album_mmap(const char* filename) {
+    return reinterpret_cast<dmusicpak_album_t>(dmusicpak::open_album_mmap(filename));
+}
+
+DMUSICPAK_API void dmusicpak_close_album(dmusicpak_album_t album) {
+    dmusicpak::close_album(reinterpret_cast<Album*>(album));
+}
+
+DMUSICPAK_API uint32_t dmusicpak_album_track_count(dmusicpak_album_t album) {
+    return dmusicpak::album_track_count(reinterpret_cast<Album*>(album));
+}
+
+DMUSICPAK_API dmusicpak_package_t dmusicpak_album_info(dmusicpak_album_t album) {
+    return reinterpret_cast<dmusicpak_package_t>(dmusicpak::album_info(reinterpret_cast<Album*>(album)));
+}
+
+DMUSICPAK_API dmusicpak_package_t dmusicpak_load_album_track(dmusicpak_album_t album, uint32_t index) {
+    return reinterpret_cast<dmusicpak_package_t>(dmusicpak::load_album_track(reinterpret_cast<Album*>(album), index));
+}
+
+DMUSICPAK_API dmusicpak_async_context_t dmusicpak_create_async_context(uint32_t threads) {
+    return reinterpret_cast<dmusicpak_async_context_t>(dmusicpak::create_async_context(threads));
+}
+
+DMUSICPAK_API void dmusicpak_free_async_context(dmusicpak_async_context_t context) {
+    dmusicpak::free_async_context(reinterpret_cast<AsyncContext*>(context));
+}
+
+DMUSICPAK_API int dmusicpak_async_fd(dmusicpak_async_context_t context) {
+    return dmusicpak::async_fd(reinterpret_cast<AsyncContext*>(context));
+}
+
+DMUSICPAK_API void* dmusicpak_async_event(dmusicpak_async_context_t context) {
+    return dmusicpak::async_event(reinterpret_cast<AsyncContext*>(context));
+}
+
+DMUSICPAK_API uint32_t dmusicpak_async_poll(dmusicpak_async_context_t context, uint32_t timeout_ms) {
+    return dmusicpak::async_poll(reinterpret_cast<AsyncContext*>(context), timeout_ms);
+}
+
+DMUSICPAK_API uint32_t dmusicpak_async_pending(dmusicpak_async_context_t context) {
+    return dmusicpak::async_pending(reinterpret_cast<AsyncContext*>(context));
+}
+
+/* Forwards one completion to a C callback; allocated per operation, freed on delivery */
+struct c_async_callback_t {
+    dmusicpak_async_callback_t callback;
+    void* userdata;
+};
+
+static void c_on_async_completion(const AsyncCompletion* completion) {
+    c_async_callback_t* c_callback = static_cast<c_async_callback_t*>(completion->userdata);
+
+    dmusicpak_async_completion_t c_completion;
+    c_completion.operation = static_cast<dmusicpak_async_operation_t>(completion->operation);
+    c_completion.result = c_error_from_cpp(completion->result);
+    c_completion.package = reinterpret_cast<dmusicpak_package_t>(completion->package);
+    c_completion.buffer = completion->buffer;
+    c_completion.bytes = completion->bytes;
+    c_completion.userdata = c_callback->userdata;
+
+    dmusicpak_async_callback_t callback = c_callback->callback;
+    std::free(c_callback);
+    callback(&c_completion);
+}
+
+static c_async_callback_t* c_async_callback(dmusicpak_async_callback_t callback, void* userdata) {
+    if (!callback) return NULL;
+    c_async_callback_t* c_callback = static_cast<c_async_callback_t*>(std::malloc(sizeof(c_async_callback_t)));
+    if (!c_callback) return NULL;
+    c_callback->callback = callback;
+    c_callback->userdata = userdata;
+    return c_callback;
+}
+
+/* The wrapper is only handed over when the operation was accepted */
+static dmusicpak_error_t c_async_submitted(Error result, c_async_callback_t* c_callback) {
+    if (result != Error::OK) std::free(c_callback);
+    return c_error_from_cpp(result);
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_load_async(
+    dmusicpak_async_context_t context,
+    const char* filename,
+    dmusicpak_async_callback_t callback,
+    void* userdata
+) {
+    c_async_callback_t* c_callback = c_async_callback(callback, userdata);
+    if (!c_callback) return callback ? DMUSICPAK_ERROR_MEMORY_ALLOC : DMUSICPAK_ERROR_INVALID_PARAM;
+    Error result = dmusicpak::load_async(reinterpret_cast<AsyncContext*>(context), filename,
+                                         c_on_async_completion, c_callback);
+    return c_async_submitted(result, c_callback);
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_save_async(
+    dmusicpak_async_context_t context,
+    dmusicpak_package_t package,
+    const char* filename,
+    dmusicpak_async_callback_t callback,
+    void* userdata
+) {
+    c_async_callback_t* c_callback = c_async_callback(callback, userdata);
+    if (!c_callback) return callback ? DMUSICPAK_ERROR_MEMORY_ALLOC : DMUSICPAK_ERROR_INVALID_PARAM;
+    Error result = dmusicpak::save_async(reinterpret_cast<AsyncContext*>(context), reinterpret_cast<Package*>(package),
+                                         filename, c_on_async_completion, c_callback);
+    return c_async_submitted(result, c_callback);
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_read_audio_chunk_async(
+    dmusicpak_async_context_t context,
+    dmusicpak_package_t package,
+    size_t offset,
+    size_t size,
+    uint8_t* buffer,
+    dmusicpak_async_callback_t callback,
+    void* userdata
+) {
+    c_async_callback_t* c_callback = c_async_callback(callback, userdata);
+    if (!c_callback) return callback ? DMUSICPAK_ERROR_MEMORY_ALLOC : DMUSICPAK_ERROR_INVALID_PARAM;
+    Error result = dmusicpak::read_audio_chunk_async(reinterpret_cast<AsyncContext*>(context),
+                                                     reinterpret_cast<Package*>(package), offset, size, buffer,
+                                                     c_on_async_completion, c_callback);
+    return c_async_submitted(result, c_callback);
+}
+
+#ifdef DMUSICPAK_ENABLE_NETWORK
+DMUSICPAK_API dmusicpak_error_t dmusicpak_load_url_async(
+    dmusicpak_async_context_t context,
+    const char* url,
+    uint32_t timeout_ms,
+    dmusicpak_async_callback_t callback,
+    void* userdata
+) {
+    c_async_callback_t* c_callback = c_async_callback(callback, userdata);
+    if (!c_callback) return callback ? DMUSICPAK_ERROR_MEMORY_ALLOC : DMUSICPAK_ERROR_INVALID_PARAM;
+    Error result = dmusicpak::load_url_async(reinterpret_cast<AsyncContext*>(context), url, timeout_ms,
+                                             c_on_async_completion, c_callback);
+    return c_async_submitted(result, c_callback);
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_get_audio_chunk_url_async(
+    dmusicpak_async_context_t context,
+    dmusicpak_session_t session,
+    const char* url,
+    size_t offset,
+    size_t size,
+    uint8_t* buffer,
+    dmusicpak_async_callback_t callback,
+    void* userdata
+) {
+    c_async_callback_t* c_callback = c_async_callback(callback, userdata);
+    if (!c_callback) return callback ? DMUSICPAK_ERROR_MEMORY_ALLOC : DMUSICPAK_ERROR_INVALID_PARAM;
+    Error result = dmusicpak::get_audio_chunk_url_async(reinterpret_cast<AsyncContext*>(context),
+                                                        reinterpret_cast<Session*>(session), url, offset, size,
+                                                        buffer, c_on_async_completion, c_callback);
+    return c_async_submitted(result, c_callback);
+}
+#endif
+
 DMUSICPAK_API dmusicpak_error_t dmusicpak_set_metadata(dmusicpak_package_t package, const dmusicpak_metadata_t* metadata) {
     Package* pkg = reinterpret_cast<Package*>(package);
     if (!pkg || !metadata) return DMUSICPAK_ERROR_INVALID_PARAM;
@@ -272,6 +1016,119 @@ DMUSICPAK_API dmusicpak_error_t dmusicpak_get_cover(dmusicpak_package_t package,
     return c_error_from_cpp(result);
 }
 
+DMUSICPAK_API dmusicpak_error_t dmusicpak_add_cover_thumbnail(dmusicpak_package_t package, const dmusicpak_cover_t* thumbnail) {
+    Package* pkg = reinterpret_cast<Package*>(package);
+    if (!pkg || !thumbnail) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    Cover cpp_cover;
+    cpp_cover_from_c(thumbnail, &cpp_cover);
+    Error result = dmusicpak::add_cover_thumbnail(pkg, &cpp_cover);
+    return c_error_from_cpp(result);
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_clear_cover_thumbnails(dmusicpak_package_t package) {
+    return c_error_from_cpp(dmusicpak::clear_cover_thumbnails(reinterpret_cast<Package*>(package)));
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_get_cover_best_fit(
+    dmusicpak_package_t package,
+    uint32_t width,
+    uint32_t height,
+    dmusicpak_cover_t* cover
+) {
+    Package* pkg = reinterpret_cast<Package*>(package);
+    if (!pkg || !cover) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    Cover cpp_cover;
+    Error result = dmusicpak::get_cover_best_fit(pkg, width, height, &cpp_cover);
+    if (result == Error::OK) {
+        c_cover_from_cpp(&cpp_cover, cover);
+    }
+    return c_error_from_cpp(result);
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_set_lyrics_owned(dmusicpak_package_t package, dmusicpak_lyrics_t* lyrics) {
+    Package* pkg = reinterpret_cast<Package*>(package);
+    if (!pkg || !lyrics) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    Lyrics cpp_lyrics;
+    cpp_lyrics_from_c(lyrics, &cpp_lyrics);
+    Error result = dmusicpak::set_lyrics_owned(pkg, &cpp_lyrics);
+    if (result == Error::OK) {
+        lyrics->data = NULL;
+        lyrics->size = 0;
+    }
+    return c_error_from_cpp(result);
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_set_audio_owned(dmusicpak_package_t package, dmusicpak_audio_t* audio) {
+    Package* pkg = reinterpret_cast<Package*>(package);
+    if (!pkg || !audio) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    Audio cpp_audio;
+    cpp_audio_from_c(audio, &cpp_audio);
+    Error result = dmusicpak::set_audio_owned(pkg, &cpp_audio);
+    if (result == Error::OK) {
+        audio->data = NULL;
+        audio->size = 0;
+    }
+    return c_error_from_cpp(result);
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_set_cover_owned(dmusicpak_package_t package, dmusicpak_cover_t* cover) {
+    Package* pkg = reinterpret_cast<Package*>(package);
+    if (!pkg || !cover) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    Cover cpp_cover;
+    cpp_cover_from_c(cover, &cpp_cover);
+    Error result = dmusicpak::set_cover_owned(pkg, &cpp_cover);
+    if (result == Error::OK) {
+        cover->data = NULL;
+        cover->size = 0;
+    }
+    return c_error_from_cpp(result);
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_peek_metadata(dmusicpak_package_t package, dmusicpak_metadata_view_t* view) {
+    Package* pkg = reinterpret_cast<Package*>(package);
+    if (!pkg || !view) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    MetadataView cpp_view;
+    Error result = dmusicpak::peek_metadata(pkg, &cpp_view);
+    if (result == Error::OK) c_metadata_view_from_cpp(&cpp_view, view);
+    return c_error_from_cpp(result);
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_peek_lyrics(dmusicpak_package_t package, dmusicpak_lyrics_view_t* view) {
+    Package* pkg = reinterpret_cast<Package*>(package);
+    if (!pkg || !view) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    LyricsView cpp_view;
+    Error result = dmusicpak::peek_lyrics(pkg, &cpp_view);
+    if (result == Error::OK) c_lyrics_view_from_cpp(&cpp_view, view);
+    return c_error_from_cpp(result);
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_peek_audio(dmusicpak_package_t package, dmusicpak_audio_view_t* view) {
+    Package* pkg = reinterpret_cast<Package*>(package);
+    if (!pkg || !view) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    AudioView cpp_view;
+    Error result = dmusicpak::peek_audio(pkg, &cpp_view);
+    if (result == Error::OK) c_audio_view_from_cpp(&cpp_view, view);
+    return c_error_from_cpp(result);
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_peek_cover(dmusicpak_package_t package, dmusicpak_cover_view_t* view) {
+    Package* pkg = reinterpret_cast<Package*>(package);
+    if (!pkg || !view) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    CoverView cpp_view;
+    Error result = dmusicpak::peek_cover(pkg, &cpp_view);
+    if (result == Error::OK) c_cover_view_from_cpp(&cpp_view, view);
+    return c_error_from_cpp(result);
+}
+
 DMUSICPAK_API dmusicpak_error_t dmusicpak_stream_audio(
     dmusicpak_package_t package,
     dmusicpak_stream_callback_t callback,
@@ -285,6 +1142,64 @@ DMUSICPAK_API dmusicpak_error_t dmusicpak_stream_audio(
     return c_error_from_cpp(result);
 }
 
+static const StreamOptions* cpp_stream_options_from_c(const dmusicpak_stream_options_t* c_options,
+                                                      StreamOptions* options) {
+    if (!c_options) return NULL;
+
+    options->offset = c_options->offset;
+    options->length = c_options->length;
+    options->chunk_size = c_options->chunk_size;
+    options->max_spans = c_options->max_spans;
+    options->buffer = c_options->buffer;
+    options->buffer_size = c_options->buffer_size;
+    return options;
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_stream_audio_ex(
+    dmusicpak_package_t package,
+    const dmusicpak_stream_options_t* options,
+    dmusicpak_stream_callback_t callback,
+    void* userdata
+) {
+    Package* pkg = reinterpret_cast<Package*>(package);
+    if (!pkg || !callback) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    StreamOptions cpp_options;
+    StreamCallback cpp_callback = reinterpret_cast<StreamCallback>(callback);
+    Error result = dmusicpak::stream_audio_ex(pkg, cpp_stream_options_from_c(options, &cpp_options),
+                                              cpp_callback, userdata);
+    return c_error_from_cpp(result);
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_stream_audio_vec(
+    dmusicpak_package_t package,
+    const dmusicpak_stream_options_t* options,
+    dmusicpak_stream_vec_callback_t callback,
+    void* userdata
+) {
+    Package* pkg = reinterpret_cast<Package*>(package);
+    if (!pkg || !callback) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    /* dmusicpak_audio_span_t and AudioSpan share their layout */
+    StreamOptions cpp_options;
+    StreamVecCallback cpp_callback = reinterpret_cast<StreamVecCallback>(callback);
+    Error result = dmusicpak::stream_audio_vec(pkg, cpp_stream_options_from_c(options, &cpp_options),
+                                               cpp_callback, userdata);
+    return c_error_from_cpp(result);
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_send_audio(
+    dmusicpak_package_t package,
+    int fd,
+    const dmusicpak_stream_options_t* options,
+    uint64_t* sent
+) {
+    StreamOptions cpp_options;
+    Error result = dmusicpak::send_audio(reinterpret_cast<Package*>(package), fd,
+                                         cpp_stream_options_from_c(options, &cpp_options), sent);
+    return c_error_from_cpp(result);
+}
+
 DMUSICPAK_API int64_t dmusicpak_get_audio_chunk(
     dmusicpak_package_t package,
     size_t offset,
@@ -296,16 +1211,129 @@ DMUSICPAK_API int64_t dmusicpak_get_audio_chunk(
     return dmusicpak::get_audio_chunk(pkg, offset, size, buffer);
 }
 
+DMUSICPAK_API dmusicpak_error_t dmusicpak_seek_audio_ms(
+    dmusicpak_package_t package,
+    uint64_t time_ms,
+    dmusicpak_seek_point_t* point
+) {
+    Package* pkg = reinterpret_cast<Package*>(package);
+    if (!pkg || !point) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    SeekPoint cpp_point;
+    Error result = dmusicpak::seek_audio_ms(pkg, time_ms, &cpp_point);
+    if (result == Error::OK) {
+        point->time_ms = cpp_point.time_ms;
+        point->offset = cpp_point.offset;
+    }
+    return c_error_from_cpp(result);
+}
+
+DMUSICPAK_API dmusicpak_lyric_timeline_t dmusicpak_parse_lyrics(
+    const uint8_t* data,
+    size_t size,
+    dmusicpak_lyric_format_t format
+) {
+    return reinterpret_cast<dmusicpak_lyric_timeline_t>(
+        dmusicpak::parse_lyrics(data, size, cpp_lyric_format_from_c(format)));
+}
+
+DMUSICPAK_API void dmusicpak_free_lyric_timeline(dmusicpak_lyric_timeline_t timeline) {
+    dmusicpak::free_lyric_timeline(reinterpret_cast<LyricTimeline*>(timeline));
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_get_lyric_timeline(
+    dmusicpak_package_t package,
+    dmusicpak_lyric_timeline_t* timeline
+) {
+    Package* pkg = reinterpret_cast<Package*>(package);
+    if (!pkg || !timeline) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    const LyricTimeline* cpp_timeline = NULL;
+    Error result = dmusicpak::get_lyric_timeline(pkg, &cpp_timeline);
+    if (result == Error::OK) *timeline = const_cast<LyricTimeline*>(cpp_timeline);
+    return c_error_from_cpp(result);
+}
+
+DMUSICPAK_API uint32_t dmusicpak_lyric_line_count(dmusicpak_lyric_timeline_t timeline) {
+    return dmusicpak::lyric_line_count(reinterpret_cast<LyricTimeline*>(timeline));
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_get_lyric_line(
+    dmusicpak_lyric_timeline_t timeline,
+    uint32_t index,
+    dmusicpak_lyric_line_t* line
+) {
+    if (!line) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    LyricLine cpp_line;
+    Error result = dmusicpak::get_lyric_line(reinterpret_cast<LyricTimeline*>(timeline), index, &cpp_line);
+    if (result == Error::OK) {
+        line->start_ms = cpp_line.start_ms;
+        line->end_ms = cpp_line.end_ms;
+        line->text = cpp_line.text;
+        line->length = cpp_line.length;
+        line->first_word = cpp_line.first_word;
+        line->word_count = cpp_line.word_count;
+    }
+    return c_error_from_cpp(result);
+}
+
+DMUSICPAK_API dmusicpak_error_t dmusicpak_get_lyric_word(
+    dmusicpak_lyric_timeline_t timeline,
+    uint32_t index,
+    dmusicpak_lyric_word_t* word
+) {
+    if (!word) return DMUSICPAK_ERROR_INVALID_PARAM;
+
+    LyricWord cpp_word;
+    Error result = dmusicpak::get_lyric_word(reinterpret_cast<LyricTimeline*>(timeline), index, &cpp_word);
+    if (result == Error::OK) {
+        word->start_ms = cpp_word.start_ms;
+        word->end_ms = cpp_word.end_ms;
+        word->text = cpp_word.text;
+        word->length = cpp_word.length;
+    }
+    return c_error_from_cpp(result);
+}
+
+DMUSICPAK_API int64_t dmusicpak_lyric_at(dmusicpak_lyric_timeline_t timeline, uint64_t time_ms) {
+    return dmusicpak::lyric_at(reinterpret_cast<LyricTimeline*>(timeline), time_ms);
+}
+
+DMUSICPAK_API int64_t dmusicpak_lyric_cursor_advance(
+    dmusicpak_lyric_timeline_t timeline,
+    dmusicpak_lyric_cursor_t* cursor,
+    uint64_t time_ms
+) {
+    if (!cursor) return -1;
+
+    LyricCursor cpp_cursor;
+    cpp_cursor.started = cursor->started;
+    cpp_cursor.time_ms = cursor->time_ms;
+    int64_t line = dmusicpak::lyric_cursor_advance(reinterpret_cast<LyricTimeline*>(timeline), &cpp_cursor, time_ms);
+    cursor->started = cpp_cursor.started;
+    cursor->time_ms = cpp_cursor.time_ms;
+    return line;
+}
+
+DMUSICPAK_API int64_t dmusicpak_lyric_word_at(
+    dmusicpak_lyric_timeline_t timeline,
+    uint32_t line,
+    uint64_t time_ms
+) {
+    return dmusicpak::lyric_word_at(reinterpret_cast<LyricTimeline*>(timeline), line, time_ms);
+}
+
 DMUSICPAK_API void dmusicpak_free_metadata(dmusicpak_metadata_t* metadata) {
     if (!metadata) return;
     
     /* Free all string fields */
-    std::free(metadata->title);
-    std::free(metadata->artist);
-    std::free(metadata->album);
-    std::free(metadata->genre);
-    std::free(metadata->year);
-    std::free(metadata->comment);
+    dmusicpak::free_buffer(metadata->title);
+    dmusicpak::free_buffer(metadata->artist);
+    dmusicpak::free_buffer(metadata->album);
+    dmusicpak::free_buffer(metadata->genre);
+    dmusicpak::free_buffer(metadata->year);
+    dmusicpak::free_buffer(metadata->comment);
     
     memset(metadata, 0, sizeof(dmusicpak_metadata_t));
 }
@@ -314,7 +1342,7 @@ DMUSICPAK_API void dmusicpak_free_lyrics(dmusicpak_lyrics_t* lyrics) {
     if (!lyrics) return;
     
     /* Free lyrics data */
-    std::free(lyrics->data);
+    dmusicpak::free_buffer(lyrics->data);
     
     memset(lyrics, 0, sizeof(dmusicpak_lyrics_t));
 }
@@ -323,8 +1351,8 @@ DMUSICPAK_API void dmusicpak_free_audio(dmusicpak_audio_t* audio) {
     if (!audio) return;
     
     /* Free audio data and source filename */
-    std::free(audio->source_filename);
-    std::free(audio->data);
+    dmusicpak::free_buffer(audio->source_filename);
+    dmusicpak::free_buffer(audio->data);
     
     memset(audio, 0, sizeof(dmusicpak_audio_t));
 }
@@ -333,7 +1361,7 @@ DMUSICPAK_API void dmusicpak_free_cover(dmusicpak_cover_t* cover) {
     if (!cover) return;
     
     /* Free cover image data */
-    std::free(cover->data);
+    dmusicpak::free_buffer(cover->data);
     
     memset(cover, 0, sizeof(dmusicpak_cover_t));
 }
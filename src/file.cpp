@@ -0,0 +1,441 @@
+/**
+ * @file file.cpp
+ * @brief Platform file helpers (memory mapping, positional reads) for DMusicPak library
+ */
+
+#include "internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#endif
+
+using namespace dmusicpak;
+
+/* Copy a file range to a descriptor through a buffer */
+static bool send_buffered(const FileHandle* file, uint64_t offset, uint64_t size, int fd, uint64_t* sent) {
+    size_t capacity = size < STREAM_FILE_CHUNK_SIZE ? (size_t)size : STREAM_FILE_CHUNK_SIZE;
+    uint8_t* buffer = (uint8_t*)mem_malloc(capacity > 0 ? capacity : 1);
+    if (!buffer) return false;
+
+    bool ok = true;
+    while (size > 0 && ok) {
+        size_t to_send = size < capacity ? (size_t)size : capacity;
+        ok = file_read_at(file, offset, buffer, to_send) && fd_write(fd, buffer, to_send, sent);
+        offset += to_send;
+        size -= to_send;
+    }
+
+    mem_free(buffer);
+    return ok;
+}
+
+#ifdef _WIN32
+
+bool dmusicpak::map_file(const char* filename, MappedFile* mapping) {
+    if (!filename || !mapping) return false;
+    memset(mapping, 0, sizeof(MappedFile));
+
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart <= 0 ||
+        (unsigned long long)file_size.QuadPart > (size_t)-1) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE view = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!view) return false;
+
+    /* The view keeps the mapping object alive after its handle is closed */
+    void* data = MapViewOfFile(view, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(view);
+    if (!data) return false;
+
+    mapping->data = (const uint8_t*)data;
+    mapping->size = (size_t)file_size.QuadPart;
+    return true;
+}
+
+void dmusicpak::unmap_file(MappedFile* mapping) {
+    if (!mapping || !mapping->data) return;
+
+    UnmapViewOfFile((LPCVOID)mapping->data);
+    memset(mapping, 0, sizeof(MappedFile));
+}
+
+bool dmusicpak::file_open(const char* filename, FileHandle* file) {
+    if (!filename || !file) return false;
+
+    HANDLE handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) return false;
+
+    file->handle = handle;
+    return true;
+}
+
+bool dmusicpak::file_size(const FileHandle* file, uint64_t* size) {
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx((HANDLE)file->handle, &file_size)) return false;
+
+    *size = (uint64_t)file_size.QuadPart;
+    return true;
+}
+
+bool dmusicpak::file_stat(const char* filename, uint64_t* size, uint64_t* mtime_ns) {
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!filename || !GetFileAttributesExA(filename, GetFileExInfoStandard, &attributes)) return false;
+
+    /* FILETIME counts 100 ns intervals */
+    *size = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+    *mtime_ns = (((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) |
+                 attributes.ftLastWriteTime.dwLowDateTime) * 100;
+    return true;
+}
+
+bool dmusicpak::file_read_at(const FileHandle* file, uint64_t offset, void* buffer, size_t size) {
+    uint8_t* out = (uint8_t*)buffer;
+
+    while (size > 0) {
+        /* OVERLAPPED carries the offset, so concurrent reads do not race */
+        OVERLAPPED overlapped;
+        memset(&overlapped, 0, sizeof(overlapped));
+        overlapped.Offset = (DWORD)(offset & 0xFFFFFFFF);
+        overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+        DWORD to_read = size > 0x40000000 ? 0x40000000 : (DWORD)size;
+        DWORD read = 0;
+        if (!ReadFile((HANDLE)file->handle, out, to_read, &read, &overlapped) || read == 0) {
+            return false;
+        }
+
+        out += read;
+        offset += read;
+        size -= read;
+        stat_add(STAT_BYTES_READ, read);
+    }
+    return true;
+}
+
+void dmusicpak::file_close(FileHandle* file) {
+    if (!file || !file->handle) return;
+
+    CloseHandle((HANDLE)file->handle);
+    file->handle = NULL;
+}
+
+bool dmusicpak::file_open_update(const char* filename, FileHandle* file) {
+    if (!filename || !file) return false;
+
+    HANDLE handle = CreateFileA(filename, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) return false;
+
+    file->handle = handle;
+    return true;
+}
+
+bool dmusicpak::file_write_at(const FileHandle* file, uint64_t offset, const void* buffer, size_t size) {
+    const uint8_t* in = (const uint8_t*)buffer;
+
+    while (size > 0) {
+        OVERLAPPED overlapped;
+        memset(&overlapped, 0, sizeof(overlapped));
+        overlapped.Offset = (DWORD)(offset & 0xFFFFFFFF);
+        overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+        DWORD to_write = size > 0x40000000 ? 0x40000000 : (DWORD)size;
+        DWORD written = 0;
+        if (!WriteFile((HANDLE)file->handle, in, to_write, &written, &overlapped) || written == 0) {
+            return false;
+        }
+
+        in += written;
+        offset += written;
+        size -= written;
+        stat_add(STAT_BYTES_WRITTEN, written);
+    }
+    return true;
+}
+
+bool dmusicpak::file_truncate(const FileHandle* file, uint64_t size) {
+    LARGE_INTEGER position;
+    position.QuadPart = (LONGLONG)size;
+    return SetFilePointerEx((HANDLE)file->handle, position, NULL, FILE_BEGIN) &&
+           SetEndOfFile((HANDLE)file->handle);
+}
+
+bool dmusicpak::file_replace(const char* from, const char* to) {
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+bool dmusicpak::fd_write(int fd, const void* data, size_t size, uint64_t* sent) {
+    const uint8_t* in = (const uint8_t*)data;
+
+    while (size > 0) {
+        unsigned int to_write = size > 0x40000000 ? 0x40000000 : (unsigned int)size;
+        int written = _write(fd, in, to_write);
+        if (written <= 0) return false;
+
+        in += written;
+        size -= (size_t)written;
+        *sent += (uint64_t)written;
+    }
+    return true;
+}
+
+bool dmusicpak::file_send(const FileHandle* file, uint64_t offset, uint64_t size, int fd, uint64_t* sent) {
+    return send_buffered(file, offset, size, fd, sent);
+}
+
+bool dmusicpak::list_directory(const char* path, DirectoryCallback fn, void* context) {
+    size_t length = strlen(path);
+    char* pattern = (char*)mem_malloc(length + 3);
+    if (!pattern) return false;
+    memcpy(pattern, path, length);
+    memcpy(pattern + length, "\\*", 3);
+
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA(pattern, &entry);
+    mem_free(pattern);
+    if (find == INVALID_HANDLE_VALUE) return false;
+
+    do {
+        const char* name = entry.cFileName;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+
+        /* Junctions and directory links are not followed */
+        DirEntryKind kind = DIR_ENTRY_FILE;
+        if (entry.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) {
+            kind = DIR_ENTRY_OTHER;
+        } else if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            kind = DIR_ENTRY_DIRECTORY;
+        }
+        if (!fn(name, kind, context)) break;
+    } while (FindNextFileA(find, &entry));
+
+    FindClose(find);
+    return true;
+}
+
+#else
+
+bool dmusicpak::map_file(const char* filename, MappedFile* mapping) {
+    if (!filename || !mapping) return false;
+    memset(mapping, 0, sizeof(MappedFile));
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 ||
+        (unsigned long long)st.st_size > (size_t)-1) {
+        close(fd);
+        return false;
+    }
+
+    /* The mapping stays valid after the descriptor is closed */
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+
+    mapping->data = (const uint8_t*)data;
+    mapping->size = (size_t)st.st_size;
+    return true;
+}
+
+void dmusicpak::unmap_file(MappedFile* mapping) {
+    if (!mapping || !mapping->data) return;
+
+    munmap((void*)mapping->data, mapping->size);
+    memset(mapping, 0, sizeof(MappedFile));
+}
+
+bool dmusicpak::file_open(const char* filename, FileHandle* file) {
+    if (!filename || !file) return false;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return false;
+
+    file->fd = fd;
+    return true;
+}
+
+bool dmusicpak::file_size(const FileHandle* file, uint64_t* size) {
+    struct stat st;
+    if (fstat(file->fd, &st) != 0 || st.st_size < 0) return false;
+
+    *size = (uint64_t)st.st_size;
+    return true;
+}
+
+bool dmusicpak::file_stat(const char* filename, uint64_t* size, uint64_t* mtime_ns) {
+    struct stat st;
+    if (!filename || stat(filename, &st) != 0 || st.st_size < 0) return false;
+
+    *size = (uint64_t)st.st_size;
+#ifdef __APPLE__
+    *mtime_ns = (uint64_t)st.st_mtimespec.tv_sec * 1000000000ULL + (uint64_t)st.st_mtimespec.tv_nsec;
+#else
+    *mtime_ns = (uint64_t)st.st_mtim.tv_sec * 1000000000ULL + (uint64_t)st.st_mtim.tv_nsec;
+#endif
+    return true;
+}
+
+bool dmusicpak::file_read_at(const FileHandle* file, uint64_t offset, void* buffer, size_t size) {
+    uint8_t* out = (uint8_t*)buffer;
+
+    while (size > 0) {
+        ssize_t read = pread(file->fd, out, size, (off_t)offset);
+        if (read < 0 && errno == EINTR) continue;
+        if (read <= 0) return false;
+
+        out += read;
+        offset += (uint64_t)read;
+        size -= (size_t)read;
+        stat_add(STAT_BYTES_READ, (uint64_t)read);
+    }
+    return true;
+}
+
+void dmusicpak::file_close(FileHandle* file) {
+    if (!file || file->fd < 0) return;
+
+    close(file->fd);
+    file->fd = -1;
+}
+
+bool dmusicpak::file_open_update(const char* filename, FileHandle* file) {
+    if (!filename || !file) return false;
+
+    int fd = open(filename, O_RDWR);
+    if (fd < 0) return false;
+
+    file->fd = fd;
+    return true;
+}
+
+bool dmusicpak::file_write_at(const FileHandle* file, uint64_t offset, const void* buffer, size_t size) {
+    const uint8_t* in = (const uint8_t*)buffer;
+
+    while (size > 0) {
+        ssize_t written = pwrite(file->fd, in, size, (off_t)offset);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+
+        in += written;
+        offset += (uint64_t)written;
+        size -= (size_t)written;
+        stat_add(STAT_BYTES_WRITTEN, (uint64_t)written);
+    }
+    return true;
+}
+
+bool dmusicpak::file_truncate(const FileHandle* file, uint64_t size) {
+    return ftruncate(file->fd, (off_t)size) == 0;
+}
+
+bool dmusicpak::file_replace(const char* from, const char* to) {
+    return rename(from, to) == 0;
+}
+
+bool dmusicpak::fd_write(int fd, const void* data, size_t size, uint64_t* sent) {
+    const uint8_t* in = (const uint8_t*)data;
+
+    while (size > 0) {
+        ssize_t written = write(fd, in, size);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+
+        in += written;
+        size -= (size_t)written;
+        *sent += (uint64_t)written;
+    }
+    return true;
+}
+
+bool dmusicpak::file_send(const FileHandle* file, uint64_t offset, uint64_t size, int fd, uint64_t* sent) {
+#ifdef __linux__
+    /* The kernel copies from the page cache; descriptors sendfile() can't
+       pair fall back to a buffered copy */
+    while (size > 0) {
+        off_t position = (off_t)offset;
+        size_t to_send = size > 0x40000000 ? 0x40000000 : (size_t)size;
+        ssize_t written = sendfile(fd, file->fd, &position, to_send);
+        if (written < 0 && errno == EINTR) continue;
+        if (written < 0 && (errno == EINVAL || errno == ENOSYS)) {
+            return send_buffered(file, offset, size, fd, sent);
+        }
+        if (written <= 0) return false;
+
+        offset += (uint64_t)written;
+        size -= (uint64_t)written;
+        *sent += (uint64_t)written;
+    }
+    return true;
+#else
+    return send_buffered(file, offset, size, fd, sent);
+#endif
+}
+
+bool dmusicpak::list_directory(const char* path, DirectoryCallback fn, void* context) {
+    DIR* dir = opendir(path);
+    if (!dir) return false;
+
+    size_t length = strlen(path);
+    char* full = NULL;  /* For lstat() where d_type is unknown */
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char* name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+
+        /* Symbolic links are not followed */
+        DirEntryKind kind = DIR_ENTRY_OTHER;
+#ifdef DT_DIR
+        if (entry->d_type == DT_REG) kind = DIR_ENTRY_FILE;
+        else if (entry->d_type == DT_DIR) kind = DIR_ENTRY_DIRECTORY;
+        else if (entry->d_type == DT_UNKNOWN)
+#endif
+        {
+            size_t name_length = strlen(name);
+            mem_free(full);
+            full = (char*)mem_malloc(length + name_length + 2);
+            if (!full) break;
+            memcpy(full, path, length);
+            full[length] = '/';
+            memcpy(full + length + 1, name, name_length + 1);
+
+            struct stat st;
+            if (lstat(full, &st) == 0) {
+                if (S_ISREG(st.st_mode)) kind = DIR_ENTRY_FILE;
+                else if (S_ISDIR(st.st_mode)) kind = DIR_ENTRY_DIRECTORY;
+            }
+        }
+        if (!fn(name, kind, context)) break;
+    }
+
+    mem_free(full);
+    closedir(dir);
+    return true;
+}
+
+#endif
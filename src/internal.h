@@ -11,9 +11,141 @@
 #include <stdint.h>
 #include <stddef.h>
 
+/* File format constants */
+#define DMUSICPAK_MAGIC "DMPK"
+#define DMUSICPAK_VERSION 2        /* 32-bit chunk sizes */
+#define DMUSICPAK_VERSION_LARGE 3  /* 64-bit chunk sizes; written only when a chunk needs them */
+
+/* On-disk header sizes */
+#define FILE_HEADER_SIZE  12  /* magic + version + num_chunks */
+#define CHUNK_HEADER_SIZE 5   /* type + size */
+#define CHUNK_HEADER_SIZE_LARGE 9  /* type + 64-bit size (version 3) */
+#define TOC_ENTRY_SIZE    17  /* type + offset + size */
+#define CHECKSUM_ENTRY_SIZE 5 /* type + checksum */
+#define SEEK_ENTRY_SIZE   12  /* time_ms + offset */
+
+/* First read of load_index(); normally covers the header and the whole TOC */
+#define INDEX_HEAD_SIZE 4096
+
+/* Chunk type identifiers */
+#define CHUNK_METADATA 0x01
+#define CHUNK_LYRICS   0x02
+#define CHUNK_AUDIO    0x03
+#define CHUNK_COVER    0x04
+#define CHUNK_TOC      0x05
+#define CHUNK_TRACK    0x07  /* Album track: a whole package embedded as chunk data */
+#define CHUNK_CHECKSUM 0x0A
+#define CHUNK_SEEK     0x0B
+#define CHUNK_PADDING  0x0C  /* Free space; not listed in the TOC */
+#define CHUNK_THUMBNAILS 0x0D  /* Pre-scaled renditions of the cover */
+
+/* Type flag: chunk data is stored as compressed frames */
+#define CHUNK_COMPRESSED 0x80
+
+/* Compressed chunk layout */
+#define COMPRESSION_HEADER_SIZE 20                  /* codec + raw_size + frame_size + frame_count */
+#define COMPRESSION_FRAME_SIZE (256 * 1024)         /* Uncompressed bytes per frame when writing */
+#define MAX_COMPRESSION_FRAME_SIZE (16 * 1024 * 1024) /* Larger frames are rejected as corrupt */
+
+/* Checksum chunk algorithms */
+#define CHECKSUM_CRC32C 1
+
+/* Chunk types below this can carry a checksum */
+#define MAX_CHECKSUM_TYPES 16
+
+/* Larger checksum chunks are rejected as corrupt */
+#define MAX_CHECKSUM_CHUNK_SIZE (64 * 1024)
+
+/* Thumbnail chunk layout: count, then format + width + height + size per thumbnail, then the images */
+#define THUMBNAIL_ENTRY_SIZE 16
+#define MAX_THUMBNAILS 32
+
+/* Seek table spacing when one is built for seek_audio_ms() without a save option */
+#define DEFAULT_SEEK_INTERVAL_MS 1000
+
+/* Larger seek table chunks are rejected as corrupt */
+#define MAX_SEEK_CHUNK_SIZE (16 * 1024 * 1024)
+
+/* Arena block size for create_with_arena(0) */
+#define DEFAULT_ARENA_BLOCK_SIZE (64 * 1024)
+
+/* Audio streaming: read size for file-backed packages, and spans per stream_audio_vec() call */
+#define STREAM_FILE_CHUNK_SIZE (256 * 1024)
+#define DEFAULT_STREAM_SPANS 16
+#define MAX_STREAM_SPANS 64
+
+/* Instrumentation switches: get_stats() counters and the trace callback */
+#define INSTRUMENT_STATS 1
+#define INSTRUMENT_TRACE 2
+
 #ifdef __cplusplus
+#include <atomic>
+
 namespace dmusicpak {
 
+    /* Read-only memory mapping of a whole file */
+    struct MappedFile {
+        const uint8_t* data;
+        size_t size;
+    };
+
+    /* Positional-read file handle */
+    struct FileHandle {
+#ifdef _WIN32
+        void* handle;
+#else
+        int fd;
+#endif
+    };
+
+    /* Location of one chunk inside a package file */
+    struct ChunkEntry {
+        uint8_t type;      /* Without the CHUNK_COMPRESSED flag */
+        uint8_t compressed;
+        uint64_t offset;   /* Absolute offset of chunk data */
+        uint64_t size;     /* Size of chunk data (as stored) */
+    };
+
+    /* Header of a compressed chunk */
+    struct FrameHeader {
+        uint32_t codec;        /* Compression value */
+        uint64_t raw_size;     /* Uncompressed chunk size */
+        uint32_t frame_size;   /* Uncompressed bytes per frame (last may be shorter) */
+        uint32_t frame_count;
+    };
+
+    /* Frames of a compressed chunk in the backing file, for range reads */
+    struct FrameIndex {
+        FrameHeader header;
+        uint64_t* offsets;     /* frame_count + 1 absolute offsets of the stored frames */
+        uint8_t* cache;        /* Last decoded frame (unused once the package is shared) */
+        uint32_t cached;       /* Index of the cached frame (frame_count for none) */
+        uint64_t id;           /* Unique per index; keys the per-thread frame caches */
+    };
+
+    /* Audio time to frame offset map, one entry per interval (struct of arrays for the search) */
+    struct SeekTable {
+        uint32_t interval_ms;
+        uint32_t count;
+        uint32_t* times;       /* Ascending frame start times in ms */
+        uint64_t* offsets;     /* Matching byte offsets into the audio payload */
+    };
+
+    /* Backing store other than a local file for lazily loaded packages (e.g. HTTP) */
+    struct SourceOps {
+        bool (*read_at)(void* source, uint64_t offset, void* buffer, size_t size);
+        void (*close)(void* source);
+    };
+
+    /* Stored checksums by chunk type, from a checksum chunk */
+    struct ChecksumTable {
+        uint32_t mask;      /* Bit n set: checksum[n] holds the CRC32C of the type-n chunk */
+        uint32_t checksum[MAX_CHECKSUM_TYPES];
+    };
+
+    /* Bump allocator backing a package (alloc.cpp) */
+    struct Arena;
+
     /* Internal package structure */
     struct Package {
         Metadata metadata;
@@ -24,15 +156,324 @@ namespace dmusicpak {
         int has_lyrics;
         int has_audio;
         int has_cover;
+        uint8_t* thumbnails;      /* Thumbnail chunk after the count: directory, then the images */
+        size_t thumbnails_size;
+        uint32_t thumbnail_count;
+        int has_thumbnails;       /* Set with no thumbnails by clear_cover_thumbnails() */
+        MappedFile mapping;  /* Backing file for load_mmap() packages */
+        FileHandle file;     /* Backing file for load_index() packages */
+        const SourceOps* source_ops; /* Backing store used instead of 'file' when set */
+        void* source;
+        int has_file;        /* Chunks can be read from 'file' or 'source' */
+        ChunkEntry* chunks;  /* Chunk index (from TOC or chunk walk) */
+        uint32_t num_chunks;
+        uint64_t audio_offset; /* Audio payload location in the backing file (in the
+                                  uncompressed data when audio_frames is set) */
+        uint64_t audio_size;
+        int audio_located;
+        FrameIndex* audio_frames; /* Set when the audio chunk is compressed */
+        SeekTable* seek_table;    /* From the seek chunk or built from the audio; NULL until needed */
+        LyricTimeline* lyric_timeline; /* Parsed from the lyrics by get_lyric_timeline(); NULL until needed */
+        ChecksumTable checksums; /* From the loaded file; checked as chunks are decoded */
+        SaveOptions save_options;
+        Arena* arena;             /* Source of the package's memory; NULL for individual allocations */
+        int shared;               /* Immutable since share(); reads fill in nothing */
+        std::atomic<uint32_t> refs; /* References to a shared package (share() and retain()) */
+    };
+
+    /* get_stats() counters, in Stats field order */
+    enum StatCounter {
+        STAT_BYTES_READ,
+        STAT_BYTES_WRITTEN,
+        STAT_BYTES_COPIED,
+        STAT_ALLOCATIONS,
+        STAT_ALLOCATED_BYTES,
+        STAT_PACKAGES_LOADED,
+        STAT_PACKAGES_SAVED,
+        STAT_CHUNKS_PARSED,
+        STAT_NETWORK_REQUESTS,
+        STAT_NETWORK_CONNECTIONS,
+        STAT_NETWORK_BYTES,
+        STAT_LOAD_TIME_NS,
+        STAT_SAVE_TIME_NS,
+        STAT_NETWORK_TIME_NS,
+        STAT_COUNT
+    };
+
+    /* INSTRUMENT_* bits of what is switched on (stats.cpp) */
+    extern std::atomic<int> g_instrumentation;
+
+    void stat_add_enabled(StatCounter counter, uint64_t value);
+    void trace_end_enabled(uint64_t start, TraceEvent event, const char* name, uint8_t chunk_type,
+                           uint64_t bytes, Error result);
+    uint64_t trace_clock();
+
+    /* Count toward get_stats(); one relaxed load while counting is off */
+    inline void stat_add(StatCounter counter, uint64_t value) {
+        if (g_instrumentation.load(std::memory_order_relaxed) & INSTRUMENT_STATS) stat_add_enabled(counter, value);
+    }
+
+    /* Start of a traced operation, or 0 while counters and tracing are both off */
+    inline uint64_t trace_begin() {
+        return g_instrumentation.load(std::memory_order_relaxed) ? trace_clock() : 0;
+    }
+
+    /* Finish an operation from trace_begin(): counts it and reports it to the trace callback */
+    inline void trace_end(uint64_t start, TraceEvent event, const char* name, uint8_t chunk_type,
+                          uint64_t bytes, Error result) {
+        if (start) trace_end_enabled(start, event, name, chunk_type, bytes, result);
+    }
+
+    /* All library allocations, through the set_allocator() hooks (alloc.cpp) */
+    void* mem_malloc(size_t size);
+    void* mem_calloc(size_t count, size_t size);
+    void* mem_realloc(void* ptr, size_t size);
+    void mem_free(void* ptr);
+
+    /* Arenas; memory is released only by arena_destroy() (alloc.cpp) */
+    Arena* arena_create(size_t block_size);
+    void* arena_alloc(Arena* arena, size_t size);
+    void arena_destroy(Arena* arena);
+    size_t package_arena_size();  /* From set_package_arena() */
+
+    /* Package-owned memory: from the package arena if it has one. Release
+       ignores borrowed (mapped) data, frees adopted buffers and dedicated
+       arena blocks, and leaves the rest to free() */
+    void* package_alloc(Package* package, size_t size);
+    void* package_realloc(Package* package, void* ptr, size_t old_size, size_t size);
+    void package_release(Package* package, void* ptr);
+    char* package_strdup(Package* package, const char* str);
+
+    /* Memory mapping helpers (file.cpp) */
+    bool map_file(const char* filename, MappedFile* mapping);
+    void unmap_file(MappedFile* mapping);
+
+    /* Positional file reads (file.cpp); safe to call from several threads */
+    bool file_open(const char* filename, FileHandle* file);
+    bool file_size(const FileHandle* file, uint64_t* size);
+    bool file_read_at(const FileHandle* file, uint64_t offset, void* buffer, size_t size);
+    void file_close(FileHandle* file);
+
+    /* Size and modification time of a file by name, for cache validation (file.cpp) */
+    bool file_stat(const char* filename, uint64_t* size, uint64_t* mtime_ns);
+
+    /* Read-write access for in-place updates (file.cpp) */
+    bool file_open_update(const char* filename, FileHandle* file);
+    bool file_write_at(const FileHandle* file, uint64_t offset, const void* buffer, size_t size);
+    bool file_truncate(const FileHandle* file, uint64_t size);
+
+    /* Read a whole file into a malloc()ed buffer; error may be NULL (io.cpp) */
+    uint8_t* read_file(const char* filename, size_t* size, Error* error);
+
+    /* load() reporting why it failed; error may be NULL (io.cpp) */
+    Package* load_file(const char* filename, Error* error);
+
+    /* Run fn(index) for every index in [0, count) on up to 'threads' threads
+       (0 for one per core), each pulling the next index from a shared counter (batch.cpp) */
+    void parallel_for(size_t count, unsigned threads, void (*fn)(size_t index, void* context), void* context);
+
+    /* An operation submitted to an AsyncContext (async.cpp) */
+    struct AsyncJob {
+        AsyncContext* context;
+        AsyncCallback callback;
+        AsyncCompletion completion;
+        char* name;            /* File name or URL */
+        Session* session;      /* URL range reads; NULL for the process-wide session */
+        size_t offset;         /* Audio or range reads */
+        size_t size;
+        uint64_t file_offset;  /* Audio reads queued on an io_uring: where the range starts in the file */
+        uint32_t timeout_ms;   /* URL loads */
+        AsyncJob* next;
     };
 
+    /* Queue a finished job for async_poll() (async.cpp) */
+    void async_complete(AsyncJob* job);
+
+#ifdef DMUSICPAK_ENABLE_NETWORK
+    /* URL range reads of an AsyncContext, run on one curl multi handle by a
+       thread of their own; each finished job goes to async_complete(). Freeing
+       waits for the transfers in flight (network.cpp) */
+    struct AsyncTransfers;
+    AsyncTransfers* create_async_transfers();
+    bool submit_async_transfer(AsyncTransfers* transfers, AsyncJob* job);
+    void free_async_transfers(AsyncTransfers* transfers);
+
+    /* Version of a URL from a HEAD request: its ETag, else its Last-Modified
+       date, else empty; false if the request fails (network.cpp) */
+    bool url_validator(Session* session, const char* url, char* validator, size_t size);
+#endif
+
+    /* Atomically replace 'to' with 'from' (file.cpp) */
+    bool file_replace(const char* from, const char* to);
+
+    /* Directory entries as reported by list_directory(); links are DIR_ENTRY_OTHER */
+    enum DirEntryKind {
+        DIR_ENTRY_FILE,
+        DIR_ENTRY_DIRECTORY,
+        DIR_ENTRY_OTHER
+    };
+    using DirectoryCallback = bool (*)(const char* name, DirEntryKind kind, void* context);
+
+    /* Call fn for every entry of a directory except "." and "..", until it returns
+       false; false if the directory cannot be opened (file.cpp) */
+    bool list_directory(const char* path, DirectoryCallback fn, void* context);
+
+    /* Write all bytes to a descriptor, or copy a file range to it (sendfile where
+       available); 'sent' is advanced by what was written, even on failure (file.cpp) */
+    bool fd_write(int fd, const void* data, size_t size, uint64_t* sent);
+    bool file_send(const FileHandle* file, uint64_t offset, uint64_t size, int fd, uint64_t* sent);
+
+    /* Chunk headers by format version (dmusicpak.cpp) */
+    bool is_supported_version(uint32_t version);
+    size_t chunk_header_size(uint32_t version);
+    uint64_t read_chunk_size(const uint8_t* header, uint32_t version);  /* header starts at type */
+    void write_chunk_header(uint8_t* header, uint8_t type, uint64_t size, uint32_t version);
+
+    /* CRC32C, continuing from crc (0 to start) (checksum.cpp) */
+    uint32_t crc32c(uint32_t crc, const void* data, size_t size);
+
+    /* Decode a checksum chunk; false if it is malformed (checksum.cpp) */
+    bool read_checksum_chunk(const uint8_t* chunk, uint64_t size, ChecksumTable* table);
+
+    /* True if the table holds a checksum for this chunk type */
+    bool has_checksum(const ChecksumTable* table, uint8_t type);
+
+    /* Store a checksum chunk in the package; saving it again keeps checksums (checksum.cpp) */
+    bool adopt_checksums(Package* package, const uint8_t* chunk, uint64_t size);
+
+    /* Check that every checksummed chunk is indexed and that the data at
+       data + offset matches for the types not in the 'hashed' mask, which
+       were verified already (checksum.cpp) */
+    Error check_checksums(const Package* package, const uint8_t* data, uint32_t hashed);
+
+    /* Read from the backing file or source of a lazily loaded package (dmusicpak.cpp) */
+    bool package_read_at(const Package* package, uint64_t offset, void* buffer, size_t size);
+
+    /* Decode a whole package from a buffer in one bounds-checked pass; with
+       borrow, payloads point into the buffer and are checksummed in place. error
+       may be NULL (io.cpp). Not traced, unlike the public loaders built on it. */
+    Package* parse_package(const uint8_t* data, size_t size, bool borrow, Error* error);
+
+    /* Build the chunk index from the first bytes of a package (io.cpp) */
+    bool index_package(Package* package, uint64_t size, const uint8_t* head, size_t head_size);
+
+    /* share(), optionally leaving the cover chunk in the package file (dmusicpak.cpp) */
+    Error share_package(Package* package, bool load_cover);
+
+    /* Find first chunk entry of the given type, or NULL */
+    const ChunkEntry* find_chunk(const Package* package, uint8_t type);
+
+    /* Append an entry to the chunk index; type may carry CHUNK_COMPRESSED (io.cpp) */
+    bool add_chunk_entry(Package* package, uint8_t type, uint64_t offset, uint64_t size);
+
+    /* A package laid out for writing inside another file, e.g. an album track (io.cpp).
+       metadata, when set, is written instead of the package's; without_cover leaves
+       the cover out; base is where the package starts in that file, so payloads
+       align to absolute offsets. The package must stay unchanged until the plan is freed. */
+    struct PackagePlan;
+    Error plan_package(const Package* package, const Metadata* metadata, bool without_cover,
+                       uint64_t base, PackagePlan** plan);
+    uint64_t package_plan_size(const PackagePlan* plan);
+    Error write_package_plan(PackagePlan* plan, FILE* file);
+    void free_package_plan(PackagePlan* plan);
+
+    /* Metadata chunk serialization (io.cpp) */
+    size_t metadata_chunk_size(const Metadata* metadata);
+    size_t write_metadata_chunk(uint8_t* buffer, const Metadata* metadata);
+
+    /* Chunk decoding shared by the loaders and the push parser (io.cpp) */
+    bool chunk_prefix_size(uint8_t type, const uint8_t* chunk, size_t available, size_t* prefix);
+    Error apply_chunk(Package* package, uint8_t type, const uint8_t* chunk, size_t chunk_size,
+                      uint8_t* payload, size_t payload_size);
+
+    /* Cover thumbnails (thumbnail.cpp) */
+    void release_thumbnails(Package* package);
+
+    /* Incremental parser fed with package bytes as they arrive (stream_parser.cpp) */
+    struct PushParser;
+    PushParser* parser_create(const StreamListener* listener, size_t chunk_size);
+    bool parser_feed(PushParser* parser, const uint8_t* data, size_t size);
+    Package* parser_finish(PushParser* parser);  /* Releases parser, returns package or NULL */
+
+    /* Read the cover of a load_index() package into a caller-owned Cover, leaving the package as it is (io.cpp) */
+    Error read_cover_from_file(const Package* package, Cover* cover);
+
+    /* Locate the audio payload of a load_index() package without reading it (io.cpp) */
+    Error locate_audio(Package* package, uint64_t* offset, uint64_t* size);
+
+    /* Read located audio payload bytes, decoding frames of compressed audio (io.cpp) */
+    bool read_audio(Package* package, uint64_t offset, void* buffer, size_t size);
+    void free_frame_index(FrameIndex* index);
+
+    /* Per-chunk compression (compress.cpp); codecs fail when built without ENABLE_COMPRESSION */
+    bool compression_available(Compression codec);
+    bool read_frame_header(const uint8_t* chunk, uint64_t size, FrameHeader* header);
+    uint64_t frame_raw_size(const FrameHeader* header, uint32_t frame);
+    bool decode_frame(uint32_t codec, const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_size);
+    bool decode_chunk(const uint8_t* chunk, uint64_t size, uint8_t** raw, size_t* raw_size);
+    bool encode_chunk(Compression codec, int level,
+                      const uint8_t* head, size_t head_size,
+                      const uint8_t* body, size_t body_size,
+                      uint8_t** out, size_t* out_size);
+
+    /* Seek tables (seek.cpp); build_seek_table() scans the payload, metadata may be NULL */
+    bool build_seek_table(const Audio* audio, const Metadata* metadata, uint32_t interval_ms, SeekTable** table);
+    size_t seek_chunk_size(const SeekTable* table);
+    void write_seek_chunk(uint8_t* buffer, const SeekTable* table);
+    bool read_seek_chunk(const uint8_t* chunk, uint64_t size, SeekTable** table);
+    bool adopt_seek_table(Package* package, const uint8_t* chunk, uint64_t size);
+    void free_seek_table(SeekTable* table);
+
+    /* Read the seek chunk of a load_index() package (io.cpp) */
+    Error load_seek_table(Package* package);
+
+    /* True if ptr points into the package's file mapping (not owned) */
+    bool is_borrowed(const Package* package, const void* ptr);
+
     /* Little-endian integer writing functions */
     void write_uint32_le(uint8_t* buffer, uint32_t value);
     void write_uint16_le(uint8_t* buffer, uint16_t value);
+    void write_uint64_le(uint8_t* buffer, uint64_t value);
 
     /* Little-endian integer reading functions */
     uint32_t read_uint32_le(const uint8_t* buffer);
     uint16_t read_uint16_le(const uint8_t* buffer);
+    uint64_t read_uint64_le(const uint8_t* buffer);
+
+    /* Bounds-checked cursor over a chunk. A read past the end returns zeros
+       and sets 'overrun', so a parser checks once after its last field */
+    struct ByteReader {
+        const uint8_t* data;
+        size_t size;
+        size_t offset;
+        bool overrun;
+    };
+
+    inline ByteReader byte_reader(const uint8_t* data, size_t size) {
+        ByteReader reader = { data, size, 0, false };
+        return reader;
+    }
+
+    /* The next n bytes, or NULL if fewer are left */
+    inline const uint8_t* reader_take(ByteReader* reader, size_t n) {
+        if (reader->overrun || n > reader->size - reader->offset) {
+            reader->overrun = true;
+            return NULL;
+        }
+        const uint8_t* bytes = reader->data + reader->offset;
+        reader->offset += n;
+        return bytes;
+    }
+
+    inline uint32_t reader_u32(ByteReader* reader) {
+        const uint8_t* bytes = reader_take(reader, 4);
+        return bytes ? read_uint32_le(bytes) : 0;
+    }
+
+    inline uint16_t reader_u16(ByteReader* reader) {
+        const uint8_t* bytes = reader_take(reader, 2);
+        return bytes ? read_uint16_le(bytes) : 0;
+    }
 
 } // namespace dmusicpak
 #endif
@@ -11,16 +11,6 @@
 
 using namespace dmusicpak;
 
-/* File format constants */
-#define DMUSICPAK_MAGIC "DMPK"
-#define DMUSICPAK_VERSION 2
-
-/* Chunk type identifiers */
-#define CHUNK_METADATA 0x01
-#define CHUNK_LYRICS   0x02
-#define CHUNK_AUDIO    0x03
-#define CHUNK_COVER    0x04
-
 /* File header structure */
 typedef struct {
     char magic[4];      /* "DMPK" */
@@ -28,12 +18,19 @@ typedef struct {
     uint32_t num_chunks;/* Number of data chunks */
 } file_header_t;
 
-/* Chunk header structure */
+/* Chunk header structure (size is uint64 in version 3 files) */
 typedef struct {
     uint8_t type;       /* Chunk type */
     uint32_t size;      /* Chunk data size */
 } chunk_header_t;
 
+/* Table-of-contents entry (TOC chunk holds uint32 count + entries) */
+typedef struct {
+    uint8_t type;       /* Chunk type */
+    uint64_t offset;    /* Absolute offset of chunk data */
+    uint64_t size;      /* Chunk data size */
+} toc_entry_t;
+
 /* Write string to buffer */
 static size_t write_string(uint8_t* buffer, const char* str) {
     if (!str) {
@@ -49,24 +46,23 @@ static size_t write_string(uint8_t* buffer, const char* str) {
     return 4 + len;
 }
 
-/* Read string from buffer */
-static size_t read_string(const uint8_t* buffer, char** str) {
-    uint32_t len = read_uint32_le(buffer);
-    if (len == 0) {
-        *str = NULL;
-        return 4;
-    }
+/* Read a length-prefixed string into package memory; false only if allocation fails */
+static bool read_string(Package* package, ByteReader* reader, char** str) {
+    *str = NULL;
+    uint32_t len = reader_u32(reader);
+    const uint8_t* data = reader_take(reader, len);
+    if (len == 0 || !data) return true;
 
-    *str = (char*)malloc(len + 1);
-    if (!*str) return 0;
+    *str = (char*)package_alloc(package, (size_t)len + 1);
+    if (!*str) return false;
 
-    memcpy(*str, buffer + 4, len);
+    memcpy(*str, data, len);
     (*str)[len] = '\0';
-    return 4 + len;
+    return true;
 }
 
 /* Calculate metadata chunk size */
-static size_t calculate_metadata_size(const Metadata* metadata) {
+size_t dmusicpak::metadata_chunk_size(const Metadata* metadata) {
     size_t size = 0;
     size += 4 + (metadata->title ? strlen(metadata->title) : 0);
     size += 4 + (metadata->artist ? strlen(metadata->artist) : 0);
@@ -79,7 +75,7 @@ static size_t calculate_metadata_size(const Metadata* metadata) {
 }
 
 /* Write metadata chunk */
-static size_t write_metadata_chunk(uint8_t* buffer, const Metadata* metadata) {
+size_t dmusicpak::write_metadata_chunk(uint8_t* buffer, const Metadata* metadata) {
     size_t offset = 0;
 
     offset += write_string(buffer + offset, metadata->title);
@@ -101,184 +97,983 @@ static size_t write_metadata_chunk(uint8_t* buffer, const Metadata* metadata) {
     return offset;
 }
 
-/* Read metadata chunk */
-static size_t read_metadata_chunk(const uint8_t* buffer, Metadata* metadata) {
-    size_t offset = 0;
+/* Read a metadata chunk of 'size' bytes; bytes after the known fields are ignored */
+static Error read_metadata_chunk(Package* package, const uint8_t* chunk, size_t size) {
+    Metadata metadata;
+    memset(&metadata, 0, sizeof(metadata));
+    char** strings[] = {
+        &metadata.title, &metadata.artist, &metadata.album,
+        &metadata.genre, &metadata.year, &metadata.comment
+    };
+
+    ByteReader reader = byte_reader(chunk, size);
+    bool allocated = true;
+    for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]) && allocated; i++) {
+        allocated = read_string(package, &reader, strings[i]);
+    }
+    metadata.duration_ms = reader_u32(&reader);
+    metadata.bitrate = reader_u32(&reader);
+    metadata.sample_rate = reader_u32(&reader);
+    metadata.channels = reader_u16(&reader);
+
+    if (!allocated || reader.overrun) {
+        for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) package_release(package, *strings[i]);
+        return allocated ? Error::CORRUPTED : Error::MEMORY_ALLOC;
+    }
+
+    package->metadata = metadata;
+    return Error::OK;
+}
+
+/* One chunk scheduled for writing */
+typedef struct {
+    uint8_t type;
+    uint64_t size;              /* Chunk data size */
+    uint64_t offset;            /* Chunk data offset in the output */
+    const ChunkEntry* source;   /* Not loaded yet: copy raw from the backing file */
+    uint8_t* encoded;           /* Data built while planning (compressed or generated), written as is */
+    uint32_t checksum;          /* CRC32C of the chunk data (with checksums enabled) */
+    uint32_t padding;           /* Data size of a padding chunk written after this one (0 for none) */
+    uint64_t lead;              /* Bytes of a padding chunk written before this one, header included (0 for none) */
+} planned_chunk_t;
+
+/* Metadata, lyrics, seek table, audio, cover and thumbnails, plus the checksum chunk */
+#define MAX_PLANNED_CHUNKS 7
+
+/* Destination for serialized package bytes: memory buffer, stdio stream or neither (hash only) */
+typedef struct {
+    uint8_t* buffer;
+    size_t offset;
+    FILE* file;
+    int hashing;                /* Fold written bytes into crc */
+    uint32_t crc;
+} sink_t;
+
+/* Block size for copying unloaded chunks from the backing file */
+#define COPY_BLOCK_SIZE (64 * 1024)
+
+static bool sink_write(sink_t* sink, const void* data, size_t size) {
+    if (size == 0) return true;
+    if (sink->hashing) sink->crc = crc32c(sink->crc, data, size);
+    if (sink->file) {
+        if (fwrite(data, 1, size, sink->file) != size) return false;
+        sink->offset += size;
+        stat_add(STAT_BYTES_WRITTEN, size);
+        return true;
+    }
+
+    if (sink->buffer) {
+        memcpy(sink->buffer + sink->offset, data, size);
+        sink->offset += size;
+        stat_add(STAT_BYTES_WRITTEN, size);
+        stat_add(STAT_BYTES_COPIED, size);
+    }
+    return true;
+}
+
+/* Schedule one chunk if it is loaded or still only indexed (load_index packages) */
+static void plan_chunk(const Package* package, uint8_t type, int loaded, uint64_t size,
+                       planned_chunk_t* chunks, uint32_t* count) {
+    const ChunkEntry* source = NULL;
+    if (!loaded) {
+        source = package->has_file ? find_chunk(package, type) : NULL;
+        if (!source) return;
+        size = source->size;
+        if (source->compressed) type |= CHUNK_COMPRESSED;
+    }
+
+    chunks[*count].type = type;
+    chunks[*count].size = size;
+    chunks[*count].source = source;
+    chunks[*count].encoded = NULL;
+    chunks[*count].padding = 0;
+    chunks[*count].lead = 0;
+    (*count)++;
+}
+
+/* Serialized form of a loaded chunk: malloc()ed fields followed by the payload */
+static Error serialize_chunk(const Package* package, uint8_t type, uint8_t** head, size_t* head_size,
+                             const uint8_t** body, size_t* body_size) {
+    size_t size = 0;
+    *body = NULL;
+    *body_size = 0;
+    switch (type) {
+        case CHUNK_METADATA: size = metadata_chunk_size(&package->metadata); break;
+        case CHUNK_LYRICS: size = 4; break;
+        case CHUNK_AUDIO:
+            size = 8 + (package->audio.source_filename ? strlen(package->audio.source_filename) : 0);
+            break;
+        case CHUNK_COVER: size = 12; break;
+        case CHUNK_THUMBNAILS: size = 4; break;
+    }
+
+    *head = (uint8_t*)mem_malloc(size);
+    if (!*head) return Error::MEMORY_ALLOC;
+    *head_size = size;
+
+    uint8_t* fields = *head;
+    switch (type) {
+        case CHUNK_METADATA:
+            write_metadata_chunk(fields, &package->metadata);
+            break;
+
+        case CHUNK_LYRICS:
+            write_uint32_le(fields, (uint32_t)package->lyrics.format);
+            *body = package->lyrics.data;
+            *body_size = package->lyrics.size;
+            break;
+
+        case CHUNK_AUDIO:
+            write_uint32_le(fields, (uint32_t)package->audio.format);
+            write_uint32_le(fields + 4, (uint32_t)(size - 8));
+            if (size > 8) memcpy(fields + 8, package->audio.source_filename, size - 8);
+            *body = package->audio.data;
+            *body_size = package->audio.size;
+            break;
+
+        case CHUNK_COVER:
+            write_uint32_le(fields, (uint32_t)package->cover.format);
+            write_uint32_le(fields + 4, package->cover.width);
+            write_uint32_le(fields + 8, package->cover.height);
+            *body = package->cover.data;
+            *body_size = package->cover.size;
+            break;
+
+        case CHUNK_THUMBNAILS:
+            write_uint32_le(fields, package->thumbnail_count);
+            *body = package->thumbnails;
+            *body_size = package->thumbnails_size;
+            break;
+    }
+    return Error::OK;
+}
+
+/* Text and uncompressed media are worth compressing; MP3, FLAC, JPEG etc. are not */
+static bool is_compressible(const Package* package, uint8_t type) {
+    switch (type) {
+        case CHUNK_METADATA:
+        case CHUNK_LYRICS: return true;
+        case CHUNK_AUDIO: return package->audio.format == AudioFormat::WAV;
+        case CHUNK_COVER: return package->cover.format == CoverFormat::BMP;
+    }
+    return false;
+}
+
+/* Compress a loaded chunk; it stays as it is if that would not make it smaller */
+static Error encode_planned_chunk(const Package* package, planned_chunk_t* chunk) {
+    const SaveOptions* options = &package->save_options;
+
+    uint8_t* head = NULL;
+    size_t head_size = 0;
+    const uint8_t* body = NULL;
+    size_t body_size = 0;
+    Error result = serialize_chunk(package, chunk->type, &head, &head_size, &body, &body_size);
+    if (result != Error::OK) return result;
+
+    uint8_t* encoded = NULL;
+    size_t encoded_size = 0;
+    if (!encode_chunk(options->compression, options->compression_level,
+                      head, head_size, body, body_size, &encoded, &encoded_size)) {
+        result = Error::MEMORY_ALLOC;
+    } else if (encoded_size < chunk->size) {
+        chunk->type |= CHUNK_COMPRESSED;
+        chunk->size = encoded_size;
+        chunk->encoded = encoded;
+    } else {
+        mem_free(encoded);
+    }
+
+    mem_free(head);
+    return result;
+}
+
+/* Schedule a seek table for loaded audio, reusing the package's when it has the right spacing */
+static Error plan_seek_table(const Package* package, planned_chunk_t* chunks, uint32_t* count) {
+    uint32_t interval_ms = package->save_options.seek_interval_ms;
+    SeekTable* built = NULL;
+    const SeekTable* table = package->seek_table;
+    if (!table || table->interval_ms != interval_ms) {
+        /* Audio without frames to index gets no table */
+        if (!build_seek_table(&package->audio, package->has_metadata ? &package->metadata : NULL,
+                              interval_ms, &built)) {
+            return Error::OK;
+        }
+        table = built;
+    }
+
+    size_t size = seek_chunk_size(table);
+    uint8_t* data = (uint8_t*)mem_malloc(size);
+    if (data) write_seek_chunk(data, table);
+    free_seek_table(built);
+    if (!data) return Error::MEMORY_ALLOC;
+
+    chunks[*count].type = CHUNK_SEEK;
+    chunks[*count].size = size;
+    chunks[*count].source = NULL;
+    chunks[*count].encoded = data;
+    chunks[*count].padding = 0;
+    chunks[*count].lead = 0;
+    (*count)++;
+    return Error::OK;
+}
+
+/* Size of the fields before the payload of a planned audio or cover chunk stored as is */
+static bool planned_prefix(const Package* package, const planned_chunk_t* chunk, uint64_t* prefix) {
+    if (chunk->encoded || (chunk->type & CHUNK_COMPRESSED)) return false;
+
+    if (chunk->type == CHUNK_COVER) {
+        *prefix = 12;
+        return true;
+    }
+    if (chunk->type != CHUNK_AUDIO) return false;
+
+    if (!chunk->source) {
+        *prefix = 8 + (package->audio.source_filename ? strlen(package->audio.source_filename) : 0);
+        return true;
+    }
+
+    /* Copied from the backing file: the filename length is stored there */
+    uint8_t head[8];
+    if (chunk->size < sizeof(head) || !package_read_at(package, chunk->source->offset, head, sizeof(head))) {
+        return false;
+    }
+    *prefix = 8 + (uint64_t)read_uint32_le(head + 4);
+    return *prefix <= chunk->size;
+}
+
+/* Free buffers held by a plan */
+static void release_plan(planned_chunk_t* chunks, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        mem_free(chunks[i].encoded);
+        chunks[i].encoded = NULL;
+    }
+}
+
+/* Compute the on-disk layout of every chunk the package will write; metadata,
+   when set, is written instead of the package's, and without_cover drops the cover and its thumbnails.
+   base is the file offset the package starts at, which payload alignment counts from */
+static Error plan_chunks(const Package* package, planned_chunk_t* chunks, uint32_t* count,
+                         uint32_t* version, const Metadata* metadata, bool without_cover, uint64_t base) {
+    *count = 0;
+
+    if (metadata) {
+        size_t size = metadata_chunk_size(metadata);
+        uint8_t* data = (uint8_t*)mem_malloc(size);
+        if (!data) return Error::MEMORY_ALLOC;
+        write_metadata_chunk(data, metadata);
+
+        chunks[0].type = CHUNK_METADATA;
+        chunks[0].size = size;
+        chunks[0].source = NULL;
+        chunks[0].encoded = data;
+        chunks[0].padding = 0;
+        chunks[0].lead = 0;
+        *count = 1;
+    } else {
+        plan_chunk(package, CHUNK_METADATA, package->has_metadata,
+                   metadata_chunk_size(&package->metadata), chunks, count);
+    }
+    plan_chunk(package, CHUNK_LYRICS, package->has_lyrics,
+               4 + package->lyrics.size, chunks, count);
+
+    /* The seek table precedes the audio so streaming readers have it before the first frame;
+       one in the backing file still matches audio that is copied from there too */
+    if (package->has_audio && package->save_options.seek_interval_ms > 0) {
+        Error result = plan_seek_table(package, chunks, count);
+        if (result != Error::OK) {
+            release_plan(chunks, *count);
+            return result;
+        }
+    } else if (!package->has_audio) {
+        plan_chunk(package, CHUNK_SEEK, 0, 0, chunks, count);
+    }
+
+    plan_chunk(package, CHUNK_AUDIO, package->has_audio,
+               4 + 4 + (package->audio.source_filename ? strlen(package->audio.source_filename) : 0) +
+               package->audio.size, chunks, count);
+    if (!without_cover) {
+        plan_chunk(package, CHUNK_COVER, package->has_cover,
+                   4 + 4 + 4 + package->cover.size, chunks, count);
+
+        /* Cleared thumbnails are loaded but empty and drop the chunk */
+        if (!package->has_thumbnails || package->thumbnail_count > 0) {
+            plan_chunk(package, CHUNK_THUMBNAILS, package->has_thumbnails,
+                       4 + package->thumbnails_size, chunks, count);
+        }
+    }
+
+    /* Chunks still in the backing file are copied as stored, compressed or not */
+    if (package->save_options.compression != Compression::NONE) {
+        if (!compression_available(package->save_options.compression)) {
+            release_plan(chunks, *count);
+            return Error::NOT_SUPPORTED;
+        }
+
+        for (uint32_t i = 0; i < *count; i++) {
+            if (chunks[i].source || chunks[i].encoded || !is_compressible(package, chunks[i].type)) continue;
+
+            Error result = encode_planned_chunk(package, &chunks[i]);
+            if (result != Error::OK) {
+                release_plan(chunks, *count);
+                return result;
+            }
+        }
+    }
+
+    /* Checksums go right after the TOC so readers know them before any data */
+    if (package->save_options.checksums && *count > 0) {
+        memmove(chunks + 1, chunks, *count * sizeof(planned_chunk_t));
+        chunks[0].type = CHUNK_CHECKSUM;
+        chunks[0].size = 8 + (uint64_t)*count * CHECKSUM_ENTRY_SIZE;
+        chunks[0].source = NULL;
+        chunks[0].encoded = NULL;
+        chunks[0].padding = 0;
+        chunks[0].lead = 0;
+        (*count)++;
+    }
 
-    offset += read_string(buffer + offset, &metadata->title);
-    offset += read_string(buffer + offset, &metadata->artist);
-    offset += read_string(buffer + offset, &metadata->album);
-    offset += read_string(buffer + offset, &metadata->genre);
-    offset += read_string(buffer + offset, &metadata->year);
-    offset += read_string(buffer + offset, &metadata->comment);
+    /* Room for update_metadata() and update_lyrics() to grow these chunks in place */
+    for (uint32_t i = 0; i < *count; i++) {
+        uint8_t type = chunks[i].type & ~CHUNK_COMPRESSED;
+        if (type == CHUNK_METADATA || type == CHUNK_LYRICS) chunks[i].padding = package->save_options.padding;
+    }
 
-    metadata->duration_ms = read_uint32_le(buffer + offset);
+    /* Version 2 unless some chunk does not fit a 32-bit size */
+    *version = DMUSICPAK_VERSION;
+    for (uint32_t i = 0; i < *count; i++) {
+        if (chunks[i].size > 0xFFFFFFFFu) *version = DMUSICPAK_VERSION_LARGE;
+    }
+    size_t header_size = chunk_header_size(*version);
+
+    /* TOC chunk comes first so readers can locate everything after one read */
+    uint32_t alignment = package->save_options.alignment;
+    uint64_t offset = FILE_HEADER_SIZE + header_size + 4 + (uint64_t)*count * TOC_ENTRY_SIZE;
+    for (uint32_t i = 0; i < *count; i++) {
+        /* A padding chunk in front moves the payload onto the boundary; the smallest is a bare header */
+        uint64_t prefix = 0;
+        if (alignment > 0 && planned_prefix(package, &chunks[i], &prefix)) {
+            uint64_t lead = (alignment - (base + offset + header_size + prefix) % alignment) % alignment;
+            if (lead > 0 && lead < header_size) lead += alignment;
+            chunks[i].lead = lead;
+            offset += lead;
+        }
+        chunks[i].offset = offset + header_size;
+        offset += header_size + chunks[i].size;
+        if (chunks[i].padding > 0) offset += header_size + chunks[i].padding;
+    }
+
+    return Error::OK;
+}
+
+/* Total output size of a planned package */
+static uint64_t planned_size(const planned_chunk_t* chunks, uint32_t count, uint32_t version) {
+    if (count == 0) return FILE_HEADER_SIZE + chunk_header_size(version) + 4;
+
+    const planned_chunk_t* last = &chunks[count - 1];
+    uint64_t padding = last->padding > 0 ? chunk_header_size(version) + last->padding : 0;
+    return last->offset + last->size + padding;
+}
+
+/* Write file header and TOC chunk */
+static Error write_header(const planned_chunk_t* chunks, uint32_t count, uint32_t version, sink_t* sink) {
+    size_t size = FILE_HEADER_SIZE + chunk_header_size(version) + 4 + (size_t)count * TOC_ENTRY_SIZE;
+    uint8_t* head = (uint8_t*)mem_malloc(size);
+    if (!head) return Error::MEMORY_ALLOC;
+
+    /* Padding chunks count as chunks but are not listed in the TOC */
+    uint32_t num_chunks = count + 1;
+    for (uint32_t i = 0; i < count; i++) {
+        if (chunks[i].padding > 0) num_chunks++;
+        if (chunks[i].lead > 0) num_chunks++;
+    }
+
+    size_t offset = 0;
+    memcpy(head + offset, DMUSICPAK_MAGIC, 4);
     offset += 4;
-    metadata->bitrate = read_uint32_le(buffer + offset);
+    write_uint32_le(head + offset, version);
     offset += 4;
-    metadata->sample_rate = read_uint32_le(buffer + offset);
+    write_uint32_le(head + offset, num_chunks);
     offset += 4;
-    metadata->channels = read_uint16_le(buffer + offset);
-    offset += 2;
 
-    return offset;
+    write_chunk_header(head + offset, CHUNK_TOC, 4 + count * TOC_ENTRY_SIZE, version);
+    offset += chunk_header_size(version);
+    write_uint32_le(head + offset, count);
+    offset += 4;
+    for (uint32_t i = 0; i < count; i++) {
+        head[offset++] = chunks[i].type;
+        write_uint64_le(head + offset, chunks[i].offset);
+        offset += 8;
+        write_uint64_le(head + offset, chunks[i].size);
+        offset += 8;
+    }
+
+    bool ok = sink_write(sink, head, offset);
+    mem_free(head);
+    return ok ? Error::OK : Error::IO;
+}
+
+/* Copy an unloaded chunk's data from the backing file in fixed blocks */
+static Error copy_chunk_from_file(const Package* package, const ChunkEntry* source, sink_t* sink) {
+    uint8_t* block = (uint8_t*)mem_malloc(COPY_BLOCK_SIZE);
+    if (!block) return Error::MEMORY_ALLOC;
+
+    Error result = Error::OK;
+    uint64_t offset = 0;
+    while (offset < source->size && result == Error::OK) {
+        size_t to_copy = COPY_BLOCK_SIZE;
+        if (offset + to_copy > source->size) to_copy = (size_t)(source->size - offset);
+
+        if (!package_read_at(package, source->offset + offset, block, to_copy)) {
+            result = Error::IO;
+        } else if (!sink_write(sink, block, to_copy)) {
+            result = Error::IO;
+        }
+        offset += to_copy;
+    }
+
+    mem_free(block);
+    return result;
+}
+
+/* Write the data of one chunk; payloads go from package memory to the sink without staging */
+static Error write_chunk_data(const Package* package, const planned_chunk_t* chunk, sink_t* sink) {
+    if (chunk->source) return copy_chunk_from_file(package, chunk->source, sink);
+    if (chunk->encoded) return sink_write(sink, chunk->encoded, (size_t)chunk->size) ? Error::OK : Error::IO;
+
+    uint8_t* head = NULL;
+    size_t head_size = 0;
+    const uint8_t* body = NULL;
+    size_t body_size = 0;
+    Error result = serialize_chunk(package, chunk->type, &head, &head_size, &body, &body_size);
+    if (result != Error::OK) return result;
+
+    bool ok = sink_write(sink, head, head_size) && sink_write(sink, body, body_size);
+    mem_free(head);
+    return ok ? Error::OK : Error::IO;
+}
+
+/* CRC32C of every data chunk, before anything is written */
+static Error compute_checksums(const Package* package, planned_chunk_t* chunks, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        planned_chunk_t* chunk = &chunks[i];
+        if (chunk->type == CHUNK_CHECKSUM) continue;
+
+        /* Unloaded chunks keep the checksum stored in their file (re-checked while copying) */
+        uint8_t type = chunk->type & ~CHUNK_COMPRESSED;
+        if (chunk->source && has_checksum(&package->checksums, type)) {
+            chunk->checksum = package->checksums.checksum[type];
+            continue;
+        }
+
+        sink_t hash;
+        memset(&hash, 0, sizeof(hash));
+        hash.hashing = 1;
+        Error result = write_chunk_data(package, chunk, &hash);
+        if (result != Error::OK) return result;
+        chunk->checksum = hash.crc;
+    }
+    return Error::OK;
+}
+
+/* Write a padding chunk of 'size' zero bytes */
+static Error write_padding_chunk(uint64_t size, uint32_t version, sink_t* sink) {
+    static const uint8_t zeros[COPY_BLOCK_SIZE] = {0};
+
+    uint8_t head[CHUNK_HEADER_SIZE_LARGE];
+    write_chunk_header(head, CHUNK_PADDING, size, version);
+    if (!sink_write(sink, head, chunk_header_size(version))) return Error::IO;
+
+    while (size > 0) {
+        size_t to_write = size < sizeof(zeros) ? (size_t)size : sizeof(zeros);
+        if (!sink_write(sink, zeros, to_write)) return Error::IO;
+        size -= to_write;
+    }
+    return Error::OK;
+}
+
+/* Write the checksum chunk listing every other planned chunk */
+static Error write_checksum_chunk(const planned_chunk_t* chunks, uint32_t count, sink_t* sink) {
+    uint8_t data[8 + MAX_PLANNED_CHUNKS * CHECKSUM_ENTRY_SIZE];
+    size_t offset = 8;
+    uint32_t entries = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (chunks[i].type == CHUNK_CHECKSUM) continue;
+        data[offset] = chunks[i].type & ~CHUNK_COMPRESSED;
+        write_uint32_le(data + offset + 1, chunks[i].checksum);
+        offset += CHECKSUM_ENTRY_SIZE;
+        entries++;
+    }
+    write_uint32_le(data, CHECKSUM_CRC32C);
+    write_uint32_le(data + 4, entries);
+
+    return sink_write(sink, data, offset) ? Error::OK : Error::IO;
+}
+
+/* Serialize a planned package into the sink */
+static Error write_package(const Package* package, planned_chunk_t* chunks,
+                           uint32_t count, uint32_t version, sink_t* sink) {
+    bool checksums = count > 0 && chunks[0].type == CHUNK_CHECKSUM;
+    Error result = checksums ? compute_checksums(package, chunks, count) : Error::OK;
+    if (result == Error::OK) result = write_header(chunks, count, version, sink);
+
+    for (uint32_t i = 0; i < count && result == Error::OK; i++) {
+        const planned_chunk_t* chunk = &chunks[i];
+        uint8_t head[CHUNK_HEADER_SIZE_LARGE];
+        size_t header_size = chunk_header_size(version);
+        if (chunk->lead > 0) {
+            result = write_padding_chunk(chunk->lead - header_size, version, sink);
+            if (result != Error::OK) break;
+        }
+        write_chunk_header(head, chunk->type, chunk->size, version);
+        if (!sink_write(sink, head, header_size)) {
+            result = Error::IO;
+            break;
+        }
+
+        if (chunk->type == CHUNK_CHECKSUM) {
+            result = write_checksum_chunk(chunks, count, sink);
+            continue;
+        }
+
+        /* Data copied from the backing file must still match what was checksummed */
+        sink->hashing = checksums && chunk->source;
+        sink->crc = 0;
+        result = write_chunk_data(package, chunk, sink);
+        if (result == Error::OK && sink->hashing && sink->crc != chunk->checksum) result = Error::CORRUPTED;
+        sink->hashing = 0;
+
+        if (result == Error::OK && chunk->padding > 0) result = write_padding_chunk(chunk->padding, version, sink);
+    }
+    return result;
+}
+
+/* Serialize into an open file; name is only reported to the trace callback */
+static Error write_stream(Package* package, FILE* file, const char* name) {
+    uint64_t start = trace_begin();
+    planned_chunk_t chunks[MAX_PLANNED_CHUNKS];
+    uint32_t count = 0;
+    uint32_t version = DMUSICPAK_VERSION;
+    Error result = plan_chunks(package, chunks, &count, &version, NULL, false, 0);
+
+    sink_t sink;
+    memset(&sink, 0, sizeof(sink));
+    sink.file = file;
+
+    if (result == Error::OK) {
+        result = write_package(package, chunks, count, version, &sink);
+        release_plan(chunks, count);
+    }
+    if (result == Error::OK && fflush(file) != 0) result = Error::IO;
+
+    trace_end(start, TraceEvent::SAVE, name, 0, sink.offset, result);
+    return result;
 }
 
 Error dmusicpak::save(Package* package, const char* filename) {
     if (!package || !filename) return Error::INVALID_PARAM;
 
-    uint8_t* buffer = NULL;
-    size_t size = 0;
-    Error result = save_memory(package, &buffer, &size);
-    if (result != Error::OK) return result;
+    /*
+     * Write next to the target and rename over it, so saving a package
+     * back to the file it was mapped or indexed from never truncates
+     * the data it is still reading.
+     */
+    size_t len = strlen(filename);
+    char* temp = (char*)mem_malloc(len + 5);
+    if (!temp) return Error::MEMORY_ALLOC;
+    memcpy(temp, filename, len);
+    memcpy(temp + len, ".tmp", 5);
 
-    FILE* file = fopen(filename, "wb");
+    FILE* file = fopen(temp, "wb");
     if (!file) {
-        ::free(buffer);
+        mem_free(temp);
         return Error::FILE_NOT_FOUND;
     }
 
-    size_t written = fwrite(buffer, 1, size, file);
-    fclose(file);
-    ::free(buffer);
+    Error result = write_stream(package, file, filename);
+    if (fclose(file) != 0 && result == Error::OK) result = Error::IO;
+    if (result == Error::OK && !file_replace(temp, filename)) result = Error::IO;
+    if (result != Error::OK) remove(temp);
+
+    mem_free(temp);
+    return result;
+}
 
-    return (written == size) ? Error::OK : Error::IO;
+Error dmusicpak::save_stream(Package* package, FILE* file) {
+    if (!package || !file) return Error::INVALID_PARAM;
+    return write_stream(package, file, NULL);
+}
+
+struct dmusicpak::PackagePlan {
+    const Package* package;
+    planned_chunk_t chunks[MAX_PLANNED_CHUNKS];
+    uint32_t count;
+    uint32_t version;
+};
+
+Error dmusicpak::plan_package(const Package* package, const Metadata* metadata, bool without_cover,
+                              uint64_t base, PackagePlan** plan) {
+    PackagePlan* created = (PackagePlan*)mem_calloc(1, sizeof(PackagePlan));
+    if (!created) return Error::MEMORY_ALLOC;
+
+    created->package = package;
+    Error result = plan_chunks(package, created->chunks, &created->count, &created->version,
+                               metadata, without_cover, base);
+    if (result != Error::OK) {
+        mem_free(created);
+        return result;
+    }
+
+    *plan = created;
+    return Error::OK;
+}
+
+uint64_t dmusicpak::package_plan_size(const PackagePlan* plan) {
+    return planned_size(plan->chunks, plan->count, plan->version);
+}
+
+Error dmusicpak::write_package_plan(PackagePlan* plan, FILE* file) {
+    sink_t sink;
+    memset(&sink, 0, sizeof(sink));
+    sink.file = file;
+    return write_package(plan->package, plan->chunks, plan->count, plan->version, &sink);
+}
+
+void dmusicpak::free_package_plan(PackagePlan* plan) {
+    if (!plan) return;
+    release_plan(plan->chunks, plan->count);
+    mem_free(plan);
 }
 
 Error dmusicpak::save_memory(Package* package, uint8_t** buffer, size_t* size) {
     if (!package || !buffer || !size) return Error::INVALID_PARAM;
 
-    /* Calculate total size */
-    size_t total_size = sizeof(file_header_t);
-    uint32_t num_chunks = 0;
+    /* Calculate layout and total size */
+    uint64_t start = trace_begin();
+    planned_chunk_t chunks[MAX_PLANNED_CHUNKS];
+    uint32_t count = 0;
+    uint32_t version = DMUSICPAK_VERSION;
+    Error result = plan_chunks(package, chunks, &count, &version, NULL, false, 0);
+    if (result != Error::OK) {
+        trace_end(start, TraceEvent::SAVE, NULL, 0, 0, result);
+        return result;
+    }
+    uint64_t total_size = planned_size(chunks, count, version);
 
-    if (package->has_metadata) {
-        total_size += sizeof(chunk_header_t) + calculate_metadata_size(&package->metadata);
-        num_chunks++;
+    /* Allocate buffer */
+    *buffer = total_size <= (size_t)-1 ? (uint8_t*)mem_malloc((size_t)total_size) : NULL;
+    if (!*buffer) {
+        release_plan(chunks, count);
+        trace_end(start, TraceEvent::SAVE, NULL, 0, 0, Error::MEMORY_ALLOC);
+        return Error::MEMORY_ALLOC;
     }
-    if (package->has_lyrics) {
-        total_size += sizeof(chunk_header_t) + 4 + package->lyrics.size;
-        num_chunks++;
+
+    sink_t sink;
+    memset(&sink, 0, sizeof(sink));
+    sink.buffer = *buffer;
+
+    result = write_package(package, chunks, count, version, &sink);
+    release_plan(chunks, count);
+    trace_end(start, TraceEvent::SAVE, NULL, 0, sink.offset, result);
+    if (result != Error::OK) {
+        mem_free(*buffer);
+        *buffer = NULL;
+        return result;
     }
-    if (package->has_audio) {
-        total_size += sizeof(chunk_header_t) + 4 +
-                     (package->audio.source_filename ? strlen(package->audio.source_filename) : 0) +
-                     package->audio.size;
-        num_chunks++;
+
+    *size = sink.offset;
+    return Error::OK;
+}
+
+/* Append an entry to the package chunk index */
+bool dmusicpak::add_chunk_entry(Package* package, uint8_t type, uint64_t offset, uint64_t size) {
+    uint32_t count = package->num_chunks;
+
+    /* Grow geometrically: capacity is the next power of two (min 4) */
+    if (count == 0 || (count >= 4 && (count & (count - 1)) == 0)) {
+        uint32_t capacity = count == 0 ? 4 : count * 2;
+        ChunkEntry* chunks = (ChunkEntry*)package_realloc(package, package->chunks, count * sizeof(ChunkEntry),
+                                                          capacity * sizeof(ChunkEntry));
+        if (!chunks) return false;
+        package->chunks = chunks;
     }
-    if (package->has_cover) {
-        total_size += sizeof(chunk_header_t) + 4 + 4 + 4 + package->cover.size;
-        num_chunks++;
+
+    package->chunks[count].type = type & ~CHUNK_COMPRESSED;
+    package->chunks[count].compressed = (type & CHUNK_COMPRESSED) != 0;
+    package->chunks[count].offset = offset;
+    package->chunks[count].size = size;
+    package->num_chunks = count + 1;
+    return true;
+}
+
+/* Size of the fields that precede the payload of a payload-bearing chunk */
+bool dmusicpak::chunk_prefix_size(uint8_t type, const uint8_t* chunk, size_t available, size_t* prefix) {
+    switch (type) {
+        case CHUNK_LYRICS: *prefix = 4; break;
+        case CHUNK_COVER: *prefix = 12; break;
+        case CHUNK_THUMBNAILS: *prefix = 4; break;
+        case CHUNK_AUDIO:
+            if (available < 8) return false;
+            *prefix = 8 + (size_t)read_uint32_le(chunk + 4);
+            break;
+        default: return false;
     }
+    return *prefix <= available;
+}
 
-    /* Allocate buffer */
-    *buffer = (uint8_t*)malloc(total_size);
-    if (!*buffer) return Error::MEMORY_ALLOC;
+/* Chunk types whose data is a fixed prefix followed by a payload */
+static bool has_payload(uint8_t type) {
+    return type == CHUNK_LYRICS || type == CHUNK_AUDIO || type == CHUNK_COVER || type == CHUNK_THUMBNAILS;
+}
 
-    size_t offset = 0;
+/* The package already holds this chunk type */
+static bool has_chunk(const Package* package, uint8_t type) {
+    switch (type) {
+        case CHUNK_METADATA: return package->has_metadata != 0;
+        case CHUNK_LYRICS: return package->has_lyrics != 0;
+        case CHUNK_AUDIO: return package->has_audio != 0;
+        case CHUNK_COVER: return package->has_cover != 0;
+        case CHUNK_THUMBNAILS: return package->has_thumbnails != 0;
+    }
+    return false;
+}
 
-    /* Write file header */
-    memcpy(*buffer + offset, DMUSICPAK_MAGIC, 4);
-    offset += 4;
-    write_uint32_le(*buffer + offset, DMUSICPAK_VERSION);
-    offset += 4;
-    write_uint32_le(*buffer + offset, num_chunks);
-    offset += 4;
+/* Store a decoded chunk in the package; payload is adopted as-is unless this fails */
+Error dmusicpak::apply_chunk(Package* package, uint8_t type, const uint8_t* chunk, size_t chunk_size,
+                             uint8_t* payload, size_t payload_size) {
+    size_t prefix = 0;
+    if (has_payload(type) && !chunk_prefix_size(type, chunk, chunk_size, &prefix)) return Error::CORRUPTED;
+
+    /* The first chunk of a type wins, as only it is covered by a checksum */
+    if (has_chunk(package, type)) {
+        package_release(package, payload);
+        return Error::OK;
+    }
+
+    switch (type) {
+        case CHUNK_METADATA: {
+            Error result = read_metadata_chunk(package, chunk, chunk_size);
+            if (result != Error::OK) return result;
+            package->has_metadata = 1;
+            break;
+        }
+
+        case CHUNK_LYRICS:
+            package->lyrics.format = (LyricFormat)read_uint32_le(chunk);
+            package->lyrics.size = payload_size;
+            if (payload) {
+                package->lyrics.data = payload;
+                package->has_lyrics = 1;
+            }
+            break;
 
-    /* Write metadata chunk */
-    if (package->has_metadata) {
-        (*buffer)[offset++] = CHUNK_METADATA;
-        uint32_t chunk_size = (uint32_t)calculate_metadata_size(&package->metadata);
-        write_uint32_le(*buffer + offset, chunk_size);
-        offset += 4;
-        offset += write_metadata_chunk(*buffer + offset, &package->metadata);
-    }
-
-    /* Write lyrics chunk */
-    if (package->has_lyrics) {
-        (*buffer)[offset++] = CHUNK_LYRICS;
-        uint32_t chunk_size = 4 + (uint32_t)package->lyrics.size;
-        write_uint32_le(*buffer + offset, chunk_size);
-        offset += 4;
-        write_uint32_le(*buffer + offset, (uint32_t)package->lyrics.format);
-        offset += 4;
-        memcpy(*buffer + offset, package->lyrics.data, package->lyrics.size);
-        offset += package->lyrics.size;
-    }
-
-    /* Write audio chunk */
-    if (package->has_audio) {
-        (*buffer)[offset++] = CHUNK_AUDIO;
-        uint32_t filename_len = package->audio.source_filename ? (uint32_t)strlen(package->audio.source_filename) : 0;
-        uint32_t chunk_size = 4 + 4 + filename_len + (uint32_t)package->audio.size;
-        write_uint32_le(*buffer + offset, chunk_size);
-        offset += 4;
-        write_uint32_le(*buffer + offset, (uint32_t)package->audio.format);
-        offset += 4;
-        offset += write_string(*buffer + offset, package->audio.source_filename);
-        memcpy(*buffer + offset, package->audio.data, package->audio.size);
-        offset += package->audio.size;
-    }
-
-    /* Write cover chunk */
-    if (package->has_cover) {
-        (*buffer)[offset++] = CHUNK_COVER;
-        uint32_t chunk_size = 4 + 4 + 4 + (uint32_t)package->cover.size;
-        write_uint32_le(*buffer + offset, chunk_size);
-        offset += 4;
-        write_uint32_le(*buffer + offset, (uint32_t)package->cover.format);
-        offset += 4;
-        write_uint32_le(*buffer + offset, package->cover.width);
-        offset += 4;
-        write_uint32_le(*buffer + offset, package->cover.height);
-        offset += 4;
-        memcpy(*buffer + offset, package->cover.data, package->cover.size);
-        offset += package->cover.size;
-    }
-
-    *size = offset;
+        case CHUNK_AUDIO: {
+            ByteReader reader = byte_reader(chunk + 4, chunk_size - 4);
+            char* source_filename = NULL;
+            if (!read_string(package, &reader, &source_filename)) return Error::MEMORY_ALLOC;
+
+            package->audio.format = (AudioFormat)read_uint32_le(chunk);
+            package_release(package, package->audio.source_filename);  /* From an empty audio chunk */
+            package->audio.source_filename = source_filename;
+            package->audio.size = payload_size;
+            if (payload) {
+                package->audio.data = payload;
+                package->has_audio = 1;
+            }
+            break;
+        }
+
+        case CHUNK_COVER:
+            package->cover.format = (CoverFormat)read_uint32_le(chunk);
+            package->cover.width = read_uint32_le(chunk + 4);
+            package->cover.height = read_uint32_le(chunk + 8);
+            package->cover.size = payload_size;
+            if (payload) {
+                package->cover.data = payload;
+                package->has_cover = 1;
+            }
+            break;
+
+        case CHUNK_THUMBNAILS:
+            /* The directory is checked against the payload when it is read */
+            package->thumbnail_count = read_uint32_le(chunk);
+            package->thumbnails_size = payload_size;
+            if (payload) {
+                package->thumbnails = payload;
+                package->has_thumbnails = 1;
+            }
+            break;
+    }
     return Error::OK;
 }
 
-Package* dmusicpak::load(const char* filename) {
-    if (!filename) return NULL;
+/* Decode a compressed chunk and store it in the package */
+static Error apply_encoded_chunk(Package* package, uint8_t type, const uint8_t* chunk, uint64_t size) {
+    FrameHeader header;
+    if (!read_frame_header(chunk, size, &header)) return Error::CORRUPTED;
+    if (!compression_available((Compression)header.codec)) return Error::NOT_SUPPORTED;
+
+    uint8_t* raw = NULL;
+    size_t raw_size = 0;
+    if (!decode_chunk(chunk, size, &raw, &raw_size)) return Error::CORRUPTED;
+
+    if (type == CHUNK_METADATA) {
+        Error result = apply_chunk(package, type, raw, raw_size, NULL, 0);
+        mem_free(raw);
+        return result;
+    }
 
-    FILE* file = fopen(filename, "rb");
-    if (!file) return NULL;
+    size_t prefix = 0;
+    if (!chunk_prefix_size(type, raw, raw_size, &prefix)) {
+        mem_free(raw);
+        return Error::CORRUPTED;
+    }
+
+    /* The payload keeps the decoded buffer; only the prefix is copied out */
+    uint8_t* head = (uint8_t*)mem_malloc(prefix);
+    if (!head) {
+        mem_free(raw);
+        return Error::MEMORY_ALLOC;
+    }
+    memcpy(head, raw, prefix);
+
+    size_t payload_size = raw_size - prefix;
+    uint8_t* payload = NULL;
+    if (payload_size > 0) {
+        memmove(raw, raw + prefix, payload_size);
+        payload = (uint8_t*)mem_realloc(raw, payload_size);
+        if (!payload) payload = raw;
+    } else {
+        mem_free(raw);
+    }
+
+    Error result = apply_chunk(package, type, head, prefix, payload, payload_size);
+    if (result != Error::OK) mem_free(payload);
+    mem_free(head);
+    return result;
+}
 
-    /* Get file size */
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
+uint8_t* dmusicpak::read_file(const char* filename, size_t* size, Error* error) {
+    /* 64-bit size and reads: ftell() is limited to 2 GB where long is 32-bit */
+    FileHandle file;
+    if (!file_open(filename, &file)) {
+        if (error) *error = Error::FILE_NOT_FOUND;
+        return NULL;
+    }
 
-    if (file_size <= 0) {
-        fclose(file);
+    uint64_t file_size = 0;
+    if (!dmusicpak::file_size(&file, &file_size) || file_size > (size_t)-1) {
+        file_close(&file);
+        if (error) *error = Error::IO;
         return NULL;
     }
 
-    /* Read entire file */
-    uint8_t* buffer = (uint8_t*)malloc(file_size);
+    uint8_t* buffer = (uint8_t*)mem_malloc(file_size > 0 ? (size_t)file_size : 1);
     if (!buffer) {
-        fclose(file);
+        file_close(&file);
+        if (error) *error = Error::MEMORY_ALLOC;
         return NULL;
     }
 
-    size_t read = fread(buffer, 1, file_size, file);
-    fclose(file);
+    bool read = file_read_at(&file, 0, buffer, (size_t)file_size);
+    file_close(&file);
 
-    if (read != (size_t)file_size) {
-        ::free(buffer);
+    if (!read) {
+        mem_free(buffer);
+        if (error) *error = Error::IO;
         return NULL;
     }
 
-    Package* package = load_memory(buffer, file_size);
-    ::free(buffer);
+    *size = (size_t)file_size;
+    return buffer;
+}
 
+Package* dmusicpak::load_file(const char* filename, Error* error) {
+    uint64_t start = trace_begin();
+    Error result = Error::OK;
+    size_t size = 0;
+    uint8_t* buffer = read_file(filename, &size, &result);
+
+    Package* package = buffer ? parse_package(buffer, size, false, &result) : NULL;
+    mem_free(buffer);
+
+    trace_end(start, TraceEvent::LOAD, filename, 0, size, result);
+    if (error && result != Error::OK) *error = result;
     return package;
 }
 
-Package* dmusicpak::load_memory(const uint8_t* data, size_t size) {
-    if (!data || size < sizeof(file_header_t)) return NULL;
+Package* dmusicpak::load(const char* filename) {
+    if (!filename) return NULL;
+
+    return load_file(filename, NULL);
+}
+
+/* Copy a payload and checksum it one block at a time, so each block is copied while still in cache */
+static uint32_t copy_hashed(uint8_t* dst, const uint8_t* src, size_t size, uint32_t crc) {
+    const size_t block = 64 * 1024;
+    for (size_t done = 0; done < size; done += block) {
+        size_t n = size - done < block ? size - done : block;
+        crc = crc32c(crc, src + done, n);
+        memcpy(dst + done, src + done, n);
+    }
+    return crc;
+}
+
+/* Decode one chunk of a package buffer; 'hash' checks it against the package's checksum */
+static Error parse_chunk(Package* package, uint8_t chunk_type, const uint8_t* chunk, size_t chunk_size,
+                         bool borrow, bool hash) {
+    uint8_t type = chunk_type & ~CHUNK_COMPRESSED;
+    uint32_t expected = hash ? package->checksums.checksum[type] : 0;
+
+    /* Payloads are checksummed as they are copied (in place when borrowed); everything else up front */
+    bool payload_chunk = !(chunk_type & CHUNK_COMPRESSED) && has_payload(type);
+    if (hash && !payload_chunk && crc32c(0, chunk, chunk_size) != expected) return Error::CORRUPTED;
+
+    if (chunk_type & CHUNK_COMPRESSED) {
+        /* Chunks without codec support are skipped like unknown ones */
+        Error result = apply_encoded_chunk(package, type, chunk, chunk_size);
+        return result == Error::NOT_SUPPORTED ? Error::OK : result;
+    }
+    if (chunk_type == CHUNK_CHECKSUM) {
+        return adopt_checksums(package, chunk, chunk_size) ? Error::OK : Error::CORRUPTED;
+    }
+    if (chunk_type == CHUNK_SEEK) {
+        adopt_seek_table(package, chunk, chunk_size);  /* Malformed tables are ignored */
+        return Error::OK;
+    }
+    if (!payload_chunk) {
+        return chunk_type == CHUNK_METADATA ? apply_chunk(package, chunk_type, chunk, chunk_size, NULL, 0) : Error::OK;
+    }
+
+    size_t prefix = 0;
+    if (!chunk_prefix_size(chunk_type, chunk, chunk_size, &prefix)) return Error::CORRUPTED;
+
+    size_t payload_size = chunk_size - prefix;
+    uint8_t* payload = NULL;
+    uint32_t crc = hash ? crc32c(0, chunk, prefix) : 0;
+    if (payload_size > 0 && borrow) {
+        payload = (uint8_t*)(chunk + prefix);
+        if (hash) crc = crc32c(crc, payload, payload_size);
+    } else if (payload_size > 0) {
+        payload = (uint8_t*)package_alloc(package, payload_size);
+        if (!payload) return Error::MEMORY_ALLOC;
+        if (hash) {
+            crc = copy_hashed(payload, chunk + prefix, payload_size, crc);
+        } else {
+            memcpy(payload, chunk + prefix, payload_size);
+        }
+        stat_add(STAT_BYTES_COPIED, payload_size);
+    }
+
+    Error result = hash && crc != expected ? Error::CORRUPTED : Error::OK;
+    if (result == Error::OK) result = apply_chunk(package, chunk_type, chunk, prefix, payload, payload_size);
+    if (result != Error::OK && !borrow) package_release(package, payload);
+    return result;
+}
+
+Package* dmusicpak::parse_package(const uint8_t* data, size_t size, bool borrow, Error* error) {
+    if (error) *error = Error::INVALID_FORMAT;
+    if (!data || size < FILE_HEADER_SIZE) return NULL;
 
     /* Verify magic number */
     if (memcmp(data, DMUSICPAK_MAGIC, 4) != 0) return NULL;
@@ -287,74 +1082,637 @@ Package* dmusicpak::load_memory(const uint8_t* data, size_t size) {
     uint32_t version = read_uint32_le(data + offset);
     offset += 4;
 
-    if (version != DMUSICPAK_VERSION) return NULL;
+    if (!is_supported_version(version)) {
+        if (error) *error = Error::NOT_SUPPORTED;
+        return NULL;
+    }
+    size_t header_size = chunk_header_size(version);
 
     uint32_t num_chunks = read_uint32_le(data + offset);
     offset += 4;
 
     Package* package = create();
-    if (!package) return NULL;
+    if (!package) {
+        if (error) *error = Error::MEMORY_ALLOC;
+        return NULL;
+    }
 
-    /* Read chunks */
-    for (uint32_t i = 0; i < num_chunks && offset < size; i++) {
-        if (offset + 5 > size) break;
-
-        uint8_t chunk_type = data[offset++];
-        uint32_t chunk_size = read_uint32_le(data + offset);
-        offset += 4;
-
-        if (offset + chunk_size > size) break;
-
-        switch (chunk_type) {
-            case CHUNK_METADATA:
-                read_metadata_chunk(data + offset, &package->metadata);
-                package->has_metadata = 1;
-                break;
-
-            case CHUNK_LYRICS:
-                package->lyrics.format = (LyricFormat)read_uint32_le(data + offset);
-                package->lyrics.size = chunk_size - 4;
-                if (package->lyrics.size > 0) {
-                    package->lyrics.data = (uint8_t*)malloc(package->lyrics.size);
-                    if (package->lyrics.data) {
-                        memcpy(package->lyrics.data, data + offset + 4, package->lyrics.size);
-                        package->has_lyrics = 1;
-                    }
-                }
-                break;
-
-            case CHUNK_AUDIO: {
-                package->audio.format = (AudioFormat)read_uint32_le(data + offset);
-                size_t str_offset = 4;
-                str_offset += read_string(data + offset + str_offset, &package->audio.source_filename);
-                package->audio.size = chunk_size - str_offset;
-                if (package->audio.size > 0) {
-                    package->audio.data = (uint8_t*)malloc(package->audio.size);
-                    if (package->audio.data) {
-                        memcpy(package->audio.data, data + offset + str_offset, package->audio.size);
-                        package->has_audio = 1;
-                    }
-                }
-                break;
-            }
+    /* One pass: every length is checked against the buffer before it is used,
+       and checksummed chunks are verified as they are decoded */
+    Error result = Error::OK;
+    uint32_t seen = 0;    /* Types whose first chunk has been read */
+    uint32_t hashed = 0;  /* Checksummed types verified while reading */
+    for (uint32_t i = 0; i < num_chunks && result == Error::OK; i++) {
+        if (header_size > size - offset) {
+            result = Error::CORRUPTED;
+            break;
+        }
+
+        uint8_t chunk_type = data[offset];
+        uint64_t chunk_size64 = read_chunk_size(data + offset, version);
+        offset += header_size;
+
+        if (chunk_size64 > size - offset) {
+            result = Error::CORRUPTED;
+            break;
+        }
+        size_t chunk_size = (size_t)chunk_size64;
+        uint64_t start = trace_begin();
+
+        if (chunk_type != CHUNK_TOC && !add_chunk_entry(package, chunk_type, offset, chunk_size)) {
+            result = Error::MEMORY_ALLOC;
+            break;
+        }
+
+        /* A checksum covers the first chunk of its type */
+        uint8_t type = chunk_type & ~CHUNK_COMPRESSED;
+        bool first = type < MAX_CHECKSUM_TYPES && !(seen & (1u << type));
+        if (first) seen |= 1u << type;
+        bool hash = first && chunk_type != CHUNK_CHECKSUM && chunk_type != CHUNK_TOC &&
+                    has_checksum(&package->checksums, type);
+
+        result = parse_chunk(package, chunk_type, data + offset, chunk_size, borrow, hash);
+        if (result == Error::OK && hash) hashed |= 1u << type;
+
+        trace_end(start, TraceEvent::CHUNK, NULL, chunk_type, chunk_size, result);
+        offset += chunk_size;
+    }
+
+    /* Missing (e.g. truncated) or mismatching chunks fail the whole load */
+    if (result == Error::OK) result = check_checksums(package, data, hashed);
+    if (result != Error::OK) {
+        dmusicpak::free(package);
+        if (error) *error = result;
+        return NULL;
+    }
+
+    if (error) *error = Error::OK;
+    return package;
+}
+
+Package* dmusicpak::load_memory(const uint8_t* data, size_t size) {
+    return load_memory_ex(data, size, NULL);
+}
+
+Package* dmusicpak::load_memory_ex(const uint8_t* data, size_t size, Error* error) {
+    uint64_t start = trace_begin();
+    Error result = Error::INVALID_PARAM;
+    Package* package = data ? parse_package(data, size, false, &result) : NULL;
+    trace_end(start, TraceEvent::LOAD, NULL, 0, size, result);
+    if (error) *error = result;
+    return package;
+}
+
+Package* dmusicpak::load_mmap(const char* filename) {
+    if (!filename) return NULL;
+
+    uint64_t start = trace_begin();
+    MappedFile mapping;
+    if (!map_file(filename, &mapping)) {
+        trace_end(start, TraceEvent::LOAD, filename, 0, 0, Error::FILE_NOT_FOUND);
+        return NULL;
+    }
+
+    /* Payloads point straight into the mapping; headers are the only reads */
+    Error result = Error::OK;
+    Package* package = parse_package(mapping.data, mapping.size, true, &result);
+    trace_end(start, TraceEvent::LOAD, filename, 0, mapping.size, result);
+    if (!package) {
+        unmap_file(&mapping);
+        return NULL;
+    }
+
+    package->mapping = mapping;
+    return package;
+}
+
+/* Fill the chunk index from a TOC chunk at the start of the file */
+static bool read_toc(Package* package, uint64_t file_size, const uint8_t* head, size_t head_size,
+                     uint32_t version) {
+    size_t offset = FILE_HEADER_SIZE;
+    size_t header_size = chunk_header_size(version);
+    if (head_size < offset + header_size + 4 || head[offset] != CHUNK_TOC) return false;
+
+    uint64_t toc_size64 = read_chunk_size(head + offset, version);
+    if (toc_size64 > 0xFFFFFFFFu) return false;
+    uint32_t toc_size = (uint32_t)toc_size64;
+    offset += header_size;
+
+    uint8_t* toc = NULL;
+    const uint8_t* entries = head + offset;
+    if (offset + toc_size > head_size) {
+        if (offset + (uint64_t)toc_size > file_size) return false;
+        toc = (uint8_t*)mem_malloc(toc_size);
+        if (!toc || !package_read_at(package, offset, toc, toc_size)) {
+            mem_free(toc);
+            return false;
+        }
+        entries = toc;
+    }
+
+    uint32_t count = read_uint32_le(entries);
+    bool ok = toc_size >= 4 && (uint64_t)count * TOC_ENTRY_SIZE <= toc_size - 4;
+    for (uint32_t i = 0; ok && i < count; i++) {
+        const uint8_t* entry = entries + 4 + (size_t)i * TOC_ENTRY_SIZE;
+        uint64_t chunk_offset = read_uint64_le(entry + 1);
+        uint64_t chunk_size = read_uint64_le(entry + 9);
+        ok = chunk_offset <= file_size && chunk_size <= file_size - chunk_offset &&
+             add_chunk_entry(package, entry[0], chunk_offset, chunk_size);
+    }
+
+    mem_free(toc);
+    if (!ok) package->num_chunks = 0;
+    return ok;
+}
+
+/* Fill the chunk index by hopping from one chunk header to the next */
+static bool walk_chunks(Package* package, uint64_t file_size, const uint8_t* head,
+                        size_t head_size, uint32_t num_chunks, uint32_t version) {
+    uint64_t offset = FILE_HEADER_SIZE;
+    size_t header_size = chunk_header_size(version);
 
-            case CHUNK_COVER:
-                package->cover.format = (CoverFormat)read_uint32_le(data + offset);
-                package->cover.width = read_uint32_le(data + offset + 4);
-                package->cover.height = read_uint32_le(data + offset + 8);
-                package->cover.size = chunk_size - 12;
-                if (package->cover.size > 0) {
-                    package->cover.data = (uint8_t*)malloc(package->cover.size);
-                    if (package->cover.data) {
-                        memcpy(package->cover.data, data + offset + 12, package->cover.size);
-                        package->has_cover = 1;
-                    }
-                }
-                break;
+    for (uint32_t i = 0; i < num_chunks && offset + header_size <= file_size; i++) {
+        uint8_t header[CHUNK_HEADER_SIZE_LARGE];
+        if (offset + header_size <= head_size) {
+            memcpy(header, head + offset, header_size);
+        } else if (!package_read_at(package, offset, header, header_size)) {
+            return false;
         }
 
+        uint64_t chunk_size = read_chunk_size(header, version);
+        offset += header_size;
+        if (chunk_size > file_size - offset) break;
+
+        if (header[0] != CHUNK_TOC && !add_chunk_entry(package, header[0], offset, chunk_size)) {
+            return false;
+        }
         offset += chunk_size;
     }
+    return true;
+}
 
+Package* dmusicpak::load_index(const char* filename) {
+    if (!filename) return NULL;
+
+    uint64_t start = trace_begin();
+    Package* package = create();
+    if (!package) return NULL;
+
+    if (!file_open(filename, &package->file)) {
+        dmusicpak::free(package);
+        trace_end(start, TraceEvent::LOAD, filename, 0, 0, Error::FILE_NOT_FOUND);
+        return NULL;
+    }
+    package->has_file = 1;
+
+    /* One small read normally covers the file header and the whole TOC */
+    uint64_t size = 0;
+    uint8_t head[INDEX_HEAD_SIZE];
+    size_t head_size = 0;
+    if (file_size(&package->file, &size) && size >= FILE_HEADER_SIZE) {
+        head_size = size < sizeof(head) ? (size_t)size : sizeof(head);
+        if (!package_read_at(package, 0, head, head_size)) head_size = 0;
+    }
+
+    if (!index_package(package, size, head, head_size)) {
+        dmusicpak::free(package);
+        trace_end(start, TraceEvent::LOAD, filename, 0, size, Error::INVALID_FORMAT);
+        return NULL;
+    }
+
+    trace_end(start, TraceEvent::LOAD, filename, 0, size, Error::OK);
     return package;
 }
+
+bool dmusicpak::index_package(Package* package, uint64_t size, const uint8_t* head, size_t head_size) {
+    if (head_size < FILE_HEADER_SIZE ||
+        memcmp(head, DMUSICPAK_MAGIC, 4) != 0 ||
+        !is_supported_version(read_uint32_le(head + 4))) {
+        return false;
+    }
+
+    uint32_t version = read_uint32_le(head + 4);
+    uint32_t num_chunks = read_uint32_le(head + 8);
+    if (!read_toc(package, size, head, head_size, version) &&
+        !walk_chunks(package, size, head, head_size, num_chunks, version)) {
+        return false;
+    }
+
+    /* A seek table that happens to be inside the head costs nothing to keep */
+    const ChunkEntry* seek = find_chunk(package, CHUNK_SEEK);
+    if (seek && !seek->compressed && seek->offset + seek->size <= head_size) {
+        adopt_seek_table(package, head + seek->offset, seek->size);
+    }
+
+    /* Checksums follow the TOC, so they are normally inside the head too */
+    const ChunkEntry* entry = find_chunk(package, CHUNK_CHECKSUM);
+    if (!entry) return true;
+    if (entry->size > MAX_CHECKSUM_CHUNK_SIZE) return false;
+    if (entry->offset + entry->size <= head_size) {
+        return adopt_checksums(package, head + entry->offset, entry->size);
+    }
+
+    uint8_t* chunk = (uint8_t*)mem_malloc(entry->size > 0 ? (size_t)entry->size : 1);
+    bool ok = chunk && package_read_at(package, entry->offset, chunk, (size_t)entry->size) &&
+              adopt_checksums(package, chunk, entry->size);
+    mem_free(chunk);
+    return ok;
+}
+
+/* Read one chunk from the backing file into the package */
+static Error read_chunk_from_file(Package* package, const ChunkEntry* entry) {
+    if (entry->size > (size_t)-1) return Error::MEMORY_ALLOC;
+
+    /* Metadata is small and compressed chunks decode as a whole: read them whole */
+    if (entry->type == CHUNK_METADATA || entry->compressed) {
+        uint8_t* chunk = (uint8_t*)mem_malloc(entry->size > 0 ? (size_t)entry->size : 1);
+        if (!chunk) return Error::MEMORY_ALLOC;
+        if (!package_read_at(package, entry->offset, chunk, (size_t)entry->size)) {
+            mem_free(chunk);
+            return Error::IO;
+        }
+        if (has_checksum(&package->checksums, entry->type) &&
+            crc32c(0, chunk, (size_t)entry->size) != package->checksums.checksum[entry->type]) {
+            mem_free(chunk);
+            return Error::CORRUPTED;
+        }
+
+        Error result = entry->compressed ? apply_encoded_chunk(package, entry->type, chunk, entry->size)
+                                         : apply_chunk(package, entry->type, chunk, (size_t)entry->size, NULL, 0);
+        mem_free(chunk);
+        return result;
+    }
+
+    /* Payload chunks: read the fixed prefix, then the payload into its own buffer */
+    uint8_t small[64];
+    size_t head_size = entry->size < sizeof(small) ? (size_t)entry->size : sizeof(small);
+    if (!package_read_at(package, entry->offset, small, head_size)) return Error::IO;
+
+    size_t prefix = 0;
+    uint8_t* head = small;
+    if (!chunk_prefix_size(entry->type, small, (size_t)entry->size, &prefix)) return Error::CORRUPTED;
+    if (prefix > head_size) {
+        /* Long source filename; read the whole prefix */
+        head = (uint8_t*)mem_malloc(prefix);
+        if (!head) return Error::MEMORY_ALLOC;
+        if (!package_read_at(package, entry->offset, head, prefix)) {
+            mem_free(head);
+            return Error::IO;
+        }
+    }
+
+    size_t payload_size = (size_t)entry->size - prefix;
+    uint8_t* payload = NULL;
+    Error result = Error::OK;
+    if (payload_size > 0) {
+        payload = (uint8_t*)package_alloc(package, payload_size);
+        if (!payload) {
+            result = Error::MEMORY_ALLOC;
+        } else if (!package_read_at(package, entry->offset + prefix, payload, payload_size)) {
+            package_release(package, payload);
+            payload = NULL;
+            result = Error::IO;
+        }
+    }
+
+    if (result == Error::OK && has_checksum(&package->checksums, entry->type)) {
+        uint32_t crc = crc32c(crc32c(0, head, prefix), payload, payload_size);
+        if (crc != package->checksums.checksum[entry->type]) {
+            package_release(package, payload);
+            result = Error::CORRUPTED;
+        }
+    }
+    if (result == Error::OK) {
+        result = apply_chunk(package, entry->type, head, prefix, payload, payload_size);
+        if (result != Error::OK) package_release(package, payload);
+    }
+    if (head != small) mem_free(head);
+    return result;
+}
+
+Error dmusicpak::read_cover_from_file(const Package* package, Cover* cover) {
+    const ChunkEntry* entry = find_chunk(package, CHUNK_COVER);
+    if (!entry || !package->has_file) return Error::NOT_SUPPORTED;
+    if (entry->size > (size_t)-1) return Error::MEMORY_ALLOC;
+    bool checked = has_checksum(&package->checksums, CHUNK_COVER);
+
+    /* Compressed covers decode as a whole, into a buffer of our own */
+    uint8_t fields[12];
+    uint8_t* raw = NULL;
+    size_t raw_size = 0;
+    if (entry->compressed) {
+        uint8_t* chunk = (uint8_t*)mem_malloc(entry->size > 0 ? (size_t)entry->size : 1);
+        if (!chunk) return Error::MEMORY_ALLOC;
+
+        FrameHeader header;
+        Error result = Error::OK;
+        if (!package_read_at(package, entry->offset, chunk, (size_t)entry->size)) {
+            result = Error::IO;
+        } else if ((checked && crc32c(0, chunk, (size_t)entry->size) != package->checksums.checksum[CHUNK_COVER]) ||
+                   !read_frame_header(chunk, entry->size, &header)) {
+            result = Error::CORRUPTED;
+        } else if (!compression_available((Compression)header.codec)) {
+            result = Error::NOT_SUPPORTED;
+        } else if (!decode_chunk(chunk, entry->size, &raw, &raw_size) || raw_size < sizeof(fields)) {
+            result = Error::CORRUPTED;
+        }
+        mem_free(chunk);
+        if (result != Error::OK) {
+            mem_free(raw);
+            return result;
+        }
+        memcpy(fields, raw, sizeof(fields));
+    } else {
+        if (entry->size < sizeof(fields)) return Error::CORRUPTED;
+        if (!package_read_at(package, entry->offset, fields, sizeof(fields))) return Error::IO;
+    }
+
+    memset(cover, 0, sizeof(Cover));
+    cover->format = (CoverFormat)read_uint32_le(fields);
+    cover->width = read_uint32_le(fields + 4);
+    cover->height = read_uint32_le(fields + 8);
+    cover->size = (raw ? raw_size : (size_t)entry->size) - sizeof(fields);
+    if (cover->size > 0) {
+        cover->data = (uint8_t*)mem_malloc(cover->size);
+        if (!cover->data) {
+            mem_free(raw);
+            memset(cover, 0, sizeof(Cover));
+            return Error::MEMORY_ALLOC;
+        }
+    }
+
+    Error result = Error::OK;
+    if (raw) {
+        memcpy(cover->data, raw + sizeof(fields), cover->size);
+        stat_add(STAT_BYTES_COPIED, cover->size);
+        mem_free(raw);
+    } else if (!package_read_at(package, entry->offset + sizeof(fields), cover->data, cover->size)) {
+        result = Error::IO;
+    } else if (checked && crc32c(crc32c(0, fields, sizeof(fields)), cover->data, cover->size) !=
+                              package->checksums.checksum[CHUNK_COVER]) {
+        result = Error::CORRUPTED;
+    }
+    if (result != Error::OK) {
+        mem_free(cover->data);
+        memset(cover, 0, sizeof(Cover));
+    }
+    return result;
+}
+
+Error dmusicpak::load_seek_table(Package* package) {
+    const ChunkEntry* entry = find_chunk(package, CHUNK_SEEK);
+    if (!entry || !package->has_file || entry->compressed) return Error::NOT_SUPPORTED;
+    if (entry->size > MAX_SEEK_CHUNK_SIZE) return Error::CORRUPTED;
+
+    uint8_t* chunk = (uint8_t*)mem_malloc(entry->size > 0 ? (size_t)entry->size : 1);
+    if (!chunk) return Error::MEMORY_ALLOC;
+
+    Error result = Error::OK;
+    if (!package_read_at(package, entry->offset, chunk, (size_t)entry->size)) {
+        result = Error::IO;
+    } else if ((has_checksum(&package->checksums, CHUNK_SEEK) &&
+                crc32c(0, chunk, (size_t)entry->size) != package->checksums.checksum[CHUNK_SEEK]) ||
+               !adopt_seek_table(package, chunk, entry->size)) {
+        result = Error::CORRUPTED;
+    }
+    mem_free(chunk);
+    return result;
+}
+
+Error dmusicpak::load_chunk(Package* package, ChunkType type) {
+    if (!package) return Error::INVALID_PARAM;
+
+    const ChunkEntry* entry = find_chunk(package, (uint8_t)type);
+    if (!entry) return Error::NOT_SUPPORTED;
+
+    /* Packages loaded from memory or a mapping are already decoded */
+    if (!package->has_file) return Error::OK;
+
+    switch (type) {
+        case ChunkType::METADATA: if (package->has_metadata) return Error::OK; break;
+        case ChunkType::LYRICS: if (package->has_lyrics) return Error::OK; break;
+        case ChunkType::AUDIO: if (package->has_audio) return Error::OK; break;
+        case ChunkType::COVER: if (package->has_cover) return Error::OK; break;
+        case ChunkType::THUMBNAILS: if (package->has_thumbnails) return Error::OK; break;
+    }
+    if (package->shared) return Error::NOT_SUPPORTED;
+
+    uint64_t start = trace_begin();
+    Error result = read_chunk_from_file(package, entry);
+    trace_end(start, TraceEvent::CHUNK, NULL, entry->type | (entry->compressed ? CHUNK_COMPRESSED : 0),
+              entry->size, result);
+    return result;
+}
+
+Error dmusicpak::get_chunk_info(Package* package, ChunkType type, ChunkInfo* info) {
+    if (!package || !info) return Error::INVALID_PARAM;
+
+    const ChunkEntry* entry = find_chunk(package, (uint8_t)type);
+    if (!entry) return Error::NOT_SUPPORTED;
+
+    info->type = type;
+    info->offset = entry->offset;
+    info->size = entry->size;
+    return Error::OK;
+}
+
+Error dmusicpak::get_payload_info(Package* package, ChunkType type, ChunkInfo* info) {
+    if (!package || !info) return Error::INVALID_PARAM;
+
+    const ChunkEntry* entry = find_chunk(package, (uint8_t)type);
+    if (!entry || entry->compressed || !has_payload(entry->type)) return Error::NOT_SUPPORTED;
+
+    /* Only the audio prefix varies: the filename length is in the file, or known from the loaded audio */
+    uint8_t head[8] = {0};
+    size_t available = (size_t)entry->size;
+    if (entry->type == CHUNK_AUDIO) {
+        if (package->has_file) {
+            size_t head_size = entry->size < sizeof(head) ? (size_t)entry->size : sizeof(head);
+            if (!package_read_at(package, entry->offset, head, head_size)) return Error::IO;
+        } else if (package->audio.source_filename) {
+            write_uint32_le(head + 4, (uint32_t)strlen(package->audio.source_filename));
+        }
+    }
+
+    size_t prefix = 0;
+    if (!chunk_prefix_size(entry->type, head, available, &prefix)) return Error::CORRUPTED;
+
+    info->type = type;
+    info->offset = entry->offset + prefix;
+    info->size = entry->size - prefix;
+    return Error::OK;
+}
+
+/* Source of FrameIndex::id */
+static std::atomic<uint64_t> g_next_frame_index(1);
+
+/* Read the frame table of compressed audio so frames can be decoded on demand */
+static Error index_audio_frames(Package* package, const ChunkEntry* entry) {
+    uint8_t head[COMPRESSION_HEADER_SIZE];
+    if (entry->size < sizeof(head)) return Error::CORRUPTED;
+    if (!package_read_at(package, entry->offset, head, sizeof(head))) return Error::IO;
+
+    FrameIndex* index = (FrameIndex*)mem_calloc(1, sizeof(FrameIndex));
+    if (!index) return Error::MEMORY_ALLOC;
+
+    /* The header check only covers what it sees; the table follows it */
+    if (!read_frame_header(head, entry->size, &index->header)) {
+        mem_free(index);
+        return Error::CORRUPTED;
+    }
+    if (!compression_available((Compression)index->header.codec)) {
+        mem_free(index);
+        return Error::NOT_SUPPORTED;
+    }
+
+    uint32_t count = index->header.frame_count;
+    size_t table_size = (size_t)count * 4;
+    uint8_t* table = (uint8_t*)mem_malloc(table_size > 0 ? table_size : 1);
+    index->offsets = (uint64_t*)mem_malloc(((size_t)count + 1) * sizeof(uint64_t));
+    index->cache = (uint8_t*)mem_malloc(index->header.frame_size);
+    index->cached = count;
+    index->id = g_next_frame_index.fetch_add(1, std::memory_order_relaxed);
+    if (!table || !index->offsets || !index->cache) {
+        mem_free(table);
+        free_frame_index(index);
+        return Error::MEMORY_ALLOC;
+    }
+    if (!package_read_at(package, entry->offset + sizeof(head), table, table_size)) {
+        mem_free(table);
+        free_frame_index(index);
+        return Error::IO;
+    }
+
+    uint64_t offset = COMPRESSION_HEADER_SIZE + table_size;
+    bool ok = true;
+    for (uint32_t i = 0; i < count && ok; i++) {
+        index->offsets[i] = entry->offset + offset;
+        offset += read_uint32_le(table + (size_t)i * 4);
+        ok = offset <= entry->size;
+    }
+    index->offsets[count] = entry->offset + offset;
+    mem_free(table);
+
+    if (!ok) {
+        free_frame_index(index);
+        return Error::CORRUPTED;
+    }
+
+    package->audio_frames = index;
+    return Error::OK;
+}
+
+Error dmusicpak::locate_audio(Package* package, uint64_t* offset, uint64_t* size) {
+    if (!package->audio_located) {
+        const ChunkEntry* entry = find_chunk(package, CHUNK_AUDIO);
+        if (!entry || !package->has_file) return Error::NOT_SUPPORTED;
+
+        /* Offsets into compressed audio count uncompressed bytes from the chunk start */
+        uint64_t base = entry->offset;
+        uint64_t chunk_size = entry->size;
+        if (entry->compressed) {
+            if (!package->audio_frames) {
+                Error result = index_audio_frames(package, entry);
+                if (result != Error::OK) return result;
+            }
+            base = 0;
+            chunk_size = package->audio_frames->header.raw_size;
+        }
+
+        /* Only the format and filename length precede the payload */
+        uint8_t head[8];
+        if (chunk_size < sizeof(head)) return Error::CORRUPTED;
+        if (!read_audio(package, base, head, sizeof(head))) return Error::IO;
+
+        uint64_t prefix = 8 + (uint64_t)read_uint32_le(head + 4);
+        if (prefix > chunk_size) return Error::CORRUPTED;
+
+        package->audio_offset = base + prefix;
+        package->audio_size = chunk_size - prefix;
+        package->audio_located = 1;
+    }
+
+    *offset = package->audio_offset;
+    *size = package->audio_size;
+    return Error::OK;
+}
+
+/* Decoded frame of a shared package, one per thread: the package's own cache is never written */
+struct ThreadFrameCache {
+    uint64_t index_id;   /* FrameIndex the frame belongs to (0 for none) */
+    uint32_t cached;
+    uint8_t* data;
+    size_t capacity;
+
+    ~ThreadFrameCache() { mem_free(data); }
+};
+
+static ThreadFrameCache* thread_frame_cache(const FrameIndex* index) {
+    static thread_local ThreadFrameCache cache;
+    if (cache.index_id != index->id) {
+        if (cache.capacity < index->header.frame_size) {
+            uint8_t* data = (uint8_t*)mem_realloc(cache.data, index->header.frame_size);
+            if (!data) return NULL;
+            cache.data = data;
+            cache.capacity = index->header.frame_size;
+        }
+        cache.index_id = index->id;
+        cache.cached = index->header.frame_count;
+    }
+    return &cache;
+}
+
+bool dmusicpak::read_audio(Package* package, uint64_t offset, void* buffer, size_t size) {
+    FrameIndex* index = package->audio_frames;
+    if (!index) return package_read_at(package, offset, buffer, size);
+
+    uint8_t* cache = index->cache;
+    uint32_t* cached = &index->cached;
+    if (package->shared) {
+        ThreadFrameCache* thread_cache = thread_frame_cache(index);
+        if (!thread_cache) return false;
+        cache = thread_cache->data;
+        cached = &thread_cache->cached;
+    }
+
+    /* Decode each frame the range touches; sequential reads hit the cached frame */
+    const FrameHeader* header = &index->header;
+    uint8_t* out = (uint8_t*)buffer;
+    while (size > 0) {
+        if (offset >= header->raw_size) return false;
+        uint32_t frame = (uint32_t)(offset / header->frame_size);
+
+        if (*cached != frame) {
+            uint64_t stored = index->offsets[frame + 1] - index->offsets[frame];
+            uint8_t* data = (uint8_t*)mem_malloc(stored > 0 ? (size_t)stored : 1);
+            bool ok = data && package_read_at(package, index->offsets[frame], data, (size_t)stored) &&
+                      decode_frame(header->codec, data, (size_t)stored, cache,
+                                   (size_t)frame_raw_size(header, frame));
+            mem_free(data);
+            if (!ok) {
+                *cached = header->frame_count;
+                return false;
+            }
+            *cached = frame;
+        }
+
+        uint64_t start = (uint64_t)frame * header->frame_size;
+        size_t within = (size_t)(offset - start);
+        size_t available = (size_t)frame_raw_size(header, frame) - within;
+        size_t n = size < available ? size : available;
+        memcpy(out, cache + within, n);
+
+        out += n;
+        offset += n;
+        size -= n;
+    }
+    return true;
+}
+
+void dmusicpak::free_frame_index(FrameIndex* index) {
+    if (!index) return;
+
+    mem_free(index->offsets);
+    mem_free(index->cache);
+    mem_free(index);
+}
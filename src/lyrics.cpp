@@ -0,0 +1,717 @@
+/**
+ * @file lyrics.cpp
+ * @brief Timed lyric parsing for DMusicPak library
+ *
+ * Lyrics text is tokenized once into a LyricTimeline: parallel arrays of
+ * line start/end times and text offsets into one string pool, and the same
+ * for word timings, all in a single allocation. Lookups by playback time
+ * are a binary search over the start times, or a short forward walk from a
+ * LyricCursor while playback moves forward.
+ */
+
+#include "internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+using namespace dmusicpak;
+
+/* End time filled in from the next line once lines are sorted */
+#define UNSET_TIME 0xFFFFFFFFu
+
+struct dmusicpak::LyricTimeline {
+    uint32_t count;
+    uint32_t word_count;
+    uint32_t* start_ms;       /* Ascending */
+    uint32_t* end_ms;
+    uint32_t* text;           /* Pool offsets of NUL-terminated line text */
+    uint32_t* length;
+    uint32_t* first_word;     /* count + 1 entries: line i has words [first_word[i], first_word[i + 1]) */
+    uint32_t* word_start_ms;
+    uint32_t* word_end_ms;
+    uint32_t* word_text;      /* Pool offsets inside the line text */
+    uint32_t* word_length;
+    char* pool;
+};
+
+/* Lines and words as they are parsed, before sorting */
+struct pending_line_t {
+    uint32_t start_ms;
+    uint32_t end_ms;
+    uint32_t text;
+    uint32_t length;
+    uint32_t first_word;   /* Into builder_t::words */
+    uint32_t word_count;
+};
+
+struct pending_word_t {
+    uint32_t start_ms;
+    uint32_t end_ms;
+    uint32_t text;
+    uint32_t length;
+};
+
+struct builder_t {
+    pending_line_t* lines;
+    size_t line_count;
+    size_t line_capacity;
+    pending_word_t* words;
+    size_t word_count;
+    size_t word_capacity;
+    char* pool;
+    size_t pool_size;
+    size_t pool_capacity;
+    bool failed;
+};
+
+static bool grow(void** array, size_t* capacity, size_t needed, size_t element) {
+    if (needed <= *capacity) return true;
+
+    size_t new_capacity = *capacity ? *capacity * 2 : 64;
+    while (new_capacity < needed) new_capacity *= 2;
+    void* grown = mem_realloc(*array, new_capacity * element);
+    if (!grown) return false;
+
+    *array = grown;
+    *capacity = new_capacity;
+    return true;
+}
+
+static void pool_append(builder_t* b, const char* text, size_t size) {
+    if (b->failed) return;
+    if (!grow((void**)&b->pool, &b->pool_capacity, b->pool_size + size, 1)) {
+        b->failed = true;
+        return;
+    }
+    memcpy(b->pool + b->pool_size, text, size);
+    b->pool_size += size;
+}
+
+static pending_line_t* add_line(builder_t* b, uint32_t start_ms, uint32_t end_ms, uint32_t text, uint32_t length) {
+    if (b->failed) return NULL;
+    if (!grow((void**)&b->lines, &b->line_capacity, b->line_count + 1, sizeof(pending_line_t))) {
+        b->failed = true;
+        return NULL;
+    }
+
+    pending_line_t* line = &b->lines[b->line_count++];
+    line->start_ms = start_ms;
+    line->end_ms = end_ms;
+    line->text = text;
+    line->length = length;
+    line->first_word = (uint32_t)b->word_count;
+    line->word_count = 0;
+    return line;
+}
+
+static bool add_word(builder_t* b, uint32_t start_ms, uint32_t end_ms, uint32_t text, uint32_t length) {
+    if (b->failed) return false;
+    if (!grow((void**)&b->words, &b->word_capacity, b->word_count + 1, sizeof(pending_word_t))) {
+        b->failed = true;
+        return false;
+    }
+
+    pending_word_t* word = &b->words[b->word_count++];
+    word->start_ms = start_ms;
+    word->end_ms = end_ms;
+    word->text = text;
+    word->length = length;
+    return true;
+}
+
+static void release_builder(builder_t* b) {
+    mem_free(b->lines);
+    mem_free(b->words);
+    mem_free(b->pool);
+}
+
+/* Next line of [*pos, end) without its line break or trailing '\r' */
+static bool next_line(const char** pos, const char* end, const char** line, const char** line_end) {
+    if (*pos >= end) return false;
+
+    const char* p = *pos;
+    const char* nl = (const char*)memchr(p, '\n', (size_t)(end - p));
+    const char* stop = nl ? nl : end;
+    *pos = nl ? nl + 1 : end;
+
+    if (stop > p && stop[-1] == '\r') stop--;
+    *line = p;
+    *line_end = stop;
+    return true;
+}
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+/* Digits at *p, at most max_digits of them (0 for any); false if there are none */
+static bool parse_number(const char** p, const char* end, size_t max_digits, uint32_t* value, size_t* digits) {
+    uint64_t result = 0;
+    size_t n = 0;
+    while (*p < end && is_digit(**p) && (max_digits == 0 || n < max_digits)) {
+        if (result < 0xFFFFFFFFu) result = result * 10 + (uint32_t)(**p - '0');
+        (*p)++;
+        n++;
+    }
+    if (n == 0) return false;
+
+    *value = result > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)result;
+    if (digits) *digits = n;
+    return true;
+}
+
+/* Fraction digits as milliseconds: "5" is 500, "05" is 50, "005" is 5; extra digits are ignored */
+static uint32_t fraction_ms(const char** p, const char* end) {
+    uint32_t value = 0;
+    size_t digits = 0;
+    while (*p < end && is_digit(**p)) {
+        if (digits < 3) value = value * 10 + (uint32_t)(**p - '0');
+        (*p)++;
+        digits++;
+    }
+    for (; digits < 3; digits++) value *= 10;
+    return value;
+}
+
+static uint32_t clamp_ms(uint64_t ms) {
+    return ms >= UNSET_TIME ? UNSET_TIME - 1 : (uint32_t)ms;
+}
+
+/* LRC time "mm:ss", "mm:ss.xx" or "mm:ss:xx" filling all of [p, end) */
+static bool parse_lrc_time(const char* p, const char* end, uint32_t* ms) {
+    uint32_t minutes, seconds;
+    if (!parse_number(&p, end, 0, &minutes, NULL)) return false;
+    if (p >= end || *p != ':') return false;
+    p++;
+    if (!parse_number(&p, end, 2, &seconds, NULL)) return false;
+
+    uint32_t fraction = 0;
+    if (p < end && (*p == '.' || *p == ':')) {
+        p++;
+        if (p >= end || !is_digit(*p)) return false;
+        fraction = fraction_ms(&p, end);
+    }
+    if (p != end) return false;
+
+    *ms = clamp_ms((uint64_t)minutes * 60000 + (uint64_t)seconds * 1000 + fraction);
+    return true;
+}
+
+/* Timestamp tag "[time]" or "<time>" at p; *tag_end is just past it */
+static bool parse_lrc_tag(const char* p, const char* end, char open, uint32_t* ms, const char** tag_end) {
+    if (p >= end || *p != open) return false;
+
+    char close = open == '[' ? ']' : '>';
+    const char* stop = (const char*)memchr(p + 1, close, (size_t)(end - p - 1));
+    if (!stop || !parse_lrc_time(p + 1, stop, ms)) return false;
+
+    *tag_end = stop + 1;
+    return true;
+}
+
+/* Text after the line timestamps, split into words at "<time>" or inline "[time]" tags */
+static void parse_lrc_text(builder_t* b, pending_line_t* line, const char* p, const char* end) {
+    uint32_t word_start = line->start_ms;
+    const char* segment = p;
+    size_t tags = 0;
+
+    while (true) {
+        uint32_t ms = 0;
+        const char* tag_end = p;
+        bool at_end = p >= end;
+        bool tag = !at_end && (parse_lrc_tag(p, end, '<', &ms, &tag_end) ||
+                               parse_lrc_tag(p, end, '[', &ms, &tag_end));
+        if (!at_end && !tag) {
+            p++;
+            continue;
+        }
+
+        /* Text since the previous tag is one word */
+        if (p > segment) {
+            uint32_t offset = (uint32_t)b->pool_size;
+            pool_append(b, segment, (size_t)(p - segment));
+            if (add_word(b, word_start, UNSET_TIME, offset, (uint32_t)(p - segment))) line->word_count++;
+        }
+        if (at_end) break;
+
+        /* A tag closes the word before it */
+        if (line->word_count > 0 && b->words[b->word_count - 1].end_ms == UNSET_TIME) {
+            b->words[b->word_count - 1].end_ms = ms;
+        }
+        word_start = ms;
+        p = segment = tag_end;
+        tags++;
+    }
+
+    line->length = (uint32_t)(b->pool_size - line->text);
+    pool_append(b, "", 1);
+
+    /* Plain lines keep their text but no word timings */
+    if (tags == 0) {
+        b->word_count -= line->word_count;
+        line->word_count = 0;
+    }
+}
+
+static void shift_lrc_times(builder_t* b, int64_t offset_ms) {
+    for (size_t i = 0; i < b->line_count; i++) {
+        int64_t start = (int64_t)b->lines[i].start_ms - offset_ms;
+        b->lines[i].start_ms = start < 0 ? 0 : clamp_ms((uint64_t)start);
+    }
+    for (size_t i = 0; i < b->word_count; i++) {
+        int64_t start = (int64_t)b->words[i].start_ms - offset_ms;
+        b->words[i].start_ms = start < 0 ? 0 : clamp_ms((uint64_t)start);
+        if (b->words[i].end_ms != UNSET_TIME) {
+            int64_t word_end = (int64_t)b->words[i].end_ms - offset_ms;
+            b->words[i].end_ms = word_end < 0 ? 0 : clamp_ms((uint64_t)word_end);
+        }
+    }
+}
+
+/* LRC and its word-timed variants; "[offset:ms]" shifts every time */
+static void parse_lrc(builder_t* b, const char* p, const char* end) {
+    const char* line;
+    const char* line_end;
+    int64_t offset_ms = 0;
+
+    while (next_line(&p, end, &line, &line_end)) {
+        uint32_t stamps[16];
+        size_t stamp_count = 0;
+        size_t repeats = 0;
+        const char* text = line;
+        uint32_t ms;
+        const char* tag_end;
+
+        /* "[01:02.00][02:30.00]Chorus" repeats one line at several times */
+        while (parse_lrc_tag(text, line_end, '[', &ms, &tag_end)) {
+            if (stamp_count < sizeof(stamps) / sizeof(stamps[0])) stamps[stamp_count++] = ms;
+            repeats++;
+            text = tag_end;
+        }
+
+        if (repeats == 0) {
+            /* ID tags; only the offset matters here */
+            static const char offset_tag[] = "[offset:";
+            size_t tag_size = sizeof(offset_tag) - 1;
+            if ((size_t)(line_end - line) > tag_size && memcmp(line, offset_tag, tag_size) == 0) {
+                const char* q = line + tag_size;
+                while (q < line_end && *q == ' ') q++;
+                bool negative = q < line_end && *q == '-';
+                if (q < line_end && (*q == '-' || *q == '+')) q++;
+                uint32_t value;
+                if (parse_number(&q, line_end, 0, &value, NULL)) {
+                    offset_ms = negative ? -(int64_t)value : (int64_t)value;
+                }
+            }
+            continue;
+        }
+
+        pending_line_t* first = add_line(b, stamps[0], UNSET_TIME, (uint32_t)b->pool_size, 0);
+        if (!first) return;
+        parse_lrc_text(b, first, text, line_end);
+        pending_line_t copy = *first;
+
+        /* Word times are absolute, so they belong to the first stamp only */
+        for (size_t i = 1; i < stamp_count; i++) {
+            add_line(b, stamps[i], UNSET_TIME, copy.text, copy.length);
+        }
+    }
+
+    if (offset_ms != 0) shift_lrc_times(b, offset_ms);
+}
+
+/* "h:mm:ss" followed by ',' or '.' and a fraction (SRT "00:01:02,500", ASS "0:01:02.50") */
+static bool parse_clock_time(const char** pos, const char* end, uint32_t* ms) {
+    const char* p = *pos;
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+
+    uint32_t hours, minutes, seconds;
+    if (!parse_number(&p, end, 0, &hours, NULL)) return false;
+    if (p >= end || *p != ':') return false;
+    p++;
+    if (!parse_number(&p, end, 2, &minutes, NULL)) return false;
+    if (p >= end || *p != ':') return false;
+    p++;
+    if (!parse_number(&p, end, 2, &seconds, NULL)) return false;
+
+    uint32_t fraction = 0;
+    if (p < end && (*p == ',' || *p == '.')) {
+        p++;
+        fraction = fraction_ms(&p, end);
+    }
+
+    *ms = clamp_ms((uint64_t)hours * 3600000 + (uint64_t)minutes * 60000 + (uint64_t)seconds * 1000 + fraction);
+    *pos = p;
+    return true;
+}
+
+/* SRT cues: optional index, "start --> end", then text lines up to a blank line */
+static void parse_srt(builder_t* b, const char* p, const char* end) {
+    const char* line;
+    const char* line_end;
+
+    while (next_line(&p, end, &line, &line_end)) {
+        const char* arrow = NULL;
+        for (const char* q = line; q + 3 <= line_end; q++) {
+            if (q[0] == '-' && q[1] == '-' && q[2] == '>') {
+                arrow = q;
+                break;
+            }
+        }
+        if (!arrow) continue;
+
+        uint32_t start_ms, end_ms;
+        const char* q = line;
+        if (!parse_clock_time(&q, arrow, &start_ms)) continue;
+        q = arrow + 3;
+        if (!parse_clock_time(&q, line_end, &end_ms)) continue;
+
+        uint32_t text = (uint32_t)b->pool_size;
+        bool first = true;
+        const char* rewind = p;
+        while (next_line(&p, end, &line, &line_end) && line_end > line) {
+            if (!first) pool_append(b, "\n", 1);
+            pool_append(b, line, (size_t)(line_end - line));
+            first = false;
+            rewind = p;
+        }
+        p = rewind;
+
+        uint32_t length = (uint32_t)(b->pool_size - text);
+        pool_append(b, "", 1);
+        add_line(b, start_ms, end_ms < start_ms ? start_ms : end_ms, text, length);
+    }
+}
+
+static bool starts_with(const char* p, const char* end, const char* prefix) {
+    size_t size = strlen(prefix);
+    return (size_t)(end - p) >= size && memcmp(p, prefix, size) == 0;
+}
+
+/* Field position of name in an ASS "Format:" line, or -1 */
+static int ass_field(const char* p, const char* end, const char* name) {
+    size_t size = strlen(name);
+    int index = 0;
+    while (p < end) {
+        while (p < end && *p == ' ') p++;
+        if (p >= end) break;
+        size_t left = (size_t)(end - p);
+        const char* stop = (const char*)memchr(p, ',', left);
+        if (!stop) stop = end;
+        const char* field_end = stop;
+        while (field_end > p && field_end[-1] == ' ') field_end--;
+        if ((size_t)(field_end - p) == size && memcmp(p, name, size) == 0) return index;
+        p = stop < end ? stop + 1 : end;
+        index++;
+    }
+    return -1;
+}
+
+/* ASS dialogue text: override blocks are dropped, "{\k}" karaoke tags become words */
+static void parse_ass_text(builder_t* b, pending_line_t* line, const char* p, const char* end) {
+    uint32_t elapsed = 0;     /* Karaoke time since the line start, in ms */
+    bool timed = false;       /* Inside a karaoke syllable */
+    uint32_t word_start = 0;
+    uint32_t word_end = 0;
+    uint32_t word_text = (uint32_t)b->pool_size;
+
+    while (p <= end) {
+        bool at_end = p == end;
+        if (!at_end && *p == '{') {
+            const char* close = (const char*)memchr(p, '}', (size_t)(end - p));
+            if (!close) close = end;
+
+            for (const char* q = p + 1; q + 1 < close; q++) {
+                if (q[0] != '\\' || (q[1] != 'k' && q[1] != 'K')) continue;
+                const char* n = q + 2;
+                if (n < close && (*n == 'f' || *n == 'o')) n++;
+                uint32_t centiseconds;
+                if (!parse_number(&n, close, 0, &centiseconds, NULL)) continue;
+
+                /* A karaoke tag ends the previous syllable */
+                if (timed && b->pool_size > word_text) {
+                    if (add_word(b, word_start, word_end, word_text, (uint32_t)(b->pool_size - word_text))) {
+                        line->word_count++;
+                    }
+                }
+                uint64_t duration = (uint64_t)centiseconds * 10;
+                word_start = clamp_ms((uint64_t)line->start_ms + elapsed);
+                word_end = clamp_ms((uint64_t)word_start + duration);
+                elapsed = clamp_ms((uint64_t)elapsed + duration);
+                word_text = (uint32_t)b->pool_size;
+                timed = true;
+            }
+            p = close < end ? close + 1 : end;
+            continue;
+        }
+
+        if (at_end) {
+            if (timed && b->pool_size > word_text) {
+                if (add_word(b, word_start, word_end, word_text, (uint32_t)(b->pool_size - word_text))) {
+                    line->word_count++;
+                }
+            }
+            break;
+        }
+
+        if (*p == '\\' && p + 1 < end && (p[1] == 'N' || p[1] == 'n' || p[1] == 'h')) {
+            pool_append(b, p[1] == 'h' ? " " : "\n", 1);
+            p += 2;
+        } else {
+            pool_append(b, p, 1);
+            p++;
+        }
+    }
+
+    line->length = (uint32_t)(b->pool_size - line->text);
+    pool_append(b, "", 1);
+}
+
+/* ASS/SSA "Dialogue:" events, with fields located by the [Events] "Format:" line */
+static void parse_ass(builder_t* b, const char* p, const char* end) {
+    const char* line;
+    const char* line_end;
+    bool events = false;
+    int start_field = 1, end_field = 2, text_field = 9;  /* Standard v4+ format */
+
+    while (next_line(&p, end, &line, &line_end)) {
+        if (line < line_end && *line == '[') {
+            events = starts_with(line, line_end, "[Events]");
+            continue;
+        }
+        if (!events) continue;
+
+        if (starts_with(line, line_end, "Format:")) {
+            const char* fields = line + 7;
+            int s = ass_field(fields, line_end, "Start");
+            int e = ass_field(fields, line_end, "End");
+            int t = ass_field(fields, line_end, "Text");
+            if (s >= 0 && e >= 0 && t >= 0) {
+                start_field = s;
+                end_field = e;
+                text_field = t;
+            }
+            continue;
+        }
+        if (!starts_with(line, line_end, "Dialogue:")) continue;
+
+        /* Text is the last field and may itself contain commas */
+        const char* field = line + 9;
+        uint32_t start_ms = 0, end_ms = 0;
+        bool have_start = false, have_end = false;
+        int index = 0;
+        for (; index < text_field && field < line_end; index++) {
+            const char* q = field;
+            if (index == start_field) have_start = parse_clock_time(&q, line_end, &start_ms);
+            if (index == end_field) have_end = parse_clock_time(&q, line_end, &end_ms);
+            const char* comma = (const char*)memchr(field, ',', (size_t)(line_end - field));
+            field = comma ? comma + 1 : line_end;
+        }
+        if (index != text_field || !have_start || !have_end) continue;
+
+        pending_line_t* entry = add_line(b, start_ms, end_ms < start_ms ? start_ms : end_ms,
+                                         (uint32_t)b->pool_size, 0);
+        if (!entry) return;
+        parse_ass_text(b, entry, field, line_end);
+    }
+}
+
+static bool earlier_line(const pending_line_t& a, const pending_line_t& b) {
+    return a.start_ms < b.start_ms;
+}
+
+/* Sort lines, fill open end times and pack everything into one allocation */
+static LyricTimeline* finish_timeline(builder_t* b) {
+    if (b->failed) return NULL;
+    if (b->line_count > 0xFFFFFFFFu - 1 || b->word_count > 0xFFFFFFFFu || b->pool_size > 0xFFFFFFFFu) return NULL;
+
+    /* Lines sharing a start time (e.g. translations) keep their file order */
+    std::stable_sort(b->lines, b->lines + b->line_count, earlier_line);
+
+    /* An open line lasts until the next line with a later start */
+    uint32_t next_start = UNSET_TIME;
+    for (size_t i = b->line_count; i-- > 0;) {
+        if (i + 1 < b->line_count && b->lines[i + 1].start_ms > b->lines[i].start_ms) {
+            next_start = b->lines[i + 1].start_ms;
+        }
+        if (b->lines[i].end_ms == UNSET_TIME) b->lines[i].end_ms = next_start;
+    }
+
+    size_t count = b->line_count;
+    size_t words = 0;
+    for (size_t i = 0; i < count; i++) words += b->lines[i].word_count;
+
+    size_t arrays = count * 4 + (count + 1) + words * 4;
+    size_t total = sizeof(LyricTimeline) + arrays * sizeof(uint32_t) + b->pool_size;
+    uint8_t* block = (uint8_t*)mem_malloc(total);
+    if (!block) return NULL;
+
+    LyricTimeline* timeline = (LyricTimeline*)block;
+    uint32_t* cursor = (uint32_t*)(block + sizeof(LyricTimeline));
+    timeline->count = (uint32_t)count;
+    timeline->word_count = (uint32_t)words;
+    timeline->start_ms = cursor; cursor += count;
+    timeline->end_ms = cursor; cursor += count;
+    timeline->text = cursor; cursor += count;
+    timeline->length = cursor; cursor += count;
+    timeline->first_word = cursor; cursor += count + 1;
+    timeline->word_start_ms = cursor; cursor += words;
+    timeline->word_end_ms = cursor; cursor += words;
+    timeline->word_text = cursor; cursor += words;
+    timeline->word_length = cursor; cursor += words;
+    timeline->pool = (char*)cursor;
+    if (b->pool_size > 0) memcpy(timeline->pool, b->pool, b->pool_size);
+
+    uint32_t w = 0;
+    for (size_t i = 0; i < count; i++) {
+        const pending_line_t* line = &b->lines[i];
+        timeline->start_ms[i] = line->start_ms;
+        timeline->end_ms[i] = line->end_ms;
+        timeline->text[i] = line->text;
+        timeline->length[i] = line->length;
+        timeline->first_word[i] = w;
+
+        /* An open word lasts until the next word, the last until the line ends */
+        for (uint32_t j = 0; j < line->word_count; j++, w++) {
+            const pending_word_t* word = &b->words[line->first_word + j];
+            uint32_t word_end = word->end_ms;
+            if (word_end == UNSET_TIME) {
+                word_end = j + 1 < line->word_count ? b->words[line->first_word + j + 1].start_ms : line->end_ms;
+            }
+            timeline->word_start_ms[w] = word->start_ms;
+            timeline->word_end_ms[w] = word_end < word->start_ms ? word->start_ms : word_end;
+            timeline->word_text[w] = word->text;
+            timeline->word_length[w] = word->length;
+        }
+    }
+    timeline->first_word[count] = w;
+
+    return timeline;
+}
+
+LyricTimeline* dmusicpak::parse_lyrics(const uint8_t* data, size_t size, LyricFormat format) {
+    if ((!data && size > 0) || size >= 0x7FFFFFFFu) return NULL;
+
+    const char* p = (const char*)data;
+    const char* end = p + size;
+    if (size >= 3 && memcmp(p, "\xEF\xBB\xBF", 3) == 0) p += 3;
+
+    builder_t b;
+    memset(&b, 0, sizeof(b));
+
+    switch (format) {
+        case LyricFormat::LRC_ESLYRIC:
+        case LyricFormat::LRC_WORD_BY_WORD:
+        case LyricFormat::LRC_LINE_BY_LINE:
+            parse_lrc(&b, p, end);
+            break;
+        case LyricFormat::SRT:
+            parse_srt(&b, p, end);
+            break;
+        case LyricFormat::ASS:
+            parse_ass(&b, p, end);
+            break;
+        default:
+            return NULL;
+    }
+
+    LyricTimeline* timeline = finish_timeline(&b);
+    release_builder(&b);
+    return timeline;
+}
+
+void dmusicpak::free_lyric_timeline(LyricTimeline* timeline) {
+    mem_free(timeline);
+}
+
+Error dmusicpak::get_lyric_timeline(Package* package, const LyricTimeline** timeline) {
+    if (!package || !timeline) return Error::INVALID_PARAM;
+
+    if (!package->lyric_timeline) {
+        if (package->shared) return Error::NOT_SUPPORTED;
+        LyricsView view;
+        Error result = peek_lyrics(package, &view);
+        if (result != Error::OK) return result;
+        if (view.format == LyricFormat::NONE) return Error::NOT_SUPPORTED;
+
+        package->lyric_timeline = parse_lyrics(view.data, view.size, view.format);
+        if (!package->lyric_timeline) return Error::MEMORY_ALLOC;
+    }
+
+    *timeline = package->lyric_timeline;
+    return Error::OK;
+}
+
+uint32_t dmusicpak::lyric_line_count(const LyricTimeline* timeline) {
+    return timeline ? timeline->count : 0;
+}
+
+Error dmusicpak::get_lyric_line(const LyricTimeline* timeline, uint32_t index, LyricLine* line) {
+    if (!timeline || !line || index >= timeline->count) return Error::INVALID_PARAM;
+
+    line->start_ms = timeline->start_ms[index];
+    line->end_ms = timeline->end_ms[index];
+    line->text = timeline->pool + timeline->text[index];
+    line->length = timeline->length[index];
+    line->first_word = timeline->first_word[index];
+    line->word_count = timeline->first_word[index + 1] - timeline->first_word[index];
+
+    return Error::OK;
+}
+
+Error dmusicpak::get_lyric_word(const LyricTimeline* timeline, uint32_t index, LyricWord* word) {
+    if (!timeline || !word || index >= timeline->word_count) return Error::INVALID_PARAM;
+
+    word->start_ms = timeline->word_start_ms[index];
+    word->end_ms = timeline->word_end_ms[index];
+    word->text = timeline->pool + timeline->word_text[index];
+    word->length = timeline->word_length[index];
+
+    return Error::OK;
+}
+
+/* Number of lines starting at or before time_ms */
+static uint32_t lines_started(const LyricTimeline* timeline, uint64_t time_ms) {
+    return (uint32_t)(std::upper_bound(timeline->start_ms, timeline->start_ms + timeline->count, time_ms) -
+                      timeline->start_ms);
+}
+
+/* Latest started line if it is still showing */
+static int64_t showing_line(const LyricTimeline* timeline, uint32_t started, uint64_t time_ms) {
+    if (started == 0) return -1;
+    uint32_t index = started - 1;
+    return time_ms < timeline->end_ms[index] || timeline->end_ms[index] == UNSET_TIME ? (int64_t)index : -1;
+}
+
+int64_t dmusicpak::lyric_at(const LyricTimeline* timeline, uint64_t time_ms) {
+    if (!timeline) return -1;
+    return showing_line(timeline, lines_started(timeline, time_ms), time_ms);
+}
+
+int64_t dmusicpak::lyric_cursor_advance(const LyricTimeline* timeline, LyricCursor* cursor, uint64_t time_ms) {
+    if (!timeline || !cursor) return -1;
+
+    uint32_t started = cursor->started;
+    if (time_ms < cursor->time_ms || started > timeline->count) {
+        /* Seeked backwards */
+        started = lines_started(timeline, time_ms);
+    } else {
+        while (started < timeline->count && timeline->start_ms[started] <= time_ms) started++;
+    }
+
+    cursor->started = started;
+    cursor->time_ms = time_ms;
+    return showing_line(timeline, started, time_ms);
+}
+
+int64_t dmusicpak::lyric_word_at(const LyricTimeline* timeline, uint32_t line, uint64_t time_ms) {
+    if (!timeline || line >= timeline->count) return -1;
+
+    const uint32_t* first = timeline->word_start_ms + timeline->first_word[line];
+    const uint32_t* last = timeline->word_start_ms + timeline->first_word[line + 1];
+    const uint32_t* found = std::upper_bound(first, last, time_ms);
+    if (found == first) return -1;
+
+    uint32_t index = (uint32_t)(found - timeline->word_start_ms) - 1;
+    return time_ms < timeline->word_end_ms[index] ? (int64_t)index : -1;
+}
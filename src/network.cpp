@@ -12,18 +12,44 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
 
 using namespace dmusicpak;
 
-/* Initialize curl library (call once at startup) */
-static bool curl_initialized = false;
+/* Idle easy handles kept per session; in-flight requests beyond this are not limited */
+#define SESSION_POOL_SIZE 8
 
-/* Helper function to ensure curl is initialized */
-static void ensure_curl_initialized() {
-    if (!curl_initialized) {
-        curl_global_init(CURL_GLOBAL_DEFAULT);
-        curl_initialized = true;
+/* Longest ETag or Last-Modified value kept for revalidation */
+#define MAX_VALIDATOR_SIZE 256
+
+/* Global curl state: curl_global_init() runs once until network_cleanup() */
+static std::mutex g_curl_lock;
+static std::atomic<bool> g_curl_initialized(false);
+static std::atomic<Session*> g_default_session(NULL);
+
+/* Initialize curl on first use; later calls are one atomic load */
+static bool ensure_curl_initialized() {
+    if (g_curl_initialized.load(std::memory_order_acquire)) return true;
+
+    std::lock_guard<std::mutex> lock(g_curl_lock);
+    if (!g_curl_initialized.load(std::memory_order_relaxed)) {
+        if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK) return false;
+        g_curl_initialized.store(true, std::memory_order_release);
     }
+    return true;
+}
+
+Error dmusicpak::network_init() {
+    return ensure_curl_initialized() ? Error::OK : Error::NETWORK;
+}
+
+void dmusicpak::network_cleanup() {
+    std::lock_guard<std::mutex> lock(g_curl_lock);
+    free_session(g_default_session.exchange(NULL));
+    if (g_curl_initialized.exchange(false)) curl_global_cleanup();
 }
 
 /* Memory buffer structure for curl write callback */
@@ -46,7 +72,7 @@ static size_t write_callback(void* contents, size_t size, size_t nmemb, void* us
             new_capacity = mem->offset + realsize + 1024;
         }
         
-        uint8_t* new_data = (uint8_t*)realloc(mem->data, new_capacity);
+        uint8_t* new_data = (uint8_t*)mem_realloc(mem->data, new_capacity);
         if (!new_data) {
             return 0; /* Signal error */
         }
@@ -62,13 +88,8 @@ static size_t write_callback(void* contents, size_t size, size_t nmemb, void* us
     return realsize;
 }
 
-/* Initialize curl (thread-safe) */
-static CURL* init_curl_handle(const char* url, uint32_t timeout_ms) {
-    ensure_curl_initialized();
-    CURL* curl = curl_easy_init();
-    if (!curl) return NULL;
-    
-    curl_easy_setopt(curl, CURLOPT_URL, url);
+/* Options shared by one-shot and session handles */
+static void configure_curl_handle(CURL* curl, uint32_t timeout_ms) {
     curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
     curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
@@ -79,20 +100,262 @@ static CURL* init_curl_handle(const char* url, uint32_t timeout_ms) {
         curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)timeout_ms);
         curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, (long)(timeout_ms / 3));
     }
+}
+
+/* Initialize curl (thread-safe) */
+static CURL* init_curl_handle(const char* url, uint32_t timeout_ms) {
+    if (!ensure_curl_initialized()) return NULL;
+    CURL* curl = curl_easy_init();
+    if (!curl) return NULL;
+    
+    configure_curl_handle(curl, timeout_ms);
+    curl_easy_setopt(curl, CURLOPT_URL, url);
     
     return curl;
 }
 
+/* Count and trace one finished transfer started at trace_begin() */
+static void report_transfer(CURL* curl, uint64_t start, const char* url, CURLcode res) {
+    if (!start) return;
+
+    long connects = 0;
+    if (curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects) == CURLE_OK && connects > 0) {
+        stat_add(STAT_NETWORK_CONNECTIONS, (uint64_t)connects);
+    }
+
+    uint64_t bytes = 0;
+#if LIBCURL_VERSION_NUM >= 0x073700
+    curl_off_t downloaded = 0;
+    if (curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &downloaded) == CURLE_OK && downloaded > 0) {
+        bytes = (uint64_t)downloaded;
+    }
+#else
+    double downloaded = 0;
+    if (curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD, &downloaded) == CURLE_OK && downloaded > 0) {
+        bytes = (uint64_t)downloaded;
+    }
+#endif
+
+    trace_end(start, TraceEvent::NETWORK_REQUEST, url, 0, bytes, res == CURLE_OK ? Error::OK : Error::NETWORK);
+}
+
+/* Header values identifying the version of a resource */
+struct ValidatorHeaders {
+    char* out;
+    size_t capacity;
+    bool etag;  /* 'out' holds an ETag, which wins over Last-Modified */
+};
+
+/* Copy a header value without surrounding blanks; false if it is not 'name' */
+static bool header_value(const char* header, size_t size, const char* name, char* out, size_t capacity) {
+    size_t name_length = strlen(name);
+    if (size <= name_length) return false;
+    for (size_t i = 0; i < name_length; i++) {
+        if ((header[i] | 0x20) != name[i]) return false;
+    }
+
+    const char* value = header + name_length;
+    const char* end = header + size;
+    while (value < end && (*value == ' ' || *value == '\t')) value++;
+    while (end > value && (end[-1] == '\r' || end[-1] == '\n' || end[-1] == ' ')) end--;
+
+    size_t length = (size_t)(end - value);
+    if (length >= capacity) length = capacity - 1;
+    memcpy(out, value, length);
+    out[length] = '\0';
+    return true;
+}
+
+static size_t validator_header_callback(char* header, size_t size, size_t nitems, void* userp) {
+    size_t realsize = size * nitems;
+    ValidatorHeaders* headers = (ValidatorHeaders*)userp;
+
+    if (realsize >= 5 && memcmp(header, "HTTP/", 5) == 0) {
+        /* A redirect's headers describe another resource */
+        headers->out[0] = '\0';
+        headers->etag = false;
+    } else if (header_value(header, realsize, "etag:", headers->out, headers->capacity)) {
+        headers->etag = true;
+    } else if (!headers->etag) {
+        header_value(header, realsize, "last-modified:", headers->out, headers->capacity);
+    }
+    return realsize;
+}
+
+/* load_url() disk cache directory; NULL when off */
+static std::mutex g_url_cache_lock;
+static char* g_url_cache_dir = NULL;
+static std::atomic<uint32_t> g_url_cache_writes(0);
+
+Error dmusicpak::set_url_cache_dir(const char* directory) {
+    char* copy = NULL;
+    if (directory) {
+        size_t length = strlen(directory);
+        if (length == 0) return Error::INVALID_PARAM;
+        copy = (char*)mem_malloc(length + 1);
+        if (!copy) return Error::MEMORY_ALLOC;
+        memcpy(copy, directory, length + 1);
+    }
+
+    std::lock_guard<std::mutex> lock(g_url_cache_lock);
+    mem_free(g_url_cache_dir);
+    g_url_cache_dir = copy;
+    return Error::OK;
+}
+
+/* Cached copy of one URL: "<hash>.dmusicpak" and "<hash>.validator" */
+struct UrlCacheEntry {
+    char* package_path;
+    char* validator_path;
+    char validator[MAX_VALIDATOR_SIZE];  /* ETag or Last-Modified of the copy; empty if none */
+    bool etag;
+};
+
+static char* url_cache_path(const char* directory, uint64_t hash, const char* extension) {
+    size_t length = strlen(directory);
+    const char* separator = directory[length - 1] == '/' || directory[length - 1] == '\\' ? "" : "/";
+    size_t size = length + 1 + 16 + strlen(extension) + 1;
+    char* path = (char*)mem_malloc(size);
+    if (path) snprintf(path, size, "%s%s%016llx%s", directory, separator, (unsigned long long)hash, extension);
+    return path;
+}
+
+static void close_url_cache(UrlCacheEntry* entry) {
+    mem_free(entry->package_path);
+    mem_free(entry->validator_path);
+}
+
+/* Cache file names of a URL and the validator of its copy; false when caching is off */
+static bool open_url_cache(const char* url, UrlCacheEntry* entry) {
+    memset(entry, 0, sizeof(UrlCacheEntry));
+
+    uint64_t hash = 14695981039346656037ULL;  /* FNV-1a */
+    for (const uint8_t* p = (const uint8_t*)url; *p; p++) hash = (hash ^ *p) * 1099511628211ULL;
+    {
+        std::lock_guard<std::mutex> lock(g_url_cache_lock);
+        if (!g_url_cache_dir) return false;
+        entry->package_path = url_cache_path(g_url_cache_dir, hash, ".dmusicpak");
+        entry->validator_path = url_cache_path(g_url_cache_dir, hash, ".validator");
+    }
+    if (!entry->package_path || !entry->validator_path) {
+        close_url_cache(entry);
+        return false;
+    }
+
+    /* "<url>\n<etag or date>\n<value>\n"; the URL line rules out hash collisions */
+    size_t size = 0;
+    uint8_t* data = read_file(entry->validator_path, &size, NULL);
+    if (!data) return true;
+
+    const char* text = (const char*)data;
+    const char* end = text + size;
+    size_t url_length = strlen(url);
+    const char* kind = text + url_length + 1;
+    if (size > url_length + 1 && memcmp(text, url, url_length) == 0 && text[url_length] == '\n') {
+        const char* value = (const char*)memchr(kind, '\n', (size_t)(end - kind));
+        const char* value_end = value ? (const char*)memchr(value + 1, '\n', (size_t)(end - value - 1)) : NULL;
+        size_t value_length = value_end ? (size_t)(value_end - value - 1) : 0;
+        if (value_end && value_length > 0 && value_length < sizeof(entry->validator)) {
+            memcpy(entry->validator, value + 1, value_length);
+            entry->validator[value_length] = '\0';
+            entry->etag = (size_t)(value - kind) == 4 && memcmp(kind, "etag", 4) == 0;
+        }
+    }
+    mem_free(data);
+    return true;
+}
+
+/* Write a cache file under a temporary name, then move it into place */
+static bool write_url_cache_file(const char* path, const void* data, size_t size) {
+    size_t temp_size = strlen(path) + 32;
+    char* temp = (char*)mem_malloc(temp_size);
+    if (!temp) return false;
+    snprintf(temp, temp_size, "%s.%llx.%u.tmp", path, (unsigned long long)trace_clock(),
+             g_url_cache_writes.fetch_add(1, std::memory_order_relaxed));
+
+    FILE* file = fopen(temp, "wb");
+    bool ok = file != NULL;
+    if (file) {
+        ok = fwrite(data, 1, size, file) == size;
+        ok = fclose(file) == 0 && ok;
+    }
+    ok = ok && file_replace(temp, path);
+    if (!ok) remove(temp);
+    mem_free(temp);
+    return ok;
+}
+
+/* Store a downloaded package; the validator goes last, so it never describes an older copy */
+static void store_url_cache(const UrlCacheEntry* entry, const char* url, const MemoryBuffer* mem,
+                            const ValidatorHeaders* received) {
+    if (!received->out[0]) {
+        /* Nothing to revalidate with next time */
+        remove(entry->validator_path);
+        return;
+    }
+
+    size_t size = strlen(url) + strlen(received->out) + 8;
+    char* text = (char*)mem_malloc(size);
+    if (!text) return;
+    int length = snprintf(text, size, "%s\n%s\n%s\n", url, received->etag ? "etag" : "date", received->out);
+
+    remove(entry->validator_path);
+    if (write_url_cache_file(entry->package_path, mem->data, mem->size)) {
+        write_url_cache_file(entry->validator_path, text, (size_t)length);
+    }
+    mem_free(text);
+}
+
+/* One GET into mem, conditional when there is a cached copy; sets not_modified on a 304 */
+static CURLcode download_url(const char* url, uint32_t timeout_ms, const UrlCacheEntry* cached,
+                             MemoryBuffer* mem, ValidatorHeaders* received, bool* not_modified) {
+    *not_modified = false;
+    mem->size = 0;
+    mem->offset = 0;
+    received->out[0] = '\0';
+    received->etag = false;
+
+    CURL* curl = init_curl_handle(url, timeout_ms);
+    if (!curl) return CURLE_FAILED_INIT;
+
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, mem);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, validator_header_callback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, received);
+
+    struct curl_slist* headers = NULL;
+    if (cached && cached->validator[0]) {
+        char header[MAX_VALIDATOR_SIZE + 32];
+        snprintf(header, sizeof(header), "%s: %s", cached->etag ? "If-None-Match" : "If-Modified-Since",
+                 cached->validator);
+        headers = curl_slist_append(NULL, header);
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    }
+
+    uint64_t start = trace_begin();
+    CURLcode res = curl_easy_perform(curl);
+
+    /* Check HTTP response code */
+    long http_code = 0;
+    if (res == CURLE_OK) {
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+        if (http_code == 304 && headers) {
+            *not_modified = true;
+        } else if (http_code < 200 || http_code >= 300) {
+            res = CURLE_HTTP_RETURNED_ERROR;
+        }
+    }
+
+    report_transfer(curl, start, url, res);
+    curl_easy_cleanup(curl);
+    curl_slist_free_all(headers);
+    return res;
+}
+
 /* Download entire file from URL */
 Package* dmusicpak::load_url(const char* url, uint32_t timeout_ms) {
     if (!url) return NULL;
     if (timeout_ms == 0) timeout_ms = 30000; /* Default 30 seconds */
     
-    /* Initialize curl */
-    CURLcode res;
-    CURL* curl = init_curl_handle(url, timeout_ms);
-    if (!curl) return NULL;
-    
     /* Initialize memory buffer */
     MemoryBuffer mem;
     mem.data = NULL;
@@ -102,52 +365,373 @@ Package* dmusicpak::load_url(const char* url, uint32_t timeout_ms) {
     
     /* Allocate initial buffer */
     mem.capacity = 64 * 1024; /* 64KB initial */
-    mem.data = (uint8_t*)malloc(mem.capacity);
-    if (!mem.data) {
-        curl_easy_cleanup(curl);
-        return NULL;
-    }
-    
-    /* Set write callback */
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &mem);
+    mem.data = (uint8_t*)mem_malloc(mem.capacity);
+    if (!mem.data) return NULL;
+
+    UrlCacheEntry cached;
+    bool caching = open_url_cache(url, &cached);
+
+    char validator[MAX_VALIDATOR_SIZE];
+    ValidatorHeaders received;
+    received.out = validator;
+    received.capacity = sizeof(validator);
     
     /* Perform download */
-    res = curl_easy_perform(curl);
-    
-    /* Check HTTP response code */
-    long http_code = 0;
-    if (res == CURLE_OK) {
-        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-        if (http_code < 200 || http_code >= 300) {
-            res = CURLE_HTTP_RETURNED_ERROR;
+    uint64_t start = trace_begin();
+    bool not_modified = false;
+    CURLcode res = download_url(url, timeout_ms, caching ? &cached : NULL, &mem, &received, &not_modified);
+
+    if (res == CURLE_OK && not_modified) {
+        /* 304: the cached copy is current */
+        size_t size = 0;
+        uint8_t* data = read_file(cached.package_path, &size, NULL);
+        Package* package = data ? parse_package(data, size, false, NULL) : NULL;
+        mem_free(data);
+        if (package) {
+            mem_free(mem.data);
+            close_url_cache(&cached);
+            trace_end(start, TraceEvent::LOAD, url, 0, size, Error::OK);
+            return package;
         }
+
+        /* The copy is gone or damaged: fetch the package unconditionally */
+        cached.validator[0] = '\0';
+        res = download_url(url, timeout_ms, &cached, &mem, &received, &not_modified);
     }
     
-    curl_easy_cleanup(curl);
-    
     if (res != CURLE_OK) {
-        if (mem.data) ::free(mem.data);
+        mem_free(mem.data);
+        if (caching) close_url_cache(&cached);
+        trace_end(start, TraceEvent::LOAD, url, 0, 0, Error::NETWORK);
         return NULL;
     }
     
     /* Parse downloaded data */
-    Package* package = load_memory(mem.data, mem.size);
-    ::free(mem.data);
+    Package* package = parse_package(mem.data, mem.size, false, NULL);
+    if (package && caching) store_url_cache(&cached, url, &mem, &received);
+    if (caching) close_url_cache(&cached);
+    mem_free(mem.data);
+    trace_end(start, TraceEvent::LOAD, url, 0, mem.size, package ? Error::OK : Error::INVALID_FORMAT);
     
     return package;
 }
 
+/* Feed received bytes straight into the push parser */
+static size_t parser_write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
+    size_t total_size = size * nmemb;
+    PushParser* parser = (PushParser*)userp;
+
+    /* Returning a short count makes curl abort the transfer */
+    return parser_feed(parser, (const uint8_t*)contents, total_size) ? total_size : 0;
+}
+
 /* Stream and parse incrementally */
 Package* dmusicpak::load_url_stream(const char* url, uint32_t timeout_ms, size_t chunk_size) {
+    return load_url_stream_ex(url, timeout_ms, chunk_size, NULL);
+}
+
+Package* dmusicpak::load_url_stream_ex(
+    const char* url,
+    uint32_t timeout_ms,
+    size_t chunk_size,
+    const StreamListener* listener
+) {
     if (!url) return NULL;
     if (timeout_ms == 0) timeout_ms = 30000; /* Default 30 seconds */
     if (chunk_size == 0) chunk_size = 65536; /* Default 64KB */
-    
-    /* For now, use simple download approach */
-    /* TODO: Implement true streaming parser that can parse chunks as they arrive */
-    /* This requires modifying the parser to handle partial data */
-    
-    return load_url(url, timeout_ms);
+
+    CURL* curl = init_curl_handle(url, timeout_ms);
+    if (!curl) return NULL;
+
+    PushParser* parser = parser_create(listener, chunk_size);
+    if (!parser) {
+        curl_easy_cleanup(curl);
+        return NULL;
+    }
+
+    /* Error bodies must not reach the parser */
+    long buffer_size = chunk_size > CURL_MAX_READ_SIZE ? CURL_MAX_READ_SIZE : (long)chunk_size;
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, buffer_size);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, parser_write_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, parser);
+
+    uint64_t start = trace_begin();
+    CURLcode res = curl_easy_perform(curl);
+    report_transfer(curl, start, url, res);
+    curl_easy_cleanup(curl);
+
+    Package* package = parser_finish(parser);
+    if (res != CURLE_OK && package) {
+        dmusicpak::free(package);
+        package = NULL;
+    }
+
+    trace_end(start, TraceEvent::LOAD, url, 0, 0, package ? Error::OK : Error::NETWORK);
+    return package;
+}
+
+/* HTTP session: share handle for DNS/TLS/connection caches plus idle easy handles */
+struct dmusicpak::Session {
+    CURLSH* share;
+    std::mutex share_locks[CURL_LOCK_DATA_LAST];
+    std::mutex pool_lock;
+    CURL* idle[SESSION_POOL_SIZE];
+    int num_idle;
+    uint32_t timeout_ms;
+};
+
+static void session_lock(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr) {
+    (void)handle;
+    (void)access;
+    ((Session*)userptr)->share_locks[data].lock();
+}
+
+static void session_unlock(CURL* handle, curl_lock_data data, void* userptr) {
+    (void)handle;
+    ((Session*)userptr)->share_locks[data].unlock();
+}
+
+Session* dmusicpak::create_session(uint32_t timeout_ms) {
+    if (!ensure_curl_initialized()) return NULL;
+
+    Session* session = new (std::nothrow) Session();
+    if (!session) return NULL;
+
+    session->share = curl_share_init();
+    if (!session->share) {
+        delete session;
+        return NULL;
+    }
+
+    session->timeout_ms = timeout_ms > 0 ? timeout_ms : 30000; /* Default 30 seconds */
+    curl_share_setopt(session->share, CURLSHOPT_LOCKFUNC, session_lock);
+    curl_share_setopt(session->share, CURLSHOPT_UNLOCKFUNC, session_unlock);
+    curl_share_setopt(session->share, CURLSHOPT_USERDATA, session);
+    curl_share_setopt(session->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(session->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+    /* Shared connection cache (curl 7.57+); older versions reuse per handle only */
+    curl_share_setopt(session->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+
+    return session;
+}
+
+void dmusicpak::free_session(Session* session) {
+    if (!session) return;
+
+    /* Easy handles must be gone before the share handle they use */
+    for (int i = 0; i < session->num_idle; i++) {
+        curl_easy_cleanup(session->idle[i]);
+    }
+    curl_share_cleanup(session->share);
+    delete session;
+}
+
+/* Take an idle handle from the session, or create one */
+static CURL* acquire_handle(Session* session) {
+    {
+        std::lock_guard<std::mutex> lock(session->pool_lock);
+        if (session->num_idle > 0) return session->idle[--session->num_idle];
+    }
+
+    CURL* curl = curl_easy_init();
+    if (!curl) return NULL;
+
+    configure_curl_handle(curl, session->timeout_ms);
+    curl_easy_setopt(curl, CURLOPT_SHARE, session->share);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    /* Prefer HTTP/2 over TLS. No CURLOPT_PIPEWAIT here: a blocking transfer
+       waiting on a connection another thread's transfer holds never wakes up */
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+    return curl;
+}
+
+/* Return a handle to the session; its connection stays cached for reuse */
+static void release_handle(Session* session, CURL* curl) {
+    {
+        std::lock_guard<std::mutex> lock(session->pool_lock);
+        if (session->num_idle < SESSION_POOL_SIZE) {
+            session->idle[session->num_idle++] = curl;
+            return;
+        }
+    }
+    curl_easy_cleanup(curl);
+}
+
+/* Fixed output buffer for range requests */
+struct RangeBuffer {
+    uint8_t* data;
+    size_t capacity;
+    size_t size;
+    bool truncated;  /* Server sent more than requested */
+    uint64_t total;  /* Full resource size from Content-Range, 0 if unknown */
+};
+
+/* Pick the resource size out of "Content-Range: bytes first-last/total" */
+static size_t range_header_callback(char* header, size_t size, size_t nitems, void* userp) {
+    size_t realsize = size * nitems;
+    RangeBuffer* range = (RangeBuffer*)userp;
+
+    static const char name[] = "content-range:";
+    if (realsize > sizeof(name) - 1) {
+        size_t i = 0;
+        while (i < sizeof(name) - 1 && (header[i] | 0x20) == name[i]) i++;
+        if (i == sizeof(name) - 1) {
+            const char* slash = (const char*)memchr(header, '/', realsize);
+            uint64_t total = 0;
+            if (slash) {
+                for (const char* p = slash + 1; p < header + realsize && *p >= '0' && *p <= '9'; p++) {
+                    total = total * 10 + (uint64_t)(*p - '0');
+                }
+            }
+            range->total = total;
+        }
+    }
+    return realsize;
+}
+
+static size_t range_callback(void* contents, size_t size, size_t nmemb, void* userp) {
+    size_t realsize = size * nmemb;
+    RangeBuffer* range = (RangeBuffer*)userp;
+
+    size_t room = range->capacity - range->size;
+    if (realsize > room) {
+        /* Keep what fits and stop the transfer */
+        memcpy(range->data + range->size, contents, room);
+        range->size += room;
+        range->truncated = true;
+        return 0;
+    }
+
+    memcpy(range->data + range->size, contents, realsize);
+    range->size += realsize;
+    return realsize;
+}
+
+/* Point a handle at one Range request into 'out' */
+static void prepare_range(CURL* curl, const char* url, size_t offset, size_t size, uint8_t* buffer,
+                          RangeBuffer* out) {
+    char range[64];
+    snprintf(range, sizeof(range), "%zu-%zu", offset, offset + size - 1);
+
+    out->data = buffer;
+    out->capacity = size;
+    out->size = 0;
+    out->truncated = false;
+    out->total = 0;
+
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_RANGE, range);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, range_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, out);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, range_header_callback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, out);
+}
+
+/* Outcome of a finished Range request from the transfer result and status */
+static CURLcode range_result(CURL* curl, CURLcode res, const RangeBuffer* out, size_t offset) {
+    long http_code = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+
+    /* A 200 means the range was ignored: the body starts at byte 0 */
+    if (res == CURLE_WRITE_ERROR && out->truncated && http_code == 200 && offset == 0) {
+        res = CURLE_OK;
+    }
+    if (res == CURLE_OK) {
+        /* 206 is Partial Content (expected for Range requests) */
+        if (http_code != 206 && (http_code != 200 || offset != 0)) {
+            res = CURLE_HTTP_RETURNED_ERROR;
+        }
+    }
+    return res;
+}
+
+/* Perform one Range request on a prepared handle */
+static int64_t perform_range(CURL* curl, const char* url, size_t offset, size_t size,
+                             uint8_t* buffer, uint64_t* total) {
+    RangeBuffer out;
+    prepare_range(curl, url, offset, size, buffer, &out);
+
+    uint64_t start = trace_begin();
+    CURLcode res = range_result(curl, curl_easy_perform(curl), &out, offset);
+    report_transfer(curl, start, url, res);
+
+    if (res != CURLE_OK) {
+        return -1;
+    }
+
+    /* A complete 200 body is the whole resource */
+    if (total) *total = out.total > 0 ? out.total : (out.truncated ? 0 : out.size);
+    return (int64_t)out.size;
+}
+
+int64_t dmusicpak::get_audio_chunk_session(
+    Session* session,
+    const char* url,
+    size_t offset,
+    size_t size,
+    uint8_t* buffer
+) {
+    if (!session || !url || !buffer || size == 0) return -1;
+
+    CURL* curl = acquire_handle(session);
+    if (!curl) return -1;
+
+    int64_t result = perform_range(curl, url, offset, size, buffer, NULL);
+    release_handle(session, curl);
+    return result;
+}
+
+/* Process-wide session behind get_audio_chunk_url() */
+static Session* default_session() {
+    Session* session = g_default_session.load(std::memory_order_acquire);
+    if (session || !ensure_curl_initialized()) return session;
+
+    std::lock_guard<std::mutex> lock(g_curl_lock);
+    session = g_default_session.load(std::memory_order_relaxed);
+    if (!session) {
+        session = create_session(0);
+        g_default_session.store(session, std::memory_order_release);
+    }
+    return session;
+}
+
+bool dmusicpak::url_validator(Session* session, const char* url, char* validator, size_t size) {
+    if (!url || !validator || size == 0) return false;
+    if (!session) session = default_session();
+    if (!session) return false;
+
+    ValidatorHeaders headers;
+    headers.out = validator;
+    headers.capacity = size;
+    headers.etag = false;
+    validator[0] = '\0';
+
+    CURL* curl = acquire_handle(session);
+    if (!curl) return false;
+
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_RANGE, NULL);
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, validator_header_callback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &headers);
+
+    uint64_t start = trace_begin();
+    CURLcode res = curl_easy_perform(curl);
+
+    long http_code = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+    if (res == CURLE_OK && http_code != 200) res = CURLE_HTTP_RETURNED_ERROR;
+    report_transfer(curl, start, url, res);
+
+    /* Pooled handles go back as GET handles */
+    curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+    release_handle(session, curl);
+
+    if (res != CURLE_OK) validator[0] = '\0';
+    return res == CURLE_OK;
 }
 
 /* Get audio chunk using HTTP Range request */
@@ -161,49 +745,573 @@ int64_t dmusicpak::get_audio_chunk_url(
     if (!url || !buffer || size == 0) return -1;
     if (timeout_ms == 0) timeout_ms = 30000; /* Default 30 seconds */
     
-    CURL* curl = init_curl_handle(url, timeout_ms);
+    Session* session = default_session();
+    if (!session) return -1;
+    
+    CURL* curl = acquire_handle(session);
     if (!curl) return -1;
     
-    /* Set up Range request */
-    char range_header[64];
-    snprintf(range_header, sizeof(range_header), "Range: bytes=%zu-%zu", offset, offset + size - 1);
-    struct curl_slist* headers = NULL;
-    headers = curl_slist_append(headers, range_header);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    /* Per-call timeout on the shared handle */
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)timeout_ms);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, (long)(timeout_ms / 3));
     
-    /* Set up write callback with fixed buffer */
-    MemoryBuffer mem;
-    mem.data = buffer;
-    mem.size = 0;
-    mem.capacity = size;
-    mem.offset = 0;
+    int64_t result = perform_range(curl, url, offset, size, buffer, NULL);
     
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &mem);
+    /* Restore the session default before the handle is reused */
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)session->timeout_ms);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, (long)(session->timeout_ms / 3));
+    release_handle(session, curl);
     
-    /* Perform request */
-    CURLcode res = curl_easy_perform(curl);
-    
-    long http_code = 0;
-    if (res == CURLE_OK) {
-        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-        /* 206 is Partial Content (expected for Range requests) */
-        if (http_code != 206 && (http_code < 200 || http_code >= 300)) {
-            res = CURLE_HTTP_RETURNED_ERROR;
+    return result;
+}
+
+/* Backing store of a load_url_index() package */
+struct RemoteSource {
+    Session* session;
+    char* url;
+};
+
+static bool remote_read_at(void* source, uint64_t offset, void* buffer, size_t size) {
+    RemoteSource* remote = (RemoteSource*)source;
+    if (size == 0) return true;
+    if (offset > (size_t)-1) return false;
+
+    return get_audio_chunk_session(remote->session, remote->url, (size_t)offset, size,
+                                   (uint8_t*)buffer) == (int64_t)size;
+}
+
+static void remote_close(void* source) {
+    RemoteSource* remote = (RemoteSource*)source;
+    mem_free(remote->url);
+    mem_free(remote);
+}
+
+static const SourceOps remote_source_ops = { remote_read_at, remote_close };
+
+/* Open a package over HTTP from its header and index */
+Package* dmusicpak::load_url_index(const char* url, Session* session) {
+    if (!url) return NULL;
+    if (!session) session = default_session();
+    if (!session) return NULL;
+
+    /* One small Range request normally covers the file header and the whole TOC */
+    uint64_t start = trace_begin();
+    uint8_t head[INDEX_HEAD_SIZE];
+    uint64_t size = 0;
+    CURL* curl = acquire_handle(session);
+    if (!curl) return NULL;
+    int64_t head_size = perform_range(curl, url, 0, sizeof(head), head, &size);
+    release_handle(session, curl);
+    if (head_size < FILE_HEADER_SIZE || size == 0) {
+        trace_end(start, TraceEvent::LOAD, url, 0, 0, Error::NETWORK);
+        return NULL;
+    }
+
+    Package* package = create();
+    RemoteSource* remote = (RemoteSource*)mem_calloc(1, sizeof(RemoteSource));
+    size_t url_length = strlen(url);
+    if (remote) remote->url = (char*)mem_malloc(url_length + 1);
+    if (!package || !remote || !remote->url) {
+        if (remote) mem_free(remote->url);
+        mem_free(remote);
+        dmusicpak::free(package);
+        return NULL;
+    }
+    memcpy(remote->url, url, url_length + 1);
+    remote->session = session;
+
+    package->source_ops = &remote_source_ops;
+    package->source = remote;
+    package->has_file = 1;
+
+    if (!index_package(package, size, head, (size_t)head_size)) {
+        dmusicpak::free(package);
+        trace_end(start, TraceEvent::LOAD, url, 0, size, Error::INVALID_FORMAT);
+        return NULL;
+    }
+
+    trace_end(start, TraceEvent::LOAD, url, 0, size, Error::OK);
+    return package;
+}
+
+/* Prefetch window states */
+enum {
+    SLOT_EMPTY,    /* Free for the next window */
+    SLOT_LOADING,  /* Transfer in flight; 'filled' bytes already readable */
+    SLOT_READY,    /* Window complete */
+    SLOT_FAILED    /* Transfer failed; reads of this window return -1 */
+};
+
+/* One Range window of a prefetcher */
+struct PrefetchSlot {
+    Prefetcher* prefetcher;
+    CURL* curl;
+    uint8_t* data;
+    uint64_t start;       /* Audio-relative offset of the window */
+    size_t size;
+    size_t filled;
+    uint32_t generation;  /* Seek generation the window was requested for */
+    int state;
+    uint64_t trace_start; /* trace_begin() when the window was requested */
+};
+
+struct dmusicpak::Prefetcher {
+    Session* session;
+    const char* url;
+    uint64_t audio_offset;  /* Audio payload location in the remote file */
+    uint64_t audio_size;
+    size_t window_size;
+    uint32_t depth;
+    PrefetchSlot* slots;
+    CURLM* multi;
+    std::thread worker;
+    std::mutex lock;
+    std::condition_variable changed;  /* Signalled when window data or state changes */
+    uint64_t cursor;       /* Next audio byte the player reads */
+    uint64_t next_start;   /* Start of the next window to request */
+    uint32_t generation;   /* Bumped by every seek */
+    bool stop;
+};
+
+/* Wake the thread driving a multi handle out of curl_multi_poll() */
+static void wake_multi(CURLM* multi) {
+#if LIBCURL_VERSION_NUM >= 0x074400
+    curl_multi_wakeup(multi);
+#else
+    (void)multi;  /* The thread polls with a short timeout instead */
+#endif
+}
+
+static void wake_worker(Prefetcher* prefetcher) {
+    wake_multi(prefetcher->multi);
+}
+
+static size_t prefetch_write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
+    size_t realsize = size * nmemb;
+    PrefetchSlot* slot = (PrefetchSlot*)userp;
+    Prefetcher* prefetcher = slot->prefetcher;
+
+    std::lock_guard<std::mutex> lock(prefetcher->lock);
+
+    /* Abort windows made stale by a seek, and bodies longer than requested */
+    if (slot->generation != prefetcher->generation || realsize > slot->size - slot->filled) return 0;
+
+    memcpy(slot->data + slot->filled, contents, realsize);
+    slot->filled += realsize;
+    prefetcher->changed.notify_all();
+    return realsize;
+}
+
+/* Drop stale or consumed windows and request new ones; called with the lock held */
+static void schedule_windows(Prefetcher* prefetcher) {
+    for (uint32_t i = 0; i < prefetcher->depth; i++) {
+        PrefetchSlot* slot = &prefetcher->slots[i];
+        bool stale = slot->generation != prefetcher->generation;
+        bool consumed = slot->start + slot->size <= prefetcher->cursor;
+
+        if (slot->state == SLOT_LOADING && stale) {
+            curl_multi_remove_handle(prefetcher->multi, slot->curl);
+            slot->state = SLOT_EMPTY;
+        } else if ((slot->state == SLOT_READY && (stale || consumed)) ||
+                   (slot->state == SLOT_FAILED && stale)) {
+            slot->state = SLOT_EMPTY;
         }
     }
-    
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
-    
-    if (res != CURLE_OK) {
-        return -1;
+
+    for (uint32_t i = 0; i < prefetcher->depth && prefetcher->next_start < prefetcher->audio_size; i++) {
+        PrefetchSlot* slot = &prefetcher->slots[i];
+        if (slot->state != SLOT_EMPTY) continue;
+
+        uint64_t remaining = prefetcher->audio_size - prefetcher->next_start;
+        slot->start = prefetcher->next_start;
+        slot->size = remaining < prefetcher->window_size ? (size_t)remaining : prefetcher->window_size;
+        slot->filled = 0;
+        slot->generation = prefetcher->generation;
+        slot->state = SLOT_LOADING;
+        slot->trace_start = trace_begin();
+        prefetcher->next_start += slot->size;
+
+        char range[64];
+        uint64_t first = prefetcher->audio_offset + slot->start;
+        snprintf(range, sizeof(range), "%llu-%llu",
+                 (unsigned long long)first, (unsigned long long)(first + slot->size - 1));
+        curl_easy_setopt(slot->curl, CURLOPT_RANGE, range);
+        curl_multi_add_handle(prefetcher->multi, slot->curl);
     }
-    
-    return (int64_t)mem.size;
 }
 
-/* Note: We rely on the OS to clean up curl on program exit */
-/* For production use, consider adding a cleanup function */
+/* Mark finished transfers ready or failed; returns whether any finished */
+static bool collect_windows(Prefetcher* prefetcher) {
+    bool finished = false;
+    CURLMsg* msg;
+    int queued = 0;
+    while ((msg = curl_multi_info_read(prefetcher->multi, &queued))) {
+        if (msg->msg != CURLMSG_DONE) continue;
+
+        PrefetchSlot* slot = NULL;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&slot);
+        long http_code = 0;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &http_code);
+        CURLcode result = msg->data.result;
+        report_transfer(msg->easy_handle, slot->trace_start, prefetcher->url,
+                        result == CURLE_OK && http_code != 206 ? CURLE_HTTP_RETURNED_ERROR : result);
+        curl_multi_remove_handle(prefetcher->multi, msg->easy_handle);
+
+        std::lock_guard<std::mutex> lock(prefetcher->lock);
+        finished = true;
+        if (slot->state != SLOT_LOADING) {
+            continue;
+        } else if (slot->generation != prefetcher->generation) {
+            slot->state = SLOT_EMPTY;
+        } else if (result == CURLE_OK && http_code == 206 && slot->filled == slot->size) {
+            slot->state = SLOT_READY;
+        } else {
+            slot->state = SLOT_FAILED;
+        }
+        prefetcher->changed.notify_all();
+    }
+    return finished;
+}
+
+static void prefetch_worker(Prefetcher* prefetcher) {
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(prefetcher->lock);
+            if (prefetcher->stop) break;
+            schedule_windows(prefetcher);
+        }
+
+        int running = 0;
+        curl_multi_perform(prefetcher->multi, &running);
+
+        /* Finished windows free slots: schedule again before sleeping */
+        if (collect_windows(prefetcher)) continue;
+
+#if LIBCURL_VERSION_NUM >= 0x074400
+        curl_multi_poll(prefetcher->multi, NULL, 0, 1000, NULL);
+#else
+        curl_multi_wait(prefetcher->multi, NULL, 0, 20, NULL);
+#endif
+    }
+}
+
+static void release_prefetcher(Prefetcher* prefetcher) {
+    for (uint32_t i = 0; i < prefetcher->depth; i++) {
+        PrefetchSlot* slot = &prefetcher->slots[i];
+        if (slot->curl) {
+            if (slot->state == SLOT_LOADING) curl_multi_remove_handle(prefetcher->multi, slot->curl);
+            curl_easy_setopt(slot->curl, CURLOPT_PRIVATE, NULL);
+            curl_easy_setopt(slot->curl, CURLOPT_PIPEWAIT, 0L);
+            release_handle(prefetcher->session, slot->curl);
+        }
+        mem_free(slot->data);
+    }
+    mem_free(prefetcher->slots);
+    if (prefetcher->multi) curl_multi_cleanup(prefetcher->multi);
+    delete prefetcher;
+}
+
+Prefetcher* dmusicpak::create_prefetcher(Package* package, size_t window_size, uint32_t depth) {
+    if (!package || package->source_ops != &remote_source_ops) return NULL;
+    if (window_size == 0) window_size = 256 * 1024; /* Default 256KB */
+    if (depth == 0) depth = 4;
+
+    uint64_t audio_offset = 0;
+    uint64_t audio_size = 0;
+    if (locate_audio(package, &audio_offset, &audio_size) != Error::OK) return NULL;
+    if (package->audio_frames) return NULL;  /* Windows are raw byte ranges; compressed audio has none */
+
+    Prefetcher* prefetcher = new (std::nothrow) Prefetcher();
+    if (!prefetcher) return NULL;
+
+    RemoteSource* remote = (RemoteSource*)package->source;
+    prefetcher->session = remote->session;
+    prefetcher->url = remote->url;
+    prefetcher->audio_offset = audio_offset;
+    prefetcher->audio_size = audio_size;
+    prefetcher->window_size = window_size;
+    prefetcher->depth = depth;
+    prefetcher->multi = curl_multi_init();
+    prefetcher->slots = (PrefetchSlot*)mem_calloc(depth, sizeof(PrefetchSlot));
+    if (!prefetcher->multi || !prefetcher->slots) {
+        release_prefetcher(prefetcher);
+        return NULL;
+    }
+
+    /* Windows of one package multiplex over a shared HTTP/2 connection where possible */
+    curl_multi_setopt(prefetcher->multi, CURLMOPT_PIPELINING, (long)CURLPIPE_MULTIPLEX);
+
+    for (uint32_t i = 0; i < depth; i++) {
+        PrefetchSlot* slot = &prefetcher->slots[i];
+        slot->prefetcher = prefetcher;
+        slot->data = (uint8_t*)mem_malloc(window_size);
+        slot->curl = acquire_handle(prefetcher->session);
+        if (!slot->data || !slot->curl) {
+            release_prefetcher(prefetcher);
+            return NULL;
+        }
+
+        curl_easy_setopt(slot->curl, CURLOPT_URL, prefetcher->url);
+        curl_easy_setopt(slot->curl, CURLOPT_WRITEFUNCTION, prefetch_write_callback);
+        curl_easy_setopt(slot->curl, CURLOPT_WRITEDATA, slot);
+        curl_easy_setopt(slot->curl, CURLOPT_HEADERFUNCTION, NULL);
+        curl_easy_setopt(slot->curl, CURLOPT_HEADERDATA, NULL);
+        curl_easy_setopt(slot->curl, CURLOPT_PRIVATE, (char*)slot);
+        /* Within the one multi handle, waiting for a connection to multiplex on is safe */
+        curl_easy_setopt(slot->curl, CURLOPT_PIPEWAIT, 1L);
+    }
+
+    prefetcher->worker = std::thread(prefetch_worker, prefetcher);
+    return prefetcher;
+}
+
+void dmusicpak::free_prefetcher(Prefetcher* prefetcher) {
+    if (!prefetcher) return;
+
+    {
+        std::lock_guard<std::mutex> lock(prefetcher->lock);
+        prefetcher->stop = true;
+    }
+    wake_worker(prefetcher);
+    prefetcher->worker.join();
+
+    release_prefetcher(prefetcher);
+}
+
+/* Window holding the cursor, or NULL; called with the lock held */
+static PrefetchSlot* cursor_slot(Prefetcher* prefetcher) {
+    for (uint32_t i = 0; i < prefetcher->depth; i++) {
+        PrefetchSlot* slot = &prefetcher->slots[i];
+        if (slot->state != SLOT_EMPTY && slot->generation == prefetcher->generation &&
+            slot->start <= prefetcher->cursor && prefetcher->cursor < slot->start + slot->size) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+int64_t dmusicpak::prefetch_read(Prefetcher* prefetcher, uint8_t* buffer, size_t size) {
+    if (!prefetcher || !buffer) return -1;
+
+    std::unique_lock<std::mutex> lock(prefetcher->lock);
+    size_t copied = 0;
+    while (copied < size && prefetcher->cursor < prefetcher->audio_size) {
+        PrefetchSlot* slot = cursor_slot(prefetcher);
+        if (slot && slot->state == SLOT_FAILED) {
+            if (copied > 0) break;
+            return -1;
+        }
+
+        size_t offset = slot ? (size_t)(prefetcher->cursor - slot->start) : 0;
+        if (!slot || offset >= slot->filled) {
+            prefetcher->changed.wait(lock);
+            continue;
+        }
+
+        size_t to_copy = slot->filled - offset;
+        if (to_copy > size - copied) to_copy = size - copied;
+        memcpy(buffer + copied, slot->data + offset, to_copy);
+        copied += to_copy;
+        prefetcher->cursor += to_copy;
+
+        /* A consumed window frees its slot for the next one */
+        if (prefetcher->cursor == slot->start + slot->size) wake_worker(prefetcher);
+    }
+
+    return (int64_t)copied;
+}
+
+size_t dmusicpak::prefetch_available(Prefetcher* prefetcher) {
+    if (!prefetcher) return 0;
+
+    std::lock_guard<std::mutex> lock(prefetcher->lock);
+    uint64_t saved = prefetcher->cursor;
+    size_t available = 0;
+
+    /* Walk contiguous buffered windows starting at the cursor */
+    PrefetchSlot* slot;
+    while ((slot = cursor_slot(prefetcher)) && slot->state != SLOT_FAILED) {
+        size_t offset = (size_t)(prefetcher->cursor - slot->start);
+        if (offset >= slot->filled) break;
+        available += slot->filled - offset;
+        prefetcher->cursor += slot->filled - offset;
+        if (slot->filled < slot->size) break;
+    }
+
+    prefetcher->cursor = saved;
+    return available;
+}
+
+Error dmusicpak::prefetch_seek(Prefetcher* prefetcher, uint64_t offset) {
+    if (!prefetcher) return Error::INVALID_PARAM;
+    if (offset > prefetcher->audio_size) return Error::INVALID_PARAM;
+
+    {
+        std::lock_guard<std::mutex> lock(prefetcher->lock);
+
+        /* Windows already covering the target stay valid */
+        prefetcher->cursor = offset;
+        if (!cursor_slot(prefetcher)) {
+            prefetcher->generation++;
+            prefetcher->next_start = offset;
+        }
+        prefetcher->changed.notify_all();
+    }
+    wake_worker(prefetcher);
+    return Error::OK;
+}
+
+/* One URL range read of an async context */
+struct AsyncTransfer {
+    AsyncJob* job;
+    Session* session;
+    CURL* curl;
+    RangeBuffer out;
+    uint64_t trace_start;
+    AsyncTransfer* next;
+};
+
+struct dmusicpak::AsyncTransfers {
+    CURLM* multi;
+    std::thread worker;
+    std::mutex lock;
+    AsyncTransfer* queued;  /* Submitted and not yet on the multi handle, oldest first */
+    AsyncTransfer* queued_tail;
+    uint32_t active;        /* On the multi handle; worker only */
+    bool stop;
+};
+
+/* Hand a finished transfer's job back to its context */
+static void finish_transfer(AsyncTransfer* transfer, CURLcode res) {
+    AsyncJob* job = transfer->job;
+    res = range_result(transfer->curl, res, &transfer->out, job->offset);
+    report_transfer(transfer->curl, transfer->trace_start, job->name, res);
+
+    curl_easy_setopt(transfer->curl, CURLOPT_PRIVATE, NULL);
+    curl_easy_setopt(transfer->curl, CURLOPT_PIPEWAIT, 0L);
+    release_handle(transfer->session, transfer->curl);
+
+    job->completion.bytes = res == CURLE_OK ? (int64_t)transfer->out.size : -1;
+    job->completion.result = res == CURLE_OK ? Error::OK : Error::NETWORK;
+    mem_free(transfer);
+    async_complete(job);
+}
+
+static void async_transfer_worker(AsyncTransfers* transfers) {
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(transfers->lock);
+            while (transfers->queued) {
+                AsyncTransfer* transfer = transfers->queued;
+                transfers->queued = transfer->next;
+                transfer->trace_start = trace_begin();
+                if (curl_multi_add_handle(transfers->multi, transfer->curl) == CURLM_OK) {
+                    transfers->active++;
+                } else {
+                    finish_transfer(transfer, CURLE_FAILED_INIT);
+                }
+            }
+            /* Stopping waits for the transfers already submitted */
+            if (transfers->stop && transfers->active == 0) break;
+        }
+
+        int running = 0;
+        curl_multi_perform(transfers->multi, &running);
+
+        bool finished = false;
+        CURLMsg* msg;
+        int pending = 0;
+        while ((msg = curl_multi_info_read(transfers->multi, &pending))) {
+            if (msg->msg != CURLMSG_DONE) continue;
+
+            AsyncTransfer* transfer = NULL;
+            CURL* curl = msg->easy_handle;
+            CURLcode res = msg->data.result;
+            curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char**)&transfer);
+            curl_multi_remove_handle(transfers->multi, curl);
+            transfers->active--;
+            finish_transfer(transfer, res);
+            finished = true;
+        }
+        if (finished) continue;
+
+#if LIBCURL_VERSION_NUM >= 0x074400
+        curl_multi_poll(transfers->multi, NULL, 0, 1000, NULL);
+#else
+        curl_multi_wait(transfers->multi, NULL, 0, 20, NULL);
+#endif
+    }
+}
+
+AsyncTransfers* dmusicpak::create_async_transfers() {
+    if (!ensure_curl_initialized()) return NULL;
+
+    AsyncTransfers* transfers = new (std::nothrow) AsyncTransfers();
+    if (!transfers) return NULL;
+
+    transfers->multi = curl_multi_init();
+    if (!transfers->multi) {
+        delete transfers;
+        return NULL;
+    }
+    /* Reads of one server multiplex over a shared HTTP/2 connection where possible */
+    curl_multi_setopt(transfers->multi, CURLMOPT_PIPELINING, (long)CURLPIPE_MULTIPLEX);
+
+    try {
+        transfers->worker = std::thread(async_transfer_worker, transfers);
+    } catch (...) {
+        curl_multi_cleanup(transfers->multi);
+        delete transfers;
+        return NULL;
+    }
+    return transfers;
+}
+
+bool dmusicpak::submit_async_transfer(AsyncTransfers* transfers, AsyncJob* job) {
+    Session* session = job->session ? job->session : default_session();
+    if (!session) return false;
+
+    AsyncTransfer* transfer = (AsyncTransfer*)mem_calloc(1, sizeof(AsyncTransfer));
+    if (!transfer) return false;
+    transfer->curl = acquire_handle(session);
+    if (!transfer->curl) {
+        mem_free(transfer);
+        return false;
+    }
+
+    transfer->job = job;
+    transfer->session = session;
+    prepare_range(transfer->curl, job->name, job->offset, job->size, job->completion.buffer, &transfer->out);
+    curl_easy_setopt(transfer->curl, CURLOPT_PRIVATE, (char*)transfer);
+    /* Within the one multi handle, waiting for a connection to multiplex on is safe */
+    curl_easy_setopt(transfer->curl, CURLOPT_PIPEWAIT, 1L);
+
+    {
+        std::lock_guard<std::mutex> lock(transfers->lock);
+        if (transfers->queued) {
+            transfers->queued_tail->next = transfer;
+        } else {
+            transfers->queued = transfer;
+        }
+        transfers->queued_tail = transfer;
+    }
+    wake_multi(transfers->multi);
+    return true;
+}
+
+void dmusicpak::free_async_transfers(AsyncTransfers* transfers) {
+    if (!transfers) return;
+
+    {
+        std::lock_guard<std::mutex> lock(transfers->lock);
+        transfers->stop = true;
+    }
+    wake_multi(transfers->multi);
+    transfers->worker.join();
+
+    curl_multi_cleanup(transfers->multi);
+    delete transfers;
+}
 
 #endif /* DMUSICPAK_ENABLE_NETWORK */
 
@@ -0,0 +1,449 @@
+/**
+ * @file scan.cpp
+ * @brief Metadata scanning for library indexing in DMusicPak library
+ *
+ * scan_metadata() finds the chunks it needs from the first INDEX_HEAD_SIZE
+ * bytes of the file, where the TOC normally is, and unpacks the metadata
+ * chunk in place inside the caller's MetadataScan. The package and its
+ * payloads are never built. scan_directory() lists files in batches and
+ * hands each batch to parallel_for().
+ */
+
+#include "../include/dmusicpak/dmusicpak.h"
+#include "internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+using namespace dmusicpak;
+
+/* Files scanned per parallel_for() round by scan_directory() */
+#define SCAN_BATCH_SIZE 1024
+
+/* Arena block size for the filenames of one batch */
+#define SCAN_NAMES_BLOCK_SIZE (64 * 1024)
+
+/* Fields after the strings of a metadata chunk: duration_ms, bitrate, sample_rate, channels */
+#define METADATA_FIXED_SIZE 14
+
+/* Strings at the start of a metadata chunk */
+#define METADATA_STRING_COUNT 6
+
+/* Chunks scan_metadata() reads; type is 0 for chunks not in the file */
+struct scan_chunks_t {
+    ChunkEntry metadata;
+    ChunkEntry cover;
+    ChunkEntry checksum;
+};
+
+static void note_chunk(scan_chunks_t* chunks, uint8_t type, uint64_t offset, uint64_t size) {
+    ChunkEntry* entry = NULL;
+    switch (type & ~CHUNK_COMPRESSED) {
+        case CHUNK_METADATA: entry = &chunks->metadata; break;
+        case CHUNK_COVER: entry = &chunks->cover; break;
+        case CHUNK_CHECKSUM: entry = &chunks->checksum; break;
+        default: return;
+    }
+
+    /* The first chunk of a type is the one loaders use (find_chunk()) */
+    if (entry->type) return;
+    entry->type = type & ~CHUNK_COMPRESSED;
+    entry->compressed = (type & CHUNK_COMPRESSED) != 0;
+    entry->offset = offset;
+    entry->size = size;
+}
+
+/* Read file bytes, from the head when they are inside it */
+static bool read_range(const FileHandle* file, const uint8_t* head, size_t head_size,
+                       uint64_t offset, void* buffer, size_t size) {
+    if (offset <= head_size && size <= head_size - offset) {
+        memcpy(buffer, head + offset, size);
+        return true;
+    }
+    return file_read_at(file, offset, buffer, size);
+}
+
+/* Find the chunks from a TOC that fits in the head */
+static bool find_chunks_in_toc(uint64_t file_size, const uint8_t* head, size_t head_size,
+                               uint32_t version, scan_chunks_t* chunks) {
+    size_t offset = FILE_HEADER_SIZE;
+    size_t header_size = chunk_header_size(version);
+    if (head_size < offset + header_size + 4 || head[offset] != CHUNK_TOC) return false;
+
+    uint64_t toc_size = read_chunk_size(head + offset, version);
+    offset += header_size;
+    if (toc_size < 4 || toc_size > head_size - offset) return false;
+
+    const uint8_t* entries = head + offset;
+    uint32_t count = read_uint32_le(entries);
+    if ((uint64_t)count * TOC_ENTRY_SIZE > toc_size - 4) return false;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t* entry = entries + 4 + (size_t)i * TOC_ENTRY_SIZE;
+        uint64_t chunk_offset = read_uint64_le(entry + 1);
+        uint64_t chunk_size = read_uint64_le(entry + 9);
+        if (chunk_offset > file_size || chunk_size > file_size - chunk_offset) return false;
+        note_chunk(chunks, entry[0], chunk_offset, chunk_size);
+    }
+    return true;
+}
+
+/* Find the chunks by hopping from one chunk header to the next */
+static bool walk_chunks(const FileHandle* file, uint64_t file_size, const uint8_t* head, size_t head_size,
+                        uint32_t num_chunks, uint32_t version, scan_chunks_t* chunks) {
+    uint64_t offset = FILE_HEADER_SIZE;
+    size_t header_size = chunk_header_size(version);
+
+    for (uint32_t i = 0; i < num_chunks && offset + header_size <= file_size; i++) {
+        uint8_t header[CHUNK_HEADER_SIZE_LARGE];
+        if (!read_range(file, head, head_size, offset, header, header_size)) return false;
+
+        uint64_t chunk_size = read_chunk_size(header, version);
+        offset += header_size;
+        if (chunk_size > file_size - offset) break;
+
+        note_chunk(chunks, header[0], offset, chunk_size);
+        if (chunks->metadata.type && chunks->cover.type && chunks->checksum.type) break;
+        offset += chunk_size;
+    }
+    return true;
+}
+
+/*
+ * Turn the length-prefixed strings at the start of scan->storage into C
+ * strings in place. 'available' bytes of the 'size'-byte chunk are in
+ * storage; 'tail' holds its last METADATA_FIXED_SIZE bytes.
+ */
+static Error unpack_metadata(MetadataScan* scan, size_t available, uint64_t size, const uint8_t* tail) {
+    const char** fields[METADATA_STRING_COUNT] = {
+        &scan->metadata.title, &scan->metadata.artist, &scan->metadata.album,
+        &scan->metadata.genre, &scan->metadata.year, &scan->metadata.comment
+    };
+
+    uint64_t strings_size = size - METADATA_FIXED_SIZE;
+    uint64_t position = 0;
+    size_t written = 0;  /* Never ahead of position, so strings only move down */
+
+    for (int i = 0; i < METADATA_STRING_COUNT; i++) {
+        if (strings_size - position < 4) return Error::CORRUPTED;
+        if (position + 4 > available) {
+            scan->truncated = 1;
+            break;
+        }
+
+        uint32_t length = read_uint32_le((const uint8_t*)scan->storage + position);
+        position += 4;
+        if (length > strings_size - position) return Error::CORRUPTED;
+        if (position + length > available) {
+            scan->truncated = 1;
+            break;
+        }
+
+        if (length > 0) {
+            memmove(scan->storage + written, scan->storage + position, length);
+            scan->storage[written + length] = '\0';
+            *fields[i] = scan->storage + written;
+            written += (size_t)length + 1;
+        }
+        position += length;
+    }
+
+    scan->metadata.duration_ms = read_uint32_le(tail);
+    scan->metadata.bitrate = read_uint32_le(tail + 4);
+    scan->metadata.sample_rate = read_uint32_le(tail + 8);
+    scan->metadata.channels = read_uint16_le(tail + 12);
+    scan->has_metadata = 1;
+    return Error::OK;
+}
+
+/* Decode a compressed metadata chunk into scan->storage */
+static Error scan_compressed_metadata(const FileHandle* file, const uint8_t* head, size_t head_size,
+                                      const ChunkEntry* entry, const ChecksumTable* checksums,
+                                      MetadataScan* scan) {
+    if (entry->size > MAX_COMPRESSION_FRAME_SIZE) return Error::CORRUPTED;
+
+    uint8_t* chunk = (uint8_t*)mem_malloc(entry->size > 0 ? (size_t)entry->size : 1);
+    if (!chunk) return Error::MEMORY_ALLOC;
+
+    Error result = Error::OK;
+    FrameHeader frames;
+    uint8_t* raw = NULL;
+    size_t raw_size = 0;
+    if (!read_range(file, head, head_size, entry->offset, chunk, (size_t)entry->size)) {
+        result = Error::IO;
+    } else if (has_checksum(checksums, CHUNK_METADATA) &&
+               crc32c(0, chunk, (size_t)entry->size) != checksums->checksum[CHUNK_METADATA]) {
+        result = Error::CORRUPTED;
+    } else if (!read_frame_header(chunk, entry->size, &frames)) {
+        result = Error::CORRUPTED;
+    } else if (!compression_available((Compression)frames.codec)) {
+        result = Error::NOT_SUPPORTED;
+    } else if (!decode_chunk(chunk, entry->size, &raw, &raw_size)) {
+        result = Error::CORRUPTED;
+    }
+    mem_free(chunk);
+    if (result != Error::OK) return result;
+
+    if (raw_size < METADATA_FIXED_SIZE) {
+        mem_free(raw);
+        return Error::CORRUPTED;
+    }
+
+    size_t available = raw_size < sizeof(scan->storage) ? raw_size : sizeof(scan->storage);
+    uint8_t tail[METADATA_FIXED_SIZE];
+    memcpy(scan->storage, raw, available);
+    memcpy(tail, raw + raw_size - METADATA_FIXED_SIZE, METADATA_FIXED_SIZE);
+    mem_free(raw);
+
+    return unpack_metadata(scan, available, raw_size, tail);
+}
+
+static Error scan_metadata_chunk(const FileHandle* file, const uint8_t* head, size_t head_size,
+                                 const ChunkEntry* entry, const ChecksumTable* checksums,
+                                 MetadataScan* scan) {
+    if (entry->compressed) return scan_compressed_metadata(file, head, head_size, entry, checksums, scan);
+    if (entry->size < METADATA_FIXED_SIZE) return Error::CORRUPTED;
+
+    /* Oversized metadata: the strings that fit, plus the fixed fields from the end */
+    size_t available = entry->size < sizeof(scan->storage) ? (size_t)entry->size : sizeof(scan->storage);
+    uint8_t tail[METADATA_FIXED_SIZE];
+    if (!read_range(file, head, head_size, entry->offset, scan->storage, available) ||
+        !read_range(file, head, head_size, entry->offset + entry->size - METADATA_FIXED_SIZE,
+                    tail, METADATA_FIXED_SIZE)) {
+        return Error::IO;
+    }
+
+    /* Only a chunk read whole can be checked */
+    if (available == entry->size && has_checksum(checksums, CHUNK_METADATA) &&
+        crc32c(0, scan->storage, available) != checksums->checksum[CHUNK_METADATA]) {
+        return Error::CORRUPTED;
+    }
+
+    return unpack_metadata(scan, available, entry->size, tail);
+}
+
+static Error scan_file(const FileHandle* file, MetadataScan* scan) {
+    uint64_t size = 0;
+    uint8_t head[INDEX_HEAD_SIZE];
+    if (!file_size(file, &size)) return Error::IO;
+    if (size < FILE_HEADER_SIZE) return Error::INVALID_FORMAT;
+
+    size_t head_size = size < sizeof(head) ? (size_t)size : sizeof(head);
+    if (!file_read_at(file, 0, head, head_size)) return Error::IO;
+
+    if (memcmp(head, DMUSICPAK_MAGIC, 4) != 0 || !is_supported_version(read_uint32_le(head + 4))) {
+        return Error::INVALID_FORMAT;
+    }
+
+    uint32_t version = read_uint32_le(head + 4);
+    scan_chunks_t chunks;
+    memset(&chunks, 0, sizeof(chunks));
+    if (!find_chunks_in_toc(size, head, head_size, version, &chunks)) {
+        memset(&chunks, 0, sizeof(chunks));
+        if (!walk_chunks(file, size, head, head_size, read_uint32_le(head + 8), version, &chunks)) {
+            return Error::IO;
+        }
+    }
+
+    /* Checksums follow the TOC, so they are normally inside the head */
+    ChecksumTable checksums;
+    memset(&checksums, 0, sizeof(checksums));
+    if (chunks.checksum.type && !chunks.checksum.compressed) {
+        if (chunks.checksum.size > MAX_CHECKSUM_CHUNK_SIZE) return Error::CORRUPTED;
+
+        const ChunkEntry* entry = &chunks.checksum;
+        if (entry->offset <= head_size && entry->size <= head_size - entry->offset) {
+            if (!read_checksum_chunk(head + entry->offset, entry->size, &checksums)) return Error::CORRUPTED;
+        } else {
+            uint8_t* chunk = (uint8_t*)mem_malloc(entry->size > 0 ? (size_t)entry->size : 1);
+            if (!chunk) return Error::MEMORY_ALLOC;
+            bool read = file_read_at(file, entry->offset, chunk, (size_t)entry->size);
+            bool ok = read && read_checksum_chunk(chunk, entry->size, &checksums);
+            mem_free(chunk);
+            if (!ok) return read ? Error::CORRUPTED : Error::IO;
+        }
+    }
+
+    if (chunks.metadata.type) {
+        Error result = scan_metadata_chunk(file, head, head_size, &chunks.metadata, &checksums, scan);
+        if (result != Error::OK) return result;
+    }
+
+    if (chunks.cover.type) {
+        scan->has_cover = 1;
+
+        /* The prefix of a compressed cover is inside its first frame */
+        uint8_t prefix[12];
+        if (!chunks.cover.compressed && chunks.cover.size >= sizeof(prefix)) {
+            if (!read_range(file, head, head_size, chunks.cover.offset, prefix, sizeof(prefix))) return Error::IO;
+            scan->cover_format = (CoverFormat)read_uint32_le(prefix);
+            scan->cover_width = read_uint32_le(prefix + 4);
+            scan->cover_height = read_uint32_le(prefix + 8);
+        }
+    }
+
+    return Error::OK;
+}
+
+Error dmusicpak::scan_metadata(const char* filename, MetadataScan* scan) {
+    if (!filename || !scan) return Error::INVALID_PARAM;
+
+    /* Everything but the storage, which only holds what the strings need */
+    memset(scan, 0, offsetof(MetadataScan, storage));
+
+    FileHandle file;
+    if (!file_open(filename, &file)) return Error::FILE_NOT_FOUND;
+
+    Error result = scan_file(&file, scan);
+    file_close(&file);
+
+    if (result != Error::OK) memset(scan, 0, offsetof(MetadataScan, storage));
+    return result;
+}
+
+/* State of one scan_directory() call */
+struct directory_scan_t {
+    const char* extension;
+    int recursive;
+    unsigned threads;
+    ScanCallback callback;
+    void* userdata;
+
+    Arena* names;       /* Filenames of the current batch */
+    const char** batch;
+    size_t count;
+    bool failed;        /* Out of memory; stop listing */
+};
+
+static bool has_extension(const char* name, const char* extension) {
+    size_t name_length = strlen(name);
+    size_t length = strlen(extension);
+    if (length > name_length) return false;
+
+    const char* suffix = name + name_length - length;
+    for (size_t i = 0; i < length; i++) {
+        char a = suffix[i];
+        char b = extension[i];
+        if (a >= 'A' && a <= 'Z') a = (char)(a - 'A' + 'a');
+        if (b >= 'A' && b <= 'Z') b = (char)(b - 'A' + 'a');
+        if (a != b) return false;
+    }
+    return true;
+}
+
+static void scan_task(size_t index, void* context) {
+    directory_scan_t* state = (directory_scan_t*)context;
+    const char* filename = state->batch[index];
+
+    MetadataScan scan;
+    Error result = scan_metadata(filename, &scan);
+    state->callback(filename, &scan, result, state->userdata);
+}
+
+static bool flush_batch(directory_scan_t* state) {
+    parallel_for(state->count, state->threads, scan_task, state);
+    state->count = 0;
+
+    arena_destroy(state->names);
+    state->names = arena_create(SCAN_NAMES_BLOCK_SIZE);
+    return state->names != NULL;
+}
+
+/* Directory being listed by scan_directory_level() */
+struct directory_walk_t {
+    directory_scan_t* state;
+    const char* path;
+    size_t path_length;
+};
+
+static bool scan_directory_level(directory_scan_t* state, const char* path);
+
+static bool scan_entry(const char* name, DirEntryKind kind, void* context) {
+    directory_walk_t* walk = (directory_walk_t*)context;
+    directory_scan_t* state = walk->state;
+
+    if (kind == DIR_ENTRY_OTHER) return true;
+    if (kind == DIR_ENTRY_DIRECTORY && !state->recursive) return true;
+    if (kind == DIR_ENTRY_FILE && state->extension && !has_extension(name, state->extension)) return true;
+
+    size_t name_length = strlen(name);
+    if (kind == DIR_ENTRY_DIRECTORY) {
+        /* Subdirectory paths live only while it is listed */
+        char* child = (char*)mem_malloc(walk->path_length + name_length + 2);
+        if (!child) {
+            state->failed = true;
+            return false;
+        }
+        memcpy(child, walk->path, walk->path_length);
+        child[walk->path_length] = '/';
+        memcpy(child + walk->path_length + 1, name, name_length + 1);
+
+        scan_directory_level(state, child);
+        mem_free(child);
+        return !state->failed;
+    }
+
+    char* filename = (char*)arena_alloc(state->names, walk->path_length + name_length + 2);
+    if (!filename) {
+        state->failed = true;
+        return false;
+    }
+    memcpy(filename, walk->path, walk->path_length);
+    filename[walk->path_length] = '/';
+    memcpy(filename + walk->path_length + 1, name, name_length + 1);
+
+    state->batch[state->count++] = filename;
+    if (state->count == SCAN_BATCH_SIZE && !flush_batch(state)) {
+        state->failed = true;
+        return false;
+    }
+    return true;
+}
+
+static bool scan_directory_level(directory_scan_t* state, const char* path) {
+    directory_walk_t walk;
+    walk.state = state;
+    walk.path = path;
+    walk.path_length = strlen(path);
+
+    /* "dir/" and "dir" name the same files */
+    while (walk.path_length > 1 && (path[walk.path_length - 1] == '/' || path[walk.path_length - 1] == '\\')) {
+        walk.path_length--;
+    }
+
+    return list_directory(path, scan_entry, &walk);
+}
+
+Error dmusicpak::scan_directory(const char* directory, const char* extension, int recursive,
+                                unsigned threads, ScanCallback callback, void* userdata) {
+    if (!directory || !callback) return Error::INVALID_PARAM;
+
+    directory_scan_t state;
+    state.extension = extension;
+    state.recursive = recursive;
+    state.threads = threads;
+    state.callback = callback;
+    state.userdata = userdata;
+    state.count = 0;
+    state.failed = false;
+    state.names = arena_create(SCAN_NAMES_BLOCK_SIZE);
+    state.batch = (const char**)mem_malloc(SCAN_BATCH_SIZE * sizeof(const char*));
+    if (!state.names || !state.batch) {
+        arena_destroy(state.names);
+        mem_free(state.batch);
+        return Error::MEMORY_ALLOC;
+    }
+
+    Error result = Error::OK;
+    if (!scan_directory_level(&state, directory)) {
+        result = Error::FILE_NOT_FOUND;
+    } else if (state.failed) {
+        result = Error::MEMORY_ALLOC;
+    }
+
+    /* Files listed before a failure are still scanned */
+    if (state.count > 0) parallel_for(state.count, state.threads, scan_task, &state);
+
+    arena_destroy(state.names);
+    mem_free(state.batch);
+    return result;
+}
@@ -0,0 +1,542 @@
+/**
+ * @file seek.cpp
+ * @brief Audio seek tables for DMusicPak library
+ *
+ * A seek table maps playback time to the byte offset of an audio frame
+ * boundary, one entry per interval, so a player can start decoding near any
+ * time without parsing the bitstream up to it. Tables are built by scanning
+ * frame headers of MP3, ADTS AAC, FLAC and Ogg payloads and from the format
+ * chunk of WAV; other formats get an estimate from the bitrate or duration.
+ */
+
+#include "../include/dmusicpak/dmusicpak.h"
+#include "internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+using namespace dmusicpak;
+
+/* Seek table under construction */
+struct seek_builder_t {
+    SeekTable* table;
+    uint32_t capacity;
+    uint64_t next_ms;    /* Time of the next entry to record */
+    bool failed;
+};
+
+/* Record a frame starting at offset if it is the first one of a new interval */
+static void add_frame(seek_builder_t* builder, uint64_t time_ms, uint64_t offset) {
+    SeekTable* table = builder->table;
+    if (builder->failed || time_ms < builder->next_ms || time_ms > 0xFFFFFFFFu) return;
+
+    if (table->count == builder->capacity) {
+        uint32_t capacity = builder->capacity ? builder->capacity * 2 : 64;
+        uint32_t* times = (uint32_t*)mem_realloc(table->times, capacity * sizeof(uint32_t));
+        if (times) table->times = times;
+        uint64_t* offsets = (uint64_t*)mem_realloc(table->offsets, capacity * sizeof(uint64_t));
+        if (offsets) table->offsets = offsets;
+        if (!times || !offsets) {
+            builder->failed = true;
+            return;
+        }
+        builder->capacity = capacity;
+    }
+
+    table->times[table->count] = (uint32_t)time_ms;
+    table->offsets[table->count] = offset;
+    table->count++;
+    builder->next_ms = (time_ms / table->interval_ms + 1) * table->interval_ms;
+}
+
+/* ---- MP3 ---- */
+
+/* Bitrates in kbps by [MPEG-1 / MPEG-2 and 2.5][layer I, II, III][index] */
+static const uint16_t mp3_bitrates[2][3][16] = {
+    {
+        {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0},
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0},
+        {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0},
+    },
+    {
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0},
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0},
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0},
+    },
+};
+
+static const uint32_t mp3_sample_rates[3] = {44100, 48000, 32000};
+
+/* Decode an MPEG audio frame header; false if p does not start a valid one */
+static bool mp3_frame(const uint8_t* p, size_t available, size_t* length,
+                      uint32_t* samples, uint32_t* sample_rate) {
+    if (available < 4 || p[0] != 0xFF || (p[1] & 0xE0) != 0xE0) return false;
+
+    uint32_t version = (p[1] >> 3) & 3;  /* 0: 2.5, 2: 2, 3: 1 */
+    uint32_t layer = 4 - ((p[1] >> 1) & 3);  /* 1..3; 4 is reserved */
+    uint32_t bitrate_index = p[2] >> 4;
+    uint32_t rate_index = (p[2] >> 2) & 3;
+    if (version == 1 || layer == 4 || bitrate_index == 0 || bitrate_index == 15 || rate_index == 3) {
+        return false;
+    }
+
+    uint32_t bitrate = mp3_bitrates[version == 3 ? 0 : 1][layer - 1][bitrate_index] * 1000;
+    *sample_rate = mp3_sample_rates[rate_index] >> (version == 3 ? 0 : version == 2 ? 1 : 2);
+
+    uint32_t padding = (p[2] >> 1) & 1;
+    if (layer == 1) {
+        *samples = 384;
+        *length = (12 * bitrate / *sample_rate + padding) * 4;
+    } else {
+        *samples = (layer == 3 && version != 3) ? 576 : 1152;
+        *length = *samples / 8 * bitrate / *sample_rate + padding;
+    }
+    return *length > 4;
+}
+
+/* Size of a leading ID3v2 tag */
+static size_t id3_size(const uint8_t* data, size_t size) {
+    if (size < 10 || memcmp(data, "ID3", 3) != 0) return 0;
+
+    size_t tag = 10 + (((size_t)(data[6] & 0x7F) << 21) | ((size_t)(data[7] & 0x7F) << 14) |
+                       ((size_t)(data[8] & 0x7F) << 7) | (size_t)(data[9] & 0x7F));
+    if (data[5] & 0x10) tag += 10;  /* Footer */
+    return tag < size ? tag : size;
+}
+
+static bool scan_mp3(seek_builder_t* builder, const uint8_t* data, size_t size) {
+    uint64_t samples_done = 0;
+    bool found = false;
+
+    size_t offset = id3_size(data, size);
+    while (offset + 4 <= size) {
+        size_t length = 0;
+        uint32_t samples = 0;
+        uint32_t sample_rate = 0;
+
+        /* A frame counts if the next one follows it, which rules out stray sync bytes */
+        size_t next_length = 0;
+        uint32_t next_samples = 0;
+        uint32_t next_rate = 0;
+        if (!mp3_frame(data + offset, size - offset, &length, &samples, &sample_rate) ||
+            (offset + length < size &&
+             !mp3_frame(data + offset + length, size - offset - length, &next_length, &next_samples, &next_rate) &&
+             offset + length + 128 != size)) {  /* ID3v1 tag at the end */
+            offset++;
+            continue;
+        }
+
+        add_frame(builder, samples_done * 1000 / sample_rate, offset);
+        samples_done += samples;
+        offset += length;
+        found = true;
+    }
+    return found;
+}
+
+/* ---- ADTS AAC ---- */
+
+static const uint32_t aac_sample_rates[13] = {
+    96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350
+};
+
+static bool adts_frame(const uint8_t* p, size_t available, size_t* length,
+                       uint32_t* samples, uint32_t* sample_rate) {
+    if (available < 7 || p[0] != 0xFF || (p[1] & 0xF6) != 0xF0) return false;
+
+    uint32_t rate_index = (p[2] >> 2) & 0x0F;
+    if (rate_index >= 13) return false;
+
+    *sample_rate = aac_sample_rates[rate_index];
+    *length = ((size_t)(p[3] & 3) << 11) | ((size_t)p[4] << 3) | (p[5] >> 5);
+    *samples = 1024 * ((p[6] & 3) + 1);
+    return *length >= 7;
+}
+
+static bool scan_adts(seek_builder_t* builder, const uint8_t* data, size_t size) {
+    uint64_t samples_done = 0;
+    bool found = false;
+
+    size_t offset = id3_size(data, size);
+    while (offset + 7 <= size) {
+        size_t length = 0;
+        uint32_t samples = 0;
+        uint32_t sample_rate = 0;
+
+        size_t next_length = 0;
+        uint32_t next_samples = 0;
+        uint32_t next_rate = 0;
+        if (!adts_frame(data + offset, size - offset, &length, &samples, &sample_rate) ||
+            (offset + length < size &&
+             !adts_frame(data + offset + length, size - offset - length, &next_length, &next_samples, &next_rate))) {
+            offset++;
+            continue;
+        }
+
+        add_frame(builder, samples_done * 1000 / sample_rate, offset);
+        samples_done += samples;
+        offset += length;
+        found = true;
+    }
+    return found;
+}
+
+/* ---- FLAC ---- */
+
+static uint8_t flac_crc8(const uint8_t* data, size_t size) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) crc = (uint8_t)((crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1);
+    }
+    return crc;
+}
+
+/* Decode a FLAC frame header; first_sample is the frame's position in samples */
+static bool flac_frame(const uint8_t* p, size_t available, uint32_t fixed_block_size,
+                       uint64_t* first_sample) {
+    if (available < 6 || p[0] != 0xFF || (p[1] & 0xFE) != 0xF8) return false;
+
+    uint32_t block_code = p[2] >> 4;
+    uint32_t rate_code = p[2] & 0x0F;
+    if (block_code == 0 || rate_code == 15 || (p[3] & 1) || ((p[3] >> 4) >= 11) ||
+        ((p[3] >> 1) & 7) == 3 || ((p[3] >> 1) & 7) == 7) {
+        return false;
+    }
+
+    /* UTF-8 style coded frame or sample number */
+    size_t offset = 4;
+    uint64_t number = p[offset];
+    uint32_t extra = 0;
+    if ((number & 0x80) == 0) {
+        extra = 0;
+    } else if ((number & 0xE0) == 0xC0) {
+        extra = 1; number &= 0x1F;
+    } else if ((number & 0xF0) == 0xE0) {
+        extra = 2; number &= 0x0F;
+    } else if ((number & 0xF8) == 0xF0) {
+        extra = 3; number &= 0x07;
+    } else if ((number & 0xFC) == 0xF8) {
+        extra = 4; number &= 0x03;
+    } else if ((number & 0xFE) == 0xFC) {
+        extra = 5; number &= 0x01;
+    } else if (number == 0xFE) {
+        extra = 6; number = 0;
+    } else {
+        return false;
+    }
+    offset++;
+    if (offset + extra > available) return false;
+    for (uint32_t i = 0; i < extra; i++, offset++) {
+        if ((p[offset] & 0xC0) != 0x80) return false;
+        number = (number << 6) | (p[offset] & 0x3F);
+    }
+
+    if (block_code == 6) offset += 1;
+    else if (block_code == 7) offset += 2;
+    if (rate_code == 12) offset += 1;
+    else if (rate_code == 13 || rate_code == 14) offset += 2;
+    if (offset >= available || flac_crc8(p, offset) != p[offset]) return false;
+
+    /* Fixed block size streams number frames, variable ones number samples */
+    *first_sample = (p[1] & 1) ? number : number * fixed_block_size;
+    return true;
+}
+
+static bool scan_flac(seek_builder_t* builder, const uint8_t* data, size_t size) {
+    if (size < 8 || memcmp(data, "fLaC", 4) != 0) return false;
+
+    /* STREAMINFO comes first among the metadata blocks */
+    size_t offset = 4;
+    uint32_t block_size = 0;
+    uint32_t sample_rate = 0;
+    bool last = false;
+    while (!last && offset + 4 <= size) {
+        uint32_t type = data[offset] & 0x7F;
+        last = (data[offset] & 0x80) != 0;
+        size_t length = ((size_t)data[offset + 1] << 16) | ((size_t)data[offset + 2] << 8) | data[offset + 3];
+        offset += 4;
+        if (length > size - offset) return false;
+
+        if (type == 0 && length >= 18) {
+            const uint8_t* info = data + offset;
+            block_size = ((uint32_t)info[0] << 8) | info[1];
+            sample_rate = ((uint32_t)info[10] << 12) | ((uint32_t)info[11] << 4) | (info[12] >> 4);
+        }
+        offset += length;
+    }
+    if (sample_rate == 0) return false;
+
+    bool found = false;
+    uint64_t last_sample = 0;
+    while (offset + 6 <= size) {
+        const uint8_t* sync = (const uint8_t*)memchr(data + offset, 0xFF, size - offset);
+        if (!sync) break;
+        offset = (size_t)(sync - data);
+
+        uint64_t first_sample = 0;
+        if (flac_frame(data + offset, size - offset, block_size, &first_sample) &&
+            (!found || first_sample > last_sample)) {
+            add_frame(builder, first_sample * 1000 / sample_rate, offset);
+            last_sample = first_sample;
+            found = true;
+        }
+        offset++;
+    }
+    return found;
+}
+
+/* ---- Ogg (Vorbis, Opus) ---- */
+
+static bool scan_ogg(seek_builder_t* builder, const uint8_t* data, size_t size) {
+    uint32_t sample_rate = 0;
+    uint64_t pre_skip = 0;
+    uint64_t last_granule = 0;  /* Samples decoded before the current page */
+    bool found = false;
+
+    size_t offset = 0;
+    while (offset + 27 <= size) {
+        const uint8_t* page = data + offset;
+        if (memcmp(page, "OggS", 4) != 0 || page[4] != 0) {
+            offset++;
+            continue;
+        }
+
+        uint32_t segments = page[26];
+        if (offset + 27 + segments > size) break;
+        size_t body = 0;
+        for (uint32_t i = 0; i < segments; i++) body += page[27 + i];
+        size_t header = 27 + segments;
+        if (body > size - offset - header) break;
+
+        const uint8_t* packet = page + header;
+        if (sample_rate == 0) {
+            /* The first page carries the codec identification header */
+            if (body >= 16 && memcmp(packet, "\x01vorbis", 7) == 0) {
+                sample_rate = read_uint32_le(packet + 12);
+            } else if (body >= 19 && memcmp(packet, "OpusHead", 8) == 0) {
+                sample_rate = 48000;  /* Opus granule positions always count 48 kHz samples */
+                pre_skip = read_uint16_le(packet + 10);
+            }
+            if (sample_rate == 0) return false;
+        }
+
+        /* Decoding can start on a page that begins a packet; header pages have granule 0 */
+        uint64_t granule = read_uint64_le(page + 6);
+        if (offset > 0 && granule != 0 && !(page[5] & 1)) {
+            uint64_t start = last_granule > pre_skip ? last_granule - pre_skip : 0;
+            add_frame(builder, start * 1000 / sample_rate, offset);
+            found = true;
+        }
+
+        /* -1: no packet ends on this page */
+        if (granule != (uint64_t)-1 && granule > last_granule) last_granule = granule;
+        offset += header + body;
+    }
+    return found;
+}
+
+/* ---- WAV ---- */
+
+static bool scan_wav(seek_builder_t* builder, const uint8_t* data, size_t size) {
+    if (size < 12 || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0) return false;
+
+    uint32_t sample_rate = 0;
+    uint32_t block_align = 0;
+    size_t offset = 12;
+    while (offset + 8 <= size) {
+        const uint8_t* chunk = data + offset;
+        uint64_t length = read_uint32_le(chunk + 4);
+        offset += 8;
+
+        if (memcmp(chunk, "fmt ", 4) == 0 && length >= 16 && offset + 16 <= size) {
+            sample_rate = read_uint32_le(chunk + 12);
+            block_align = read_uint16_le(chunk + 20);
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (sample_rate == 0 || block_align == 0) return false;
+
+            /* PCM is linear: one frame boundary per interval, computed directly */
+            uint64_t frames = (length < size - offset ? length : size - offset) / block_align;
+            uint64_t step = builder->table->interval_ms;
+            for (uint64_t ms = 0;; ms += step) {
+                uint64_t frame = ms * sample_rate / 1000;
+                if (frame >= frames && ms > 0) break;
+                add_frame(builder, frame * 1000 / sample_rate, offset + frame * block_align);
+                if (builder->failed) break;
+            }
+            return true;
+        }
+
+        offset += length + (length & 1);  /* Chunks are padded to even sizes */
+    }
+    return false;
+}
+
+/* ---- Estimate ---- */
+
+/* Constant-bitrate estimate for formats without frame scanning */
+static bool estimate(seek_builder_t* builder, size_t size, const Metadata* metadata) {
+    uint64_t byte_rate = 0;  /* Bytes per second */
+    if (metadata && metadata->bitrate > 0) {
+        byte_rate = (uint64_t)metadata->bitrate * 125;
+    } else if (metadata && metadata->duration_ms > 0) {
+        byte_rate = (uint64_t)size * 1000 / metadata->duration_ms;
+    }
+    if (byte_rate == 0) return false;
+
+    uint64_t step = builder->table->interval_ms;
+    for (uint64_t ms = 0;; ms += step) {
+        uint64_t offset = ms * byte_rate / 1000;
+        if (offset >= size && ms > 0) break;
+        add_frame(builder, ms, offset);
+        if (builder->failed) break;
+    }
+    return true;
+}
+
+bool dmusicpak::build_seek_table(const Audio* audio, const Metadata* metadata, uint32_t interval_ms,
+                                 SeekTable** table) {
+    if (interval_ms == 0) return false;
+
+    seek_builder_t builder;
+    memset(&builder, 0, sizeof(builder));
+    builder.table = (SeekTable*)mem_calloc(1, sizeof(SeekTable));
+    if (!builder.table) return false;
+    builder.table->interval_ms = interval_ms;
+
+    const uint8_t* data = audio->data;
+    size_t size = audio->data ? audio->size : 0;
+
+    bool scanned = false;
+    switch (audio->format) {
+        case AudioFormat::MP3: scanned = scan_mp3(&builder, data, size); break;
+        case AudioFormat::AAC: scanned = scan_adts(&builder, data, size); break;
+        case AudioFormat::FLAC: scanned = scan_flac(&builder, data, size); break;
+        case AudioFormat::OGG:
+        case AudioFormat::OPUS: scanned = scan_ogg(&builder, data, size); break;
+        case AudioFormat::WAV: scanned = scan_wav(&builder, data, size); break;
+        default: break;
+    }
+
+    /* Unscannable payload (e.g. M4A, or a format mislabelled): fall back to the estimate */
+    if (!scanned && !builder.failed) {
+        free_seek_table(builder.table);
+        memset(&builder, 0, sizeof(builder));
+        builder.table = (SeekTable*)mem_calloc(1, sizeof(SeekTable));
+        if (!builder.table) return false;
+        builder.table->interval_ms = interval_ms;
+        scanned = estimate(&builder, size, metadata);
+    }
+
+    if (!scanned || builder.failed || builder.table->count == 0) {
+        free_seek_table(builder.table);
+        return false;
+    }
+
+    *table = builder.table;
+    return true;
+}
+
+size_t dmusicpak::seek_chunk_size(const SeekTable* table) {
+    return 8 + (size_t)table->count * SEEK_ENTRY_SIZE;
+}
+
+void dmusicpak::write_seek_chunk(uint8_t* buffer, const SeekTable* table) {
+    write_uint32_le(buffer, table->interval_ms);
+    write_uint32_le(buffer + 4, table->count);
+
+    uint8_t* entry = buffer + 8;
+    for (uint32_t i = 0; i < table->count; i++, entry += SEEK_ENTRY_SIZE) {
+        write_uint32_le(entry, table->times[i]);
+        write_uint64_le(entry + 4, table->offsets[i]);
+    }
+}
+
+bool dmusicpak::read_seek_chunk(const uint8_t* chunk, uint64_t size, SeekTable** table) {
+    if (size < 8) return false;
+
+    uint32_t interval_ms = read_uint32_le(chunk);
+    uint32_t count = read_uint32_le(chunk + 4);
+    if (interval_ms == 0 || count == 0 || (uint64_t)count * SEEK_ENTRY_SIZE > size - 8) return false;
+
+    SeekTable* result = (SeekTable*)mem_calloc(1, sizeof(SeekTable));
+    if (!result) return false;
+    result->interval_ms = interval_ms;
+    result->times = (uint32_t*)mem_malloc(count * sizeof(uint32_t));
+    result->offsets = (uint64_t*)mem_malloc(count * sizeof(uint64_t));
+    if (!result->times || !result->offsets) {
+        free_seek_table(result);
+        return false;
+    }
+
+    /* Binary search needs times in order */
+    const uint8_t* entry = chunk + 8;
+    for (uint32_t i = 0; i < count; i++, entry += SEEK_ENTRY_SIZE) {
+        result->times[i] = read_uint32_le(entry);
+        result->offsets[i] = read_uint64_le(entry + 4);
+        if (i > 0 && result->times[i] < result->times[i - 1]) {
+            free_seek_table(result);
+            return false;
+        }
+    }
+    result->count = count;
+
+    *table = result;
+    return true;
+}
+
+bool dmusicpak::adopt_seek_table(Package* package, const uint8_t* chunk, uint64_t size) {
+    SeekTable* table = NULL;
+    if (!read_seek_chunk(chunk, size, &table)) return false;
+
+    free_seek_table(package->seek_table);
+    package->seek_table = table;
+
+    /* Saving the package again keeps a seek table */
+    package->save_options.seek_interval_ms = table->interval_ms;
+    return true;
+}
+
+void dmusicpak::free_seek_table(SeekTable* table) {
+    if (!table) return;
+
+    mem_free(table->times);
+    mem_free(table->offsets);
+    mem_free(table);
+}
+
+Error dmusicpak::seek_audio_ms(Package* package, uint64_t time_ms, SeekPoint* point) {
+    if (!package || !point) return Error::INVALID_PARAM;
+
+    /* Stored table first (lazily read for load_index() packages), then one built from loaded audio */
+    if (!package->seek_table) {
+        if (package->shared) return Error::NOT_SUPPORTED;
+        if (package->has_audio) {
+            uint32_t interval_ms = package->save_options.seek_interval_ms;
+            if (interval_ms == 0) interval_ms = DEFAULT_SEEK_INTERVAL_MS;
+            if (!build_seek_table(&package->audio, package->has_metadata ? &package->metadata : NULL,
+                                  interval_ms, &package->seek_table)) {
+                return Error::NOT_SUPPORTED;
+            }
+        } else {
+            Error result = load_seek_table(package);
+            if (result != Error::OK) return result;
+        }
+    }
+
+    /* Last entry at or before time_ms */
+    const SeekTable* table = package->seek_table;
+    uint32_t low = 0;
+    uint32_t high = table->count;
+    while (high - low > 1) {
+        uint32_t middle = low + (high - low) / 2;
+        if (table->times[middle] <= time_ms) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+
+    point->time_ms = table->times[low];
+    point->offset = table->offsets[low];
+    return Error::OK;
+}
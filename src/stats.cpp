@@ -0,0 +1,161 @@
+/**
+ * @file stats.cpp
+ * @brief Instrumentation counters and trace callback for DMusicPak library
+ *
+ * Each thread counts into its own block of relaxed atomics, registered on
+ * the thread's first count; only the owning thread writes a block, so the
+ * counting points never contend. get_stats() sums the live blocks and the
+ * totals left behind by exited threads, minus a baseline taken by
+ * reset_stats().
+ */
+
+#include "internal.h"
+#include <string.h>
+#include <chrono>
+#include <mutex>
+
+using namespace dmusicpak;
+
+static_assert(sizeof(Stats) == STAT_COUNT * sizeof(uint64_t), "Stats fields must match StatCounter");
+
+std::atomic<int> dmusicpak::g_instrumentation(0);
+
+static TraceCallback g_trace_callback = NULL;
+static void* g_trace_userdata = NULL;
+
+/* One thread's counters */
+struct ThreadStats {
+    std::atomic<uint64_t> counters[STAT_COUNT];
+    ThreadStats* next;
+
+    ThreadStats();
+    ~ThreadStats();
+};
+
+static std::mutex g_stats_lock;
+static ThreadStats* g_threads = NULL;        /* Live threads that have counted */
+static uint64_t g_retired[STAT_COUNT];       /* Counts of exited threads */
+static uint64_t g_baseline[STAT_COUNT];      /* Totals at the last reset_stats() */
+
+ThreadStats::ThreadStats() {
+    for (int i = 0; i < STAT_COUNT; i++) counters[i].store(0, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(g_stats_lock);
+    next = g_threads;
+    g_threads = this;
+}
+
+ThreadStats::~ThreadStats() {
+    std::lock_guard<std::mutex> lock(g_stats_lock);
+    for (int i = 0; i < STAT_COUNT; i++) g_retired[i] += counters[i].load(std::memory_order_relaxed);
+
+    for (ThreadStats** link = &g_threads; *link; link = &(*link)->next) {
+        if (*link == this) {
+            *link = next;
+            break;
+        }
+    }
+}
+
+static ThreadStats& thread_stats() {
+    static thread_local ThreadStats stats;
+    return stats;
+}
+
+/* Sum of every thread's counters; called with g_stats_lock held */
+static void total_counts(uint64_t* totals) {
+    memcpy(totals, g_retired, sizeof(g_retired));
+    for (ThreadStats* thread = g_threads; thread; thread = thread->next) {
+        for (int i = 0; i < STAT_COUNT; i++) totals[i] += thread->counters[i].load(std::memory_order_relaxed);
+    }
+}
+
+void dmusicpak::stat_add_enabled(StatCounter counter, uint64_t value) {
+    /* Single writer: a plain add, not a locked read-modify-write */
+    std::atomic<uint64_t>& slot = thread_stats().counters[counter];
+    slot.store(slot.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+uint64_t dmusicpak::trace_clock() {
+    uint64_t now = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    return now > 0 ? now : 1;  /* 0 means "not traced" */
+}
+
+void dmusicpak::trace_end_enabled(uint64_t start, TraceEvent event, const char* name, uint8_t chunk_type,
+                                  uint64_t bytes, Error result) {
+    uint64_t end = trace_clock();
+    uint64_t duration = end > start ? end - start : 0;
+    int enabled = g_instrumentation.load(std::memory_order_relaxed);
+
+    if (enabled & INSTRUMENT_STATS) {
+        switch (event) {
+            case TraceEvent::LOAD:
+                if (result == Error::OK) stat_add_enabled(STAT_PACKAGES_LOADED, 1);
+                stat_add_enabled(STAT_LOAD_TIME_NS, duration);
+                break;
+            case TraceEvent::SAVE:
+                if (result == Error::OK) stat_add_enabled(STAT_PACKAGES_SAVED, 1);
+                stat_add_enabled(STAT_SAVE_TIME_NS, duration);
+                break;
+            case TraceEvent::CHUNK:
+                stat_add_enabled(STAT_CHUNKS_PARSED, 1);
+                break;
+            case TraceEvent::NETWORK_REQUEST:
+                stat_add_enabled(STAT_NETWORK_REQUESTS, 1);
+                stat_add_enabled(STAT_NETWORK_BYTES, bytes);
+                stat_add_enabled(STAT_NETWORK_TIME_NS, duration);
+                break;
+        }
+    }
+
+    TraceCallback callback = g_trace_callback;
+    if ((enabled & INSTRUMENT_TRACE) && callback) {
+        TraceRecord record;
+        record.event = event;
+        record.name = name;
+        record.chunk_type = chunk_type;
+        record.bytes = bytes;
+        record.start_ns = start;
+        record.duration_ns = duration;
+        record.result = result;
+        callback(&record, g_trace_userdata);
+    }
+}
+
+void dmusicpak::set_stats_enabled(int enabled) {
+    if (enabled) {
+        g_instrumentation.fetch_or(INSTRUMENT_STATS);
+    } else {
+        g_instrumentation.fetch_and(~INSTRUMENT_STATS);
+    }
+}
+
+Error dmusicpak::get_stats(Stats* stats) {
+    if (!stats) return Error::INVALID_PARAM;
+
+    uint64_t totals[STAT_COUNT];
+    {
+        std::lock_guard<std::mutex> lock(g_stats_lock);
+        total_counts(totals);
+        for (int i = 0; i < STAT_COUNT; i++) totals[i] -= g_baseline[i];
+    }
+
+    memcpy(stats, totals, sizeof(Stats));
+    return Error::OK;
+}
+
+void dmusicpak::reset_stats() {
+    std::lock_guard<std::mutex> lock(g_stats_lock);
+    total_counts(g_baseline);
+}
+
+void dmusicpak::set_trace_callback(TraceCallback callback, void* userdata) {
+    g_trace_callback = callback;
+    g_trace_userdata = userdata;
+    if (callback) {
+        g_instrumentation.fetch_or(INSTRUMENT_TRACE);
+    } else {
+        g_instrumentation.fetch_and(~INSTRUMENT_TRACE);
+    }
+}
@@ -0,0 +1,541 @@
+/**
+ * @file stream_parser.cpp
+ * @brief Incremental (push) parser for DMusicPak packages
+ *
+ * Bytes are fed as they arrive from the network. Each chunk is allocated
+ * once its header is known and filled in place; listeners see metadata,
+ * lyrics and cover as soon as their chunk completes, and audio bytes are
+ * delivered in chunk_size pieces while the audio chunk is still arriving.
+ * Compressed chunks are decoded a frame at a time and their bytes take the
+ * same path, so audio is still delivered before the chunk is complete.
+ */
+
+#include "../include/dmusicpak/dmusicpak.h"
+#include "internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+using namespace dmusicpak;
+
+/* Parser states */
+enum {
+    STATE_HEADER,        /* Reading the 12-byte file header */
+    STATE_CHUNK_HEADER,  /* Reading a 5-byte (9-byte in version 3) chunk header */
+    STATE_PREFIX,        /* Reading fixed fields (or all of a metadata chunk) */
+    STATE_PAYLOAD,       /* Reading payload bytes */
+    STATE_SKIP,          /* Skipping TOC and unknown chunks */
+    STATE_FRAME_TABLE,   /* Reading the header and frame table of a compressed chunk */
+    STATE_DONE,
+    STATE_ERROR
+};
+
+struct dmusicpak::PushParser {
+    Package* package;
+    const StreamListener* listener;
+    size_t chunk_size;           /* Audio delivery granularity */
+    int state;
+
+    uint8_t header[FILE_HEADER_SIZE];
+    size_t header_fill;
+    uint32_t version;
+    uint32_t chunks_left;
+
+    uint8_t type;                /* Current chunk, without the CHUNK_COMPRESSED flag */
+    uint64_t remaining;          /* Bytes of the current chunk not yet consumed (as stored) */
+    uint64_t total;              /* Size of the current chunk (uncompressed) */
+    uint64_t stored;             /* Size of the current chunk as stored */
+    uint64_t trace_start;        /* trace_begin() at the chunk header */
+
+    uint8_t* prefix;
+    size_t prefix_need;
+    size_t prefix_fill;
+
+    uint8_t* payload;            /* NULL for audio that is only delivered */
+    size_t payload_size;
+    size_t payload_fill;
+    size_t delivered;            /* Audio bytes already handed to the listener */
+
+    uint8_t* staging;            /* Audio delivery buffer when audio is not retained */
+    size_t staging_fill;
+
+    int hashing;                 /* Current chunk has a stored checksum */
+    uint32_t crc;                /* CRC32C of the current chunk so far */
+    uint32_t seen;               /* Bit n set: a type-n chunk has completed */
+
+    int encoded;                 /* Current chunk is compressed */
+    FrameHeader frames;          /* frame_size 0 until the header is read */
+    uint8_t* table;              /* Frame header and table as stored */
+    size_t table_need;
+    size_t table_fill;
+    uint32_t frame;              /* Frame being received */
+    uint8_t* frame_data;         /* Stored bytes of that frame */
+    size_t frame_fill;
+    uint8_t* raw;                /* Its decoded bytes */
+};
+
+PushParser* dmusicpak::parser_create(const StreamListener* listener, size_t chunk_size) {
+    PushParser* parser = (PushParser*)mem_calloc(1, sizeof(PushParser));
+    if (!parser) return NULL;
+
+    parser->package = create();
+    if (!parser->package) {
+        mem_free(parser);
+        return NULL;
+    }
+
+    parser->listener = listener;
+    parser->chunk_size = chunk_size > 0 ? chunk_size : 65536;
+    parser->state = STATE_HEADER;
+    return parser;
+}
+
+static bool retain_audio(const PushParser* parser) {
+    return !parser->listener || !parser->listener->on_audio || parser->listener->retain_audio;
+}
+
+/* Hand audio to the listener; returns false if it asked to stop */
+static bool deliver_audio(PushParser* parser, const uint8_t* data, size_t size) {
+    const StreamListener* listener = parser->listener;
+    if (!listener || !listener->on_audio || size == 0) return true;
+
+    return listener->on_audio((void*)data, 1, size, listener->userdata) == size;
+}
+
+/* Deliver retained audio in chunk_size slices (all of it at the end) */
+static bool flush_retained_audio(PushParser* parser, bool final) {
+    while (parser->payload_fill - parser->delivered >= parser->chunk_size ||
+           (final && parser->payload_fill > parser->delivered)) {
+        size_t size = parser->payload_fill - parser->delivered;
+        if (size > parser->chunk_size) size = parser->chunk_size;
+
+        if (!deliver_audio(parser, parser->payload + parser->delivered, size)) return false;
+        parser->delivered += size;
+    }
+    return true;
+}
+
+/* Notify listeners about a completed chunk */
+static void notify_chunk(PushParser* parser) {
+    const StreamListener* listener = parser->listener;
+    if (!listener) return;
+
+    Package* package = parser->package;
+    switch (parser->type) {
+        case CHUNK_METADATA:
+            if (listener->on_metadata) {
+                MetadataView view;
+                if (peek_metadata(package, &view) == Error::OK) listener->on_metadata(&view, listener->userdata);
+            }
+            break;
+
+        case CHUNK_LYRICS:
+            if (listener->on_lyrics) {
+                LyricsView view;
+                if (peek_lyrics(package, &view) == Error::OK) listener->on_lyrics(&view, listener->userdata);
+            }
+            break;
+
+        case CHUNK_COVER:
+            if (listener->on_cover) {
+                CoverView view;
+                if (peek_cover(package, &view) == Error::OK) listener->on_cover(&view, listener->userdata);
+            }
+            break;
+    }
+}
+
+/* Store the current chunk in the package and move on to the next one */
+static void finish_chunk(PushParser* parser) {
+    Package* package = parser->package;
+    bool ok = true;
+    if (parser->hashing) {
+        ok = parser->crc == package->checksums.checksum[parser->type];
+    }
+
+    if (!ok) {
+        package_release(package, parser->payload);
+    } else if (parser->state == STATE_SKIP) {
+        /* Nothing was read, e.g. a compressed checksum or seek chunk */
+    } else if (parser->type == CHUNK_CHECKSUM) {
+        ok = adopt_checksums(package, parser->prefix, parser->total);
+    } else if (parser->type == CHUNK_SEEK) {
+        adopt_seek_table(package, parser->prefix, parser->total);  /* Malformed tables are ignored */
+    } else {
+        ok = apply_chunk(package, parser->type, parser->prefix, parser->prefix_need,
+                         parser->payload, parser->payload_size) == Error::OK;
+        if (ok) {
+            notify_chunk(parser);
+        } else {
+            package_release(package, parser->payload);
+        }
+    }
+    if (parser->type < MAX_CHECKSUM_TYPES) parser->seen |= 1u << parser->type;
+    trace_end(parser->trace_start, TraceEvent::CHUNK, NULL, parser->type | (parser->encoded ? CHUNK_COMPRESSED : 0),
+              parser->stored, ok ? Error::OK : Error::CORRUPTED);
+
+    mem_free(parser->prefix);
+    mem_free(parser->table);
+    mem_free(parser->frame_data);
+    mem_free(parser->raw);
+    parser->prefix = parser->table = parser->frame_data = parser->raw = NULL;
+    parser->encoded = 0;
+    memset(&parser->frames, 0, sizeof(parser->frames));
+    parser->table_need = parser->table_fill = parser->frame_fill = 0;
+    parser->frame = 0;
+    parser->payload = NULL;  /* Adopted by the package */
+    parser->prefix_need = parser->prefix_fill = 0;
+    parser->payload_size = parser->payload_fill = parser->delivered = 0;
+
+    parser->chunks_left--;
+    if (!ok) {
+        parser->state = STATE_ERROR;
+    } else {
+        parser->state = parser->chunks_left > 0 ? STATE_CHUNK_HEADER : STATE_DONE;
+    }
+}
+
+/* Set up reading of the chunk contents (parser->total bytes, uncompressed) */
+static bool begin_contents(PushParser* parser) {
+    switch (parser->type) {
+        case CHUNK_METADATA: parser->prefix_need = (size_t)parser->total; break;
+        case CHUNK_CHECKSUM:
+            if (parser->total > MAX_CHECKSUM_CHUNK_SIZE) return false;
+            parser->prefix_need = (size_t)parser->total;
+            break;
+        case CHUNK_SEEK:
+            if (parser->total > MAX_SEEK_CHUNK_SIZE) return false;
+            parser->prefix_need = (size_t)parser->total;
+            break;
+        case CHUNK_LYRICS: parser->prefix_need = 4; break;
+        case CHUNK_AUDIO: parser->prefix_need = 8; break;  /* Grows by the filename length */
+        case CHUNK_COVER: parser->prefix_need = 12; break;
+        case CHUNK_THUMBNAILS: parser->prefix_need = 4; break;
+        default:
+            parser->state = STATE_SKIP;
+            if (parser->remaining == 0) finish_chunk(parser);
+            return true;
+    }
+
+    if (parser->prefix_need > parser->total || parser->total > (size_t)-1) return false;
+
+    parser->prefix = (uint8_t*)mem_malloc(parser->prefix_need > 0 ? parser->prefix_need : 1);
+    if (!parser->prefix) return false;
+
+    parser->state = STATE_PREFIX;
+    if (parser->prefix_need == 0) finish_chunk(parser);
+    return true;
+}
+
+/* Start a chunk once its header is complete */
+static bool begin_chunk(PushParser* parser) {
+    parser->type = parser->header[0] & ~CHUNK_COMPRESSED;
+    parser->encoded = (parser->header[0] & CHUNK_COMPRESSED) != 0;
+    parser->total = read_chunk_size(parser->header, parser->version);
+    parser->remaining = parser->total;
+    parser->stored = parser->total;
+    parser->trace_start = trace_begin();
+
+    /* Only the first chunk of a type is covered by its checksum */
+    parser->hashing = has_checksum(&parser->package->checksums, parser->type) &&
+                      !(parser->seen & (1u << parser->type));
+    parser->crc = 0;
+
+    if (!parser->encoded) return begin_contents(parser);
+
+    switch (parser->type) {
+        case CHUNK_METADATA:
+        case CHUNK_LYRICS:
+        case CHUNK_AUDIO:
+        case CHUNK_COVER:
+        case CHUNK_THUMBNAILS:
+            break;
+        default:
+            parser->state = STATE_SKIP;
+            if (parser->remaining == 0) finish_chunk(parser);
+            return true;
+    }
+
+    if (parser->total < COMPRESSION_HEADER_SIZE) return false;
+    parser->table_need = COMPRESSION_HEADER_SIZE;
+    parser->table = (uint8_t*)mem_malloc(parser->table_need);
+    if (!parser->table) return false;
+
+    parser->state = STATE_FRAME_TABLE;
+    return true;
+}
+
+/* Frame header or table complete: size the frame buffers and start the contents */
+static bool end_frame_table(PushParser* parser) {
+    uint64_t stored = parser->remaining + parser->table_fill;
+
+    if (parser->frames.frame_size == 0) {
+        if (!read_frame_header(parser->table, stored, &parser->frames)) return false;
+
+        /* Without the codec the chunk is skipped like an unknown one */
+        if (!compression_available((Compression)parser->frames.codec)) {
+            parser->state = STATE_SKIP;
+            if (parser->remaining == 0) finish_chunk(parser);
+            return true;
+        }
+
+        parser->table_need += (size_t)parser->frames.frame_count * 4;
+        if (parser->table_need > parser->table_fill) {
+            uint8_t* table = (uint8_t*)mem_realloc(parser->table, parser->table_need);
+            if (!table) return false;
+            parser->table = table;
+            return true;
+        }
+    }
+
+    /* Frames must account for exactly the rest of the chunk */
+    uint64_t sum = 0;
+    uint32_t largest = 0;
+    for (uint32_t i = 0; i < parser->frames.frame_count; i++) {
+        uint32_t size = read_uint32_le(parser->table + COMPRESSION_HEADER_SIZE + (size_t)i * 4);
+        sum += size;
+        if (size > largest) largest = size;
+    }
+    if (sum != parser->remaining || parser->frames.raw_size > (size_t)-1) return false;
+
+    parser->frame_data = (uint8_t*)mem_malloc(largest > 0 ? largest : 1);
+    parser->raw = (uint8_t*)mem_malloc(parser->frames.frame_size);
+    if (!parser->frame_data || !parser->raw) return false;
+
+    parser->total = parser->frames.raw_size;
+    return begin_contents(parser);
+}
+
+/* Fixed fields complete: learn payload size and allocate it */
+static bool end_prefix(PushParser* parser) {
+    if (parser->type == CHUNK_AUDIO && parser->prefix_need == 8) {
+        size_t need = 8 + (size_t)read_uint32_le(parser->prefix + 4);
+        if (need > parser->total) return false;
+        if (need > 8) {
+            uint8_t* prefix = (uint8_t*)mem_realloc(parser->prefix, need);
+            if (!prefix) return false;
+            parser->prefix = prefix;
+            parser->prefix_need = need;
+            return true;
+        }
+    }
+
+    if (parser->type == CHUNK_METADATA || parser->type == CHUNK_CHECKSUM || parser->type == CHUNK_SEEK) {
+        finish_chunk(parser);
+        return true;
+    }
+
+    parser->payload_size = (size_t)(parser->total - parser->prefix_need);
+    if (parser->type == CHUNK_AUDIO) {
+        const StreamListener* listener = parser->listener;
+        if (listener && listener->on_audio_start) {
+            AudioView view;
+            view.format = (AudioFormat)read_uint32_le(parser->prefix);
+            view.source_filename = NULL;
+            view.data = NULL;
+            view.size = parser->payload_size;
+            listener->on_audio_start(&view, listener->userdata);
+        }
+
+        if (!retain_audio(parser)) {
+            parser->staging = (uint8_t*)mem_malloc(parser->chunk_size);
+            if (!parser->staging) return false;
+        }
+    }
+
+    if (parser->payload_size > 0 && (parser->type != CHUNK_AUDIO || retain_audio(parser))) {
+        parser->payload = (uint8_t*)package_alloc(parser->package, parser->payload_size);
+        if (!parser->payload) return false;
+    }
+
+    if (parser->payload_size == 0) {
+        finish_chunk(parser);
+    } else {
+        parser->state = STATE_PAYLOAD;
+    }
+    return true;
+}
+
+/* Consume payload bytes of the current chunk */
+static bool take_payload(PushParser* parser, const uint8_t* data, size_t size) {
+    stat_add(STAT_BYTES_COPIED, size);
+    if (parser->type != CHUNK_AUDIO) {
+        memcpy(parser->payload + parser->payload_fill, data, size);
+        parser->payload_fill += size;
+        return true;
+    }
+
+    if (parser->payload) {
+        memcpy(parser->payload + parser->payload_fill, data, size);
+        parser->payload_fill += size;
+        return flush_retained_audio(parser, parser->payload_fill == parser->payload_size);
+    }
+
+    /* Deliver-only audio goes through a chunk_size staging buffer */
+    parser->payload_fill += size;
+    while (size > 0) {
+        size_t room = parser->chunk_size - parser->staging_fill;
+        size_t n = size < room ? size : room;
+        memcpy(parser->staging + parser->staging_fill, data, n);
+        parser->staging_fill += n;
+        data += n;
+        size -= n;
+
+        if (parser->staging_fill == parser->chunk_size ||
+            (parser->payload_fill == parser->payload_size && size == 0)) {
+            if (!deliver_audio(parser, parser->staging, parser->staging_fill)) return false;
+            parser->staging_fill = 0;
+        }
+    }
+    return true;
+}
+
+/* Bytes the prefix or payload still needs */
+static size_t contents_wanted(const PushParser* parser) {
+    if (parser->state == STATE_PREFIX) return parser->prefix_need - parser->prefix_fill;
+    return parser->payload_size - parser->payload_fill;
+}
+
+/* Consume uncompressed prefix or payload bytes; size is at most contents_wanted() */
+static bool consume_contents(PushParser* parser, const uint8_t* data, size_t size) {
+    if (parser->state == STATE_PREFIX) {
+        memcpy(parser->prefix + parser->prefix_fill, data, size);
+        parser->prefix_fill += size;
+        return parser->prefix_fill < parser->prefix_need || end_prefix(parser);
+    }
+
+    if (!take_payload(parser, data, size)) return false;
+    if (parser->payload_fill == parser->payload_size) finish_chunk(parser);
+    return true;
+}
+
+/* Consume stored bytes of a compressed chunk, decoding each frame as it completes */
+static bool feed_frames(PushParser* parser, const uint8_t* data, size_t size, size_t* used) {
+    const FrameHeader* frames = &parser->frames;
+    if (parser->frame >= frames->frame_count) return false;
+
+    size_t stored = read_uint32_le(parser->table + COMPRESSION_HEADER_SIZE + (size_t)parser->frame * 4);
+    size_t n = stored - parser->frame_fill;
+    if (n > size) n = size;
+    memcpy(parser->frame_data + parser->frame_fill, data, n);
+    if (parser->hashing) parser->crc = crc32c(parser->crc, data, n);
+    parser->frame_fill += n;
+    parser->remaining -= n;
+    *used = n;
+    if (parser->frame_fill < stored) return true;
+
+    size_t raw_size = (size_t)frame_raw_size(frames, parser->frame);
+    if (!decode_frame(frames->codec, parser->frame_data, stored, parser->raw, raw_size)) return false;
+    parser->frame++;
+    parser->frame_fill = 0;
+
+    /* The contents end exactly with the last frame */
+    const uint8_t* raw = parser->raw;
+    while (raw_size > 0) {
+        if (parser->state != STATE_PREFIX && parser->state != STATE_PAYLOAD) return false;
+        size_t k = contents_wanted(parser);
+        if (k > raw_size) k = raw_size;
+        if (!consume_contents(parser, raw, k)) return false;
+        raw += k;
+        raw_size -= k;
+    }
+    return true;
+}
+
+bool dmusicpak::parser_feed(PushParser* parser, const uint8_t* data, size_t size) {
+    if (!parser) return false;
+
+    while (size > 0 && parser->state != STATE_DONE && parser->state != STATE_ERROR) {
+        size_t n = 0;
+        bool ok = true;
+
+        switch (parser->state) {
+            case STATE_HEADER:
+            case STATE_CHUNK_HEADER: {
+                size_t need = parser->state == STATE_HEADER ? FILE_HEADER_SIZE
+                                                            : chunk_header_size(parser->version);
+                n = need - parser->header_fill;
+                if (n > size) n = size;
+                memcpy(parser->header + parser->header_fill, data, n);
+                parser->header_fill += n;
+                if (parser->header_fill < need) break;
+
+                parser->header_fill = 0;
+                if (parser->state == STATE_CHUNK_HEADER) {
+                    ok = begin_chunk(parser);
+                } else if (memcmp(parser->header, DMUSICPAK_MAGIC, 4) != 0 ||
+                           !is_supported_version(read_uint32_le(parser->header + 4))) {
+                    ok = false;
+                } else {
+                    parser->version = read_uint32_le(parser->header + 4);
+                    parser->chunks_left = read_uint32_le(parser->header + 8);
+                    parser->state = parser->chunks_left > 0 ? STATE_CHUNK_HEADER : STATE_DONE;
+                }
+                break;
+            }
+
+            case STATE_PREFIX:
+            case STATE_PAYLOAD:
+                if (parser->encoded) {
+                    ok = feed_frames(parser, data, size, &n);
+                    break;
+                }
+                n = contents_wanted(parser);
+                if (n > size) n = size;
+                if (parser->hashing) parser->crc = crc32c(parser->crc, data, n);
+                parser->remaining -= n;
+                ok = consume_contents(parser, data, n);
+                break;
+
+            case STATE_FRAME_TABLE:
+                n = parser->table_need - parser->table_fill;
+                if (n > size) n = size;
+                memcpy(parser->table + parser->table_fill, data, n);
+                if (parser->hashing) parser->crc = crc32c(parser->crc, data, n);
+                parser->table_fill += n;
+                parser->remaining -= n;
+                if (parser->table_fill == parser->table_need) ok = end_frame_table(parser);
+                break;
+
+            case STATE_SKIP:
+                n = parser->remaining < size ? (size_t)parser->remaining : size;
+                if (parser->hashing) parser->crc = crc32c(parser->crc, data, n);
+                parser->remaining -= n;
+                if (parser->remaining == 0) finish_chunk(parser);
+                break;
+        }
+
+        if (!ok) {
+            parser->state = STATE_ERROR;
+            return false;
+        }
+
+        data += n;
+        size -= n;
+    }
+
+    return parser->state != STATE_ERROR;
+}
+
+Package* dmusicpak::parser_finish(PushParser* parser) {
+    if (!parser) return NULL;
+
+    /* Like load_memory(), a truncated stream yields the chunks completed so far,
+       unless checksums show that chunks are missing */
+    Package* package = parser->package;
+
+    /* Drop any partially received chunk (its payload is package memory) */
+    mem_free(parser->prefix);
+    if (parser->state == STATE_PAYLOAD || parser->state == STATE_ERROR) package_release(package, parser->payload);
+
+    if (parser->state == STATE_HEADER || parser->state == STATE_ERROR ||
+        (package->checksums.mask & ~parser->seen) != 0) {
+        dmusicpak::free(package);
+        package = NULL;
+    }
+    mem_free(parser->staging);
+    mem_free(parser->table);
+    mem_free(parser->frame_data);
+    mem_free(parser->raw);
+    mem_free(parser);
+    return package;
+}
@@ -0,0 +1,285 @@
+/**
+ * @file thumbnail.cpp
+ * @brief Cover thumbnails for DMusicPak library
+ *
+ * Pre-scaled renditions of the cover live in one thumbnail chunk: a count,
+ * a directory of format, width, height and size per thumbnail (smallest
+ * first), then the images in directory order. The library does not scale
+ * images; callers add each rendition. get_cover_best_fit() picks among the
+ * thumbnails and the full cover from the directory alone, so on lazily
+ * loaded packages only the directory and the chosen image are read.
+ */
+
+#include "../include/dmusicpak/dmusicpak.h"
+#include "internal.h"
+#include <string.h>
+
+using namespace dmusicpak;
+
+/* One cover image: in memory, or at file_offset in the backing file */
+struct CoverImage {
+    CoverFormat format;
+    uint32_t width;
+    uint32_t height;
+    size_t size;
+    const uint8_t* data;
+    uint64_t file_offset;
+};
+
+/* Decode a thumbnail directory; false if it does not fit payload_size bytes */
+static bool read_thumbnail_directory(const uint8_t* directory, uint32_t count, uint64_t payload_size,
+                                     CoverImage* images) {
+    if (count > MAX_THUMBNAILS) return false;
+
+    uint64_t offset = (uint64_t)count * THUMBNAIL_ENTRY_SIZE;
+    if (offset > payload_size) return false;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t* entry = directory + (size_t)i * THUMBNAIL_ENTRY_SIZE;
+        uint32_t size = read_uint32_le(entry + 12);
+        if (size > payload_size - offset) return false;
+
+        images[i].format = (CoverFormat)read_uint32_le(entry);
+        images[i].width = read_uint32_le(entry + 4);
+        images[i].height = read_uint32_le(entry + 8);
+        images[i].size = size;
+        images[i].data = NULL;
+        images[i].file_offset = offset;  /* Into the payload until placed by the caller */
+        offset += size;
+    }
+    return true;
+}
+
+/* Thumbnails of the package, in memory or in the backing file; none if malformed */
+static Error thumbnail_images(Package* package, CoverImage* images, uint32_t* count) {
+    *count = 0;
+
+    const ChunkEntry* entry = NULL;
+    if (!package->has_thumbnails && package->has_file) {
+        entry = find_chunk(package, CHUNK_THUMBNAILS);
+        if (!entry) return Error::OK;
+
+        /* Compressed chunks only decode as a whole */
+        if (entry->compressed) {
+            if (package->shared) return Error::OK;
+            Error result = load_chunk(package, ChunkType::THUMBNAILS);
+            if (result != Error::OK) return result;
+            entry = NULL;
+        }
+    }
+
+    if (entry) {
+        uint8_t directory[4 + MAX_THUMBNAILS * THUMBNAIL_ENTRY_SIZE];
+        if (entry->size < 4) return Error::OK;
+        if (!package_read_at(package, entry->offset, directory, 4)) return Error::IO;
+
+        uint32_t stored = read_uint32_le(directory);
+        uint64_t payload_size = entry->size - 4;
+        size_t directory_size = (size_t)stored * THUMBNAIL_ENTRY_SIZE;
+        if (stored > MAX_THUMBNAILS || directory_size > payload_size) return Error::OK;
+        if (!package_read_at(package, entry->offset + 4, directory + 4, directory_size)) return Error::IO;
+        if (!read_thumbnail_directory(directory + 4, stored, payload_size, images)) return Error::OK;
+
+        for (uint32_t i = 0; i < stored; i++) images[i].file_offset += entry->offset + 4;
+        *count = stored;
+        return Error::OK;
+    }
+
+    if (!package->has_thumbnails ||
+        !read_thumbnail_directory(package->thumbnails, package->thumbnail_count, package->thumbnails_size, images)) {
+        return Error::OK;
+    }
+    for (uint32_t i = 0; i < package->thumbnail_count; i++) {
+        images[i].data = package->thumbnails + images[i].file_offset;
+    }
+    *count = package->thumbnail_count;
+    return Error::OK;
+}
+
+/* The full cover, in memory or in the backing file */
+static Error full_cover_image(Package* package, CoverImage* image, bool* found) {
+    *found = false;
+
+    const ChunkEntry* entry = NULL;
+    if (!package->has_cover && package->has_file) {
+        entry = find_chunk(package, CHUNK_COVER);
+        if (!entry) return Error::OK;
+
+        if (entry->compressed) {
+            if (package->shared) return Error::OK;
+            Error result = load_chunk(package, ChunkType::COVER);
+            if (result != Error::OK) return result;
+            entry = NULL;
+        }
+    }
+
+    if (entry) {
+        uint8_t fields[12];
+        if (entry->size < sizeof(fields) || entry->size - sizeof(fields) > (size_t)-1) return Error::CORRUPTED;
+        if (!package_read_at(package, entry->offset, fields, sizeof(fields))) return Error::IO;
+
+        image->format = (CoverFormat)read_uint32_le(fields);
+        image->width = read_uint32_le(fields + 4);
+        image->height = read_uint32_le(fields + 8);
+        image->size = (size_t)(entry->size - sizeof(fields));
+        image->data = NULL;
+        image->file_offset = entry->offset + sizeof(fields);
+        *found = true;
+        return Error::OK;
+    }
+
+    if (!package->has_cover) return Error::OK;
+    image->format = package->cover.format;
+    image->width = package->cover.width;
+    image->height = package->cover.height;
+    image->size = package->cover.size;
+    image->data = package->cover.data;
+    image->file_offset = 0;
+    *found = true;
+    return Error::OK;
+}
+
+/* Pixel count used to order images; a cover without dimensions counts as the largest */
+static uint64_t image_area(const CoverImage* image) {
+    if (image->width == 0 || image->height == 0) return (uint64_t)-1;
+    return (uint64_t)image->width * image->height;
+}
+
+static bool image_covers(const CoverImage* image, uint32_t width, uint32_t height) {
+    if (image->width == 0 || image->height == 0) return true;
+    return image->width >= width && image->height >= height;
+}
+
+void dmusicpak::release_thumbnails(Package* package) {
+    package_release(package, package->thumbnails);
+    package->thumbnails = NULL;
+    package->thumbnails_size = 0;
+    package->thumbnail_count = 0;
+    package->has_thumbnails = 0;
+}
+
+Error dmusicpak::add_cover_thumbnail(Package* package, const Cover* thumbnail) {
+    if (!package || !thumbnail || !thumbnail->data || thumbnail->size == 0 || thumbnail->size > 0xFFFFFFFFu ||
+        thumbnail->width == 0 || thumbnail->height == 0) {
+        return Error::INVALID_PARAM;
+    }
+    if (package->shared) return Error::NOT_SUPPORTED;
+
+    /* Thumbnails still in the file are kept */
+    if (!package->has_thumbnails && package->has_file && find_chunk(package, CHUNK_THUMBNAILS)) {
+        Error result = load_chunk(package, ChunkType::THUMBNAILS);
+        if (result != Error::OK) return result;
+    }
+
+    CoverImage images[MAX_THUMBNAILS + 1];
+    uint32_t count = 0;
+    Error result = thumbnail_images(package, images, &count);
+    if (result != Error::OK) return result;
+
+    /* Same size replaces; the rest stay ordered smallest first */
+    CoverImage added;
+    added.format = thumbnail->format;
+    added.width = thumbnail->width;
+    added.height = thumbnail->height;
+    added.size = thumbnail->size;
+    added.data = thumbnail->data;
+    added.file_offset = 0;
+
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (images[i].width != added.width || images[i].height != added.height) images[kept++] = images[i];
+    }
+    if (kept >= MAX_THUMBNAILS) return Error::INVALID_PARAM;
+
+    uint32_t position = kept;
+    while (position > 0 && image_area(&images[position - 1]) > image_area(&added)) {
+        images[position] = images[position - 1];
+        position--;
+    }
+    images[position] = added;
+    count = kept + 1;
+
+    size_t size = (size_t)count * THUMBNAIL_ENTRY_SIZE;
+    for (uint32_t i = 0; i < count; i++) size += images[i].size;
+
+    uint8_t* block = (uint8_t*)package_alloc(package, size);
+    if (!block) return Error::MEMORY_ALLOC;
+
+    size_t offset = (size_t)count * THUMBNAIL_ENTRY_SIZE;
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t* entry = block + (size_t)i * THUMBNAIL_ENTRY_SIZE;
+        write_uint32_le(entry, (uint32_t)images[i].format);
+        write_uint32_le(entry + 4, images[i].width);
+        write_uint32_le(entry + 8, images[i].height);
+        write_uint32_le(entry + 12, (uint32_t)images[i].size);
+        memcpy(block + offset, images[i].data, images[i].size);
+        offset += images[i].size;
+    }
+    stat_add(STAT_BYTES_COPIED, size);
+
+    release_thumbnails(package);
+    package->thumbnails = block;
+    package->thumbnails_size = size;
+    package->thumbnail_count = count;
+    package->has_thumbnails = 1;
+    return Error::OK;
+}
+
+Error dmusicpak::clear_cover_thumbnails(Package* package) {
+    if (!package) return Error::INVALID_PARAM;
+    if (package->shared) return Error::NOT_SUPPORTED;
+
+    /* Loaded but empty, so a chunk still in the file is not copied on save */
+    release_thumbnails(package);
+    package->has_thumbnails = 1;
+    return Error::OK;
+}
+
+Error dmusicpak::get_cover_best_fit(Package* package, uint32_t width, uint32_t height, Cover* cover) {
+    if (!package || !cover) return Error::INVALID_PARAM;
+
+    CoverImage images[MAX_THUMBNAILS + 1];
+    uint32_t count = 0;
+    Error result = thumbnail_images(package, images, &count);
+    if (result != Error::OK) return result;
+
+    bool found = false;
+    result = full_cover_image(package, &images[count], &found);
+    if (result != Error::OK) return result;
+    if (found) count++;
+    if (count == 0) return Error::NOT_SUPPORTED;
+
+    /* Smallest image covering the area, else the largest there is */
+    const CoverImage* best = NULL;
+    const CoverImage* largest = NULL;
+    for (uint32_t i = 0; i < count; i++) {
+        const CoverImage* image = &images[i];
+        if (!largest || image_area(image) > image_area(largest)) largest = image;
+        if (!image_covers(image, width, height)) continue;
+        if (!best || image_area(image) < image_area(best) ||
+            (image_area(image) == image_area(best) && image->size < best->size)) {
+            best = image;
+        }
+    }
+    if (!best) best = largest;
+
+    memset(cover, 0, sizeof(Cover));
+    cover->format = best->format;
+    cover->width = best->width;
+    cover->height = best->height;
+    cover->size = best->size;
+    if (best->size > 0) {
+        cover->data = (uint8_t*)mem_malloc(best->size);
+        if (!cover->data) return Error::MEMORY_ALLOC;
+
+        if (best->data) {
+            memcpy(cover->data, best->data, best->size);
+            stat_add(STAT_BYTES_COPIED, best->size);
+        } else if (!package_read_at(package, best->file_offset, cover->data, best->size)) {
+            mem_free(cover->data);
+            memset(cover, 0, sizeof(Cover));
+            return Error::IO;
+        }
+    }
+    return Error::OK;
+}
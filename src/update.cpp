@@ -0,0 +1,322 @@
+/**
+ * @file update.cpp
+ * @brief In-place chunk updates for DMusicPak library
+ *
+ * update_metadata() and update_lyrics() rewrite one chunk of a package file
+ * together with the header, TOC and checksum fields that describe it; the
+ * audio and every other chunk stay where they are. A chunk that grows takes
+ * over the padding chunk behind it (SaveOptions::padding), or simply grows
+ * when it is the last one in the file. Otherwise it moves to the end of the
+ * file and its old place becomes padding.
+ */
+
+#include "../include/dmusicpak/dmusicpak.h"
+#include "internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+using namespace dmusicpak;
+
+/* Block of zeros for clearing freed space */
+#define ZERO_BLOCK_SIZE (64 * 1024)
+
+/* Package file opened for an update */
+struct update_file_t {
+    FileHandle file;
+    uint64_t size;
+    uint32_t version;
+    size_t header_size;          /* Chunk header size for the version */
+    uint8_t* head;               /* File header and TOC chunk */
+    size_t head_size;
+    uint32_t entries;            /* TOC entries */
+    uint8_t* checksum;           /* Checksum chunk data; NULL without one */
+    uint64_t checksum_offset;
+    size_t checksum_size;
+};
+
+static void close_update(update_file_t* update) {
+    file_close(&update->file);
+    mem_free(update->head);
+    mem_free(update->checksum);
+}
+
+static uint8_t* toc_entry(const update_file_t* update, uint8_t type) {
+    uint8_t* entries = update->head + FILE_HEADER_SIZE + update->header_size + 4;
+    for (uint32_t i = 0; i < update->entries; i++) {
+        uint8_t* entry = entries + (size_t)i * TOC_ENTRY_SIZE;
+        if ((entry[0] & ~CHUNK_COMPRESSED) == type) return entry;
+    }
+    return NULL;
+}
+
+/* Open a package and read its TOC and checksums; only files with a TOC can be updated */
+static Error open_update(const char* filename, update_file_t* update) {
+    memset(update, 0, sizeof(update_file_t));
+    if (!file_open_update(filename, &update->file)) return Error::FILE_NOT_FOUND;
+
+    uint8_t header[FILE_HEADER_SIZE + CHUNK_HEADER_SIZE_LARGE];
+    if (!file_size(&update->file, &update->size)) return Error::IO;
+    if (update->size < FILE_HEADER_SIZE) return Error::INVALID_FORMAT;
+
+    size_t header_read = update->size < sizeof(header) ? (size_t)update->size : sizeof(header);
+    if (!file_read_at(&update->file, 0, header, header_read)) return Error::IO;
+    if (memcmp(header, DMUSICPAK_MAGIC, 4) != 0 || !is_supported_version(read_uint32_le(header + 4))) {
+        return Error::INVALID_FORMAT;
+    }
+
+    update->version = read_uint32_le(header + 4);
+    update->header_size = chunk_header_size(update->version);
+    if (header_read < FILE_HEADER_SIZE + update->header_size || header[FILE_HEADER_SIZE] != CHUNK_TOC) {
+        return Error::NOT_SUPPORTED;
+    }
+
+    uint64_t toc_size = read_chunk_size(header + FILE_HEADER_SIZE, update->version);
+    uint64_t toc_offset = FILE_HEADER_SIZE + update->header_size;
+    if (toc_size < 4 || toc_size > 0xFFFFFFFFu || toc_size > update->size - toc_offset) return Error::CORRUPTED;
+
+    update->head_size = (size_t)(toc_offset + toc_size);
+    update->head = (uint8_t*)mem_malloc(update->head_size);
+    if (!update->head) return Error::MEMORY_ALLOC;
+    if (!file_read_at(&update->file, 0, update->head, update->head_size)) return Error::IO;
+
+    update->entries = read_uint32_le(update->head + toc_offset);
+    if ((uint64_t)update->entries * TOC_ENTRY_SIZE > toc_size - 4) return Error::CORRUPTED;
+
+    const uint8_t* entry = toc_entry(update, CHUNK_CHECKSUM);
+    if (!entry) return Error::OK;
+
+    uint64_t offset = read_uint64_le(entry + 1);
+    uint64_t size = read_uint64_le(entry + 9);
+    if (offset > update->size || size > update->size - offset || size > MAX_CHECKSUM_CHUNK_SIZE) {
+        return Error::CORRUPTED;
+    }
+
+    ChecksumTable table;
+    update->checksum_offset = offset;
+    update->checksum_size = (size_t)size;
+    update->checksum = (uint8_t*)mem_malloc(size > 0 ? (size_t)size : 1);
+    if (!update->checksum) return Error::MEMORY_ALLOC;
+    if (!file_read_at(&update->file, offset, update->checksum, (size_t)size)) return Error::IO;
+    if (!read_checksum_chunk(update->checksum, size, &table)) return Error::CORRUPTED;
+    return Error::OK;
+}
+
+/* Store the checksum of a chunk's new data in the checksum chunk, if it lists the type */
+static void set_checksum(update_file_t* update, uint8_t type, uint32_t crc) {
+    if (!update->checksum || read_uint32_le(update->checksum) != CHECKSUM_CRC32C) return;
+
+    uint32_t count = read_uint32_le(update->checksum + 4);
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t* entry = update->checksum + 8 + (size_t)i * CHECKSUM_ENTRY_SIZE;
+        if (entry[0] == type) {
+            write_uint32_le(entry + 1, crc);
+            return;
+        }
+    }
+}
+
+/* Write the file header and TOC, and the checksum chunk (in the same write when it follows the TOC) */
+static Error write_head(update_file_t* update) {
+    if (update->checksum && update->checksum_offset == update->head_size + update->header_size) {
+        size_t size = update->head_size + update->header_size + update->checksum_size;
+        uint8_t* buffer = (uint8_t*)mem_malloc(size);
+        if (!buffer) return Error::MEMORY_ALLOC;
+
+        memcpy(buffer, update->head, update->head_size);
+        write_chunk_header(buffer + update->head_size, CHUNK_CHECKSUM, update->checksum_size, update->version);
+        memcpy(buffer + update->head_size + update->header_size, update->checksum, update->checksum_size);
+        bool ok = file_write_at(&update->file, 0, buffer, size);
+        mem_free(buffer);
+        return ok ? Error::OK : Error::IO;
+    }
+
+    if (!file_write_at(&update->file, 0, update->head, update->head_size)) return Error::IO;
+    if (update->checksum &&
+        !file_write_at(&update->file, update->checksum_offset, update->checksum, update->checksum_size)) {
+        return Error::IO;
+    }
+    return Error::OK;
+}
+
+/* Turn 'size' bytes at 'offset' (header included) into a zero-filled padding chunk */
+static bool write_padding(update_file_t* update, uint64_t offset, uint64_t size) {
+    static const uint8_t zeros[ZERO_BLOCK_SIZE] = {0};
+
+    uint8_t header[CHUNK_HEADER_SIZE_LARGE];
+    write_chunk_header(header, CHUNK_PADDING, size - update->header_size, update->version);
+    if (!file_write_at(&update->file, offset, header, update->header_size)) return false;
+
+    offset += update->header_size;
+    size -= update->header_size;
+    while (size > 0) {
+        size_t to_write = size < sizeof(zeros) ? (size_t)size : sizeof(zeros);
+        if (!file_write_at(&update->file, offset, zeros, to_write)) return false;
+        offset += to_write;
+        size -= to_write;
+    }
+    return true;
+}
+
+/* Bytes taken by the padding chunk starting at 'offset' (header included), or 0 if there is none */
+static uint64_t padding_at(const update_file_t* update, uint64_t offset) {
+    uint8_t header[CHUNK_HEADER_SIZE_LARGE];
+    if (offset > update->size || update->size - offset < update->header_size ||
+        !file_read_at(&update->file, offset, header, update->header_size) ||
+        header[0] != CHUNK_PADDING) {
+        return 0;
+    }
+
+    uint64_t size = read_chunk_size(header, update->version);
+    if (size > update->size - offset - update->header_size) return 0;
+    return update->header_size + size;
+}
+
+/* Serialize the new chunk behind room for its header, compressed like the chunk it replaces */
+static Error build_chunk(const update_file_t* update, const uint8_t* old_entry,
+                         const uint8_t* head, size_t head_size, const uint8_t* body, size_t body_size,
+                         uint8_t** chunk, uint64_t* size, uint8_t* type) {
+    uint8_t* encoded = NULL;
+    size_t encoded_size = 0;
+    if (old_entry[0] & CHUNK_COMPRESSED) {
+        uint8_t codec[4];
+        uint64_t old_size = read_uint64_le(old_entry + 9);
+        if (old_size >= sizeof(codec) &&
+            file_read_at(&update->file, read_uint64_le(old_entry + 1), codec, sizeof(codec)) &&
+            compression_available((Compression)read_uint32_le(codec)) &&
+            !encode_chunk((Compression)read_uint32_le(codec), 0, head, head_size, body, body_size,
+                          &encoded, &encoded_size)) {
+            return Error::MEMORY_ALLOC;
+        }
+    }
+
+    *type = old_entry[0] & ~CHUNK_COMPRESSED;
+    *size = (uint64_t)head_size + body_size;
+    if (encoded && encoded_size < *size) {
+        *type |= CHUNK_COMPRESSED;
+        *size = encoded_size;
+    }
+    if (*size > 0xFFFFFFFFu && update->version < DMUSICPAK_VERSION_LARGE) {
+        mem_free(encoded);
+        return Error::NOT_SUPPORTED;
+    }
+
+    *chunk = (uint8_t*)mem_malloc(update->header_size + (size_t)*size);
+    if (!*chunk) {
+        mem_free(encoded);
+        return Error::MEMORY_ALLOC;
+    }
+
+    uint8_t* data = *chunk + update->header_size;
+    write_chunk_header(*chunk, *type, *size, update->version);
+    if (*type & CHUNK_COMPRESSED) {
+        memcpy(data, encoded, encoded_size);
+    } else {
+        if (head_size > 0) memcpy(data, head, head_size);
+        if (body_size > 0) memcpy(data + head_size, body, body_size);
+    }
+    mem_free(encoded);
+    return Error::OK;
+}
+
+/* Replace the first chunk of a type with head + body */
+static Error update_chunk(const char* filename, uint8_t type, const uint8_t* head, size_t head_size,
+                          const uint8_t* body, size_t body_size) {
+    uint64_t start = trace_begin();
+    update_file_t update;
+    Error result = open_update(filename, &update);
+    uint8_t* entry = result == Error::OK ? toc_entry(&update, type) : NULL;
+    if (result == Error::OK && !entry) result = Error::NOT_SUPPORTED;  /* Adding a chunk needs save() */
+
+    uint64_t offset = entry ? read_uint64_le(entry + 1) : 0;
+    uint64_t size = entry ? read_uint64_le(entry + 9) : 0;
+    if (result == Error::OK &&
+        (offset < FILE_HEADER_SIZE + update.header_size || offset > update.size || size > update.size - offset)) {
+        result = Error::CORRUPTED;
+    }
+
+    uint8_t* chunk = NULL;
+    uint64_t new_size = 0;
+    uint8_t new_type = 0;
+    if (result == Error::OK) {
+        result = build_chunk(&update, entry, head, head_size, body, body_size, &chunk, &new_size, &new_type);
+    }
+    if (result != Error::OK) {
+        close_update(&update);
+        trace_end(start, TraceEvent::SAVE, filename, 0, 0, result);
+        return result;
+    }
+
+    size_t header_size = update.header_size;
+    uint64_t padding = padding_at(&update, offset + size);
+    uint64_t space = size + padding;        /* Data bytes the chunk may use where it is */
+    int32_t chunks_added = padding > 0 ? -1 : 0;
+    uint64_t new_offset = offset;
+    uint64_t freed = 0;                     /* Bytes to turn into padding after the head is written */
+    bool truncate = false;
+
+    if (offset + space == update.size) {
+        /* Last in the file: the file grows or shrinks with it */
+        truncate = new_size < space;
+    } else if (new_size <= space && (space - new_size == 0 || space - new_size >= header_size)) {
+        /* Fits in place; what is left over stays padding */
+        if (space - new_size > 0) chunks_added++;
+    } else if (space > 0xFFFFFFFFu && update.version < DMUSICPAK_VERSION_LARGE) {
+        result = Error::NOT_SUPPORTED;
+    } else {
+        /* Move to the end of the file; the old place becomes padding */
+        new_offset = update.size + header_size;
+        freed = header_size + space;
+        chunks_added++;
+    }
+
+    /* New data first, then the head that points at it, then the freed space */
+    if (result == Error::OK &&
+        !file_write_at(&update.file, new_offset - header_size, chunk, header_size + (size_t)new_size)) {
+        result = Error::IO;
+    }
+    if (result == Error::OK && new_offset == offset && !truncate && space > new_size &&
+        !write_padding(&update, offset + new_size, space - new_size)) {
+        result = Error::IO;
+    }
+
+    if (result == Error::OK) {
+        entry[0] = new_type;
+        write_uint64_le(entry + 1, new_offset);
+        write_uint64_le(entry + 9, new_size);
+        write_uint32_le(update.head + 8, read_uint32_le(update.head + 8) + chunks_added);
+        set_checksum(&update, type, crc32c(0, chunk + header_size, (size_t)new_size));
+        result = write_head(&update);
+    }
+    if (result == Error::OK && freed > 0 && !write_padding(&update, offset - header_size, freed)) {
+        result = Error::IO;
+    }
+    if (result == Error::OK && truncate && !file_truncate(&update.file, offset + new_size)) {
+        result = Error::IO;
+    }
+
+    mem_free(chunk);
+    close_update(&update);
+    trace_end(start, TraceEvent::SAVE, filename, 0, header_size + new_size, result);
+    return result;
+}
+
+Error dmusicpak::update_metadata(const char* filename, const Metadata* metadata) {
+    if (!filename || !metadata) return Error::INVALID_PARAM;
+
+    size_t size = metadata_chunk_size(metadata);
+    uint8_t* data = (uint8_t*)mem_malloc(size);
+    if (!data) return Error::MEMORY_ALLOC;
+    write_metadata_chunk(data, metadata);
+
+    Error result = update_chunk(filename, CHUNK_METADATA, data, size, NULL, 0);
+    mem_free(data);
+    return result;
+}
+
+Error dmusicpak::update_lyrics(const char* filename, const Lyrics* lyrics) {
+    if (!filename || !lyrics || (!lyrics->data && lyrics->size > 0)) return Error::INVALID_PARAM;
+
+    uint8_t format[4];
+    write_uint32_le(format, (uint32_t)lyrics->format);
+    return update_chunk(filename, CHUNK_LYRICS, format, sizeof(format), lyrics->data, lyrics->size);
+}